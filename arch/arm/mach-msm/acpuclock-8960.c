@@ -24,6 +24,8 @@
 #include <linux/cpu.h>
 #include <linux/regulator/consumer.h>
 #include <linux/platform_device.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
 #ifdef CONFIG_DEBUG_FS
 #include <linux/seq_file.h>
 #include <linux/debugfs.h>
@@ -1606,6 +1608,69 @@ static void __init cpufreq_table_init(void)
 static void __init cpufreq_table_init(void) {}
 #endif
 
+#ifdef CONFIG_SMP
+/*
+ * Scheduler energy model derived from the frequency plan: dynamic power
+ * of each scaling level taken as f * Vcore^2, relative to the fastest
+ * level.  Idle leakage in WFI is approximated as a quarter of the
+ * lowest level, and a wakeup from power collapse is charged as the
+ * lowest level's power.
+ */
+static struct sched_energy acpu_energy;
+
+static void __init acpu_energy_init(void)
+{
+	struct sched_energy_state *states;
+	struct acpu_level *lvl, *max = NULL;
+	unsigned int n = 0;
+	u64 max_cost;
+
+	for (lvl = acpu_freq_tbl; lvl->speed.khz != 0; lvl++) {
+		if (lvl->use_for_scaling) {
+			max = lvl;
+			n++;
+		}
+	}
+	if (!n)
+		return;
+
+	states = kcalloc(n, sizeof(*states), GFP_KERNEL);
+	if (!states)
+		return;
+
+	max_cost = (u64)max->speed.khz * (max->vdd_core / 1000) *
+		   (max->vdd_core / 1000);
+	n = 0;
+	for (lvl = acpu_freq_tbl; lvl->speed.khz != 0; lvl++) {
+		u64 cost;
+
+		if (!lvl->use_for_scaling)
+			continue;
+		cost = (u64)lvl->speed.khz * (lvl->vdd_core / 1000) *
+		       (lvl->vdd_core / 1000);
+		states[n].freq = lvl->speed.khz;
+		states[n].capacity = max_t(unsigned long, 1,
+			div_u64((u64)lvl->speed.khz * SCHED_POWER_SCALE,
+				max->speed.khz));
+		states[n].power = max_t(unsigned long, 1,
+			div64_u64(cost * SCHED_POWER_SCALE, max_cost));
+		n++;
+	}
+
+	acpu_energy.nr_states = n;
+	acpu_energy.states = states;
+	acpu_energy.idle_power = states[0].power / 4;
+	acpu_energy.wakeup_cost = states[0].power;
+
+	if (sched_energy_register(&acpu_energy)) {
+		pr_err("acpuclk: could not register energy table\n");
+		kfree(states);
+	}
+}
+#else
+static inline void acpu_energy_init(void) {}
+#endif
+
 #define HOT_UNPLUG_KHZ STBY_KHZ
 static int acpuclock_cpu_callback(struct notifier_block *nfb,
 					    unsigned long action, void *hcpu)
@@ -1866,6 +1931,7 @@ static int __init acpuclk_8960_probe(struct platform_device *pdev)
 		regulator_init(cpu, max_acpu_level);
 #endif
 	cpufreq_table_init();
+	acpu_energy_init();
 
 	acpuclk_register(&acpuclk_8960_data);
 	register_hotcpu_notifier(&acpuclock_cpu_notifier);
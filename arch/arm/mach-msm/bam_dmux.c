@@ -2378,7 +2378,8 @@ static int bam_dmux_probe(struct platform_device *pdev)
 	}
 
 	bam_mux_rx_workqueue = alloc_workqueue("bam_dmux_rx",
-					WQ_MEM_RECLAIM | WQ_CPU_INTENSIVE, 1);
+					WQ_MEM_RECLAIM | WQ_CPU_INTENSIVE |
+					WQ_POWER_EFFICIENT, 1);
 	if (!bam_mux_rx_workqueue)
 		return -ENOMEM;
 
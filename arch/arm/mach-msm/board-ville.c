@@ -4651,11 +4651,75 @@ static void __init ville_allocate_memory_regions(void)
 	ville_allocate_fb_regions();
 }
 
+#ifdef CONFIG_PM_SLEEP
+static const struct {
+	const char *consumer;
+	const char *supplier;
+} ville_pm_links[] = {
+	{ "msm_sdcc.3",		PM8XXX_GPIO_DEV_NAME },
+	{ "HTC_HEADSET_PMIC",	PM8XXX_GPIO_DEV_NAME },
+	{ "HTC_HEADSET_PMIC",	PM8XXX_ADC_DEV_NAME },
+	{ CM3629_I2C_NAME,	PM8XXX_GPIO_DEV_NAME },
+	{ CYPRESS_CS_NAME,	PM8XXX_GPIO_DEV_NAME },
+};
+
+static int ville_pm_link_notify(struct notifier_block *nb,
+				unsigned long action, void *data)
+{
+	struct device *dev = data;
+	struct i2c_client *client;
+	const char *name;
+	int i;
+
+	if (action != BUS_NOTIFY_BOUND_DRIVER)
+		return NOTIFY_DONE;
+
+	client = i2c_verify_client(dev);
+	name = client ? client->name : dev_name(dev);
+
+	for (i = 0; i < ARRAY_SIZE(ville_pm_links); i++) {
+		struct device *supplier;
+
+		if (strcmp(name, ville_pm_links[i].consumer))
+			continue;
+
+		supplier = bus_find_device_by_name(&platform_bus_type, NULL,
+						   ville_pm_links[i].supplier);
+		if (!supplier || device_pm_add_supplier(dev, supplier)) {
+			pr_warn("%s: %s not linked to %s, keeping it synchronous\n",
+				__func__, dev_name(dev),
+				ville_pm_links[i].supplier);
+			device_disable_async_suspend(dev);
+		}
+		put_device(supplier);
+	}
+	return NOTIFY_OK;
+}
+
+static struct notifier_block ville_pm_link_platform_nb = {
+	.notifier_call = ville_pm_link_notify,
+};
+
+static struct notifier_block ville_pm_link_i2c_nb = {
+	.notifier_call = ville_pm_link_notify,
+};
+
+static void __init ville_pm_links_init(void)
+{
+	bus_register_notifier(&platform_bus_type, &ville_pm_link_platform_nb);
+	bus_register_notifier(&i2c_bus_type, &ville_pm_link_i2c_nb);
+}
+#else
+static inline void ville_pm_links_init(void) { }
+#endif
+
 static void __init ville_init(void)
 {
 	if (meminfo_init(SYS_MEMORY, SZ_256M) < 0)
 		pr_err("meminfo_init() failed!\n");
 
+	ville_pm_links_init();
+
 	msm_tsens_early_init(&msm_tsens_pdata);
         msm_thermal_init(&msm_thermal_pdata);
 	BUG_ON(msm_rpm_init(&msm8960_rpm_data));
@@ -49,6 +49,11 @@ static struct msm_cpuidle_state msm_cstates[] = {
 	{1, 2, "C2", "STANDALONE_POWER_COLLAPSE",
 		MSM_PM_SLEEP_MODE_POWER_COLLAPSE_STANDALONE},
 
+#ifdef CONFIG_MSM_CPUIDLE_COUPLED
+	{1, 3, "C3", "POWER_COLLAPSE",
+		MSM_PM_SLEEP_MODE_POWER_COLLAPSE},
+#endif
+
 	{2, 0, "C0", "WFI",
 		MSM_PM_SLEEP_MODE_WAIT_FOR_INTERRUPT},
 
@@ -58,6 +63,11 @@ static struct msm_cpuidle_state msm_cstates[] = {
 	{2, 2, "C2", "STANDALONE_POWER_COLLAPSE",
 		MSM_PM_SLEEP_MODE_POWER_COLLAPSE_STANDALONE},
 
+#ifdef CONFIG_MSM_CPUIDLE_COUPLED
+	{2, 3, "C3", "POWER_COLLAPSE",
+		MSM_PM_SLEEP_MODE_POWER_COLLAPSE},
+#endif
+
 	{3, 0, "C0", "WFI",
 		MSM_PM_SLEEP_MODE_WAIT_FOR_INTERRUPT},
 
@@ -66,6 +76,11 @@ static struct msm_cpuidle_state msm_cstates[] = {
 
 	{3, 2, "C2", "STANDALONE_POWER_COLLAPSE",
 		MSM_PM_SLEEP_MODE_POWER_COLLAPSE_STANDALONE},
+
+#ifdef CONFIG_MSM_CPUIDLE_COUPLED
+	{3, 3, "C3", "POWER_COLLAPSE",
+		MSM_PM_SLEEP_MODE_POWER_COLLAPSE},
+#endif
 };
 
 
@@ -153,6 +168,10 @@ static void __init msm_cpuidle_set_states(void)
 		snprintf(state->name, CPUIDLE_NAME_LEN, cstate->name);
 		snprintf(state->desc, CPUIDLE_DESC_LEN, cstate->desc);
 		state->flags = 0;
+#ifdef CONFIG_MSM_CPUIDLE_COUPLED
+		if (cstate->mode_nr == MSM_PM_SLEEP_MODE_POWER_COLLAPSE)
+			state->flags |= CPUIDLE_FLAG_COUPLED;
+#endif
 		state->exit_latency = 0;
 		state->power_usage = 0;
 		state->target_residency = 0;
@@ -201,6 +220,9 @@ int __init msm_cpuidle_init(void)
 		struct cpuidle_device *dev = &per_cpu(msm_cpuidle_devs, cpu);
 
 		dev->cpu = cpu;
+#ifdef CONFIG_MSM_CPUIDLE_COUPLED
+		cpumask_copy(&dev->coupled_cpus, cpu_possible_mask);
+#endif
 		msm_cpuidle_set_cpu_statedata(dev);
 		ret = cpuidle_register_device(dev);
 		if (ret) {
@@ -1128,7 +1128,11 @@ static int __init msm_mpdec_init(void) {
                                       1);
     if (!msm_mpdec_workq)
         return -ENOMEM;
+#ifdef CONFIG_MSM_MPDEC_DEFERRABLE
+    INIT_DELAYED_WORK_DEFERRABLE(&msm_mpdec_work, msm_mpdec_work_thread);
+#else
     INIT_DELAYED_WORK(&msm_mpdec_work, msm_mpdec_work_thread);
+#endif
 
 #ifdef CONFIG_MSM_MPDEC_INPUTBOOST_CPUMIN
     mpdec_input_wq = create_workqueue("mpdeciwq");
@@ -468,6 +468,9 @@ void radio_stat_dump(void)
 static struct msm_rpmrs_limits *msm_pm_idle_rs_limits;
 static bool msm_pm_use_qtimer;
 
+static DEFINE_PER_CPU_SHARED_ALIGNED(enum msm_pm_sleep_mode,
+		msm_pm_last_slp_mode);
+
 static void msm_pm_swfi(void)
 {
 	msm_pm_config_hw_before_swfi();
@@ -799,6 +802,37 @@ void arch_idle(void)
 	return;
 }
 
+#ifdef CONFIG_MSM_CPUIDLE_COUPLED
+#define MSM_PM_CLUSTER_WAIT_US	100
+
+static bool msm_pm_cluster_idle(struct cpuidle_device *dev,
+		struct cpuidle_driver *drv, int index)
+{
+	int timeout = MSM_PM_CLUSTER_WAIT_US;
+	unsigned int cpu;
+
+	if (dev->cpu || !(drv->states[index].flags & CPUIDLE_FLAG_COUPLED))
+		return false;
+
+	for_each_online_cpu(cpu) {
+		if (cpu == dev->cpu)
+			continue;
+		while (!msm_pm_verify_cpu_pc(cpu)) {
+			if (timeout-- <= 0)
+				return false;
+			udelay(1);
+		}
+	}
+	return true;
+}
+#else
+static inline bool msm_pm_cluster_idle(struct cpuidle_device *dev,
+		struct cpuidle_driver *drv, int index)
+{
+	return false;
+}
+#endif
+
 int msm_pm_idle_prepare(struct cpuidle_device *dev,
 		struct cpuidle_driver *drv, int index)
 {
@@ -832,7 +866,8 @@ int msm_pm_idle_prepare(struct cpuidle_device *dev,
 			if (!allow)
 				break;
 
-			if (num_online_cpus() > 1) {
+			if (num_online_cpus() > 1 &&
+			    !msm_pm_cluster_idle(dev, drv, index)) {
 				allow = false;
 				break;
 			}
@@ -962,6 +997,7 @@ int msm_pm_idle_enter(enum msm_pm_sleep_mode sleep_mode)
 			smp_processor_id(), __func__, sleep_mode);
 
 	time = ktime_to_ns(ktime_get());
+	__get_cpu_var(msm_pm_last_slp_mode) = sleep_mode;
 
 	switch (sleep_mode) {
 	case MSM_PM_SLEEP_MODE_WAIT_FOR_INTERRUPT:
@@ -1030,6 +1066,7 @@ int msm_pm_idle_enter(enum msm_pm_sleep_mode sleep_mode)
 		goto cpuidle_enter_bail;
 	}
 
+	__get_cpu_var(msm_pm_last_slp_mode) = MSM_PM_SLEEP_MODE_NR;
 	time = ktime_to_ns(ktime_get()) - time;
 	msm_pm_add_stat(exit_stat, time);
 	do_div(time, 1000);
@@ -1042,14 +1079,12 @@ int msm_pm_idle_enter(enum msm_pm_sleep_mode sleep_mode)
 	return (int) time;
 
 cpuidle_enter_bail:
+	__get_cpu_var(msm_pm_last_slp_mode) = MSM_PM_SLEEP_MODE_NR;
 	return 0;
 }
 
 static struct msm_pm_sleep_status_data *msm_pm_slp_sts;
 
-static DEFINE_PER_CPU_SHARED_ALIGNED(enum msm_pm_sleep_mode,
-		msm_pm_last_slp_mode);
-
 bool msm_pm_verify_cpu_pc(unsigned int cpu)
 {
 	enum msm_pm_sleep_mode mode = per_cpu(msm_pm_last_slp_mode, cpu);
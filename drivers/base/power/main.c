@@ -29,6 +29,7 @@
 #include <linux/async.h>
 #include <linux/suspend.h>
 #include <linux/timer.h>
+#include <linux/slab.h>
 
 #include "../base.h"
 #include "power.h"
@@ -54,6 +55,17 @@ struct dpm_drv_wd_data {
 
 static int async_error;
 
+struct dpm_link {
+	struct device *supplier;
+	struct device *consumer;
+	struct list_head s_node;
+	struct list_head c_node;
+};
+
+static DEFINE_SPINLOCK(dpm_links_lock);
+
+#define DPM_SLOW_NS	NSEC_PER_MSEC
+
 void device_pm_init(struct device *dev)
 {
 	dev->power.is_prepared = false;
@@ -64,6 +76,8 @@ void device_pm_init(struct device *dev)
 	spin_lock_init(&dev->power.lock);
 	pm_runtime_init(dev);
 	INIT_LIST_HEAD(&dev->power.entry);
+	INIT_LIST_HEAD(&dev->power.suppliers);
+	INIT_LIST_HEAD(&dev->power.consumers);
 	dev->power.power_state = PMSG_INVALID;
 }
 
@@ -90,14 +104,29 @@ void device_pm_add(struct device *dev)
 	mutex_unlock(&dpm_list_mtx);
 }
 
+static void dpm_link_free(struct dpm_link *link)
+{
+	spin_lock(&dpm_links_lock);
+	list_del(&link->s_node);
+	list_del(&link->c_node);
+	spin_unlock(&dpm_links_lock);
+	kfree(link);
+}
+
 void device_pm_remove(struct device *dev)
 {
+	struct dpm_link *link, *tmp;
+
 	pr_debug("PM: Removing info for %s:%s\n",
 		 dev->bus ? dev->bus->name : "No Bus", dev_name(dev));
 	complete_all(&dev->power.completion);
 	mutex_lock(&dpm_list_mtx);
 	dev_pm_qos_constraints_destroy(dev);
 	list_del_init(&dev->power.entry);
+	list_for_each_entry_safe(link, tmp, &dev->power.suppliers, c_node)
+		dpm_link_free(link);
+	list_for_each_entry_safe(link, tmp, &dev->power.consumers, s_node)
+		dpm_link_free(link);
 	mutex_unlock(&dpm_list_mtx);
 	device_wakeup_disable(dev);
 	pm_runtime_remove(dev);
@@ -128,6 +157,107 @@ void device_pm_move_last(struct device *dev)
 	list_move_tail(&dev->power.entry, &dpm_list);
 }
 
+static bool dpm_depends_on(struct device *dev, struct device *target)
+{
+	struct dpm_link *link;
+
+	if (dev == target)
+		return true;
+
+	if (dev->parent && dpm_depends_on(dev->parent, target))
+		return true;
+
+	list_for_each_entry(link, &dev->power.suppliers, c_node)
+		if (dpm_depends_on(link->supplier, target))
+			return true;
+
+	return false;
+}
+
+static int dpm_reorder_child(struct device *dev, void *unused);
+
+static void dpm_reorder_to_tail(struct device *dev)
+{
+	struct dpm_link *link;
+
+	device_pm_move_last(dev);
+	device_for_each_child(dev, NULL, dpm_reorder_child);
+	list_for_each_entry(link, &dev->power.consumers, s_node)
+		dpm_reorder_to_tail(link->consumer);
+}
+
+static int dpm_reorder_child(struct device *dev, void *unused)
+{
+	if (!list_empty(&dev->power.entry))
+		dpm_reorder_to_tail(dev);
+	return 0;
+}
+
+int device_pm_add_supplier(struct device *consumer, struct device *supplier)
+{
+	struct dpm_link *link, *new;
+	int error = 0;
+
+	if (!consumer || !supplier)
+		return -EINVAL;
+
+	new = kzalloc(sizeof(*new), GFP_KERNEL);
+	if (!new)
+		return -ENOMEM;
+
+	mutex_lock(&dpm_list_mtx);
+
+	if (list_empty(&consumer->power.entry)
+	    || list_empty(&supplier->power.entry)) {
+		error = -ENODEV;
+		goto out;
+	}
+
+	if (consumer->power.is_prepared || supplier->power.is_prepared) {
+		error = -EBUSY;
+		goto out;
+	}
+
+	list_for_each_entry(link, &consumer->power.suppliers, c_node)
+		if (link->supplier == supplier)
+			goto out;
+
+	if (dpm_depends_on(supplier, consumer)) {
+		error = -EINVAL;
+		goto out;
+	}
+
+	new->supplier = supplier;
+	new->consumer = consumer;
+	spin_lock(&dpm_links_lock);
+	list_add_tail(&new->s_node, &supplier->power.consumers);
+	list_add_tail(&new->c_node, &consumer->power.suppliers);
+	spin_unlock(&dpm_links_lock);
+	new = NULL;
+
+	dpm_reorder_to_tail(consumer);
+
+ out:
+	mutex_unlock(&dpm_list_mtx);
+	kfree(new);
+	return error;
+}
+EXPORT_SYMBOL_GPL(device_pm_add_supplier);
+
+void device_pm_remove_supplier(struct device *consumer, struct device *supplier)
+{
+	struct dpm_link *link;
+
+	mutex_lock(&dpm_list_mtx);
+	list_for_each_entry(link, &consumer->power.suppliers, c_node)
+		if (link->supplier == supplier) {
+			dpm_link_free(link);
+			break;
+		}
+	mutex_unlock(&dpm_list_mtx);
+}
+EXPORT_SYMBOL_GPL(device_pm_remove_supplier);
+
 static ktime_t initcall_debug_start(struct device *dev)
 {
 	ktime_t calltime = ktime_set(0, 0);
@@ -155,12 +285,18 @@ static void initcall_debug_report(struct device *dev, ktime_t calltime,
 	}
 }
 
+static bool dpm_async(struct device *dev)
+{
+	return pm_async_enabled
+		&& (dev->power.async_suspend || dev->power.async_leaf);
+}
+
 static void dpm_wait(struct device *dev, bool async)
 {
 	if (!dev)
 		return;
 
-	if (async || (pm_async_enabled && dev->power.async_suspend))
+	if (async || dpm_async(dev))
 		wait_for_completion(&dev->power.completion);
 }
 
@@ -175,6 +311,48 @@ static void dpm_wait_for_children(struct device *dev, bool async)
        device_for_each_child(dev, &async, dpm_wait_fn);
 }
 
+static bool dpm_link_pending(struct device *dev, bool async)
+{
+	return !completion_done(&dev->power.completion)
+		&& (async || dpm_async(dev));
+}
+
+static void dpm_wait_for_link(struct device *dev, bool async)
+{
+	get_device(dev);
+	spin_unlock(&dpm_links_lock);
+	dpm_wait(dev, async);
+	put_device(dev);
+}
+
+static void dpm_wait_for_suppliers(struct device *dev, bool async)
+{
+	struct dpm_link *link;
+
+ again:
+	spin_lock(&dpm_links_lock);
+	list_for_each_entry(link, &dev->power.suppliers, c_node)
+		if (dpm_link_pending(link->supplier, async)) {
+			dpm_wait_for_link(link->supplier, async);
+			goto again;
+		}
+	spin_unlock(&dpm_links_lock);
+}
+
+static void dpm_wait_for_consumers(struct device *dev, bool async)
+{
+	struct dpm_link *link;
+
+ again:
+	spin_lock(&dpm_links_lock);
+	list_for_each_entry(link, &dev->power.consumers, s_node)
+		if (dpm_link_pending(link->consumer, async)) {
+			dpm_wait_for_link(link->consumer, async);
+			goto again;
+		}
+	spin_unlock(&dpm_links_lock);
+}
+
 static pm_callback_t pm_op(const struct dev_pm_ops *ops, pm_message_t state)
 {
 	switch (state.event) {
@@ -474,6 +652,8 @@ static int device_resume(struct device *dev, pm_message_t state, bool async)
 	TRACE_RESUME(0);
 
 	dpm_wait(dev->parent, async);
+	dpm_wait_for_suppliers(dev, async);
+	dev->power.dpm_start = ktime_get();
 	device_lock(dev);
 
 	dev->power.is_prepared = false;
@@ -531,6 +711,7 @@ static int device_resume(struct device *dev, pm_message_t state, bool async)
 
  Unlock:
 	device_unlock(dev);
+	dev->power.dpm_end = ktime_get();
 	complete_all(&dev->power.completion);
 
 	TRACE_RESUME(error);
@@ -554,8 +735,114 @@ static void async_resume(void *data, async_cookie_t cookie)
 
 static bool is_async(struct device *dev)
 {
-	return dev->power.async_suspend && pm_async_enabled
-		&& !pm_trace_is_enabled();
+	return dpm_async(dev) && !pm_trace_is_enabled();
+}
+
+struct dpm_path {
+	ktime_t phase;
+	struct device *dev;
+	struct device *best;
+};
+
+static bool dpm_in_phase(struct device *dev, ktime_t phase)
+{
+	return ktime_to_ns(dev->power.dpm_start) >= ktime_to_ns(phase);
+}
+
+static void dpm_path_consider(struct dpm_path *path, struct device *dev)
+{
+	s64 end;
+
+	if (!dev || !dpm_in_phase(dev, path->phase))
+		return;
+
+	end = ktime_to_ns(dev->power.dpm_end);
+	if (end > ktime_to_ns(path->dev->power.dpm_start)
+	    || end >= ktime_to_ns(path->dev->power.dpm_end))
+		return;
+
+	if (!path->best || end > ktime_to_ns(path->best->power.dpm_end))
+		path->best = dev;
+}
+
+static int dpm_path_child_fn(struct device *dev, void *data)
+{
+	dpm_path_consider(data, dev);
+	return 0;
+}
+
+static struct device *dpm_path_prev(struct list_head *list,
+				    struct device *dev, bool suspend)
+{
+	struct list_head *pos = &dev->power.entry;
+	struct device *prev;
+
+	if (!suspend && is_async(dev))
+		return NULL;
+
+	for (;;) {
+		pos = suspend ? pos->next : pos->prev;
+		if (pos == list)
+			return NULL;
+		prev = to_device(pos);
+		if (suspend ? !dpm_async(prev) : !is_async(prev))
+			return prev;
+	}
+}
+
+static void dpm_show_critical_path(struct list_head *list, ktime_t starttime,
+				   bool suspend)
+{
+	struct device *dev, *last = NULL;
+	struct dpm_path path;
+	struct dpm_link *link;
+	s64 usecs;
+
+	if (!pm_print_times_enabled)
+		return;
+
+	mutex_lock(&dpm_list_mtx);
+	list_for_each_entry(dev, list, power.entry) {
+		if (!dpm_in_phase(dev, starttime))
+			continue;
+		usecs = ktime_us_delta(dev->power.dpm_end, dev->power.dpm_start);
+		if (usecs * NSEC_PER_USEC >= DPM_SLOW_NS)
+			pr_info("PM: %s %s: %s took %lld usecs\n",
+				dev_driver_string(dev), dev_name(dev),
+				suspend ? "suspend" : "resume", usecs);
+		if (!last || ktime_to_ns(dev->power.dpm_end) >
+			     ktime_to_ns(last->power.dpm_end))
+			last = dev;
+	}
+
+	if (last)
+		pr_info("PM: %s critical path, last device first:\n",
+			suspend ? "suspend" : "resume");
+
+	path.phase = starttime;
+	for (dev = last; dev; dev = path.best) {
+		pr_info("PM:   %s %s: done at +%lld usecs, took %lld usecs%s\n",
+			dev_driver_string(dev), dev_name(dev),
+			ktime_us_delta(dev->power.dpm_end, starttime),
+			ktime_us_delta(dev->power.dpm_end,
+				       dev->power.dpm_start),
+			(suspend ? dpm_async(dev) : is_async(dev)) ?
+				" async" : "");
+
+		path.dev = dev;
+		path.best = NULL;
+		if (suspend) {
+			device_for_each_child(dev, &path, dpm_path_child_fn);
+			list_for_each_entry(link, &dev->power.consumers, s_node)
+				dpm_path_consider(&path, link->consumer);
+		} else {
+			dpm_path_consider(&path, dev->parent);
+			list_for_each_entry(link, &dev->power.suppliers, c_node)
+				dpm_path_consider(&path, link->supplier);
+		}
+		dpm_path_consider(&path, dpm_path_prev(list, dev, suspend));
+	}
+	mutex_unlock(&dpm_list_mtx);
 }
 
 static void dpm_drv_timeout(unsigned long data)
@@ -617,6 +904,7 @@ void dpm_resume(pm_message_t state)
 	mutex_unlock(&dpm_list_mtx);
 	async_synchronize_full();
 	dpm_show_time(starttime, state, NULL);
+	dpm_show_critical_path(&dpm_prepared_list, starttime, false);
 }
 
 static void device_complete(struct device *dev, pm_message_t state)
@@ -868,6 +1156,8 @@ static int __device_suspend(struct device *dev, pm_message_t state, bool async)
 	struct dpm_drv_wd_data data;
 
 	dpm_wait_for_children(dev, async);
+	dpm_wait_for_consumers(dev, async);
+	dev->power.dpm_start = ktime_get();
 
 	if (async_error)
 		goto Complete;
@@ -949,6 +1239,7 @@ static int __device_suspend(struct device *dev, pm_message_t state, bool async)
 	destroy_timer_on_stack(&timer);
 
 Complete:
+	dev->power.dpm_end = ktime_get();
 	complete_all(&dev->power.completion);
 
 	if (error) {
@@ -979,7 +1270,7 @@ static int device_suspend(struct device *dev)
 {
 	INIT_COMPLETION(dev->power.completion);
 
-	if (pm_async_enabled && dev->power.async_suspend) {
+	if (dpm_async(dev)) {
 		get_device(dev);
 		async_schedule(async_suspend, dev);
 		return 0;
@@ -1026,8 +1317,10 @@ int dpm_suspend(pm_message_t state)
 	if (error) {
 		suspend_stats.failed_suspend++;
 		dpm_save_failed_step(SUSPEND_SUSPEND);
-	} else
+	} else {
 		dpm_show_time(starttime, state, NULL);
+		dpm_show_critical_path(&dpm_suspended_list, starttime, true);
+	}
 	return error;
 }
 
@@ -1070,6 +1363,11 @@ static int device_prepare(struct device *dev, pm_message_t state)
 	return error;
 }
 
+static int dpm_has_child_fn(struct device *dev, void *unused)
+{
+	return 1;
+}
+
 int dpm_prepare(pm_message_t state)
 {
 	int error = 0;
@@ -1099,6 +1397,9 @@ int dpm_prepare(pm_message_t state)
 			break;
 		}
 		dev->power.is_prepared = true;
+		dev->power.async_leaf = pm_async_leaf_enabled
+			&& dev->driver && !dev->power.no_async
+			&& !device_for_each_child(dev, NULL, dpm_has_child_fn);
 		if (!list_empty(&dev->power.entry))
 			list_move_tail(&dev->power.entry, &dpm_prepared_list);
 		put_device(dev);
@@ -1130,7 +1431,7 @@ EXPORT_SYMBOL_GPL(__suspend_report_result);
 
 int device_pm_wait_for_dev(struct device *subordinate, struct device *dev)
 {
-	dpm_wait(dev, subordinate->power.async_suspend);
+	dpm_wait(dev, dpm_async(subordinate));
 	return async_error;
 }
 EXPORT_SYMBOL_GPL(device_pm_wait_for_dev);
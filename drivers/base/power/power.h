@@ -15,6 +15,8 @@ static inline void pm_runtime_remove(struct device *dev) {}
 #ifdef CONFIG_PM_SLEEP
 
 extern int pm_async_enabled;
+extern int pm_async_leaf_enabled;
+extern int pm_print_times_enabled;
 
 extern struct list_head dpm_list;	
 
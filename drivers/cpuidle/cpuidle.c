@@ -53,6 +53,32 @@ static void cpuidle_kick_cpus(void) {}
 
 static int __cpuidle_register_device(struct cpuidle_device *dev);
 
+static void cpuidle_account_residency(struct cpuidle_device *dev,
+				      struct cpuidle_driver *drv, int index)
+{
+	struct cpuidle_state_usage *usage = &dev->states_usage[index];
+	unsigned int residency = dev->last_residency;
+	int i;
+
+	if (!(drv->states[index].flags & CPUIDLE_FLAG_TIME_VALID))
+		return;
+
+	if (residency < drv->states[index].target_residency) {
+		usage->above++;
+		return;
+	}
+
+	for (i = index + 1; i < drv->state_count; i++) {
+		struct cpuidle_state *s = &drv->states[i];
+
+		if (s->disable)
+			continue;
+		if (residency >= s->target_residency + s->exit_latency)
+			usage->below++;
+		break;
+	}
+}
+
 static inline int cpuidle_enter(struct cpuidle_device *dev,
 				struct cpuidle_driver *drv, int index)
 {
@@ -97,6 +123,38 @@ int cpuidle_play_dead(void)
 	return -ENODEV;
 }
 
+/**
+ * cpuidle_enter_state - enter the state and update stats
+ * @dev: cpuidle device for this cpu
+ * @drv: cpuidle driver for this cpu
+ * @next_state: index into drv->states of the state to enter
+ */
+int cpuidle_enter_state(struct cpuidle_device *dev, struct cpuidle_driver *drv,
+		int next_state)
+{
+	int entered_state;
+
+	trace_power_start_rcuidle(POWER_CSTATE, next_state, dev->cpu);
+	trace_cpu_idle_rcuidle(next_state, dev->cpu);
+
+	entered_state = cpuidle_enter_ops(dev, drv, next_state);
+
+	trace_power_end_rcuidle(dev->cpu);
+	trace_cpu_idle_rcuidle(PWR_EVENT_EXIT, dev->cpu);
+
+	if (entered_state >= 0) {
+		
+		dev->states_usage[entered_state].time +=
+				(unsigned long long)dev->last_residency;
+		dev->states_usage[entered_state].usage++;
+		cpuidle_account_residency(dev, drv, entered_state);
+	} else {
+		dev->last_residency = 0;
+	}
+
+	return entered_state;
+}
+
 int cpuidle_idle_call(void)
 {
 	struct cpuidle_device *dev = __this_cpu_read(cpuidle_devices);
@@ -125,22 +183,11 @@ int cpuidle_idle_call(void)
 		return 0;
 	}
 
-	trace_power_start_rcuidle(POWER_CSTATE, next_state, dev->cpu);
-	trace_cpu_idle_rcuidle(next_state, dev->cpu);
-
-	entered_state = cpuidle_enter_ops(dev, drv, next_state);
-
-	trace_power_end_rcuidle(dev->cpu);
-	trace_cpu_idle_rcuidle(PWR_EVENT_EXIT, dev->cpu);
-
-	if (entered_state >= 0) {
-		
-		dev->states_usage[entered_state].time +=
-				(unsigned long long)dev->last_residency;
-		dev->states_usage[entered_state].usage++;
-	} else {
-		dev->last_residency = 0;
-	}
+	if (cpuidle_state_is_coupled(dev, drv, next_state))
+		entered_state = cpuidle_enter_state_coupled(dev, drv,
+							    next_state);
+	else
+		entered_state = cpuidle_enter_state(dev, drv, next_state);
 
 	
 	if (cpuidle_curr_governor->reflect)
@@ -279,6 +326,8 @@ int cpuidle_enable_device(struct cpuidle_device *dev)
 	for (i = 0; i < dev->state_count; i++) {
 		dev->states_usage[i].usage = 0;
 		dev->states_usage[i].time = 0;
+		dev->states_usage[i].above = 0;
+		dev->states_usage[i].below = 0;
 	}
 	dev->last_residency = 0;
 
@@ -330,13 +379,23 @@ static int __cpuidle_register_device(struct cpuidle_device *dev)
 
 	per_cpu(cpuidle_devices, dev->cpu) = dev;
 	list_add(&dev->device_list, &cpuidle_detected_devices);
-	if ((ret = cpuidle_add_sysfs(cpu_dev))) {
-		module_put(cpuidle_driver->owner);
-		return ret;
-	}
+	if ((ret = cpuidle_add_sysfs(cpu_dev)))
+		goto err_sysfs;
+
+	if ((ret = cpuidle_coupled_register_device(dev)))
+		goto err_coupled;
 
 	dev->registered = 1;
 	return 0;
+
+err_coupled:
+	cpuidle_remove_sysfs(cpu_dev);
+	wait_for_completion(&dev->kobj_unregister);
+err_sysfs:
+	list_del(&dev->device_list);
+	per_cpu(cpuidle_devices, dev->cpu) = NULL;
+	module_put(cpuidle_driver->owner);
+	return ret;
 }
 
 int cpuidle_register_device(struct cpuidle_device *dev)
@@ -378,6 +437,8 @@ void cpuidle_unregister_device(struct cpuidle_device *dev)
 	wait_for_completion(&dev->kobj_unregister);
 	per_cpu(cpuidle_devices, dev->cpu) = NULL;
 
+	cpuidle_coupled_unregister_device(dev);
+
 	cpuidle_resume_and_unlock();
 
 	module_put(cpuidle_driver->owner);
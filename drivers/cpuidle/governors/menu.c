@@ -27,6 +27,9 @@
 #define DECAY 8
 #define MAX_INTERESTING 50000
 #define STDDEV_THRESH 400
+#define MAX_INTERVAL_US (1 << 24)
+#define IRQ_SLACK_US 20
+#define IRQ_DECAY 8
 
 
 
@@ -41,6 +44,11 @@ struct menu_device {
 	u64		correction_factor[BUCKETS];
 	u32		intervals[INTERVALS];
 	int		interval_ptr;
+
+	ktime_t		last_wakeup;
+	ktime_t		last_irq;
+	unsigned int	irq_interval_us;
+	unsigned int	irq_dev_us;
 };
 
 
@@ -92,28 +100,96 @@ static u64 div_round64(u64 dividend, u32 divisor)
 
 static void detect_repeating_patterns(struct menu_device *data)
 {
+	unsigned int thresh = UINT_MAX;
+	unsigned int max, divisor;
+	u64 avg, variance;
 	int i;
-	uint64_t avg = 0;
-	uint64_t stddev = 0; 
 
-	
-	for (i = 0; i < INTERVALS; i++)
-		avg += data->intervals[i];
-	avg = avg / INTERVALS;
+again:
+	avg = 0;
+	max = 0;
+	divisor = 0;
+	for (i = 0; i < INTERVALS; i++) {
+		unsigned int value = data->intervals[i];
+
+		if (value <= thresh) {
+			avg += value;
+			divisor++;
+			if (value > max)
+				max = value;
+		}
+	}
+	avg = div_u64(avg, divisor);
 
-	
-	if (avg > data->expected_us)
+	variance = 0;
+	for (i = 0; i < INTERVALS; i++) {
+		unsigned int value = data->intervals[i];
+
+		if (value <= thresh) {
+			s64 diff = (s64)value - avg;
+
+			variance += diff * diff;
+		}
+	}
+	variance = div_u64(variance, divisor);
+
+	if (avg && (variance <= STDDEV_THRESH ||
+		    (avg * avg > variance * 36 &&
+		     divisor * 4 >= INTERVALS * 3))) {
+		if (avg <= data->expected_us)
+			data->predicted_us = avg;
+		return;
+	}
+
+	if (divisor * 4 <= INTERVALS * 3)
 		return;
 
-	for (i = 0; i < INTERVALS; i++)
-		stddev += (data->intervals[i] - avg) *
-			  (data->intervals[i] - avg);
+	thresh = max - 1;
+	goto again;
+}
 
-	stddev = stddev / INTERVALS;
+static void predict_next_irq(struct menu_device *data, ktime_t now)
+{
+	s64 since;
 
+	if (!data->irq_interval_us ||
+	    data->irq_dev_us * 4 > data->irq_interval_us)
+		return;
 
-	if (avg && stddev < STDDEV_THRESH)
-		data->predicted_us = avg;
+	since = ktime_to_us(ktime_sub(now, data->last_irq));
+	if (since > data->irq_interval_us + data->irq_dev_us)
+		return;
+
+	if (since >= data->irq_interval_us)
+		data->predicted_us = min_t(u64, data->predicted_us,
+					   data->irq_dev_us);
+	else
+		data->predicted_us = min_t(u64, data->predicted_us,
+					   data->irq_interval_us - since);
+}
+
+static void update_irq_rate(struct menu_device *data, ktime_t now)
+{
+	s64 interval = ktime_to_us(ktime_sub(now, data->last_irq));
+	unsigned int dev;
+
+	data->last_irq = now;
+
+	if (interval <= 0 || interval > MAX_INTERESTING) {
+		data->irq_interval_us = 0;
+		data->irq_dev_us = 0;
+		return;
+	}
+
+	if (!data->irq_interval_us) {
+		data->irq_interval_us = interval;
+		return;
+	}
+
+	dev = abs((int)interval - (int)data->irq_interval_us);
+	data->irq_interval_us += ((int)interval -
+				  (int)data->irq_interval_us) / IRQ_DECAY;
+	data->irq_dev_us += ((int)dev - (int)data->irq_dev_us) / IRQ_DECAY;
 }
 
 static int menu_select(struct cpuidle_driver *drv, struct cpuidle_device *dev)
@@ -124,6 +200,7 @@ static int menu_select(struct cpuidle_driver *drv, struct cpuidle_device *dev)
 	int i;
 	int multiplier;
 	struct timespec t;
+	ktime_t now;
 
 	if (data->needs_update) {
 		menu_update(drv, dev);
@@ -156,6 +233,9 @@ static int menu_select(struct cpuidle_driver *drv, struct cpuidle_device *dev)
 
 	detect_repeating_patterns(data);
 
+	now = ktime_get();
+	predict_next_irq(data, now);
+
 	if (data->expected_us > 5 &&
 		drv->states[CPUIDLE_DRIVER_STATE_START].disable == 0)
 		data->last_state_idx = CPUIDLE_DRIVER_STATE_START;
@@ -186,8 +266,10 @@ static void menu_reflect(struct cpuidle_device *dev, int index)
 {
 	struct menu_device *data = &__get_cpu_var(menu_devices);
 	data->last_state_idx = index;
-	if (index >= 0)
+	if (index >= 0) {
+		data->last_wakeup = ktime_get();
 		data->needs_update = 1;
+	}
 }
 
 static void menu_update(struct cpuidle_driver *drv, struct cpuidle_device *dev)
@@ -224,8 +306,12 @@ static void menu_update(struct cpuidle_driver *drv, struct cpuidle_device *dev)
 
 	data->correction_factor[data->bucket] = new_factor;
 
+	if (last_idle_us + IRQ_SLACK_US < data->expected_us)
+		update_irq_rate(data, data->last_wakeup);
+
 	
-	data->intervals[data->interval_ptr++] = last_idle_us;
+	data->intervals[data->interval_ptr++] =
+		min_t(unsigned int, last_idle_us, MAX_INTERVAL_US);
 	if (data->interval_ptr >= INTERVALS)
 		data->interval_ptr = 0;
 }
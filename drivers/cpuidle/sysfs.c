@@ -195,6 +195,19 @@ static const struct sysfs_ops cpuidle_sysfs_ops = {
 	.store = cpuidle_store,
 };
 
+#ifdef CONFIG_ARCH_NEEDS_CPU_IDLE_COUPLED
+define_one_ro(coupled, cpuidle_coupled_show_stats);
+
+static struct attribute *cpuidle_dev_default_attrs[] = {
+	&attr_coupled.attr,
+	NULL
+};
+#else
+static struct attribute *cpuidle_dev_default_attrs[] = {
+	NULL
+};
+#endif
+
 static void cpuidle_sysfs_release(struct kobject *kobj)
 {
 	struct cpuidle_device *dev = kobj_to_cpuidledev(kobj);
@@ -204,6 +217,7 @@ static void cpuidle_sysfs_release(struct kobject *kobj)
 
 static struct kobj_type ktype_cpuidle = {
 	.sysfs_ops = &cpuidle_sysfs_ops,
+	.default_attrs = cpuidle_dev_default_attrs,
 	.release = cpuidle_sysfs_release,
 };
 
@@ -265,6 +279,8 @@ define_show_state_function(exit_latency)
 define_show_state_function(power_usage)
 define_show_state_ull_function(usage)
 define_show_state_ull_function(time)
+define_show_state_ull_function(above)
+define_show_state_ull_function(below)
 define_show_state_str_function(name)
 define_show_state_str_function(desc)
 define_show_state_function(disable)
@@ -276,6 +292,8 @@ define_one_state_ro(latency, show_state_exit_latency);
 define_one_state_ro(power, show_state_power_usage);
 define_one_state_ro(usage, show_state_usage);
 define_one_state_ro(time, show_state_time);
+define_one_state_ro(above, show_state_above);
+define_one_state_ro(below, show_state_below);
 define_one_state_rw(disable, show_state_disable, store_state_disable);
 
 static struct attribute *cpuidle_state_default_attrs[] = {
@@ -285,6 +303,8 @@ static struct attribute *cpuidle_state_default_attrs[] = {
 	&attr_power.attr,
 	&attr_usage.attr,
 	&attr_time.attr,
+	&attr_above.attr,
+	&attr_below.attr,
 	&attr_disable.attr,
 	NULL
 };
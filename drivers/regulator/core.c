@@ -1230,6 +1230,9 @@ found:
 out:
 	mutex_unlock(&regulator_list_mutex);
 
+	if (!IS_ERR(regulator) && dev && rdev->dev.parent)
+		device_pm_add_supplier(dev, rdev->dev.parent);
+
 	return regulator;
 }
 
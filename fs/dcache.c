@@ -23,13 +23,13 @@
 #include <linux/rculist_bl.h>
 #include <linux/prefetch.h>
 #include <linux/ratelimit.h>
+#include <linux/ramfs.h>
 #include "internal.h"
 #include "mount.h"
 
 int sysctl_vfs_cache_pressure __read_mostly = 100;
 EXPORT_SYMBOL_GPL(sysctl_vfs_cache_pressure);
 
-static __cacheline_aligned_in_smp DEFINE_SPINLOCK(dcache_lru_lock);
 __cacheline_aligned_in_smp DEFINE_SEQLOCK(rename_lock);
 
 EXPORT_SYMBOL(rename_lock);
@@ -57,6 +57,7 @@ struct dentry_stat_t dentry_stat = {
 };
 
 static DEFINE_PER_CPU(unsigned int, nr_dentry);
+static DEFINE_PER_CPU(unsigned int, nr_dentry_unused);
 
 #if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
 static int get_nr_dentry(void)
@@ -68,10 +69,20 @@ static int get_nr_dentry(void)
 	return sum < 0 ? 0 : sum;
 }
 
+static int get_nr_dentry_unused(void)
+{
+	int i;
+	int sum = 0;
+	for_each_possible_cpu(i)
+		sum += per_cpu(nr_dentry_unused, i);
+	return sum < 0 ? 0 : sum;
+}
+
 int proc_nr_dentry(ctl_table *table, int write, void __user *buffer,
 		   size_t *lenp, loff_t *ppos)
 {
 	dentry_stat.nr_dentry = get_nr_dentry();
+	dentry_stat.nr_unused = get_nr_dentry_unused();
 	return proc_dointvec(table, write, buffer, lenp, ppos);
 }
 #endif
@@ -197,29 +208,29 @@ static void dentry_unlink_inode(struct dentry * dentry)
 static void dentry_lru_add(struct dentry *dentry)
 {
 	if (list_empty(&dentry->d_lru)) {
-		spin_lock(&dcache_lru_lock);
-		list_add(&dentry->d_lru, &dentry->d_sb->s_dentry_lru);
-		dentry->d_sb->s_nr_dentry_unused++;
-		dentry_stat.nr_unused++;
-		spin_unlock(&dcache_lru_lock);
+		if (list_lru_add(&dentry->d_sb->s_dentry_lru, &dentry->d_lru))
+			this_cpu_inc(nr_dentry_unused);
 	}
 }
 
 static void __dentry_lru_del(struct dentry *dentry)
 {
-	list_del_init(&dentry->d_lru);
-	dentry->d_flags &= ~DCACHE_SHRINK_LIST;
-	dentry->d_sb->s_nr_dentry_unused--;
-	dentry_stat.nr_unused--;
+	struct super_block *sb = dentry->d_sb;
+
+	if (dentry->d_flags & DCACHE_SHRINK_LIST) {
+		spin_lock(&sb->s_dentry_shrink_lock);
+		list_del_init(&dentry->d_lru);
+		dentry->d_flags &= ~DCACHE_SHRINK_LIST;
+		spin_unlock(&sb->s_dentry_shrink_lock);
+	} else if (!list_lru_del(&sb->s_dentry_lru, &dentry->d_lru))
+		return;
+	this_cpu_dec(nr_dentry_unused);
 }
 
 static void dentry_lru_del(struct dentry *dentry)
 {
-	if (!list_empty(&dentry->d_lru)) {
-		spin_lock(&dcache_lru_lock);
+	if (!list_empty(&dentry->d_lru))
 		__dentry_lru_del(dentry);
-		spin_unlock(&dcache_lru_lock);
-	}
 }
 
 static void dentry_lru_prune(struct dentry *dentry)
@@ -228,23 +239,22 @@ static void dentry_lru_prune(struct dentry *dentry)
 		if (dentry->d_flags & DCACHE_OP_PRUNE)
 			dentry->d_op->d_prune(dentry);
 
-		spin_lock(&dcache_lru_lock);
 		__dentry_lru_del(dentry);
-		spin_unlock(&dcache_lru_lock);
 	}
 }
 
 static void dentry_lru_move_list(struct dentry *dentry, struct list_head *list)
 {
-	spin_lock(&dcache_lru_lock);
-	if (list_empty(&dentry->d_lru)) {
-		list_add_tail(&dentry->d_lru, list);
-		dentry->d_sb->s_nr_dentry_unused++;
-		dentry_stat.nr_unused++;
-	} else {
-		list_move_tail(&dentry->d_lru, list);
-	}
-	spin_unlock(&dcache_lru_lock);
+	struct super_block *sb = dentry->d_sb;
+
+	if (list_empty(&dentry->d_lru) ||
+	    !list_lru_del(&sb->s_dentry_lru, &dentry->d_lru))
+		this_cpu_inc(nr_dentry_unused);
+
+	spin_lock(&sb->s_dentry_shrink_lock);
+	list_add_tail(&dentry->d_lru, list);
+	dentry->d_flags |= DCACHE_SHRINK_LIST;
+	spin_unlock(&sb->s_dentry_shrink_lock);
 }
 
 static struct dentry *d_kill(struct dentry *dentry, struct dentry *parent)
@@ -560,42 +570,50 @@ static void shrink_dentry_list(struct list_head *list)
 	rcu_read_unlock();
 }
 
-void prune_dcache_sb(struct super_block *sb, int count)
+static enum lru_status __dentry_lru_isolate(struct dentry *dentry,
+					    struct list_head *freeable)
 {
-	struct dentry *dentry;
-	LIST_HEAD(referenced);
-	LIST_HEAD(tmp);
+	struct super_block *sb = dentry->d_sb;
 
-relock:
-	spin_lock(&dcache_lru_lock);
-	while (!list_empty(&sb->s_dentry_lru)) {
-		dentry = list_entry(sb->s_dentry_lru.prev,
-				struct dentry, d_lru);
-		BUG_ON(dentry->d_sb != sb);
-
-		if (!spin_trylock(&dentry->d_lock)) {
-			spin_unlock(&dcache_lru_lock);
-			cpu_relax();
-			goto relock;
-		}
+	spin_lock(&sb->s_dentry_shrink_lock);
+	list_move_tail(&dentry->d_lru, freeable);
+	dentry->d_flags |= DCACHE_SHRINK_LIST;
+	spin_unlock(&sb->s_dentry_shrink_lock);
+	spin_unlock(&dentry->d_lock);
+	return LRU_REMOVED;
+}
 
-		if (dentry->d_flags & DCACHE_REFERENCED) {
-			dentry->d_flags &= ~DCACHE_REFERENCED;
-			list_move(&dentry->d_lru, &referenced);
-			spin_unlock(&dentry->d_lock);
-		} else {
-			list_move_tail(&dentry->d_lru, &tmp);
-			dentry->d_flags |= DCACHE_SHRINK_LIST;
-			spin_unlock(&dentry->d_lock);
-			if (!--count)
-				break;
-		}
-		cond_resched_lock(&dcache_lru_lock);
+static enum lru_status dentry_lru_isolate(struct list_head *item,
+					  spinlock_t *lru_lock, void *arg)
+{
+	struct dentry *dentry = list_entry(item, struct dentry, d_lru);
+
+	if (!spin_trylock(&dentry->d_lock))
+		return LRU_SKIP;
+
+	if (dentry->d_flags & DCACHE_REFERENCED) {
+		dentry->d_flags &= ~DCACHE_REFERENCED;
+		spin_unlock(&dentry->d_lock);
+		return LRU_ROTATE;
 	}
-	if (!list_empty(&referenced))
-		list_splice(&referenced, &sb->s_dentry_lru);
-	spin_unlock(&dcache_lru_lock);
+	return __dentry_lru_isolate(dentry, arg);
+}
+
+static enum lru_status dentry_lru_isolate_all(struct list_head *item,
+					      spinlock_t *lru_lock, void *arg)
+{
+	struct dentry *dentry = list_entry(item, struct dentry, d_lru);
+
+	if (!spin_trylock(&dentry->d_lock))
+		return LRU_SKIP;
+	return __dentry_lru_isolate(dentry, arg);
+}
 
+void prune_dcache_sb(struct super_block *sb, int count)
+{
+	LIST_HEAD(tmp);
+
+	list_lru_walk(&sb->s_dentry_lru, dentry_lru_isolate, &tmp, count);
 	shrink_dentry_list(&tmp);
 }
 
@@ -603,14 +621,11 @@ void shrink_dcache_sb(struct super_block *sb)
 {
 	LIST_HEAD(tmp);
 
-	spin_lock(&dcache_lru_lock);
-	while (!list_empty(&sb->s_dentry_lru)) {
-		list_splice_init(&sb->s_dentry_lru, &tmp);
-		spin_unlock(&dcache_lru_lock);
+	while (list_lru_count(&sb->s_dentry_lru)) {
+		list_lru_walk(&sb->s_dentry_lru, dentry_lru_isolate_all,
+			      &tmp, ULONG_MAX);
 		shrink_dentry_list(&tmp);
-		spin_lock(&dcache_lru_lock);
 	}
-	spin_unlock(&dcache_lru_lock);
 }
 EXPORT_SYMBOL(shrink_dcache_sb);
 
@@ -808,7 +823,6 @@ resume:
 			dentry_lru_del(dentry);
 		} else if (!(dentry->d_flags & DCACHE_SHRINK_LIST)) {
 			dentry_lru_move_list(dentry, dispose);
-			dentry->d_flags |= DCACHE_SHRINK_LIST;
 			found++;
 		}
 		if (found && need_resched()) {
@@ -2165,6 +2179,81 @@ static void __init dcache_init(void)
 		INIT_HLIST_BL_HEAD(dentry_hashtable + loop);
 }
 
+#ifdef CONFIG_TEST_DCACHE_LRU
+#define TEST_DCACHE_LRU_LEN 256
+
+static int __init dcache_lru_test(void)
+{
+	struct file_system_type *type;
+	struct vfsmount *mnt;
+	struct dentry *root;
+	struct super_block *sb;
+	unsigned long count;
+	int i, err = -ENOMEM;
+
+	type = get_fs_type("ramfs");
+	if (!type)
+		return -ENODEV;
+	mnt = kern_mount(type);
+	put_filesystem(type);
+	if (IS_ERR(mnt))
+		return PTR_ERR(mnt);
+	root = mnt->mnt_root;
+	sb = root->d_sb;
+
+	printk(KERN_DEBUG "dcache_lru_test: %u shards\n",
+	       1U << sb->s_dentry_lru.shard_bits);
+
+	mutex_lock(&root->d_inode->i_mutex);
+	for (i = 0; i < TEST_DCACHE_LRU_LEN; i++) {
+		struct dentry *dentry;
+		struct inode *inode;
+		char name[16];
+
+		snprintf(name, sizeof(name), "lru%d", i);
+		dentry = d_alloc_name(root, name);
+		if (!dentry)
+			break;
+		inode = ramfs_get_inode(sb, root->d_inode, S_IFREG | 0644, 0);
+		if (!inode) {
+			dput(dentry);
+			break;
+		}
+		d_add(dentry, inode);
+		dput(dentry);
+	}
+	mutex_unlock(&root->d_inode->i_mutex);
+	if (i != TEST_DCACHE_LRU_LEN) {
+		printk(KERN_ERR "dcache_lru_test: error: allocation failed\n");
+		goto exit;
+	}
+
+	count = list_lru_count(&sb->s_dentry_lru);
+	if (count != TEST_DCACHE_LRU_LEN) {
+		printk(KERN_ERR "dcache_lru_test: error: %lu of %d dentries "
+				"on the lru\n", count, TEST_DCACHE_LRU_LEN);
+		err = -EINVAL;
+		goto exit;
+	}
+
+	shrink_dcache_sb(sb);
+
+	count = list_lru_count(&sb->s_dentry_lru);
+	if (count) {
+		printk(KERN_ERR "dcache_lru_test: error: %lu dentries left "
+				"after shrink_dcache_sb\n", count);
+		err = -EINVAL;
+		goto exit;
+	}
+
+	err = 0;
+exit:
+	kern_unmount(mnt);
+	return err;
+}
+late_initcall(dcache_lru_test);
+#endif
+
 struct kmem_cache *names_cachep __read_mostly;
 EXPORT_SYMBOL(names_cachep);
 
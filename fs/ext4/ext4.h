@@ -735,6 +735,7 @@ struct ext4_inode_info {
 #define EXT4_MOUNT_DIOREAD_NOLOCK	0x400000 
 #define EXT4_MOUNT_JOURNAL_CHECKSUM	0x800000 
 #define EXT4_MOUNT_JOURNAL_ASYNC_COMMIT	0x1000000 
+#define EXT4_MOUNT_DISCARD_ASYNC	0x2000000 
 #define EXT4_MOUNT_MBLK_IO_SUBMIT	0x4000000 
 #define EXT4_MOUNT_DELALLOC		0x8000000 
 #define EXT4_MOUNT_DATA_ERR_ABORT	0x10000000 
@@ -1011,6 +1012,19 @@ struct ext4_sb_info {
 	
 	atomic_t s_last_trim_minblks;
 
+	
+	spinlock_t s_discard_lock;
+	struct list_head s_discard_list;
+	unsigned int s_discard_pending;
+	struct mutex s_discard_mutex;
+	struct task_struct *s_discard_thread;
+	wait_queue_head_t s_discard_wait;
+	unsigned int s_discard_interval;
+	unsigned int s_discard_max_pending;
+	atomic_t s_discard_reqs;
+	atomic_t s_discard_merged;
+	atomic_t s_discard_unaligned;
+
 #ifdef CONFIG_EXT4_E2FSCK_RECOVER
 	
 	struct work_struct reboot_work;
@@ -1507,6 +1521,8 @@ extern int ext4_mb_add_groupinfo(struct super_block *sb,
 extern int ext4_group_add_blocks(handle_t *handle, struct super_block *sb,
 				ext4_fsblk_t block, unsigned long count);
 extern int ext4_trim_fs(struct super_block *, struct fstrim_range *);
+extern int ext4_mb_start_discard_thread(struct super_block *);
+extern unsigned int ext4_mb_flush_discards(struct super_block *);
 
 struct buffer_head *ext4_getblk(handle_t *, struct inode *,
 						ext4_lblk_t, int, int *);
@@ -22,6 +22,10 @@
 #include "mballoc.h"
 #include <linux/debugfs.h>
 #include <linux/slab.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/list_sort.h>
+#include <linux/blkdev.h>
 #include <trace/events/ext4.h>
 
 
@@ -47,6 +51,7 @@ static void ext4_mb_generate_from_freelist(struct super_block *sb, void *bitmap,
 						ext4_group_t group);
 static void ext4_free_data_callback(struct super_block *sb,
 				struct ext4_journal_cb_entry *jce, int rc);
+static void ext4_mb_stop_discard_thread(struct super_block *sb);
 
 static inline void *mb_correct_addr_and_bit(int *bit, void *addr)
 {
@@ -1842,6 +1847,14 @@ int ext4_mb_init(struct super_block *sb, int needs_recovery)
 	spin_lock_init(&sbi->s_md_lock);
 	spin_lock_init(&sbi->s_bal_lock);
 
+	spin_lock_init(&sbi->s_discard_lock);
+	INIT_LIST_HEAD(&sbi->s_discard_list);
+	mutex_init(&sbi->s_discard_mutex);
+	init_waitqueue_head(&sbi->s_discard_wait);
+	sbi->s_discard_interval = MB_DEFAULT_DISCARD_INTERVAL;
+	sbi->s_discard_max_pending = MB_DEFAULT_DISCARD_MAX_PENDING >>
+				     sbi->s_cluster_bits;
+
 	sbi->s_mb_max_to_scan = MB_DEFAULT_MAX_TO_SCAN;
 	sbi->s_mb_min_to_scan = MB_DEFAULT_MIN_TO_SCAN;
 	sbi->s_mb_stats = MB_DEFAULT_STATS;
@@ -1877,6 +1890,9 @@ int ext4_mb_init(struct super_block *sb, int needs_recovery)
 		proc_create_data("mb_groups", S_IRUGO, sbi->s_proc,
 				 &ext4_mb_seq_groups_fops, sb);
 
+	if (test_opt(sb, DISCARD_ASYNC))
+		ext4_mb_start_discard_thread(sb);
+
 	return 0;
 
 out_free_locality_groups:
@@ -1921,6 +1937,8 @@ int ext4_mb_release(struct super_block *sb)
 	if (sbi->s_proc)
 		remove_proc_entry("mb_groups", sbi->s_proc);
 
+	ext4_mb_stop_discard_thread(sb);
+
 	if (sbi->s_group_info) {
 		for (i = 0; i < ngroups; i++) {
 			grinfo = ext4_get_group_info(sb, i);
@@ -1965,6 +1983,12 @@ int ext4_mb_release(struct super_block *sb)
 		       "mballoc: %u preallocated, %u discarded",
 				atomic_read(&sbi->s_mb_preallocated),
 				atomic_read(&sbi->s_mb_discarded));
+		ext4_msg(sb, KERN_INFO,
+		       "mballoc: %u discard requests, %u extents merged, "
+				"%u unaligned",
+				atomic_read(&sbi->s_discard_reqs),
+				atomic_read(&sbi->s_discard_merged),
+				atomic_read(&sbi->s_discard_unaligned));
 	}
 
 	free_percpu(sbi->s_locality_groups);
@@ -1985,37 +2009,25 @@ static inline int ext4_issue_discard(struct super_block *sb,
 	return sb_issue_discard(sb, discard_block, count, GFP_NOFS, 0);
 }
 
-static void ext4_free_data_callback(struct super_block *sb,
-				    struct ext4_journal_cb_entry *jce,
-				    int rc)
+static void ext4_mb_release_free_data(struct super_block *sb,
+				      struct ext4_free_data *entry,
+				      int trimmed)
 {
-	struct ext4_free_data *entry = (struct ext4_free_data *)jce;
 	struct ext4_buddy e4b;
 	struct ext4_group_info *db;
-	int err, count = 0, count2 = 0;
-
-	mb_debug(1, "gonna free %u blocks in group %u (0x%p):",
-		 entry->efd_count, entry->efd_group, entry);
-
-	if (test_opt(sb, DISCARD))
-		ext4_issue_discard(sb, entry->efd_group,
-				   entry->efd_start_cluster, entry->efd_count);
+	int err;
 
 	err = ext4_mb_load_buddy(sb, entry->efd_group, &e4b);
 	
 	BUG_ON(err != 0);
 
-
 	db = e4b.bd_info;
-	
-	count += entry->efd_count;
-	count2++;
 	ext4_lock_group(sb, entry->efd_group);
 	
 	rb_erase(&entry->efd_node, &(db->bb_free_root));
 	mb_free_blocks(NULL, &e4b, entry->efd_start_cluster, entry->efd_count);
 
-	if (!test_opt(sb, DISCARD))
+	if (!trimmed)
 		EXT4_MB_GRP_CLEAR_TRIMMED(db);
 
 	if (!db->bb_free_root.rb_node) {
@@ -2025,8 +2037,215 @@ static void ext4_free_data_callback(struct super_block *sb,
 	ext4_unlock_group(sb, entry->efd_group);
 	kmem_cache_free(ext4_free_data_cachep, entry);
 	ext4_mb_unload_buddy(&e4b);
+}
+
+static void ext4_mb_queue_discard(struct super_block *sb,
+				  struct ext4_free_data *entry)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int wake;
+
+	spin_lock(&sbi->s_discard_lock);
+	list_add_tail(&entry->efd_jce.jce_list, &sbi->s_discard_list);
+	sbi->s_discard_pending += entry->efd_count;
+	wake = sbi->s_discard_pending >= sbi->s_discard_max_pending;
+	spin_unlock(&sbi->s_discard_lock);
+
+	if (wake)
+		wake_up(&sbi->s_discard_wait);
+}
+
+static void ext4_free_data_callback(struct super_block *sb,
+				    struct ext4_journal_cb_entry *jce,
+				    int rc)
+{
+	struct ext4_free_data *entry = (struct ext4_free_data *)jce;
+
+	mb_debug(1, "gonna free %u blocks in group %u (0x%p):",
+		 entry->efd_count, entry->efd_group, entry);
+
+	if (test_opt(sb, DISCARD_ASYNC) && EXT4_SB(sb)->s_discard_thread) {
+		ext4_mb_queue_discard(sb, entry);
+		return;
+	}
+
+	if (test_opt(sb, DISCARD))
+		ext4_issue_discard(sb, entry->efd_group,
+				   entry->efd_start_cluster, entry->efd_count);
+
+	ext4_mb_release_free_data(sb, entry, test_opt(sb, DISCARD));
+}
+
+static inline ext4_fsblk_t ext4_free_data_block(struct super_block *sb,
+						struct ext4_free_data *entry)
+{
+	return ext4_group_first_block_no(sb, entry->efd_group) +
+		EXT4_C2B(EXT4_SB(sb), entry->efd_start_cluster);
+}
+
+static int ext4_mb_discard_cmp(void *priv, struct list_head *a,
+			       struct list_head *b)
+{
+	struct ext4_free_data *ea, *eb;
+
+	ea = list_entry(a, struct ext4_free_data, efd_jce.jce_list);
+	eb = list_entry(b, struct ext4_free_data, efd_jce.jce_list);
+
+	if (ea->efd_group != eb->efd_group)
+		return ea->efd_group < eb->efd_group ? -1 : 1;
+	return ea->efd_start_cluster - eb->efd_start_cluster;
+}
+
+static void ext4_mb_discard_range(struct super_block *sb,
+				  struct list_head *range,
+				  ext4_fsblk_t start, ext4_fsblk_t end,
+				  unsigned int gran)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_free_data *entry, *tmp;
+	ext4_fsblk_t astart, aend;
+	int err = -EINVAL;
+
+	astart = start + gran - 1;
+	do_div(astart, gran);
+	astart *= gran;
+	aend = end;
+	do_div(aend, gran);
+	aend *= gran;
+
+	if (aend > astart) {
+		trace_ext4_discard_blocks(sb, (unsigned long long) astart,
+					  aend - astart);
+		err = sb_issue_discard(sb, astart, aend - astart, GFP_NOFS, 0);
+		if (!err)
+			atomic_inc(&sbi->s_discard_reqs);
+	}
+	if (astart != start || aend != end)
+		atomic_inc(&sbi->s_discard_unaligned);
+
+	list_for_each_entry_safe(entry, tmp, range, efd_jce.jce_list) {
+		ext4_fsblk_t block = ext4_free_data_block(sb, entry);
+		int trimmed = !err && block >= astart &&
+			block + EXT4_C2B(sbi, entry->efd_count) <= aend;
+
+		list_del_init(&entry->efd_jce.jce_list);
+		ext4_mb_release_free_data(sb, entry, trimmed);
+	}
+}
+
+unsigned int ext4_mb_flush_discards(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct request_queue *q = bdev_get_queue(sb->s_bdev);
+	struct ext4_free_data *entry;
+	unsigned int gran, pending;
+	LIST_HEAD(list);
+	LIST_HEAD(range);
+
+	mutex_lock(&sbi->s_discard_mutex);
+	spin_lock(&sbi->s_discard_lock);
+	list_splice_init(&sbi->s_discard_list, &list);
+	pending = sbi->s_discard_pending;
+	sbi->s_discard_pending = 0;
+	spin_unlock(&sbi->s_discard_lock);
+
+	if (list_empty(&list))
+		goto out;
+
+	list_sort(NULL, &list, ext4_mb_discard_cmp);
+	gran = max_t(unsigned int, 1,
+		     q->limits.discard_granularity >> sb->s_blocksize_bits);
+
+	while (!list_empty(&list)) {
+		ext4_fsblk_t start, end;
+
+		entry = list_first_entry(&list, struct ext4_free_data,
+					 efd_jce.jce_list);
+		start = ext4_free_data_block(sb, entry);
+		end = start;
+		do {
+			end += EXT4_C2B(sbi, entry->efd_count);
+			list_move_tail(&entry->efd_jce.jce_list, &range);
+			if (list_empty(&list))
+				break;
+			entry = list_first_entry(&list, struct ext4_free_data,
+						 efd_jce.jce_list);
+			if (ext4_free_data_block(sb, entry) != end)
+				break;
+			atomic_inc(&sbi->s_discard_merged);
+		} while (1);
+
+		ext4_mb_discard_range(sb, &range, start, end, gran);
+		cond_resched();
+	}
+out:
+	mutex_unlock(&sbi->s_discard_mutex);
+	return pending;
+}
 
-	mb_debug(1, "freed %u blocks in %u structures\n", count, count2);
+static int ext4_bdev_idle(struct super_block *sb)
+{
+	struct request_list *rl = &bdev_get_queue(sb->s_bdev)->rq;
+
+	return !rl->count[BLK_RW_SYNC] && !rl->count[BLK_RW_ASYNC];
+}
+
+static int ext4_discard_over_limit(struct ext4_sb_info *sbi)
+{
+	return sbi->s_discard_pending >= sbi->s_discard_max_pending;
+}
+
+static int ext4_discard_thread(void *data)
+{
+	struct super_block *sb = data;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	set_freezable();
+	while (!kthread_should_stop()) {
+		wait_event_freezable_timeout(sbi->s_discard_wait,
+				kthread_should_stop() ||
+				ext4_discard_over_limit(sbi),
+				msecs_to_jiffies(max_t(unsigned int, 10,
+						sbi->s_discard_interval)));
+		if (kthread_should_stop())
+			break;
+		if (!sbi->s_discard_pending || sb->s_frozen != SB_UNFROZEN)
+			continue;
+		if (!ext4_discard_over_limit(sbi) && !ext4_bdev_idle(sb))
+			continue;
+		ext4_mb_flush_discards(sb);
+	}
+	return 0;
+}
+
+int ext4_mb_start_discard_thread(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct task_struct *t;
+
+	if (sbi->s_discard_thread)
+		return 0;
+
+	t = kthread_run(ext4_discard_thread, sb, "ext4-discard/%s", sb->s_id);
+	if (IS_ERR(t)) {
+		ext4_msg(sb, KERN_WARNING, "failed to start discard thread, "
+			 "falling back to synchronous discard");
+		clear_opt(sb, DISCARD_ASYNC);
+		return PTR_ERR(t);
+	}
+	sbi->s_discard_thread = t;
+	return 0;
+}
+
+static void ext4_mb_stop_discard_thread(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	if (sbi->s_discard_thread) {
+		kthread_stop(sbi->s_discard_thread);
+		sbi->s_discard_thread = NULL;
+	}
+	ext4_mb_flush_discards(sb);
 }
 
 #ifdef CONFIG_EXT4_DEBUG
@@ -3484,6 +3703,8 @@ repeat:
 		}
 	} else {
 		freed  = ext4_mb_discard_preallocations(sb, ac->ac_o_ex.fe_len);
+		if (!freed && test_opt(sb, DISCARD_ASYNC))
+			freed = ext4_mb_flush_discards(sb);
 		if (freed)
 			goto repeat;
 		*errp = -ENOSPC;
@@ -3732,7 +3953,8 @@ do_more:
 	if (err)
 		goto error_return;
 
-	if ((flags & EXT4_FREE_BLOCKS_METADATA) && ext4_handle_valid(handle)) {
+	if (((flags & EXT4_FREE_BLOCKS_METADATA) ||
+	     test_opt(sb, DISCARD_ASYNC)) && ext4_handle_valid(handle)) {
 		struct ext4_free_data *new_entry;
 		new_entry = kmem_cache_alloc(ext4_free_data_cachep, GFP_NOFS);
 		if (!new_entry) {
@@ -3752,6 +3974,7 @@ do_more:
 		ext4_lock_group(sb, block_group);
 		mb_clear_bits(bitmap_bh->b_data, bit, count_clusters);
 		mb_free_blocks(inode, &e4b, bit, count_clusters);
+		EXT4_MB_GRP_CLEAR_TRIMMED(e4b.bd_info);
 	}
 
 	ret = ext4_free_group_clusters(sb, gdp) + count_clusters;
@@ -4029,8 +4252,17 @@ int ext4_trim_fs(struct super_block *sb, struct fstrim_range *range)
 	
 	end = EXT4_CLUSTERS_PER_GROUP(sb) - 1;
 
+	if (test_opt(sb, DISCARD_ASYNC))
+		ext4_mb_flush_discards(sb);
+
 	for (group = first_group; group <= last_group; group++) {
 		grp = ext4_get_group_info(sb, group);
+
+		if (EXT4_MB_GRP_WAS_TRIMMED(grp) &&
+		    minlen >= atomic_read(&EXT4_SB(sb)->s_last_trim_minblks)) {
+			first_cluster = 0;
+			continue;
+		}
 		
 		if (unlikely(EXT4_MB_GRP_NEED_INIT(grp))) {
 			ret = ext4_mb_init_group(sb, group);
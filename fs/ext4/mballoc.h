@@ -52,6 +52,10 @@ extern u8 mb_enable_debug;
 
 #define MB_DEFAULT_GROUP_PREALLOC	512
 
+#define MB_DEFAULT_DISCARD_INTERVAL	1000
+
+#define MB_DEFAULT_DISCARD_MAX_PENDING	16384
+
 
 struct ext4_free_data {
 	
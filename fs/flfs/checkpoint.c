@@ -0,0 +1,416 @@
+/*
+ * fs/flfs/checkpoint.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/fs.h>
+#include <linux/bio.h>
+#include <linux/mpage.h>
+#include <linux/writeback.h>
+#include <linux/blkdev.h>
+#include <linux/backing-dev.h>
+
+#include "flfs.h"
+#include "node.h"
+#include "segment.h"
+
+struct orphan_inode_entry {
+	struct list_head list;
+	nid_t ino;
+};
+
+static struct kmem_cache *orphan_entry_slab;
+
+int acquire_orphan_inode(struct flfs_sb_info *sbi)
+{
+	int err = 0;
+
+	mutex_lock(&sbi->orphan_inode_mutex);
+	if (sbi->n_orphans >= sbi->max_orphans)
+		err = -ENOSPC;
+	else
+		sbi->n_orphans++;
+	mutex_unlock(&sbi->orphan_inode_mutex);
+	return err;
+}
+
+void release_orphan_inode(struct flfs_sb_info *sbi)
+{
+	mutex_lock(&sbi->orphan_inode_mutex);
+	BUG_ON(!sbi->n_orphans);
+	sbi->n_orphans--;
+	mutex_unlock(&sbi->orphan_inode_mutex);
+}
+
+void add_orphan_inode(struct flfs_sb_info *sbi, nid_t ino)
+{
+	struct orphan_inode_entry *new, *orphan;
+	struct list_head *head = &sbi->orphan_inode_list;
+
+	new = kmem_cache_alloc(orphan_entry_slab, GFP_NOFS | __GFP_NOFAIL);
+	new->ino = ino;
+
+	mutex_lock(&sbi->orphan_inode_mutex);
+	list_for_each_entry(orphan, head, list) {
+		if (orphan->ino == ino) {
+			sbi->n_orphans--;
+			mutex_unlock(&sbi->orphan_inode_mutex);
+			kmem_cache_free(orphan_entry_slab, new);
+			return;
+		}
+	}
+	list_add_tail(&new->list, head);
+	mutex_unlock(&sbi->orphan_inode_mutex);
+}
+
+void remove_orphan_inode(struct flfs_sb_info *sbi, nid_t ino)
+{
+	struct orphan_inode_entry *orphan;
+
+	mutex_lock(&sbi->orphan_inode_mutex);
+	list_for_each_entry(orphan, &sbi->orphan_inode_list, list) {
+		if (orphan->ino == ino) {
+			list_del(&orphan->list);
+			kmem_cache_free(orphan_entry_slab, orphan);
+			sbi->n_orphans--;
+			break;
+		}
+	}
+	mutex_unlock(&sbi->orphan_inode_mutex);
+}
+
+static void recover_orphan_inode(struct flfs_sb_info *sbi, nid_t ino)
+{
+	struct inode *inode = flfs_iget(sbi->sb, ino);
+
+	if (IS_ERR(inode)) {
+		flfs_msg(sbi->sb, KERN_WARNING,
+			 "cannot recover orphan inode %u", ino);
+		return;
+	}
+	clear_nlink(inode);
+	iput(inode);
+}
+
+int recover_orphan_inodes(struct flfs_sb_info *sbi)
+{
+	struct flfs_checkpoint *ckpt = FLFS_CKPT(sbi);
+	block_t start_blk, orphan_blkaddr;
+	unsigned int i, j;
+
+	if (!is_set_ckpt_flags(ckpt, CP_ORPHAN_PRESENT_FLAG))
+		return 0;
+
+	start_blk = __start_cp_addr(sbi) + 1;
+	orphan_blkaddr = le32_to_cpu(ckpt->cp_pack_start_sum) - 1;
+
+	for (i = 0; i < orphan_blkaddr; i++) {
+		struct flfs_orphan_block *orphan_blk;
+		struct buffer_head *bh;
+
+		bh = sb_bread(sbi->sb, start_blk + i);
+		if (!bh)
+			return -EIO;
+		orphan_blk = (struct flfs_orphan_block *)bh->b_data;
+		for (j = 0; j < le32_to_cpu(orphan_blk->entry_count) &&
+					j < FLFS_ORPHANS_PER_BLOCK; j++)
+			recover_orphan_inode(sbi,
+					le32_to_cpu(orphan_blk->ino[j]));
+		brelse(bh);
+	}
+
+	clear_ckpt_flags(ckpt, CP_ORPHAN_PRESENT_FLAG);
+	write_checkpoint(sbi, false);
+	return 0;
+}
+
+static void write_cp_block(struct flfs_sb_info *sbi, const void *src,
+			block_t blkaddr, bool sync)
+{
+	struct buffer_head *bh = sb_getblk(sbi->sb, blkaddr);
+
+	lock_buffer(bh);
+	memcpy(bh->b_data, src, FLFS_BLKSIZE);
+	set_buffer_uptodate(bh);
+	unlock_buffer(bh);
+	mark_buffer_dirty(bh);
+	if (sync && __sync_dirty_buffer(bh, WRITE_FLUSH_FUA))
+		sbi->cp_error = true;
+	brelse(bh);
+}
+
+static void write_orphan_inodes(struct flfs_sb_info *sbi, block_t start_blk,
+			unsigned int orphan_blocks)
+{
+	struct orphan_inode_entry *orphan;
+	struct flfs_orphan_block *orphan_blk;
+	unsigned int nentries = 0;
+	unsigned short index = 1;
+
+	orphan_blk = kzalloc(FLFS_BLKSIZE, GFP_NOFS | __GFP_NOFAIL);
+
+	mutex_lock(&sbi->orphan_inode_mutex);
+	list_for_each_entry(orphan, &sbi->orphan_inode_list, list) {
+		orphan_blk->ino[nentries++] = cpu_to_le32(orphan->ino);
+		if (nentries < FLFS_ORPHANS_PER_BLOCK &&
+		    !list_is_last(&orphan->list, &sbi->orphan_inode_list))
+			continue;
+
+		orphan_blk->blk_addr = cpu_to_le16(index);
+		orphan_blk->blk_count = cpu_to_le16(orphan_blocks);
+		orphan_blk->entry_count = cpu_to_le32(nentries);
+		orphan_blk->check_sum = cpu_to_le32(flfs_crc32(orphan_blk,
+				offsetof(struct flfs_orphan_block, check_sum)));
+		write_cp_block(sbi, orphan_blk, start_blk++, false);
+
+		memset(orphan_blk, 0, FLFS_BLKSIZE);
+		nentries = 0;
+		index++;
+	}
+	mutex_unlock(&sbi->orphan_inode_mutex);
+	kfree(orphan_blk);
+}
+
+void set_dirty_dir_page(struct inode *inode, struct page *page)
+{
+	struct flfs_sb_info *sbi = FLFS_I_SB(inode);
+	struct flfs_inode_info *fi = FLFS_I(inode);
+
+	spin_lock(&sbi->dir_inode_lock);
+	if (list_empty(&fi->dirty_dir))
+		list_add_tail(&fi->dirty_dir, &sbi->dir_inode_list);
+	atomic_inc(&fi->dirty_dents);
+	inc_page_count(sbi, FLFS_DIRTY_DENTS);
+	spin_unlock(&sbi->dir_inode_lock);
+}
+
+void inode_dec_dirty_dents(struct inode *inode)
+{
+	atomic_dec(&FLFS_I(inode)->dirty_dents);
+	dec_page_count(FLFS_I_SB(inode), FLFS_DIRTY_DENTS);
+}
+
+void remove_dirty_dir_inode(struct inode *inode)
+{
+	struct flfs_sb_info *sbi = FLFS_I_SB(inode);
+	struct flfs_inode_info *fi = FLFS_I(inode);
+
+	if (!S_ISDIR(inode->i_mode))
+		return;
+
+	spin_lock(&sbi->dir_inode_lock);
+	if (!list_empty(&fi->dirty_dir))
+		list_del_init(&fi->dirty_dir);
+	spin_unlock(&sbi->dir_inode_lock);
+}
+
+void sync_dirty_dir_inodes(struct flfs_sb_info *sbi)
+{
+	struct flfs_inode_info *fi;
+	struct inode *inode;
+	LIST_HEAD(list);
+
+	spin_lock(&sbi->dir_inode_lock);
+	list_splice_init(&sbi->dir_inode_list, &list);
+	while (!list_empty(&list)) {
+		fi = list_first_entry(&list, struct flfs_inode_info, dirty_dir);
+		if (!atomic_read(&fi->dirty_dents)) {
+			list_del_init(&fi->dirty_dir);
+			continue;
+		}
+		list_move_tail(&fi->dirty_dir, &sbi->dir_inode_list);
+		inode = igrab(&fi->vfs_inode);
+		spin_unlock(&sbi->dir_inode_lock);
+		if (inode) {
+			filemap_flush(inode->i_mapping);
+			iput(inode);
+		}
+		cond_resched();
+		spin_lock(&sbi->dir_inode_lock);
+	}
+	spin_unlock(&sbi->dir_inode_lock);
+}
+
+static void block_operations(struct flfs_sb_info *sbi)
+{
+retry:
+	flfs_lock_all(sbi);
+	if (get_pages(sbi, FLFS_DIRTY_DENTS)) {
+		flfs_unlock_all(sbi);
+		sync_dirty_dir_inodes(sbi);
+		if (get_pages(sbi, FLFS_DIRTY_DENTS))
+			congestion_wait(BLK_RW_ASYNC, HZ / 50);
+		goto retry;
+	}
+
+	mutex_lock(&sbi->node_write);
+	sync_node_pages(sbi);
+}
+
+static void unblock_operations(struct flfs_sb_info *sbi)
+{
+	mutex_unlock(&sbi->node_write);
+	flfs_unlock_all(sbi);
+}
+
+static void do_checkpoint(struct flfs_sb_info *sbi, bool is_umount)
+{
+	struct flfs_checkpoint *ckpt = FLFS_CKPT(sbi);
+	unsigned int orphan_blocks, total;
+	block_t start_blk;
+	u32 crc;
+
+	flfs_submit_merged_bio(sbi, DATA);
+	flfs_submit_merged_bio(sbi, NODE);
+	wait_event(sbi->cp_wait, !get_pages(sbi, FLFS_WRITEBACK));
+
+	flush_nat_entries(sbi);
+	flush_sit_entries(sbi);
+
+	ckpt->checkpoint_ver = cpu_to_le64(cur_cp_version(ckpt) + 1);
+	fill_curseg_checkpoint(sbi);
+
+	spin_lock(&sbi->stat_lock);
+	ckpt->valid_block_count = cpu_to_le64(sbi->total_valid_block_count);
+	ckpt->valid_node_count = cpu_to_le32(sbi->total_valid_node_count);
+	ckpt->valid_inode_count = cpu_to_le32(sbi->total_valid_inode_count);
+	spin_unlock(&sbi->stat_lock);
+	ckpt->next_free_nid = cpu_to_le32(next_free_nid(sbi));
+
+	orphan_blocks = DIV_ROUND_UP(sbi->n_orphans, FLFS_ORPHANS_PER_BLOCK);
+	total = 2 + orphan_blocks + NR_CURSEG_TYPE;
+	ckpt->cp_pack_start_sum = cpu_to_le32(1 + orphan_blocks);
+	ckpt->cp_pack_total_block_count = cpu_to_le32(total);
+
+	if (is_umount)
+		set_ckpt_flags(ckpt, CP_UMOUNT_FLAG);
+	else
+		clear_ckpt_flags(ckpt, CP_UMOUNT_FLAG);
+	if (sbi->n_orphans)
+		set_ckpt_flags(ckpt, CP_ORPHAN_PRESENT_FLAG);
+	else
+		clear_ckpt_flags(ckpt, CP_ORPHAN_PRESENT_FLAG);
+	if (sbi->cp_error)
+		set_ckpt_flags(ckpt, CP_ERROR_FLAG);
+
+	crc = flfs_crc32(ckpt, le32_to_cpu(ckpt->checksum_offset));
+	*(__le32 *)((unsigned char *)ckpt +
+		    le32_to_cpu(ckpt->checksum_offset)) = cpu_to_le32(crc);
+
+	start_blk = le32_to_cpu(sbi->raw_super->cp_blkaddr);
+	if (sbi->cur_cp_pack == 1)
+		start_blk += sbi->blocks_per_seg;
+
+	write_cp_block(sbi, ckpt, start_blk, false);
+	if (orphan_blocks)
+		write_orphan_inodes(sbi, start_blk + 1, orphan_blocks);
+	write_curseg_summaries(sbi, start_blk + 1 + orphan_blocks);
+
+	sync_blockdev(sbi->sb->s_bdev);
+
+	write_cp_block(sbi, ckpt, start_blk + total - 1, true);
+
+	sbi->cur_cp_pack = sbi->cur_cp_pack == 1 ? 2 : 1;
+	clear_prefree_segments(sbi);
+	sbi->stat.checkpoints++;
+}
+
+void write_checkpoint(struct flfs_sb_info *sbi, bool is_umount)
+{
+	mutex_lock(&sbi->cp_mutex);
+	block_operations(sbi);
+	do_checkpoint(sbi, is_umount);
+	unblock_operations(sbi);
+	mutex_unlock(&sbi->cp_mutex);
+}
+
+static struct buffer_head *validate_checkpoint(struct flfs_sb_info *sbi,
+			block_t cp_addr, unsigned long long *version)
+{
+	struct buffer_head *bh1, *bh2;
+	struct flfs_checkpoint *cp;
+	unsigned long long pre_version;
+	unsigned int crc_offset, total;
+
+	bh1 = sb_bread(sbi->sb, cp_addr);
+	if (!bh1)
+		return NULL;
+	cp = (struct flfs_checkpoint *)bh1->b_data;
+	crc_offset = le32_to_cpu(cp->checksum_offset);
+	if (crc_offset != FLFS_CP_CHECKSUM_OFFSET ||
+	    !flfs_crc_valid(le32_to_cpu(*(__le32 *)(bh1->b_data + crc_offset)),
+			    cp, crc_offset))
+		goto invalid;
+	pre_version = cur_cp_version(cp);
+
+	total = le32_to_cpu(cp->cp_pack_total_block_count);
+	if (total < 2 + NR_CURSEG_TYPE || total > sbi->blocks_per_seg)
+		goto invalid;
+
+	bh2 = sb_bread(sbi->sb, cp_addr + total - 1);
+	if (!bh2)
+		goto invalid;
+	cp = (struct flfs_checkpoint *)bh2->b_data;
+	if (le32_to_cpu(cp->checksum_offset) != crc_offset ||
+	    !flfs_crc_valid(le32_to_cpu(*(__le32 *)(bh2->b_data + crc_offset)),
+			    cp, crc_offset) ||
+	    cur_cp_version(cp) != pre_version) {
+		brelse(bh2);
+		goto invalid;
+	}
+	brelse(bh2);
+
+	*version = pre_version;
+	return bh1;
+invalid:
+	brelse(bh1);
+	return NULL;
+}
+
+int get_valid_checkpoint(struct flfs_sb_info *sbi)
+{
+	block_t cp_start = le32_to_cpu(sbi->raw_super->cp_blkaddr);
+	unsigned long long cp1_version = 0, cp2_version = 0;
+	struct buffer_head *cp1, *cp2, *cur;
+
+	sbi->ckpt = kzalloc(FLFS_BLKSIZE, GFP_KERNEL);
+	if (!sbi->ckpt)
+		return -ENOMEM;
+
+	cp1 = validate_checkpoint(sbi, cp_start, &cp1_version);
+	cp2 = validate_checkpoint(sbi, cp_start + sbi->blocks_per_seg,
+				  &cp2_version);
+
+	if (cp1 && cp2) {
+		cur = cp2_version > cp1_version ? cp2 : cp1;
+	} else if (cp1 || cp2) {
+		cur = cp1 ? cp1 : cp2;
+	} else {
+		kfree(sbi->ckpt);
+		sbi->ckpt = NULL;
+		return -EINVAL;
+	}
+
+	memcpy(sbi->ckpt, cur->b_data, FLFS_BLKSIZE);
+	sbi->cur_cp_pack = cur == cp1 ? 1 : 2;
+
+	brelse(cp1);
+	brelse(cp2);
+	return 0;
+}
+
+int __init create_checkpoint_caches(void)
+{
+	orphan_entry_slab = kmem_cache_create("flfs_orphan_entry",
+			sizeof(struct orphan_inode_entry), 0, 0, NULL);
+	if (!orphan_entry_slab)
+		return -ENOMEM;
+	return 0;
+}
+
+void destroy_checkpoint_caches(void)
+{
+	kmem_cache_destroy(orphan_entry_slab);
+}
@@ -0,0 +1,383 @@
+/*
+ * fs/flfs/data.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/fs.h>
+#include <linux/buffer_head.h>
+#include <linux/mpage.h>
+#include <linux/writeback.h>
+#include <linux/backing-dev.h>
+#include <linux/blkdev.h>
+#include <linux/bio.h>
+
+#include "flfs.h"
+#include "node.h"
+#include "segment.h"
+
+static void set_data_blkaddr(struct dnode_of_data *dn, block_t new_addr)
+{
+	struct page *node_page = dn->node_page;
+
+	flfs_wait_on_page_writeback(node_page, NODE);
+	blkaddr_in_node(node_page)[dn->ofs_in_node] = cpu_to_le32(new_addr);
+	set_page_dirty(node_page);
+	dn->data_blkaddr = new_addr;
+}
+
+int reserve_new_block(struct dnode_of_data *dn)
+{
+	struct flfs_sb_info *sbi = FLFS_I_SB(dn->inode);
+
+	if (!inc_valid_block_count(sbi, dn->inode, 1))
+		return -ENOSPC;
+	set_data_blkaddr(dn, NEW_ADDR);
+	mark_inode_dirty(dn->inode);
+	return 0;
+}
+
+static int flfs_get_block(struct inode *inode, sector_t iblock,
+			struct buffer_head *bh_result, int create)
+{
+	struct dnode_of_data dn;
+	int err;
+
+	set_new_dnode(&dn, inode, 0);
+	err = get_dnode_of_data(&dn, iblock, LOOKUP_NODE);
+	if (err)
+		return err == -ENOENT ? 0 : err;
+
+	if (dn.data_blkaddr != NULL_ADDR && dn.data_blkaddr != NEW_ADDR)
+		map_bh(bh_result, inode->i_sb, dn.data_blkaddr);
+	flfs_put_dnode(&dn);
+	return 0;
+}
+
+struct page *get_lock_data_page(struct inode *inode, pgoff_t index)
+{
+	struct flfs_sb_info *sbi = FLFS_I_SB(inode);
+	struct dnode_of_data dn;
+	struct page *page;
+	block_t blkaddr;
+	int err;
+
+	page = grab_cache_page(inode->i_mapping, index);
+	if (!page)
+		return ERR_PTR(-ENOMEM);
+	if (PageUptodate(page))
+		return page;
+
+	set_new_dnode(&dn, inode, 0);
+	err = get_dnode_of_data(&dn, index, LOOKUP_NODE);
+	if (err) {
+		flfs_put_page(page, 1);
+		return ERR_PTR(err);
+	}
+	blkaddr = dn.data_blkaddr;
+	flfs_put_dnode(&dn);
+
+	if (blkaddr == NULL_ADDR) {
+		flfs_put_page(page, 1);
+		return ERR_PTR(-ENOENT);
+	}
+	if (blkaddr == NEW_ADDR) {
+		zero_user_segment(page, 0, PAGE_CACHE_SIZE);
+		SetPageUptodate(page);
+		return page;
+	}
+
+	err = flfs_readpage_sync(sbi, page, blkaddr, READ_SYNC);
+	if (err) {
+		flfs_put_page(page, 1);
+		return ERR_PTR(err);
+	}
+	return page;
+}
+
+struct page *get_new_data_page(struct inode *inode, pgoff_t index,
+			bool new_i_size)
+{
+	struct flfs_sb_info *sbi = FLFS_I_SB(inode);
+	struct dnode_of_data dn;
+	struct page *page;
+	block_t blkaddr;
+	int err;
+
+	set_new_dnode(&dn, inode, 0);
+	err = get_dnode_of_data(&dn, index, ALLOC_NODE);
+	if (err)
+		return ERR_PTR(err);
+	if (dn.data_blkaddr == NULL_ADDR) {
+		err = reserve_new_block(&dn);
+		if (err) {
+			flfs_put_dnode(&dn);
+			return ERR_PTR(err);
+		}
+	}
+	blkaddr = dn.data_blkaddr;
+	flfs_put_dnode(&dn);
+
+	page = grab_cache_page(inode->i_mapping, index);
+	if (!page)
+		return ERR_PTR(-ENOMEM);
+
+	if (!PageUptodate(page)) {
+		if (blkaddr == NEW_ADDR) {
+			zero_user_segment(page, 0, PAGE_CACHE_SIZE);
+			SetPageUptodate(page);
+		} else {
+			err = flfs_readpage_sync(sbi, page, blkaddr, READ_SYNC);
+			if (err) {
+				flfs_put_page(page, 1);
+				return ERR_PTR(err);
+			}
+		}
+	}
+
+	if (new_i_size &&
+	    i_size_read(inode) < ((loff_t)(index + 1) << PAGE_CACHE_SHIFT)) {
+		i_size_write(inode, ((loff_t)(index + 1) << PAGE_CACHE_SHIFT));
+		mark_inode_dirty(inode);
+	}
+	return page;
+}
+
+int do_write_data_page(struct page *page, int type)
+{
+	struct inode *inode = page->mapping->host;
+	struct flfs_sb_info *sbi = FLFS_I_SB(inode);
+	struct dnode_of_data dn;
+	struct flfs_summary sum;
+	struct node_info ni;
+	block_t new_addr;
+	int err;
+
+	set_new_dnode(&dn, inode, 0);
+	err = get_dnode_of_data(&dn, page->index, LOOKUP_NODE);
+	if (err)
+		return err;
+	if (dn.data_blkaddr == NULL_ADDR) {
+		flfs_put_dnode(&dn);
+		return -ENOENT;
+	}
+
+	set_page_writeback(page);
+	get_node_info(sbi, dn.nid, &ni);
+	memset(&sum, 0, sizeof(sum));
+	sum.nid = cpu_to_le32(dn.nid);
+	sum.version = ni.version;
+	sum.ofs_in_node = cpu_to_le16(dn.ofs_in_node);
+
+	allocate_data_block(sbi, dn.data_blkaddr, &new_addr, &sum, type);
+	set_data_blkaddr(&dn, new_addr);
+	flfs_submit_page_mbio(sbi, page, new_addr, DATA);
+	flfs_put_dnode(&dn);
+	return 0;
+}
+
+static int data_seg_type(struct inode *inode)
+{
+	if (S_ISDIR(inode->i_mode))
+		return CURSEG_HOT_DATA;
+	if (FLFS_I(inode)->i_advise & FLFS_ADVISE_COLD)
+		return CURSEG_COLD_DATA;
+	return CURSEG_WARM_DATA;
+}
+
+static int flfs_write_data_page(struct page *page,
+			struct writeback_control *wbc)
+{
+	struct inode *inode = page->mapping->host;
+	struct flfs_sb_info *sbi = FLFS_I_SB(inode);
+	loff_t i_size = i_size_read(inode);
+	const pgoff_t end_index = i_size >> PAGE_CACHE_SHIFT;
+	unsigned int offset;
+	int err;
+
+	if (page->index < end_index)
+		goto write;
+
+	offset = i_size & (PAGE_CACHE_SIZE - 1);
+	if (page->index >= end_index + 1 || !offset) {
+		if (S_ISDIR(inode->i_mode))
+			inode_dec_dirty_dents(inode);
+		goto out;
+	}
+	zero_user_segment(page, offset, PAGE_CACHE_SIZE);
+write:
+	if (S_ISDIR(inode->i_mode) || wbc->for_reclaim) {
+		if (!down_read_trylock(&sbi->cp_rwsem))
+			goto redirty_out;
+	} else {
+		flfs_lock_op(sbi);
+	}
+	err = do_write_data_page(page, data_seg_type(inode));
+	flfs_unlock_op(sbi);
+
+	if (err == -ENOENT)
+		goto out;
+	if (err)
+		goto redirty_out;
+
+	if (S_ISDIR(inode->i_mode))
+		inode_dec_dirty_dents(inode);
+	if (wbc->for_reclaim)
+		flfs_submit_merged_bio(sbi, DATA);
+out:
+	unlock_page(page);
+	return 0;
+
+redirty_out:
+	redirty_page_for_writepage(wbc, page);
+	unlock_page(page);
+	return 0;
+}
+
+static int flfs_write_data_pages(struct address_space *mapping,
+			struct writeback_control *wbc)
+{
+	struct flfs_sb_info *sbi = FLFS_I_SB(mapping->host);
+	int ret;
+
+	ret = generic_writepages(mapping, wbc);
+	flfs_submit_merged_bio(sbi, DATA);
+	return ret;
+}
+
+static int flfs_read_data_page(struct file *file, struct page *page)
+{
+	return mpage_readpage(page, flfs_get_block);
+}
+
+static int flfs_read_data_pages(struct file *file,
+			struct address_space *mapping,
+			struct list_head *pages, unsigned nr_pages)
+{
+	return mpage_readpages(mapping, pages, nr_pages, flfs_get_block);
+}
+
+static int flfs_write_begin(struct file *file, struct address_space *mapping,
+			loff_t pos, unsigned len, unsigned flags,
+			struct page **pagep, void **fsdata)
+{
+	struct inode *inode = mapping->host;
+	struct flfs_sb_info *sbi = FLFS_I_SB(inode);
+	pgoff_t index = pos >> PAGE_CACHE_SHIFT;
+	struct dnode_of_data dn;
+	struct page *page;
+	block_t blkaddr;
+	int err;
+
+	flfs_balance_fs(sbi);
+
+	page = grab_cache_page_write_begin(mapping, index, flags);
+	if (!page)
+		return -ENOMEM;
+	*pagep = page;
+
+	flfs_lock_op(sbi);
+	set_new_dnode(&dn, inode, 0);
+	err = get_dnode_of_data(&dn, index, ALLOC_NODE);
+	if (!err && dn.data_blkaddr == NULL_ADDR)
+		err = reserve_new_block(&dn);
+	blkaddr = dn.data_blkaddr;
+	flfs_put_dnode(&dn);
+	flfs_unlock_op(sbi);
+	if (err)
+		goto fail;
+
+	if (len == PAGE_CACHE_SIZE || PageUptodate(page))
+		return 0;
+
+	if ((pos & PAGE_CACHE_MASK) >= i_size_read(inode)) {
+		unsigned start = pos & (PAGE_CACHE_SIZE - 1);
+		unsigned end = start + len;
+
+		zero_user_segments(page, 0, start, end, PAGE_CACHE_SIZE);
+		return 0;
+	}
+
+	if (blkaddr == NEW_ADDR) {
+		zero_user_segment(page, 0, PAGE_CACHE_SIZE);
+	} else {
+		err = flfs_readpage_sync(sbi, page, blkaddr, READ_SYNC);
+		if (err)
+			goto fail;
+	}
+	SetPageUptodate(page);
+	return 0;
+
+fail:
+	flfs_put_page(page, 1);
+	return err;
+}
+
+static int flfs_write_end(struct file *file, struct address_space *mapping,
+			loff_t pos, unsigned len, unsigned copied,
+			struct page *page, void *fsdata)
+{
+	struct inode *inode = page->mapping->host;
+
+	SetPageUptodate(page);
+	set_page_dirty(page);
+
+	if (pos + copied > i_size_read(inode)) {
+		i_size_write(inode, pos + copied);
+		mark_inode_dirty(inode);
+	}
+
+	flfs_put_page(page, 1);
+	return copied;
+}
+
+static void flfs_invalidate_data_page(struct page *page, unsigned long offset)
+{
+	struct inode *inode = page->mapping->host;
+
+	if (offset)
+		return;
+	if (S_ISDIR(inode->i_mode) && PageDirty(page))
+		inode_dec_dirty_dents(inode);
+	ClearPagePrivate(page);
+}
+
+static int flfs_release_data_page(struct page *page, gfp_t wait)
+{
+	ClearPagePrivate(page);
+	return 1;
+}
+
+static int flfs_set_data_page_dirty(struct page *page)
+{
+	struct inode *inode = page->mapping->host;
+
+	SetPageUptodate(page);
+	if (!PageDirty(page)) {
+		__set_page_dirty_nobuffers(page);
+		SetPagePrivate(page);
+		if (S_ISDIR(inode->i_mode))
+			set_dirty_dir_page(inode, page);
+		return 1;
+	}
+	return 0;
+}
+
+static sector_t flfs_bmap(struct address_space *mapping, sector_t block)
+{
+	return generic_block_bmap(mapping, block, flfs_get_block);
+}
+
+const struct address_space_operations flfs_dblock_aops = {
+	.readpage	= flfs_read_data_page,
+	.readpages	= flfs_read_data_pages,
+	.writepage	= flfs_write_data_page,
+	.writepages	= flfs_write_data_pages,
+	.write_begin	= flfs_write_begin,
+	.write_end	= flfs_write_end,
+	.set_page_dirty	= flfs_set_data_page_dirty,
+	.invalidatepage	= flfs_invalidate_data_page,
+	.releasepage	= flfs_release_data_page,
+	.bmap		= flfs_bmap,
+};
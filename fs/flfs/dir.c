@@ -0,0 +1,448 @@
+/*
+ * fs/flfs/dir.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/fs.h>
+#include <linux/crc32.h>
+
+#include "flfs.h"
+#include "node.h"
+
+#define GET_DENTRY_SLOTS(x)	((x + FLFS_SLOT_LEN - 1) >> FLFS_SLOT_LEN_BITS)
+#define DIR_BUCKET_BLOCKS	2
+
+static unsigned long dir_blocks(struct inode *inode)
+{
+	return ((unsigned long long)(i_size_read(inode) + PAGE_CACHE_SIZE - 1))
+							>> PAGE_CACHE_SHIFT;
+}
+
+static unsigned int dir_buckets(unsigned int level)
+{
+	if (level < MAX_DIR_HASH_DEPTH / 2)
+		return 1 << level;
+	return 1 << ((MAX_DIR_HASH_DEPTH / 2) - 1);
+}
+
+static unsigned long dir_block_index(unsigned int level, unsigned int idx)
+{
+	unsigned long bidx = 0;
+	unsigned int i;
+
+	for (i = 0; i < level; i++)
+		bidx += dir_buckets(i) * DIR_BUCKET_BLOCKS;
+	return bidx + idx * DIR_BUCKET_BLOCKS;
+}
+
+static u32 flfs_dentry_hash(const char *name, size_t len)
+{
+	if ((len == 1 && name[0] == '.') ||
+	    (len == 2 && name[0] == '.' && name[1] == '.'))
+		return 0;
+	return crc32_le(~0, name, len);
+}
+
+#define S_SHIFT 12
+static unsigned char flfs_type_by_mode[S_IFMT >> S_SHIFT] = {
+	[S_IFREG >> S_SHIFT]	= FLFS_FT_REG_FILE,
+	[S_IFDIR >> S_SHIFT]	= FLFS_FT_DIR,
+	[S_IFCHR >> S_SHIFT]	= FLFS_FT_CHRDEV,
+	[S_IFBLK >> S_SHIFT]	= FLFS_FT_BLKDEV,
+	[S_IFIFO >> S_SHIFT]	= FLFS_FT_FIFO,
+	[S_IFSOCK >> S_SHIFT]	= FLFS_FT_SOCK,
+	[S_IFLNK >> S_SHIFT]	= FLFS_FT_SYMLINK,
+};
+
+static unsigned char flfs_filetype_table[FLFS_FT_MAX] = {
+	[FLFS_FT_UNKNOWN]	= DT_UNKNOWN,
+	[FLFS_FT_REG_FILE]	= DT_REG,
+	[FLFS_FT_DIR]		= DT_DIR,
+	[FLFS_FT_CHRDEV]	= DT_CHR,
+	[FLFS_FT_BLKDEV]	= DT_BLK,
+	[FLFS_FT_FIFO]		= DT_FIFO,
+	[FLFS_FT_SOCK]		= DT_SOCK,
+	[FLFS_FT_SYMLINK]	= DT_LNK,
+};
+
+static void set_de_type(struct flfs_dir_entry *de, struct inode *inode)
+{
+	de->file_type = flfs_type_by_mode[(inode->i_mode & S_IFMT) >> S_SHIFT];
+}
+
+static struct flfs_dir_entry *find_in_block(struct page *dentry_page,
+			const char *name, size_t namelen, u32 namehash)
+{
+	struct flfs_dentry_block *dentry_blk = kmap(dentry_page);
+	struct flfs_dir_entry *de;
+	unsigned long bit_pos;
+
+	bit_pos = find_next_bit_le(dentry_blk->dentry_bitmap,
+				   NR_DENTRY_IN_BLOCK, 0);
+	while (bit_pos < NR_DENTRY_IN_BLOCK) {
+		de = &dentry_blk->dentry[bit_pos];
+		if (le32_to_cpu(de->hash_code) == namehash &&
+		    le16_to_cpu(de->name_len) == namelen &&
+		    !memcmp(dentry_blk->filename[bit_pos], name, namelen))
+			return de;
+		bit_pos = find_next_bit_le(dentry_blk->dentry_bitmap,
+				NR_DENTRY_IN_BLOCK, bit_pos +
+				GET_DENTRY_SLOTS(le16_to_cpu(de->name_len)));
+	}
+	kunmap(dentry_page);
+	return NULL;
+}
+
+static struct flfs_dir_entry *find_in_level(struct inode *dir,
+			unsigned int level, const char *name, size_t namelen,
+			u32 namehash, struct page **res_page)
+{
+	struct flfs_dir_entry *de = NULL;
+	unsigned long bidx, end;
+
+	bidx = dir_block_index(level, namehash % dir_buckets(level));
+	end = bidx + DIR_BUCKET_BLOCKS;
+
+	for (; bidx < end; bidx++) {
+		struct page *dentry_page = get_lock_data_page(dir, bidx);
+
+		if (IS_ERR(dentry_page))
+			continue;
+		unlock_page(dentry_page);
+
+		de = find_in_block(dentry_page, name, namelen, namehash);
+		if (de) {
+			*res_page = dentry_page;
+			break;
+		}
+		page_cache_release(dentry_page);
+	}
+	return de;
+}
+
+struct flfs_dir_entry *flfs_find_entry(struct inode *dir,
+			struct qstr *child, struct page **res_page)
+{
+	unsigned int max_depth = FLFS_I(dir)->i_current_depth;
+	struct flfs_dir_entry *de = NULL;
+	unsigned int level;
+	u32 namehash;
+
+	*res_page = NULL;
+	if (!dir_blocks(dir))
+		return NULL;
+
+	namehash = flfs_dentry_hash(child->name, child->len);
+	for (level = 0; level < max_depth; level++) {
+		de = find_in_level(dir, level, child->name, child->len,
+				   namehash, res_page);
+		if (de)
+			break;
+	}
+	return de;
+}
+
+ino_t flfs_inode_by_name(struct inode *dir, struct qstr *qstr)
+{
+	struct flfs_dir_entry *de;
+	struct page *page;
+	ino_t res = 0;
+
+	de = flfs_find_entry(dir, qstr, &page);
+	if (de) {
+		res = le32_to_cpu(de->ino);
+		kunmap(page);
+		page_cache_release(page);
+	}
+	return res;
+}
+
+void flfs_set_link(struct inode *dir, struct flfs_dir_entry *de,
+			struct page *page, struct inode *inode)
+{
+	lock_page(page);
+	flfs_wait_on_page_writeback(page, DATA);
+	de->ino = cpu_to_le32(inode->i_ino);
+	set_de_type(de, inode);
+	kunmap(page);
+	set_page_dirty(page);
+	flfs_put_page(page, 1);
+
+	dir->i_mtime = dir->i_ctime = CURRENT_TIME;
+	update_inode_page(dir);
+}
+
+static int init_inode_metadata(struct inode *inode)
+{
+	struct page *page;
+
+	if (!is_inode_flag_set(FLFS_I(inode), FI_NEW_INODE))
+		return update_inode_page(inode);
+
+	page = new_inode_page(inode);
+	if (IS_ERR(page))
+		return PTR_ERR(page);
+	flfs_put_page(page, 1);
+	return 0;
+}
+
+static void update_parent_metadata(struct inode *dir, struct inode *inode,
+			unsigned int current_depth)
+{
+	struct flfs_inode_info *fi = FLFS_I(inode);
+
+	if (is_inode_flag_set(fi, FI_NEW_INODE)) {
+		if (S_ISDIR(inode->i_mode))
+			inc_nlink(dir);
+		clear_inode_flag(fi, FI_NEW_INODE);
+	}
+	dir->i_mtime = dir->i_ctime = CURRENT_TIME;
+	FLFS_I(dir)->i_current_depth = current_depth;
+	update_inode_page(dir);
+}
+
+static int room_for_filename(struct flfs_dentry_block *dentry_blk, int slots)
+{
+	int bit_start = 0;
+	int zero_start, zero_end;
+
+	for (;;) {
+		zero_start = find_next_zero_bit_le(dentry_blk->dentry_bitmap,
+					NR_DENTRY_IN_BLOCK, bit_start);
+		if (zero_start >= NR_DENTRY_IN_BLOCK)
+			return NR_DENTRY_IN_BLOCK;
+		zero_end = find_next_bit_le(dentry_blk->dentry_bitmap,
+					NR_DENTRY_IN_BLOCK, zero_start);
+		if (zero_end - zero_start >= slots)
+			return zero_start;
+		bit_start = zero_end + 1;
+		if (bit_start >= NR_DENTRY_IN_BLOCK)
+			return NR_DENTRY_IN_BLOCK;
+	}
+}
+
+int flfs_add_link(struct dentry *dentry, struct inode *inode)
+{
+	struct inode *dir = dentry->d_parent->d_inode;
+	struct flfs_inode_info *fi = FLFS_I(dir);
+	const char *name = dentry->d_name.name;
+	size_t namelen = dentry->d_name.len;
+	int slots = GET_DENTRY_SLOTS(namelen);
+	unsigned int current_depth = fi->i_current_depth;
+	unsigned int level = 0;
+	struct flfs_dentry_block *dentry_blk = NULL;
+	struct page *dentry_page = NULL;
+	struct flfs_dir_entry *de;
+	unsigned long bidx, block;
+	int bit_pos, i, err;
+	u32 namehash;
+
+	namehash = flfs_dentry_hash(name, namelen);
+start:
+	if (level == MAX_DIR_HASH_DEPTH)
+		return -ENOSPC;
+	if (level == current_depth)
+		++current_depth;
+
+	bidx = dir_block_index(level, namehash % dir_buckets(level));
+	for (block = bidx; block < bidx + DIR_BUCKET_BLOCKS; block++) {
+		dentry_page = get_new_data_page(dir, block, true);
+		if (IS_ERR(dentry_page))
+			return PTR_ERR(dentry_page);
+
+		dentry_blk = kmap(dentry_page);
+		bit_pos = room_for_filename(dentry_blk, slots);
+		if (bit_pos < NR_DENTRY_IN_BLOCK)
+			goto add_dentry;
+
+		kunmap(dentry_page);
+		flfs_put_page(dentry_page, 1);
+	}
+	++level;
+	goto start;
+
+add_dentry:
+	err = init_inode_metadata(inode);
+	if (err)
+		goto fail;
+
+	flfs_wait_on_page_writeback(dentry_page, DATA);
+	de = &dentry_blk->dentry[bit_pos];
+	de->hash_code = cpu_to_le32(namehash);
+	de->name_len = cpu_to_le16(namelen);
+	memcpy(dentry_blk->filename[bit_pos], name, namelen);
+	de->ino = cpu_to_le32(inode->i_ino);
+	set_de_type(de, inode);
+	for (i = 0; i < slots; i++)
+		__set_bit_le(bit_pos + i, dentry_blk->dentry_bitmap);
+	set_page_dirty(dentry_page);
+
+	update_parent_metadata(dir, inode, current_depth);
+fail:
+	kunmap(dentry_page);
+	flfs_put_page(dentry_page, 1);
+	return err;
+}
+
+void flfs_delete_entry(struct flfs_dir_entry *dentry, struct page *page,
+			struct inode *inode)
+{
+	struct flfs_dentry_block *dentry_blk;
+	struct inode *dir = page->mapping->host;
+	struct flfs_sb_info *sbi = FLFS_I_SB(dir);
+	int slots = GET_DENTRY_SLOTS(le16_to_cpu(dentry->name_len));
+	unsigned int bit_pos;
+	int i;
+
+	lock_page(page);
+	flfs_wait_on_page_writeback(page, DATA);
+
+	dentry_blk = page_address(page);
+	bit_pos = dentry - dentry_blk->dentry;
+	for (i = 0; i < slots; i++)
+		__clear_bit_le(bit_pos + i, dentry_blk->dentry_bitmap);
+	bit_pos = find_next_bit_le(dentry_blk->dentry_bitmap,
+				   NR_DENTRY_IN_BLOCK, 0);
+	kunmap(page);
+
+	if (bit_pos == NR_DENTRY_IN_BLOCK) {
+		struct dnode_of_data dn;
+
+		set_new_dnode(&dn, dir, 0);
+		if (!get_dnode_of_data(&dn, page->index, LOOKUP_NODE)) {
+			truncate_data_blocks_range(&dn, 1);
+			flfs_put_dnode(&dn);
+		}
+		if (clear_page_dirty_for_io(page))
+			inode_dec_dirty_dents(dir);
+		ClearPageUptodate(page);
+	} else {
+		set_page_dirty(page);
+	}
+	flfs_put_page(page, 1);
+
+	dir->i_ctime = dir->i_mtime = CURRENT_TIME;
+	if (inode && S_ISDIR(inode->i_mode))
+		drop_nlink(dir);
+	update_inode_page(dir);
+
+	if (inode) {
+		inode->i_ctime = CURRENT_TIME;
+		drop_nlink(inode);
+		if (S_ISDIR(inode->i_mode)) {
+			drop_nlink(inode);
+			i_size_write(inode, 0);
+		}
+		update_inode_page(inode);
+		if (!inode->i_nlink)
+			add_orphan_inode(sbi, inode->i_ino);
+		else
+			release_orphan_inode(sbi);
+	}
+}
+
+bool flfs_empty_dir(struct inode *dir)
+{
+	unsigned long bidx, nblock = dir_blocks(dir);
+
+	for (bidx = 0; bidx < nblock; bidx++) {
+		struct flfs_dentry_block *dentry_blk;
+		struct page *dentry_page;
+		unsigned int bit_pos;
+
+		dentry_page = get_lock_data_page(dir, bidx);
+		if (IS_ERR(dentry_page)) {
+			if (PTR_ERR(dentry_page) == -ENOENT)
+				continue;
+			return false;
+		}
+
+		dentry_blk = kmap_atomic(dentry_page);
+		bit_pos = find_next_bit_le(dentry_blk->dentry_bitmap,
+					   NR_DENTRY_IN_BLOCK, 0);
+		kunmap_atomic(dentry_blk);
+		flfs_put_page(dentry_page, 1);
+
+		if (bit_pos < NR_DENTRY_IN_BLOCK)
+			return false;
+	}
+	return true;
+}
+
+static int flfs_readdir(struct file *file, void *dirent, filldir_t filldir)
+{
+	struct inode *inode = file->f_dentry->d_inode;
+	unsigned long npages = dir_blocks(inode);
+	unsigned long n;
+	unsigned int bit_pos;
+	loff_t pos = file->f_pos;
+
+	if (pos == 0) {
+		if (filldir(dirent, ".", 1, 0, inode->i_ino, DT_DIR) < 0)
+			return 0;
+		file->f_pos = pos = 1;
+	}
+	if (pos == 1) {
+		nid_t pino = FLFS_I(inode)->i_pino ?: inode->i_ino;
+
+		if (filldir(dirent, "..", 2, 1, pino, DT_DIR) < 0)
+			return 0;
+		file->f_pos = pos = 2;
+	}
+
+	n = (pos - 2) / NR_DENTRY_IN_BLOCK;
+	bit_pos = (pos - 2) % NR_DENTRY_IN_BLOCK;
+
+	for (; n < npages; n++, bit_pos = 0) {
+		struct flfs_dentry_block *dentry_blk;
+		struct page *dentry_page;
+
+		dentry_page = get_lock_data_page(inode, n);
+		if (IS_ERR(dentry_page)) {
+			file->f_pos = 2 + (n + 1) * NR_DENTRY_IN_BLOCK;
+			continue;
+		}
+		unlock_page(dentry_page);
+
+		dentry_blk = kmap(dentry_page);
+		for (;;) {
+			struct flfs_dir_entry *de;
+			unsigned char d_type = DT_UNKNOWN;
+			loff_t off;
+
+			bit_pos = find_next_bit_le(dentry_blk->dentry_bitmap,
+						NR_DENTRY_IN_BLOCK, bit_pos);
+			if (bit_pos >= NR_DENTRY_IN_BLOCK)
+				break;
+
+			de = &dentry_blk->dentry[bit_pos];
+			if (de->file_type < FLFS_FT_MAX)
+				d_type = flfs_filetype_table[de->file_type];
+			off = 2 + n * NR_DENTRY_IN_BLOCK + bit_pos;
+			if (filldir(dirent, dentry_blk->filename[bit_pos],
+				    le16_to_cpu(de->name_len), off,
+				    le32_to_cpu(de->ino), d_type) < 0) {
+				file->f_pos = off;
+				kunmap(dentry_page);
+				page_cache_release(dentry_page);
+				goto out;
+			}
+			bit_pos += GET_DENTRY_SLOTS(le16_to_cpu(de->name_len));
+		}
+		file->f_pos = 2 + (n + 1) * NR_DENTRY_IN_BLOCK;
+		kunmap(dentry_page);
+		page_cache_release(dentry_page);
+	}
+out:
+	file_accessed(file);
+	return 0;
+}
+
+const struct file_operations flfs_dir_operations = {
+	.llseek		= generic_file_llseek,
+	.read		= generic_read_dir,
+	.readdir	= flfs_readdir,
+	.fsync		= flfs_sync_file,
+};
@@ -0,0 +1,234 @@
+/*
+ * fs/flfs/file.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/fs.h>
+#include <linux/stat.h>
+#include <linux/buffer_head.h>
+#include <linux/writeback.h>
+#include <linux/mm.h>
+
+#include "flfs.h"
+#include "node.h"
+#include "segment.h"
+
+static int flfs_vm_page_mkwrite(struct vm_area_struct *vma,
+			struct vm_fault *vmf)
+{
+	struct page *page = vmf->page;
+	struct inode *inode = vma->vm_file->f_path.dentry->d_inode;
+	struct flfs_sb_info *sbi = FLFS_I_SB(inode);
+	struct dnode_of_data dn;
+	loff_t size;
+	int err;
+
+	flfs_balance_fs(sbi);
+
+	lock_page(page);
+	size = i_size_read(inode);
+	if (page->mapping != inode->i_mapping || page_offset(page) >= size ||
+	    !PageUptodate(page)) {
+		unlock_page(page);
+		err = -EFAULT;
+		goto out;
+	}
+
+	flfs_lock_op(sbi);
+	set_new_dnode(&dn, inode, 0);
+	err = get_dnode_of_data(&dn, page->index, ALLOC_NODE);
+	if (!err && dn.data_blkaddr == NULL_ADDR)
+		err = reserve_new_block(&dn);
+	flfs_put_dnode(&dn);
+	flfs_unlock_op(sbi);
+	if (err) {
+		unlock_page(page);
+		goto out;
+	}
+
+	if (page->index == (size >> PAGE_CACHE_SHIFT) &&
+	    (size & ~PAGE_CACHE_MASK))
+		zero_user_segment(page, size & ~PAGE_CACHE_MASK,
+				  PAGE_CACHE_SIZE);
+	set_page_dirty(page);
+	flfs_wait_on_page_writeback(page, DATA);
+	file_update_time(vma->vm_file);
+	return VM_FAULT_LOCKED;
+out:
+	return block_page_mkwrite_return(err);
+}
+
+static const struct vm_operations_struct flfs_file_vm_ops = {
+	.fault		= filemap_fault,
+	.map_pages	= filemap_map_pages,
+	.page_mkwrite	= flfs_vm_page_mkwrite,
+};
+
+static int flfs_file_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	file_accessed(file);
+	vma->vm_ops = &flfs_file_vm_ops;
+	vma->vm_flags |= VM_CAN_NONLINEAR;
+	return 0;
+}
+
+int flfs_sync_file(struct file *file, loff_t start, loff_t end, int datasync)
+{
+	struct inode *inode = file->f_mapping->host;
+	struct flfs_sb_info *sbi = FLFS_I_SB(inode);
+	int ret;
+
+	if (inode->i_sb->s_flags & MS_RDONLY)
+		return 0;
+
+	ret = filemap_write_and_wait_range(inode->i_mapping, start, end);
+	if (ret)
+		return ret;
+
+	mutex_lock(&inode->i_mutex);
+	ret = sync_inode_metadata(inode, 1);
+	if (!ret && (get_pages(sbi, FLFS_DIRTY_NODES) ||
+		     get_pages(sbi, FLFS_DIRTY_DENTS)))
+		write_checkpoint(sbi, false);
+	mutex_unlock(&inode->i_mutex);
+
+	if (!ret && sbi->cp_error)
+		ret = -EIO;
+	return ret;
+}
+
+void truncate_data_blocks_range(struct dnode_of_data *dn, int count)
+{
+	struct flfs_sb_info *sbi = FLFS_I_SB(dn->inode);
+	int nr_free = 0, ofs = dn->ofs_in_node;
+	__le32 *addr;
+
+	flfs_wait_on_page_writeback(dn->node_page, NODE);
+	addr = blkaddr_in_node(dn->node_page) + ofs;
+
+	for (; count > 0; count--, addr++, dn->ofs_in_node++) {
+		block_t blkaddr = le32_to_cpu(*addr);
+
+		if (blkaddr == NULL_ADDR)
+			continue;
+		*addr = cpu_to_le32(NULL_ADDR);
+		invalidate_blocks(sbi, blkaddr);
+		nr_free++;
+	}
+	if (nr_free) {
+		dec_valid_block_count(sbi, dn->inode, nr_free);
+		set_page_dirty(dn->node_page);
+	}
+	dn->ofs_in_node = ofs;
+}
+
+static void truncate_partial_data_page(struct inode *inode, u64 from)
+{
+	unsigned offset = from & (PAGE_CACHE_SIZE - 1);
+	struct page *page;
+
+	if (!offset)
+		return;
+
+	page = get_lock_data_page(inode, from >> PAGE_CACHE_SHIFT);
+	if (IS_ERR(page))
+		return;
+
+	flfs_wait_on_page_writeback(page, DATA);
+	zero_user_segment(page, offset, PAGE_CACHE_SIZE);
+	set_page_dirty(page);
+	flfs_put_page(page, 1);
+}
+
+int truncate_blocks(struct inode *inode, u64 from)
+{
+	struct flfs_sb_info *sbi = FLFS_I_SB(inode);
+	struct dnode_of_data dn;
+	pgoff_t free_from;
+	int count, err;
+
+	free_from = (pgoff_t)((from + FLFS_BLKSIZE - 1) >> FLFS_BLKSIZE_BITS);
+
+	flfs_lock_op(sbi);
+	set_new_dnode(&dn, inode, 0);
+	err = get_dnode_of_data(&dn, free_from, LOOKUP_NODE);
+	if (err) {
+		if (err == -ENOENT)
+			goto free_next;
+		flfs_unlock_op(sbi);
+		return err;
+	}
+
+	count = ADDRS_PER_PAGE(dn.node_page) - dn.ofs_in_node;
+	if (dn.ofs_in_node || IS_INODE(dn.node_page)) {
+		truncate_data_blocks_range(&dn, count);
+		free_from += count;
+	}
+	flfs_put_dnode(&dn);
+free_next:
+	err = truncate_inode_blocks(inode, free_from);
+	flfs_unlock_op(sbi);
+	return err;
+}
+
+void flfs_truncate(struct inode *inode)
+{
+	if (!(S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode) ||
+	      S_ISLNK(inode->i_mode)))
+		return;
+
+	if (!truncate_blocks(inode, i_size_read(inode))) {
+		truncate_partial_data_page(inode, i_size_read(inode));
+		inode->i_mtime = inode->i_ctime = CURRENT_TIME;
+		mark_inode_dirty(inode);
+	}
+}
+
+int flfs_getattr(struct vfsmount *mnt, struct dentry *dentry,
+			struct kstat *stat)
+{
+	generic_fillattr(dentry->d_inode, stat);
+	stat->blocks = dentry->d_inode->i_blocks;
+	return 0;
+}
+
+int flfs_setattr(struct dentry *dentry, struct iattr *attr)
+{
+	struct inode *inode = dentry->d_inode;
+	int err;
+
+	err = inode_change_ok(inode, attr);
+	if (err)
+		return err;
+
+	if ((attr->ia_valid & ATTR_SIZE) &&
+	    attr->ia_size != i_size_read(inode)) {
+		truncate_setsize(inode, attr->ia_size);
+		flfs_truncate(inode);
+		flfs_balance_fs(FLFS_I_SB(inode));
+	}
+
+	setattr_copy(inode, attr);
+	mark_inode_dirty(inode);
+	return 0;
+}
+
+const struct inode_operations flfs_file_inode_operations = {
+	.getattr	= flfs_getattr,
+	.setattr	= flfs_setattr,
+};
+
+const struct file_operations flfs_file_operations = {
+	.llseek		= generic_file_llseek,
+	.read		= do_sync_read,
+	.write		= do_sync_write,
+	.aio_read	= generic_file_aio_read,
+	.aio_write	= generic_file_aio_write,
+	.open		= generic_file_open,
+	.mmap		= flfs_file_mmap,
+	.fsync		= flfs_sync_file,
+	.splice_read	= generic_file_splice_read,
+	.splice_write	= generic_file_splice_write,
+};
@@ -0,0 +1,486 @@
+/*
+ * fs/flfs/flfs.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef _FLFS_H
+#define _FLFS_H
+
+#include <linux/types.h>
+#include <linux/page-flags.h>
+#include <linux/buffer_head.h>
+#include <linux/slab.h>
+#include <linux/crc32.h>
+#include <linux/pagemap.h>
+#include <linux/rwsem.h>
+#include <linux/mutex.h>
+#include <linux/wait.h>
+#include <linux/flfs_fs.h>
+
+typedef u32 block_t;
+typedef u32 nid_t;
+
+#define FLFS_MOUNT_BG_GC		0x00000001
+#define FLFS_MOUNT_DISABLE_SSR		0x00000002
+
+#define clear_opt(sbi, option)	(sbi->mount_opt &= ~FLFS_MOUNT_##option)
+#define set_opt(sbi, option)	(sbi->mount_opt |= FLFS_MOUNT_##option)
+#define test_opt(sbi, option)	(sbi->mount_opt & FLFS_MOUNT_##option)
+
+#define FLFS_LINK_MAX			32000
+
+#define FLFS_BLKSIZE_BITS		FLFS_LOG_BLKSIZE
+#define SECTOR_FROM_BLOCK(blk)		((sector_t)(blk) << (FLFS_LOG_BLKSIZE - 9))
+
+enum page_type {
+	DATA,
+	NODE,
+	NR_PAGE_TYPE,
+};
+
+enum count_type {
+	FLFS_DIRTY_DENTS,
+	FLFS_DIRTY_NODES,
+	FLFS_WRITEBACK,
+	NR_COUNT_TYPE,
+};
+
+enum {
+	LOOKUP_NODE,
+	ALLOC_NODE,
+};
+
+enum {
+	FG_GC,
+	BG_GC,
+};
+
+#define FI_NEW_INODE			0
+
+struct flfs_inode_info {
+	struct inode vfs_inode;
+	unsigned long flags;
+	unsigned int i_current_depth;
+	nid_t i_pino;
+	unsigned char i_advise;
+	unsigned int i_ext_flags;
+	struct list_head dirty_dir;
+	atomic_t dirty_dents;
+};
+
+struct node_info {
+	nid_t nid;
+	nid_t ino;
+	block_t blk_addr;
+	unsigned char version;
+};
+
+struct dnode_of_data {
+	struct inode *inode;
+	struct page *inode_page;
+	struct page *node_page;
+	nid_t nid;
+	unsigned int ofs_in_node;
+	block_t data_blkaddr;
+};
+
+struct flfs_bio_info {
+	struct mutex io_mutex;
+	struct bio *bio;
+	block_t last_block_in_bio;
+};
+
+struct flfs_gc_kthread {
+	struct task_struct *task;
+	wait_queue_head_t wait_queue;
+};
+
+struct flfs_stats {
+	unsigned long bg_gc;
+	unsigned long fg_gc;
+	unsigned long gc_segments;
+	unsigned long gc_node_blocks;
+	unsigned long gc_data_blocks;
+	unsigned long lfs_segments;
+	unsigned long ssr_segments;
+	unsigned long checkpoints;
+};
+
+struct flfs_nm_info;
+struct flfs_sm_info;
+
+struct flfs_sb_info {
+	struct super_block *sb;
+	struct flfs_super_block *raw_super;
+	struct buffer_head *raw_super_buf;
+
+	struct flfs_checkpoint *ckpt;
+	unsigned int cur_cp_pack;
+	struct mutex cp_mutex;
+	struct rw_semaphore cp_rwsem;
+	struct mutex node_write;
+	wait_queue_head_t cp_wait;
+	bool cp_error;
+
+	struct inode *node_inode;
+	struct flfs_nm_info *nm_info;
+	struct flfs_sm_info *sm_info;
+	struct flfs_bio_info write_io[NR_PAGE_TYPE];
+
+	struct list_head orphan_inode_list;
+	struct mutex orphan_inode_mutex;
+	unsigned int n_orphans;
+	unsigned int max_orphans;
+
+	struct list_head dir_inode_list;
+	spinlock_t dir_inode_lock;
+
+	unsigned int log_blocks_per_seg;
+	unsigned int blocks_per_seg;
+	unsigned int total_node_count;
+	block_t user_block_count;
+	block_t total_valid_block_count;
+	unsigned int total_valid_node_count;
+	unsigned int total_valid_inode_count;
+	spinlock_t stat_lock;
+	u32 s_next_generation;
+	atomic_t nr_pages[NR_COUNT_TYPE];
+
+	unsigned int mount_opt;
+	struct mutex gc_mutex;
+	struct flfs_gc_kthread *gc_thread;
+	struct flfs_stats stat;
+	struct proc_dir_entry *s_proc;
+};
+
+static inline struct flfs_sb_info *FLFS_SB(struct super_block *sb)
+{
+	return sb->s_fs_info;
+}
+
+static inline struct flfs_inode_info *FLFS_I(struct inode *inode)
+{
+	return container_of(inode, struct flfs_inode_info, vfs_inode);
+}
+
+static inline struct flfs_sb_info *FLFS_I_SB(struct inode *inode)
+{
+	return FLFS_SB(inode->i_sb);
+}
+
+static inline struct flfs_sb_info *FLFS_P_SB(struct page *page)
+{
+	return FLFS_I_SB(page->mapping->host);
+}
+
+static inline struct flfs_node *FLFS_NODE(struct page *page)
+{
+	return (struct flfs_node *)page_address(page);
+}
+
+static inline struct flfs_inode *FLFS_INODE(struct page *page)
+{
+	return &FLFS_NODE(page)->i;
+}
+
+static inline struct flfs_checkpoint *FLFS_CKPT(struct flfs_sb_info *sbi)
+{
+	return sbi->ckpt;
+}
+
+static inline struct address_space *NODE_MAPPING(struct flfs_sb_info *sbi)
+{
+	return sbi->node_inode->i_mapping;
+}
+
+static inline u32 flfs_crc32(const void *buf, size_t len)
+{
+	return crc32_le(FLFS_SUPER_MAGIC, buf, len);
+}
+
+static inline bool flfs_crc_valid(u32 blk_crc, const void *buf, size_t len)
+{
+	return flfs_crc32(buf, len) == blk_crc;
+}
+
+static inline unsigned long long cur_cp_version(struct flfs_checkpoint *cp)
+{
+	return le64_to_cpu(cp->checkpoint_ver);
+}
+
+static inline bool is_set_ckpt_flags(struct flfs_checkpoint *cp, unsigned int f)
+{
+	return le32_to_cpu(cp->ckpt_flags) & f;
+}
+
+static inline void set_ckpt_flags(struct flfs_checkpoint *cp, unsigned int f)
+{
+	cp->ckpt_flags = cpu_to_le32(le32_to_cpu(cp->ckpt_flags) | f);
+}
+
+static inline void clear_ckpt_flags(struct flfs_checkpoint *cp, unsigned int f)
+{
+	cp->ckpt_flags = cpu_to_le32(le32_to_cpu(cp->ckpt_flags) & ~f);
+}
+
+static inline void flfs_lock_op(struct flfs_sb_info *sbi)
+{
+	down_read(&sbi->cp_rwsem);
+}
+
+static inline void flfs_unlock_op(struct flfs_sb_info *sbi)
+{
+	up_read(&sbi->cp_rwsem);
+}
+
+static inline void flfs_lock_all(struct flfs_sb_info *sbi)
+{
+	down_write(&sbi->cp_rwsem);
+}
+
+static inline void flfs_unlock_all(struct flfs_sb_info *sbi)
+{
+	up_write(&sbi->cp_rwsem);
+}
+
+static inline void inc_page_count(struct flfs_sb_info *sbi, int type)
+{
+	atomic_inc(&sbi->nr_pages[type]);
+}
+
+static inline void dec_page_count(struct flfs_sb_info *sbi, int type)
+{
+	atomic_dec(&sbi->nr_pages[type]);
+}
+
+static inline int get_pages(struct flfs_sb_info *sbi, int type)
+{
+	return atomic_read(&sbi->nr_pages[type]);
+}
+
+static inline bool inc_valid_block_count(struct flfs_sb_info *sbi,
+				struct inode *inode, blkcnt_t count)
+{
+	spin_lock(&sbi->stat_lock);
+	if (sbi->total_valid_block_count + count > sbi->user_block_count) {
+		spin_unlock(&sbi->stat_lock);
+		return false;
+	}
+	inode->i_blocks += count << (FLFS_LOG_BLKSIZE - 9);
+	sbi->total_valid_block_count += (block_t)count;
+	spin_unlock(&sbi->stat_lock);
+	return true;
+}
+
+static inline void dec_valid_block_count(struct flfs_sb_info *sbi,
+				struct inode *inode, blkcnt_t count)
+{
+	spin_lock(&sbi->stat_lock);
+	BUG_ON(sbi->total_valid_block_count < (block_t)count);
+	inode->i_blocks -= count << (FLFS_LOG_BLKSIZE - 9);
+	sbi->total_valid_block_count -= (block_t)count;
+	spin_unlock(&sbi->stat_lock);
+}
+
+static inline bool inc_valid_node_count(struct flfs_sb_info *sbi,
+				struct inode *inode)
+{
+	spin_lock(&sbi->stat_lock);
+	if (sbi->total_valid_block_count + 1 > sbi->user_block_count ||
+	    sbi->total_valid_node_count + 1 > sbi->total_node_count) {
+		spin_unlock(&sbi->stat_lock);
+		return false;
+	}
+	if (inode)
+		inode->i_blocks += 1 << (FLFS_LOG_BLKSIZE - 9);
+	sbi->total_valid_node_count++;
+	sbi->total_valid_block_count++;
+	spin_unlock(&sbi->stat_lock);
+	return true;
+}
+
+static inline void dec_valid_node_count(struct flfs_sb_info *sbi,
+				struct inode *inode)
+{
+	spin_lock(&sbi->stat_lock);
+	BUG_ON(!sbi->total_valid_node_count || !sbi->total_valid_block_count);
+	if (inode)
+		inode->i_blocks -= 1 << (FLFS_LOG_BLKSIZE - 9);
+	sbi->total_valid_node_count--;
+	sbi->total_valid_block_count--;
+	spin_unlock(&sbi->stat_lock);
+}
+
+static inline void inc_valid_inode_count(struct flfs_sb_info *sbi)
+{
+	spin_lock(&sbi->stat_lock);
+	sbi->total_valid_inode_count++;
+	spin_unlock(&sbi->stat_lock);
+}
+
+static inline void dec_valid_inode_count(struct flfs_sb_info *sbi)
+{
+	spin_lock(&sbi->stat_lock);
+	BUG_ON(!sbi->total_valid_inode_count);
+	sbi->total_valid_inode_count--;
+	spin_unlock(&sbi->stat_lock);
+}
+
+static inline void flfs_put_page(struct page *page, int unlock)
+{
+	if (!page || IS_ERR(page))
+		return;
+	if (unlock)
+		unlock_page(page);
+	page_cache_release(page);
+}
+
+static inline void set_new_dnode(struct dnode_of_data *dn, struct inode *inode,
+				nid_t nid)
+{
+	memset(dn, 0, sizeof(*dn));
+	dn->inode = inode;
+	dn->nid = nid;
+}
+
+static inline bool is_inode_flag_set(struct flfs_inode_info *fi, int flag)
+{
+	return test_bit(flag, &fi->flags);
+}
+
+static inline void set_inode_flag(struct flfs_inode_info *fi, int flag)
+{
+	set_bit(flag, &fi->flags);
+}
+
+static inline void clear_inode_flag(struct flfs_inode_info *fi, int flag)
+{
+	clear_bit(flag, &fi->flags);
+}
+
+static inline int flfs_readonly(struct super_block *sb)
+{
+	return sb->s_flags & MS_RDONLY;
+}
+
+static inline int flfs_test_bit(unsigned int nr, const char *addr)
+{
+	return addr[nr >> 3] & (1 << (nr & 7));
+}
+
+static inline void flfs_change_bit(unsigned int nr, char *addr)
+{
+	addr[nr >> 3] ^= 1 << (nr & 7);
+}
+
+static inline block_t __start_cp_addr(struct flfs_sb_info *sbi)
+{
+	block_t start = le32_to_cpu(sbi->raw_super->cp_blkaddr);
+
+	if (sbi->cur_cp_pack == 2)
+		start += sbi->blocks_per_seg;
+	return start;
+}
+
+#define flfs_msg(sb, level, fmt, ...)				\
+	printk(level "FLFS-fs (%s): " fmt "\n", (sb)->s_id, ##__VA_ARGS__)
+
+int flfs_sync_file(struct file *, loff_t, loff_t, int);
+void truncate_data_blocks_range(struct dnode_of_data *, int);
+int truncate_blocks(struct inode *, u64);
+void flfs_truncate(struct inode *);
+int flfs_setattr(struct dentry *, struct iattr *);
+int flfs_getattr(struct vfsmount *, struct dentry *, struct kstat *);
+
+struct inode *flfs_iget(struct super_block *, unsigned long);
+void update_inode(struct inode *, struct page *);
+int update_inode_page(struct inode *);
+int flfs_write_inode(struct inode *, struct writeback_control *);
+void flfs_evict_inode(struct inode *);
+
+struct dentry *flfs_get_parent(struct dentry *child);
+
+struct flfs_dir_entry *flfs_find_entry(struct inode *, struct qstr *,
+							struct page **);
+ino_t flfs_inode_by_name(struct inode *, struct qstr *);
+void flfs_set_link(struct inode *, struct flfs_dir_entry *,
+				struct page *, struct inode *);
+int flfs_add_link(struct dentry *, struct inode *);
+void flfs_delete_entry(struct flfs_dir_entry *, struct page *,
+				struct inode *);
+bool flfs_empty_dir(struct inode *);
+
+int flfs_sync_fs(struct super_block *, int);
+
+struct flfs_nm_info;
+int get_node_path(long, int [4], unsigned int [4]);
+void get_node_info(struct flfs_sb_info *, nid_t, struct node_info *);
+int get_dnode_of_data(struct dnode_of_data *, pgoff_t, int);
+void flfs_put_dnode(struct dnode_of_data *);
+int truncate_inode_blocks(struct inode *, pgoff_t);
+int remove_inode_page(struct inode *);
+struct page *new_inode_page(struct inode *);
+struct page *get_node_page(struct flfs_sb_info *, nid_t);
+void sync_node_pages(struct flfs_sb_info *);
+bool alloc_nid(struct flfs_sb_info *, nid_t *);
+void alloc_nid_done(struct flfs_sb_info *, nid_t);
+void alloc_nid_failed(struct flfs_sb_info *, nid_t);
+void flush_nat_entries(struct flfs_sb_info *);
+nid_t next_free_nid(struct flfs_sb_info *);
+int build_node_manager(struct flfs_sb_info *);
+void destroy_node_manager(struct flfs_sb_info *);
+int __init create_node_manager_caches(void);
+void destroy_node_manager_caches(void);
+
+void flfs_balance_fs(struct flfs_sb_info *);
+void invalidate_blocks(struct flfs_sb_info *, block_t);
+void allocate_data_block(struct flfs_sb_info *, block_t, block_t *,
+				struct flfs_summary *, int);
+void flfs_submit_page_mbio(struct flfs_sb_info *, struct page *,
+				block_t, enum page_type);
+void flfs_submit_merged_bio(struct flfs_sb_info *, enum page_type);
+void flfs_wait_on_page_writeback(struct page *, enum page_type);
+int flfs_readpage_sync(struct flfs_sb_info *, struct page *, block_t, int);
+struct buffer_head *get_sum_block(struct flfs_sb_info *, unsigned int);
+void flush_sit_entries(struct flfs_sb_info *);
+void write_curseg_summaries(struct flfs_sb_info *, block_t);
+void fill_curseg_checkpoint(struct flfs_sb_info *);
+void clear_prefree_segments(struct flfs_sb_info *);
+int build_segment_manager(struct flfs_sb_info *);
+void destroy_segment_manager(struct flfs_sb_info *);
+
+int get_valid_checkpoint(struct flfs_sb_info *);
+void write_checkpoint(struct flfs_sb_info *, bool);
+int acquire_orphan_inode(struct flfs_sb_info *);
+void release_orphan_inode(struct flfs_sb_info *);
+void add_orphan_inode(struct flfs_sb_info *, nid_t);
+void remove_orphan_inode(struct flfs_sb_info *, nid_t);
+int recover_orphan_inodes(struct flfs_sb_info *);
+void set_dirty_dir_page(struct inode *, struct page *);
+void inode_dec_dirty_dents(struct inode *);
+void remove_dirty_dir_inode(struct inode *);
+void sync_dirty_dir_inodes(struct flfs_sb_info *);
+int __init create_checkpoint_caches(void);
+void destroy_checkpoint_caches(void);
+
+int reserve_new_block(struct dnode_of_data *);
+struct page *get_lock_data_page(struct inode *, pgoff_t);
+struct page *get_new_data_page(struct inode *, pgoff_t, bool);
+int do_write_data_page(struct page *, int);
+
+int start_gc_thread(struct flfs_sb_info *);
+void stop_gc_thread(struct flfs_sb_info *);
+int flfs_gc(struct flfs_sb_info *, int);
+
+extern const struct file_operations flfs_dir_operations;
+extern const struct file_operations flfs_file_operations;
+extern const struct inode_operations flfs_file_inode_operations;
+extern const struct address_space_operations flfs_dblock_aops;
+extern const struct address_space_operations flfs_node_aops;
+extern const struct inode_operations flfs_dir_inode_operations;
+extern const struct inode_operations flfs_symlink_inode_operations;
+extern const struct inode_operations flfs_special_inode_operations;
+
+#endif
@@ -0,0 +1,361 @@
+/*
+ * fs/flfs/gc.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/fs.h>
+#include <linux/module.h>
+#include <linux/backing-dev.h>
+#include <linux/blkdev.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/math64.h>
+
+#include "flfs.h"
+#include "node.h"
+#include "segment.h"
+
+#define GC_THREAD_MIN_SLEEP_TIME	10000
+#define GC_THREAD_MAX_SLEEP_TIME	30000
+#define GC_THREAD_NOGC_SLEEP_TIME	60000
+#define CP_INTERVAL			(30 * HZ)
+#define LIMIT_INVALID_BLOCK		40
+#define LIMIT_FREE_BLOCK		40
+
+static long increase_sleep_time(long wait)
+{
+	wait += GC_THREAD_MIN_SLEEP_TIME;
+	return min_t(long, wait, GC_THREAD_MAX_SLEEP_TIME);
+}
+
+static long decrease_sleep_time(long wait)
+{
+	wait -= GC_THREAD_MIN_SLEEP_TIME;
+	return max_t(long, wait, GC_THREAD_MIN_SLEEP_TIME);
+}
+
+static bool is_idle(struct flfs_sb_info *sbi)
+{
+	struct request_queue *q = bdev_get_queue(sbi->sb->s_bdev);
+	struct request_list *rl = &q->rq;
+
+	return !rl->count[BLK_RW_SYNC] && !rl->count[BLK_RW_ASYNC];
+}
+
+static bool has_enough_invalid_blocks(struct flfs_sb_info *sbi)
+{
+	block_t user = sbi->user_block_count;
+	block_t written = (TOTAL_SEGS(sbi) - free_segments(sbi)) <<
+						sbi->log_blocks_per_seg;
+	block_t valid = sbi->total_valid_block_count;
+	block_t invalid = written > valid ? written - valid : 0;
+
+	return invalid > (user / 100) * LIMIT_INVALID_BLOCK &&
+		user - valid < (user / 100) * LIMIT_FREE_BLOCK;
+}
+
+static int gc_thread_func(void *data)
+{
+	struct flfs_sb_info *sbi = data;
+	wait_queue_head_t *wq = &sbi->gc_thread->wait_queue;
+	unsigned long last_cp = jiffies;
+	long wait_ms = GC_THREAD_MIN_SLEEP_TIME;
+
+	set_freezable();
+	do {
+		wait_event_freezable_timeout(*wq, kthread_should_stop(),
+					     msecs_to_jiffies(wait_ms));
+		if (kthread_should_stop())
+			break;
+
+		if (sbi->sb->s_frozen >= SB_FREEZE_WRITE) {
+			wait_ms = GC_THREAD_MAX_SLEEP_TIME;
+			continue;
+		}
+
+		if (time_after(jiffies, last_cp + CP_INTERVAL)) {
+			if (get_pages(sbi, FLFS_DIRTY_NODES) ||
+			    get_pages(sbi, FLFS_DIRTY_DENTS) ||
+			    prefree_segments(sbi))
+				write_checkpoint(sbi, false);
+			last_cp = jiffies;
+		}
+
+		if (!test_opt(sbi, BG_GC))
+			continue;
+		if (!mutex_trylock(&sbi->gc_mutex))
+			continue;
+
+		if (!is_idle(sbi)) {
+			wait_ms = increase_sleep_time(wait_ms);
+			mutex_unlock(&sbi->gc_mutex);
+			continue;
+		}
+
+		if (has_enough_invalid_blocks(sbi))
+			wait_ms = decrease_sleep_time(wait_ms);
+		else
+			wait_ms = increase_sleep_time(wait_ms);
+
+		if (flfs_gc(sbi, BG_GC))
+			wait_ms = GC_THREAD_NOGC_SLEEP_TIME;
+		else
+			last_cp = jiffies;
+	} while (!kthread_should_stop());
+	return 0;
+}
+
+int start_gc_thread(struct flfs_sb_info *sbi)
+{
+	struct flfs_gc_kthread *gc_th;
+	dev_t dev = sbi->sb->s_bdev->bd_dev;
+
+	gc_th = kmalloc(sizeof(struct flfs_gc_kthread), GFP_KERNEL);
+	if (!gc_th)
+		return -ENOMEM;
+
+	sbi->gc_thread = gc_th;
+	init_waitqueue_head(&gc_th->wait_queue);
+	gc_th->task = kthread_run(gc_thread_func, sbi, "flfs_gc-%u:%u",
+				  MAJOR(dev), MINOR(dev));
+	if (IS_ERR(gc_th->task)) {
+		int err = PTR_ERR(gc_th->task);
+
+		kfree(gc_th);
+		sbi->gc_thread = NULL;
+		return err;
+	}
+	return 0;
+}
+
+void stop_gc_thread(struct flfs_sb_info *sbi)
+{
+	struct flfs_gc_kthread *gc_th = sbi->gc_thread;
+
+	if (!gc_th)
+		return;
+	kthread_stop(gc_th->task);
+	kfree(gc_th);
+	sbi->gc_thread = NULL;
+}
+
+static unsigned int get_cb_cost(struct flfs_sb_info *sbi, unsigned int segno)
+{
+	struct sit_info *sit_i = SIT_I(sbi);
+	struct seg_entry *se = get_seg_entry(sbi, segno);
+	unsigned long long mtime = se->mtime;
+	unsigned int u, age;
+
+	u = (se->valid_blocks * 100) >> sbi->log_blocks_per_seg;
+
+	if (mtime < sit_i->min_mtime)
+		sit_i->min_mtime = mtime;
+	if (mtime > sit_i->max_mtime)
+		sit_i->max_mtime = mtime;
+	if (sit_i->max_mtime != sit_i->min_mtime)
+		age = 100 - div64_u64(100 * (mtime - sit_i->min_mtime),
+				sit_i->max_mtime - sit_i->min_mtime);
+	else
+		age = 0;
+
+	return UINT_MAX - ((100 * (100 - u) * age) / (100 + u));
+}
+
+static bool get_victim(struct flfs_sb_info *sbi, unsigned int *result,
+			int gc_type)
+{
+	struct sit_info *sit_i = SIT_I(sbi);
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int segno, best = NULL_SEGNO;
+	unsigned int cost, min_cost = UINT_MAX;
+
+	mutex_lock(&sit_i->sentry_lock);
+	for_each_set_bit(segno, dirty_i->dirty_segmap[DIRTY], TOTAL_SEGS(sbi)) {
+		if (is_curseg(sbi, segno))
+			continue;
+
+		if (gc_type == FG_GC)
+			cost = get_seg_entry(sbi, segno)->valid_blocks;
+		else
+			cost = get_cb_cost(sbi, segno);
+
+		if (cost < min_cost) {
+			best = segno;
+			min_cost = cost;
+		}
+	}
+	if (best != NULL_SEGNO) {
+		dirty_i->cur_victim = best;
+		*result = best;
+	}
+	mutex_unlock(&sit_i->sentry_lock);
+	return best != NULL_SEGNO;
+}
+
+static bool check_valid_map(struct flfs_sb_info *sbi, unsigned int segno,
+			unsigned int offset)
+{
+	struct sit_info *sit_i = SIT_I(sbi);
+	bool ret;
+
+	mutex_lock(&sit_i->sentry_lock);
+	ret = test_bit_le(offset, get_seg_entry(sbi, segno)->cur_valid_map);
+	mutex_unlock(&sit_i->sentry_lock);
+	return ret;
+}
+
+static void gc_node_segment(struct flfs_sb_info *sbi,
+			struct flfs_summary *entry, unsigned int segno)
+{
+	block_t start_addr = START_BLOCK(sbi, segno);
+	unsigned int off;
+
+	for (off = 0; off < sbi->blocks_per_seg; off++, entry++) {
+		nid_t nid = le32_to_cpu(entry->nid);
+		struct page *node_page;
+		struct node_info ni;
+
+		if (!check_valid_map(sbi, segno, off))
+			continue;
+
+		get_node_info(sbi, nid, &ni);
+		if (ni.blk_addr != start_addr + off)
+			continue;
+
+		node_page = get_node_page(sbi, nid);
+		if (IS_ERR(node_page))
+			continue;
+		set_page_dirty(node_page);
+		flfs_put_page(node_page, 1);
+		sbi->stat.gc_node_blocks++;
+	}
+}
+
+static void move_data_page(struct inode *inode, pgoff_t bidx)
+{
+	struct flfs_sb_info *sbi = FLFS_I_SB(inode);
+	bool is_dir = S_ISDIR(inode->i_mode);
+	struct page *page;
+
+	if (is_dir)
+		flfs_lock_op(sbi);
+
+	page = get_lock_data_page(inode, bidx);
+	if (IS_ERR(page))
+		goto out;
+
+	flfs_wait_on_page_writeback(page, DATA);
+	if (clear_page_dirty_for_io(page) && is_dir)
+		inode_dec_dirty_dents(inode);
+
+	if (!is_dir)
+		flfs_lock_op(sbi);
+	if (!do_write_data_page(page, CURSEG_COLD_DATA))
+		sbi->stat.gc_data_blocks++;
+	if (!is_dir)
+		flfs_unlock_op(sbi);
+
+	flfs_put_page(page, 1);
+out:
+	if (is_dir)
+		flfs_unlock_op(sbi);
+}
+
+static void gc_data_segment(struct flfs_sb_info *sbi,
+			struct flfs_summary *entry, unsigned int segno)
+{
+	block_t start_addr = START_BLOCK(sbi, segno);
+	unsigned int off;
+
+	for (off = 0; off < sbi->blocks_per_seg; off++, entry++) {
+		nid_t nid = le32_to_cpu(entry->nid);
+		unsigned int ofs_in_node = le16_to_cpu(entry->ofs_in_node);
+		struct page *node_page;
+		struct inode *inode;
+		struct node_info ni;
+		pgoff_t bidx;
+		nid_t ino;
+
+		if (!check_valid_map(sbi, segno, off))
+			continue;
+
+		get_node_info(sbi, nid, &ni);
+		if (ni.version != entry->version)
+			continue;
+
+		node_page = get_node_page(sbi, nid);
+		if (IS_ERR(node_page))
+			continue;
+		if (ofs_in_node >= ADDRS_PER_PAGE(node_page) ||
+		    datablock_addr(node_page, ofs_in_node) != start_addr + off) {
+			flfs_put_page(node_page, 1);
+			continue;
+		}
+		ino = ino_of_node(node_page);
+		bidx = start_bidx_of_node(ofs_of_node(node_page)) + ofs_in_node;
+		flfs_put_page(node_page, 1);
+
+		inode = flfs_iget(sbi->sb, ino);
+		if (IS_ERR(inode))
+			continue;
+		move_data_page(inode, bidx);
+		iput(inode);
+	}
+	flfs_submit_merged_bio(sbi, DATA);
+}
+
+static void do_garbage_collect(struct flfs_sb_info *sbi, unsigned int segno)
+{
+	struct flfs_summary_block *sum;
+	struct buffer_head *bh;
+
+	bh = get_sum_block(sbi, segno);
+	if (!bh)
+		return;
+	sum = (struct flfs_summary_block *)bh->b_data;
+
+	if (sum->footer.entry_type == SUM_TYPE_NODE)
+		gc_node_segment(sbi, sum->entries, segno);
+	else
+		gc_data_segment(sbi, sum->entries, segno);
+
+	brelse(bh);
+	sbi->stat.gc_segments++;
+}
+
+int flfs_gc(struct flfs_sb_info *sbi, int gc_type)
+{
+	unsigned int segno, rounds = 0;
+	int ret = 0;
+
+gc_more:
+	if (!(sbi->sb->s_flags & MS_ACTIVE) || flfs_readonly(sbi->sb)) {
+		ret = -EINVAL;
+		goto stop;
+	}
+	if (gc_type == BG_GC && has_not_enough_free_segs(sbi))
+		gc_type = FG_GC;
+
+	if (!get_victim(sbi, &segno, gc_type)) {
+		ret = -ENODATA;
+		goto stop;
+	}
+	do_garbage_collect(sbi, segno);
+	DIRTY_I(sbi)->cur_victim = NULL_SEGNO;
+
+	if (gc_type == FG_GC)
+		sbi->stat.fg_gc++;
+	else
+		sbi->stat.bg_gc++;
+
+	write_checkpoint(sbi, false);
+
+	if (gc_type == FG_GC && has_not_enough_free_segs(sbi) &&
+	    ++rounds < reserved_segments(sbi))
+		goto gc_more;
+stop:
+	mutex_unlock(&sbi->gc_mutex);
+	return ret;
+}
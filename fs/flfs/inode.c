@@ -0,0 +1,218 @@
+/*
+ * fs/flfs/inode.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/fs.h>
+#include <linux/buffer_head.h>
+#include <linux/writeback.h>
+
+#include "flfs.h"
+#include "node.h"
+
+static void flfs_set_inode_flags(struct inode *inode)
+{
+	unsigned int flags = FLFS_I(inode)->i_ext_flags;
+
+	inode->i_flags &= ~(S_SYNC | S_APPEND | S_IMMUTABLE |
+			S_NOATIME | S_DIRSYNC);
+
+	if (flags & FS_SYNC_FL)
+		inode->i_flags |= S_SYNC;
+	if (flags & FS_APPEND_FL)
+		inode->i_flags |= S_APPEND;
+	if (flags & FS_IMMUTABLE_FL)
+		inode->i_flags |= S_IMMUTABLE;
+	if (flags & FS_NOATIME_FL)
+		inode->i_flags |= S_NOATIME;
+	if (flags & FS_DIRSYNC_FL)
+		inode->i_flags |= S_DIRSYNC;
+}
+
+static int do_read_inode(struct inode *inode)
+{
+	struct flfs_sb_info *sbi = FLFS_I_SB(inode);
+	struct flfs_inode_info *fi = FLFS_I(inode);
+	struct flfs_inode *ri;
+	struct page *node_page;
+
+	if (inode->i_ino < FLFS_ROOT_INO)
+		return -EINVAL;
+
+	node_page = get_node_page(sbi, inode->i_ino);
+	if (IS_ERR(node_page))
+		return PTR_ERR(node_page);
+
+	ri = FLFS_INODE(node_page);
+	inode->i_mode = le16_to_cpu(ri->i_mode);
+	inode->i_uid = le32_to_cpu(ri->i_uid);
+	inode->i_gid = le32_to_cpu(ri->i_gid);
+	set_nlink(inode, le32_to_cpu(ri->i_links));
+	inode->i_size = le64_to_cpu(ri->i_size);
+	inode->i_blocks = le64_to_cpu(ri->i_blocks);
+
+	inode->i_atime.tv_sec = le64_to_cpu(ri->i_atime);
+	inode->i_ctime.tv_sec = le64_to_cpu(ri->i_ctime);
+	inode->i_mtime.tv_sec = le64_to_cpu(ri->i_mtime);
+	inode->i_atime.tv_nsec = le32_to_cpu(ri->i_atime_nsec);
+	inode->i_ctime.tv_nsec = le32_to_cpu(ri->i_ctime_nsec);
+	inode->i_mtime.tv_nsec = le32_to_cpu(ri->i_mtime_nsec);
+	inode->i_generation = le32_to_cpu(ri->i_generation);
+
+	if (S_ISCHR(inode->i_mode) || S_ISBLK(inode->i_mode) ||
+	    S_ISFIFO(inode->i_mode) || S_ISSOCK(inode->i_mode))
+		inode->i_rdev = new_decode_dev(le32_to_cpu(ri->i_rdev));
+
+	fi->i_current_depth = le32_to_cpu(ri->i_current_depth);
+	fi->i_pino = le32_to_cpu(ri->i_pino);
+	fi->i_advise = ri->i_advise;
+	fi->i_ext_flags = le32_to_cpu(ri->i_flags);
+	flfs_set_inode_flags(inode);
+
+	flfs_put_page(node_page, 1);
+	return 0;
+}
+
+struct inode *flfs_iget(struct super_block *sb, unsigned long ino)
+{
+	struct inode *inode;
+	int ret;
+
+	inode = iget_locked(sb, ino);
+	if (!inode)
+		return ERR_PTR(-ENOMEM);
+	if (!(inode->i_state & I_NEW))
+		return inode;
+
+	if (ino == FLFS_NODE_INO) {
+		inode->i_mapping->a_ops = &flfs_node_aops;
+		mapping_set_gfp_mask(inode->i_mapping, GFP_NOFS);
+		goto make_now;
+	}
+	if (ino == FLFS_META_INO) {
+		ret = -EINVAL;
+		goto bad_inode;
+	}
+
+	ret = do_read_inode(inode);
+	if (ret)
+		goto bad_inode;
+
+	if (S_ISREG(inode->i_mode)) {
+		inode->i_op = &flfs_file_inode_operations;
+		inode->i_fop = &flfs_file_operations;
+		inode->i_mapping->a_ops = &flfs_dblock_aops;
+	} else if (S_ISDIR(inode->i_mode)) {
+		inode->i_op = &flfs_dir_inode_operations;
+		inode->i_fop = &flfs_dir_operations;
+		inode->i_mapping->a_ops = &flfs_dblock_aops;
+	} else if (S_ISLNK(inode->i_mode)) {
+		inode->i_op = &flfs_symlink_inode_operations;
+		inode->i_mapping->a_ops = &flfs_dblock_aops;
+	} else if (S_ISCHR(inode->i_mode) || S_ISBLK(inode->i_mode) ||
+		   S_ISFIFO(inode->i_mode) || S_ISSOCK(inode->i_mode)) {
+		inode->i_op = &flfs_special_inode_operations;
+		init_special_inode(inode, inode->i_mode, inode->i_rdev);
+	} else {
+		ret = -EIO;
+		goto bad_inode;
+	}
+make_now:
+	unlock_new_inode(inode);
+	return inode;
+
+bad_inode:
+	iget_failed(inode);
+	return ERR_PTR(ret);
+}
+
+void update_inode(struct inode *inode, struct page *node_page)
+{
+	struct flfs_inode_info *fi = FLFS_I(inode);
+	struct flfs_inode *ri;
+
+	flfs_wait_on_page_writeback(node_page, NODE);
+	ri = FLFS_INODE(node_page);
+
+	ri->i_mode = cpu_to_le16(inode->i_mode);
+	ri->i_advise = fi->i_advise;
+	ri->i_uid = cpu_to_le32(inode->i_uid);
+	ri->i_gid = cpu_to_le32(inode->i_gid);
+	ri->i_links = cpu_to_le32(inode->i_nlink);
+	ri->i_size = cpu_to_le64(i_size_read(inode));
+	ri->i_blocks = cpu_to_le64(inode->i_blocks);
+
+	ri->i_atime = cpu_to_le64(inode->i_atime.tv_sec);
+	ri->i_ctime = cpu_to_le64(inode->i_ctime.tv_sec);
+	ri->i_mtime = cpu_to_le64(inode->i_mtime.tv_sec);
+	ri->i_atime_nsec = cpu_to_le32(inode->i_atime.tv_nsec);
+	ri->i_ctime_nsec = cpu_to_le32(inode->i_ctime.tv_nsec);
+	ri->i_mtime_nsec = cpu_to_le32(inode->i_mtime.tv_nsec);
+	ri->i_generation = cpu_to_le32(inode->i_generation);
+
+	ri->i_current_depth = cpu_to_le32(fi->i_current_depth);
+	ri->i_flags = cpu_to_le32(fi->i_ext_flags);
+	ri->i_pino = cpu_to_le32(fi->i_pino);
+
+	if (S_ISCHR(inode->i_mode) || S_ISBLK(inode->i_mode) ||
+	    S_ISFIFO(inode->i_mode) || S_ISSOCK(inode->i_mode))
+		ri->i_rdev = cpu_to_le32(new_encode_dev(inode->i_rdev));
+	else
+		ri->i_rdev = 0;
+
+	set_page_dirty(node_page);
+}
+
+int update_inode_page(struct inode *inode)
+{
+	struct page *node_page;
+
+	node_page = get_node_page(FLFS_I_SB(inode), inode->i_ino);
+	if (IS_ERR(node_page))
+		return PTR_ERR(node_page);
+
+	update_inode(inode, node_page);
+	flfs_put_page(node_page, 1);
+	return 0;
+}
+
+int flfs_write_inode(struct inode *inode, struct writeback_control *wbc)
+{
+	struct flfs_sb_info *sbi = FLFS_I_SB(inode);
+	int ret;
+
+	if (inode->i_ino == FLFS_NODE_INO || inode->i_ino == FLFS_META_INO)
+		return 0;
+
+	flfs_lock_op(sbi);
+	ret = update_inode_page(inode);
+	flfs_unlock_op(sbi);
+	return ret;
+}
+
+void flfs_evict_inode(struct inode *inode)
+{
+	struct flfs_sb_info *sbi = FLFS_I_SB(inode);
+
+	truncate_inode_pages(&inode->i_data, 0);
+
+	if (inode->i_ino == FLFS_NODE_INO || inode->i_ino == FLFS_META_INO)
+		goto no_delete;
+
+	remove_dirty_dir_inode(inode);
+
+	if (inode->i_nlink || is_bad_inode(inode))
+		goto no_delete;
+
+	i_size_write(inode, 0);
+	truncate_blocks(inode, 0);
+
+	flfs_lock_op(sbi);
+	remove_inode_page(inode);
+	remove_orphan_inode(sbi, inode->i_ino);
+	flfs_unlock_op(sbi);
+no_delete:
+	end_writeback(inode);
+}
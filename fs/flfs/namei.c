@@ -0,0 +1,402 @@
+/*
+ * fs/flfs/namei.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/fs.h>
+#include <linux/pagemap.h>
+#include <linux/sched.h>
+#include <linux/random.h>
+
+#include "flfs.h"
+#include "node.h"
+
+static struct inode *flfs_new_inode(struct inode *dir, umode_t mode)
+{
+	struct super_block *sb = dir->i_sb;
+	struct flfs_sb_info *sbi = FLFS_SB(sb);
+	struct flfs_inode_info *fi;
+	struct inode *inode;
+	nid_t ino;
+	int err;
+
+	inode = new_inode(sb);
+	if (!inode)
+		return ERR_PTR(-ENOMEM);
+
+	if (!alloc_nid(sbi, &ino)) {
+		err = -ENOSPC;
+		goto fail;
+	}
+
+	inode_init_owner(inode, dir, mode);
+	inode->i_ino = ino;
+	inode->i_blocks = 0;
+	inode->i_mtime = inode->i_atime = inode->i_ctime = CURRENT_TIME;
+	inode->i_generation = sbi->s_next_generation++;
+
+	fi = FLFS_I(inode);
+	fi->i_pino = dir->i_ino;
+	fi->i_current_depth = 0;
+	fi->i_advise = 0;
+	fi->i_ext_flags = FLFS_I(dir)->i_ext_flags &
+			(FS_SYNC_FL | FS_NOATIME_FL | FS_DIRSYNC_FL);
+
+	err = insert_inode_locked(inode);
+	if (err) {
+		alloc_nid_failed(sbi, ino);
+		err = -EINVAL;
+		goto fail;
+	}
+	alloc_nid_done(sbi, ino);
+
+	set_inode_flag(fi, FI_NEW_INODE);
+	mark_inode_dirty(inode);
+	return inode;
+
+fail:
+	make_bad_inode(inode);
+	iput(inode);
+	return ERR_PTR(err);
+}
+
+static int flfs_create(struct inode *dir, struct dentry *dentry, umode_t mode,
+			struct nameidata *nd)
+{
+	struct flfs_sb_info *sbi = FLFS_I_SB(dir);
+	struct inode *inode;
+	int err;
+
+	flfs_balance_fs(sbi);
+
+	flfs_lock_op(sbi);
+	inode = flfs_new_inode(dir, mode);
+	if (IS_ERR(inode)) {
+		flfs_unlock_op(sbi);
+		return PTR_ERR(inode);
+	}
+
+	inode->i_op = &flfs_file_inode_operations;
+	inode->i_fop = &flfs_file_operations;
+	inode->i_mapping->a_ops = &flfs_dblock_aops;
+
+	err = flfs_add_link(dentry, inode);
+	flfs_unlock_op(sbi);
+	if (err)
+		goto out;
+
+	d_instantiate(dentry, inode);
+	unlock_new_inode(inode);
+	return 0;
+out:
+	clear_nlink(inode);
+	unlock_new_inode(inode);
+	iput(inode);
+	return err;
+}
+
+static int flfs_link(struct dentry *old_dentry, struct inode *dir,
+			struct dentry *dentry)
+{
+	struct inode *inode = old_dentry->d_inode;
+	struct flfs_sb_info *sbi = FLFS_I_SB(dir);
+	int err;
+
+	flfs_balance_fs(sbi);
+
+	inode->i_ctime = CURRENT_TIME;
+	ihold(inode);
+
+	flfs_lock_op(sbi);
+	inc_nlink(inode);
+	err = flfs_add_link(dentry, inode);
+	if (err)
+		drop_nlink(inode);
+	flfs_unlock_op(sbi);
+
+	if (err) {
+		iput(inode);
+		return err;
+	}
+	d_instantiate(dentry, inode);
+	return 0;
+}
+
+struct dentry *flfs_get_parent(struct dentry *child)
+{
+	nid_t pino = FLFS_I(child->d_inode)->i_pino;
+
+	if (!pino)
+		return ERR_PTR(-ENOENT);
+	return d_obtain_alias(flfs_iget(child->d_inode->i_sb, pino));
+}
+
+static struct dentry *flfs_lookup(struct inode *dir, struct dentry *dentry,
+			struct nameidata *nd)
+{
+	struct inode *inode = NULL;
+	ino_t ino;
+
+	if (dentry->d_name.len > FLFS_NAME_LEN)
+		return ERR_PTR(-ENAMETOOLONG);
+
+	ino = flfs_inode_by_name(dir, &dentry->d_name);
+	if (ino) {
+		inode = flfs_iget(dir->i_sb, ino);
+		if (IS_ERR(inode))
+			return ERR_CAST(inode);
+	}
+	return d_splice_alias(inode, dentry);
+}
+
+static int flfs_unlink(struct inode *dir, struct dentry *dentry)
+{
+	struct flfs_sb_info *sbi = FLFS_I_SB(dir);
+	struct inode *inode = dentry->d_inode;
+	struct flfs_dir_entry *de;
+	struct page *page;
+	int err;
+
+	flfs_balance_fs(sbi);
+
+	de = flfs_find_entry(dir, &dentry->d_name, &page);
+	if (!de)
+		return -ENOENT;
+
+	flfs_lock_op(sbi);
+	err = acquire_orphan_inode(sbi);
+	if (err) {
+		flfs_unlock_op(sbi);
+		kunmap(page);
+		page_cache_release(page);
+		return err;
+	}
+	flfs_delete_entry(de, page, inode);
+	flfs_unlock_op(sbi);
+	return 0;
+}
+
+static int flfs_symlink(struct inode *dir, struct dentry *dentry,
+			const char *symname)
+{
+	struct flfs_sb_info *sbi = FLFS_I_SB(dir);
+	unsigned int len = strlen(symname) + 1;
+	struct inode *inode;
+	int err;
+
+	if (len > dir->i_sb->s_blocksize)
+		return -ENAMETOOLONG;
+
+	flfs_balance_fs(sbi);
+
+	flfs_lock_op(sbi);
+	inode = flfs_new_inode(dir, S_IFLNK | S_IRWXUGO);
+	if (IS_ERR(inode)) {
+		flfs_unlock_op(sbi);
+		return PTR_ERR(inode);
+	}
+
+	inode->i_op = &flfs_symlink_inode_operations;
+	inode->i_mapping->a_ops = &flfs_dblock_aops;
+
+	err = flfs_add_link(dentry, inode);
+	flfs_unlock_op(sbi);
+	if (err)
+		goto out;
+
+	d_instantiate(dentry, inode);
+	unlock_new_inode(inode);
+	return page_symlink(inode, symname, len);
+out:
+	clear_nlink(inode);
+	unlock_new_inode(inode);
+	iput(inode);
+	return err;
+}
+
+static int flfs_mkdir(struct inode *dir, struct dentry *dentry, umode_t mode)
+{
+	struct flfs_sb_info *sbi = FLFS_I_SB(dir);
+	struct inode *inode;
+	int err;
+
+	flfs_balance_fs(sbi);
+
+	flfs_lock_op(sbi);
+	inode = flfs_new_inode(dir, S_IFDIR | mode);
+	if (IS_ERR(inode)) {
+		flfs_unlock_op(sbi);
+		return PTR_ERR(inode);
+	}
+
+	inode->i_op = &flfs_dir_inode_operations;
+	inode->i_fop = &flfs_dir_operations;
+	inode->i_mapping->a_ops = &flfs_dblock_aops;
+
+	inc_nlink(inode);
+	err = flfs_add_link(dentry, inode);
+	flfs_unlock_op(sbi);
+	if (err)
+		goto out_fail;
+
+	d_instantiate(dentry, inode);
+	unlock_new_inode(inode);
+	return 0;
+
+out_fail:
+	clear_nlink(inode);
+	unlock_new_inode(inode);
+	iput(inode);
+	return err;
+}
+
+static int flfs_rmdir(struct inode *dir, struct dentry *dentry)
+{
+	if (!flfs_empty_dir(dentry->d_inode))
+		return -ENOTEMPTY;
+	return flfs_unlink(dir, dentry);
+}
+
+static int flfs_mknod(struct inode *dir, struct dentry *dentry,
+			umode_t mode, dev_t rdev)
+{
+	struct flfs_sb_info *sbi = FLFS_I_SB(dir);
+	struct inode *inode;
+	int err;
+
+	if (!new_valid_dev(rdev))
+		return -EINVAL;
+
+	flfs_balance_fs(sbi);
+
+	flfs_lock_op(sbi);
+	inode = flfs_new_inode(dir, mode);
+	if (IS_ERR(inode)) {
+		flfs_unlock_op(sbi);
+		return PTR_ERR(inode);
+	}
+
+	init_special_inode(inode, inode->i_mode, rdev);
+	inode->i_op = &flfs_special_inode_operations;
+
+	err = flfs_add_link(dentry, inode);
+	flfs_unlock_op(sbi);
+	if (err)
+		goto out;
+
+	d_instantiate(dentry, inode);
+	unlock_new_inode(inode);
+	return 0;
+out:
+	clear_nlink(inode);
+	unlock_new_inode(inode);
+	iput(inode);
+	return err;
+}
+
+static int flfs_rename(struct inode *old_dir, struct dentry *old_dentry,
+			struct inode *new_dir, struct dentry *new_dentry)
+{
+	struct flfs_sb_info *sbi = FLFS_I_SB(old_dir);
+	struct inode *old_inode = old_dentry->d_inode;
+	struct inode *new_inode = new_dentry->d_inode;
+	struct flfs_dir_entry *old_entry, *new_entry;
+	struct page *old_page, *new_page;
+	int err;
+
+	flfs_balance_fs(sbi);
+
+	old_entry = flfs_find_entry(old_dir, &old_dentry->d_name, &old_page);
+	if (!old_entry)
+		return -ENOENT;
+
+	if (new_inode && S_ISDIR(old_inode->i_mode) &&
+	    !flfs_empty_dir(new_inode)) {
+		err = -ENOTEMPTY;
+		goto out_old;
+	}
+
+	flfs_lock_op(sbi);
+	if (new_inode) {
+		err = -ENOENT;
+		new_entry = flfs_find_entry(new_dir, &new_dentry->d_name,
+					    &new_page);
+		if (!new_entry)
+			goto out_unlock;
+
+		err = acquire_orphan_inode(sbi);
+		if (err) {
+			kunmap(new_page);
+			page_cache_release(new_page);
+			goto out_unlock;
+		}
+
+		flfs_set_link(new_dir, new_entry, new_page, old_inode);
+
+		new_inode->i_ctime = CURRENT_TIME;
+		if (S_ISDIR(new_inode->i_mode))
+			drop_nlink(new_inode);
+		drop_nlink(new_inode);
+		update_inode_page(new_inode);
+		if (!new_inode->i_nlink)
+			add_orphan_inode(sbi, new_inode->i_ino);
+		else
+			release_orphan_inode(sbi);
+	} else {
+		err = flfs_add_link(new_dentry, old_inode);
+		if (err)
+			goto out_unlock;
+		if (S_ISDIR(old_inode->i_mode)) {
+			inc_nlink(new_dir);
+			update_inode_page(new_dir);
+		}
+	}
+
+	old_inode->i_ctime = CURRENT_TIME;
+	FLFS_I(old_inode)->i_pino = new_dir->i_ino;
+	update_inode_page(old_inode);
+
+	flfs_delete_entry(old_entry, old_page, NULL);
+	if (S_ISDIR(old_inode->i_mode)) {
+		drop_nlink(old_dir);
+		update_inode_page(old_dir);
+	}
+	flfs_unlock_op(sbi);
+	return 0;
+
+out_unlock:
+	flfs_unlock_op(sbi);
+out_old:
+	kunmap(old_page);
+	page_cache_release(old_page);
+	return err;
+}
+
+const struct inode_operations flfs_dir_inode_operations = {
+	.create		= flfs_create,
+	.lookup		= flfs_lookup,
+	.link		= flfs_link,
+	.unlink		= flfs_unlink,
+	.symlink	= flfs_symlink,
+	.mkdir		= flfs_mkdir,
+	.rmdir		= flfs_rmdir,
+	.mknod		= flfs_mknod,
+	.rename		= flfs_rename,
+	.getattr	= flfs_getattr,
+	.setattr	= flfs_setattr,
+};
+
+const struct inode_operations flfs_symlink_inode_operations = {
+	.readlink	= generic_readlink,
+	.follow_link	= page_follow_link_light,
+	.put_link	= page_put_link,
+	.getattr	= flfs_getattr,
+	.setattr	= flfs_setattr,
+};
+
+const struct inode_operations flfs_special_inode_operations = {
+	.getattr	= flfs_getattr,
+	.setattr	= flfs_setattr,
+};
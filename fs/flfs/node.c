@@ -0,0 +1,1044 @@
+/*
+ * fs/flfs/node.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/fs.h>
+#include <linux/mpage.h>
+#include <linux/backing-dev.h>
+#include <linux/blkdev.h>
+#include <linux/pagevec.h>
+#include <linux/swap.h>
+#include <linux/writeback.h>
+
+#include "flfs.h"
+#include "node.h"
+#include "segment.h"
+
+#define NATVEC_SIZE	64
+
+static struct kmem_cache *nat_entry_slab;
+static struct kmem_cache *free_nid_slab;
+
+static block_t current_nat_addr(struct flfs_sb_info *sbi, nid_t nid)
+{
+	struct flfs_nm_info *nm_i = NM_I(sbi);
+	unsigned int blk = nid / NAT_ENTRY_PER_BLOCK;
+	block_t addr = nm_i->nat_blkaddr + blk;
+
+	if (flfs_test_bit(blk, nm_i->nat_bitmap))
+		addr += nm_i->nat_copy_offset;
+	return addr;
+}
+
+static block_t next_nat_addr(struct flfs_sb_info *sbi, unsigned int blk)
+{
+	struct flfs_nm_info *nm_i = NM_I(sbi);
+	block_t addr = nm_i->nat_blkaddr + blk;
+
+	if (!flfs_test_bit(blk, nm_i->nat_bitmap))
+		addr += nm_i->nat_copy_offset;
+	return addr;
+}
+
+static struct nat_entry *__lookup_nat_cache(struct flfs_nm_info *nm_i, nid_t n)
+{
+	return radix_tree_lookup(&nm_i->nat_root, n);
+}
+
+static void __del_from_nat_cache(struct flfs_nm_info *nm_i, struct nat_entry *e)
+{
+	list_del(&e->list);
+	radix_tree_delete(&nm_i->nat_root, e->ni.nid);
+	nm_i->nat_cnt--;
+	kmem_cache_free(nat_entry_slab, e);
+}
+
+static struct nat_entry *grab_nat_entry(struct flfs_nm_info *nm_i, nid_t nid)
+{
+	struct nat_entry *new;
+
+	for (;;) {
+		new = kmem_cache_alloc(nat_entry_slab, GFP_NOFS);
+		if (new) {
+			if (!radix_tree_insert(&nm_i->nat_root, nid, new))
+				break;
+			kmem_cache_free(nat_entry_slab, new);
+		}
+		cond_resched();
+	}
+	memset(new, 0, sizeof(struct nat_entry));
+	new->ni.nid = nid;
+	list_add_tail(&new->list, &nm_i->nat_entries);
+	nm_i->nat_cnt++;
+	return new;
+}
+
+static void try_to_free_nats(struct flfs_nm_info *nm_i)
+{
+	while (nm_i->nat_cnt > NAT_CACHE_MAX && !list_empty(&nm_i->nat_entries)) {
+		struct nat_entry *e = list_first_entry(&nm_i->nat_entries,
+						struct nat_entry, list);
+		__del_from_nat_cache(nm_i, e);
+	}
+}
+
+void get_node_info(struct flfs_sb_info *sbi, nid_t nid, struct node_info *ni)
+{
+	struct flfs_nm_info *nm_i = NM_I(sbi);
+	struct flfs_nat_entry *raw;
+	struct buffer_head *bh;
+	struct nat_entry *e;
+
+	down_read(&nm_i->nat_tree_lock);
+	e = __lookup_nat_cache(nm_i, nid);
+	if (e) {
+		*ni = e->ni;
+		up_read(&nm_i->nat_tree_lock);
+		return;
+	}
+
+	memset(ni, 0, sizeof(*ni));
+	ni->nid = nid;
+	bh = sb_bread(sbi->sb, current_nat_addr(sbi, nid));
+	if (!bh) {
+		up_read(&nm_i->nat_tree_lock);
+		flfs_msg(sbi->sb, KERN_ERR, "cannot read NAT entry %u", nid);
+		return;
+	}
+	raw = &((struct flfs_nat_block *)bh->b_data)->entries[nid %
+							NAT_ENTRY_PER_BLOCK];
+	ni->ino = le32_to_cpu(raw->ino);
+	ni->blk_addr = le32_to_cpu(raw->block_addr);
+	ni->version = raw->version;
+	brelse(bh);
+	up_read(&nm_i->nat_tree_lock);
+
+	down_write(&nm_i->nat_tree_lock);
+	if (!__lookup_nat_cache(nm_i, nid)) {
+		e = grab_nat_entry(nm_i, nid);
+		e->ni = *ni;
+		try_to_free_nats(nm_i);
+	}
+	up_write(&nm_i->nat_tree_lock);
+}
+
+static void set_node_addr(struct flfs_sb_info *sbi, struct node_info *ni,
+			block_t new_blkaddr)
+{
+	struct flfs_nm_info *nm_i = NM_I(sbi);
+	struct nat_entry *e;
+
+	down_write(&nm_i->nat_tree_lock);
+	e = __lookup_nat_cache(nm_i, ni->nid);
+	if (!e) {
+		e = grab_nat_entry(nm_i, ni->nid);
+		e->ni = *ni;
+	} else if (new_blkaddr == NEW_ADDR) {
+		e->ni = *ni;
+	}
+
+	if (e->ni.blk_addr != NULL_ADDR && new_blkaddr == NULL_ADDR)
+		e->ni.version++;
+	e->ni.blk_addr = new_blkaddr;
+
+	if (!e->dirty) {
+		e->dirty = true;
+		list_move_tail(&e->list, &nm_i->dirty_nat_entries);
+	}
+	up_write(&nm_i->nat_tree_lock);
+}
+
+static int add_free_nid(struct flfs_nm_info *nm_i, nid_t nid)
+{
+	struct free_nid *i;
+
+	if (nid < FLFS_FIRST_FREE_NID || nid >= nm_i->max_nid)
+		return 0;
+
+	i = kmem_cache_alloc(free_nid_slab, GFP_NOFS);
+	if (!i)
+		return -ENOMEM;
+	i->nid = nid;
+	i->state = NID_NEW;
+
+	if (radix_tree_preload(GFP_NOFS)) {
+		kmem_cache_free(free_nid_slab, i);
+		return -ENOMEM;
+	}
+	spin_lock(&nm_i->free_nid_list_lock);
+	if (radix_tree_insert(&nm_i->free_nid_root, nid, i)) {
+		spin_unlock(&nm_i->free_nid_list_lock);
+		radix_tree_preload_end();
+		kmem_cache_free(free_nid_slab, i);
+		return 0;
+	}
+	list_add_tail(&i->list, &nm_i->free_nid_list);
+	nm_i->fcnt++;
+	spin_unlock(&nm_i->free_nid_list_lock);
+	radix_tree_preload_end();
+	return 1;
+}
+
+static void build_free_nids(struct flfs_sb_info *sbi)
+{
+	struct flfs_nm_info *nm_i = NM_I(sbi);
+	nid_t nid = nm_i->next_scan_nid;
+	int scanned;
+
+	if (nid >= nm_i->max_nid)
+		nid = 0;
+
+	for (scanned = 0; scanned < FREE_NID_PAGES &&
+				nm_i->fcnt < MAX_FREE_NIDS; scanned++) {
+		struct flfs_nat_block *nat_blk;
+		struct buffer_head *bh;
+		unsigned int i;
+
+		down_read(&nm_i->nat_tree_lock);
+		bh = sb_bread(sbi->sb, current_nat_addr(sbi, nid));
+		if (!bh) {
+			up_read(&nm_i->nat_tree_lock);
+			break;
+		}
+		nat_blk = (struct flfs_nat_block *)bh->b_data;
+		for (i = nid % NAT_ENTRY_PER_BLOCK; i < NAT_ENTRY_PER_BLOCK &&
+					nid < nm_i->max_nid; i++, nid++) {
+			struct nat_entry *e;
+
+			if (le32_to_cpu(nat_blk->entries[i].block_addr) !=
+								NULL_ADDR)
+				continue;
+			e = __lookup_nat_cache(nm_i, nid);
+			if (e && (e->dirty || e->ni.blk_addr != NULL_ADDR))
+				continue;
+			add_free_nid(nm_i, nid);
+		}
+		brelse(bh);
+		up_read(&nm_i->nat_tree_lock);
+
+		if (nid >= nm_i->max_nid)
+			nid = 0;
+	}
+	nm_i->next_scan_nid = nid;
+}
+
+bool alloc_nid(struct flfs_sb_info *sbi, nid_t *nid)
+{
+	struct flfs_nm_info *nm_i = NM_I(sbi);
+	unsigned int tries = 0;
+	struct free_nid *i;
+
+	if (sbi->total_valid_node_count + 1 > sbi->total_node_count)
+		return false;
+retry:
+	spin_lock(&nm_i->free_nid_list_lock);
+	if (nm_i->fcnt) {
+		list_for_each_entry(i, &nm_i->free_nid_list, list)
+			if (i->state == NID_NEW)
+				break;
+		i->state = NID_ALLOC;
+		nm_i->fcnt--;
+		*nid = i->nid;
+		spin_unlock(&nm_i->free_nid_list_lock);
+		return true;
+	}
+	spin_unlock(&nm_i->free_nid_list_lock);
+
+	if (tries++ > nm_i->nat_blocks / FREE_NID_PAGES + 1)
+		return false;
+
+	mutex_lock(&nm_i->build_lock);
+	build_free_nids(sbi);
+	mutex_unlock(&nm_i->build_lock);
+	goto retry;
+}
+
+void alloc_nid_done(struct flfs_sb_info *sbi, nid_t nid)
+{
+	struct flfs_nm_info *nm_i = NM_I(sbi);
+	struct free_nid *i;
+
+	spin_lock(&nm_i->free_nid_list_lock);
+	i = radix_tree_lookup(&nm_i->free_nid_root, nid);
+	BUG_ON(!i || i->state != NID_ALLOC);
+	radix_tree_delete(&nm_i->free_nid_root, nid);
+	list_del(&i->list);
+	spin_unlock(&nm_i->free_nid_list_lock);
+	kmem_cache_free(free_nid_slab, i);
+}
+
+void alloc_nid_failed(struct flfs_sb_info *sbi, nid_t nid)
+{
+	struct flfs_nm_info *nm_i = NM_I(sbi);
+	struct free_nid *i;
+
+	spin_lock(&nm_i->free_nid_list_lock);
+	i = radix_tree_lookup(&nm_i->free_nid_root, nid);
+	BUG_ON(!i || i->state != NID_ALLOC);
+	i->state = NID_NEW;
+	nm_i->fcnt++;
+	spin_unlock(&nm_i->free_nid_list_lock);
+}
+
+nid_t next_free_nid(struct flfs_sb_info *sbi)
+{
+	return NM_I(sbi)->next_scan_nid;
+}
+
+int get_node_path(long block, int offset[4], unsigned int noffset[4])
+{
+	const long direct_index = ADDRS_PER_INODE;
+	const long direct_blks = ADDRS_PER_BLOCK;
+	const long dptrs_per_blk = NIDS_PER_BLOCK;
+	const long indirect_blks = ADDRS_PER_BLOCK * NIDS_PER_BLOCK;
+	const long dindirect_blks = indirect_blks * NIDS_PER_BLOCK;
+	int n = 0;
+	int level = 0;
+
+	noffset[0] = 0;
+
+	if (block < direct_index) {
+		offset[n] = block;
+		goto got;
+	}
+	block -= direct_index;
+	if (block < direct_blks) {
+		offset[n++] = NODE_DIR1_BLOCK;
+		noffset[n] = 1;
+		offset[n] = block;
+		level = 1;
+		goto got;
+	}
+	block -= direct_blks;
+	if (block < direct_blks) {
+		offset[n++] = NODE_DIR2_BLOCK;
+		noffset[n] = 2;
+		offset[n] = block;
+		level = 1;
+		goto got;
+	}
+	block -= direct_blks;
+	if (block < indirect_blks) {
+		offset[n++] = NODE_IND1_BLOCK;
+		noffset[n] = 3;
+		offset[n++] = block / direct_blks;
+		noffset[n] = 4 + offset[n - 1];
+		offset[n] = block % direct_blks;
+		level = 2;
+		goto got;
+	}
+	block -= indirect_blks;
+	if (block < indirect_blks) {
+		offset[n++] = NODE_IND2_BLOCK;
+		noffset[n] = 4 + dptrs_per_blk;
+		offset[n++] = block / direct_blks;
+		noffset[n] = 5 + dptrs_per_blk + offset[n - 1];
+		offset[n] = block % direct_blks;
+		level = 2;
+		goto got;
+	}
+	block -= indirect_blks;
+	if (block < dindirect_blks) {
+		offset[n++] = NODE_DIND_BLOCK;
+		noffset[n] = 5 + (dptrs_per_blk * 2);
+		offset[n++] = block / indirect_blks;
+		noffset[n] = 6 + (dptrs_per_blk * 2) +
+			      offset[n - 1] * (dptrs_per_blk + 1);
+		offset[n++] = (block / direct_blks) % dptrs_per_blk;
+		noffset[n] = 7 + (dptrs_per_blk * 2) +
+			      offset[n - 2] * (dptrs_per_blk + 1) +
+			      offset[n - 1];
+		offset[n] = block % direct_blks;
+		level = 3;
+		goto got;
+	} else {
+		BUG();
+	}
+got:
+	return level;
+}
+
+struct page *get_node_page(struct flfs_sb_info *sbi, nid_t nid)
+{
+	struct page *page;
+	struct node_info ni;
+	int err;
+
+	page = grab_cache_page(NODE_MAPPING(sbi), nid);
+	if (!page)
+		return ERR_PTR(-ENOMEM);
+	if (PageUptodate(page))
+		goto got;
+
+	get_node_info(sbi, nid, &ni);
+	if (ni.blk_addr == NULL_ADDR || ni.blk_addr == NEW_ADDR) {
+		flfs_put_page(page, 1);
+		return ERR_PTR(-EIO);
+	}
+	err = flfs_readpage_sync(sbi, page, ni.blk_addr, READ_SYNC);
+	if (err) {
+		flfs_put_page(page, 1);
+		return ERR_PTR(err);
+	}
+got:
+	if (nid != nid_of_node(page)) {
+		flfs_msg(sbi->sb, KERN_ERR, "node %u has bad footer nid %u",
+			 nid, nid_of_node(page));
+		flfs_put_page(page, 1);
+		return ERR_PTR(-EIO);
+	}
+	return page;
+}
+
+static struct page *new_node_page(struct dnode_of_data *dn, unsigned int ofs)
+{
+	struct flfs_sb_info *sbi = FLFS_I_SB(dn->inode);
+	struct node_info old_ni, new_ni;
+	struct page *page;
+
+	page = grab_cache_page(NODE_MAPPING(sbi), dn->nid);
+	if (!page)
+		return ERR_PTR(-ENOMEM);
+
+	get_node_info(sbi, dn->nid, &old_ni);
+	if (old_ni.blk_addr != NULL_ADDR) {
+		flfs_put_page(page, 1);
+		return ERR_PTR(-EEXIST);
+	}
+	if (!inc_valid_node_count(sbi, dn->inode)) {
+		flfs_put_page(page, 1);
+		return ERR_PTR(-ENOSPC);
+	}
+
+	flfs_wait_on_page_writeback(page, NODE);
+	new_ni = old_ni;
+	new_ni.ino = dn->inode->i_ino;
+	set_node_addr(sbi, &new_ni, NEW_ADDR);
+
+	zero_user_segment(page, 0, PAGE_CACHE_SIZE);
+	fill_node_footer(page, dn->nid, dn->inode->i_ino, ofs,
+			 !S_ISDIR(dn->inode->i_mode));
+	SetPageUptodate(page);
+	set_page_dirty(page);
+
+	if (!ofs)
+		inc_valid_inode_count(sbi);
+	return page;
+}
+
+struct page *new_inode_page(struct inode *inode)
+{
+	struct dnode_of_data dn;
+	struct page *page;
+
+	set_new_dnode(&dn, inode, inode->i_ino);
+	page = new_node_page(&dn, 0);
+	if (!IS_ERR(page))
+		update_inode(inode, page);
+	return page;
+}
+
+int get_dnode_of_data(struct dnode_of_data *dn, pgoff_t index, int mode)
+{
+	struct flfs_sb_info *sbi = FLFS_I_SB(dn->inode);
+	struct page *npage[4];
+	struct page *parent;
+	int offset[4];
+	unsigned int noffset[4];
+	nid_t nids[4];
+	int level, i;
+	int err = 0;
+
+	level = get_node_path(index, offset, noffset);
+
+	nids[0] = dn->inode->i_ino;
+	npage[0] = get_node_page(sbi, nids[0]);
+	if (IS_ERR(npage[0]))
+		return PTR_ERR(npage[0]);
+
+	parent = npage[0];
+	if (level)
+		nids[1] = get_nid(parent, offset[0], true);
+	dn->inode_page = npage[0];
+
+	for (i = 1; i <= level; i++) {
+		bool done = false;
+
+		if (!nids[i] && mode == ALLOC_NODE) {
+			if (!alloc_nid(sbi, &nids[i])) {
+				err = -ENOSPC;
+				goto release_pages;
+			}
+			dn->nid = nids[i];
+			npage[i] = new_node_page(dn, noffset[i]);
+			if (IS_ERR(npage[i])) {
+				alloc_nid_failed(sbi, nids[i]);
+				err = PTR_ERR(npage[i]);
+				goto release_pages;
+			}
+			set_nid(parent, offset[i - 1], nids[i], i == 1);
+			alloc_nid_done(sbi, nids[i]);
+			done = true;
+		} else if (!nids[i]) {
+			err = -ENOENT;
+			goto release_pages;
+		}
+		if (!done) {
+			npage[i] = get_node_page(sbi, nids[i]);
+			if (IS_ERR(npage[i])) {
+				err = PTR_ERR(npage[i]);
+				goto release_pages;
+			}
+		}
+		if (i == 1)
+			unlock_page(parent);
+		else
+			flfs_put_page(parent, 1);
+
+		if (i < level) {
+			parent = npage[i];
+			nids[i + 1] = get_nid(parent, offset[i], false);
+		}
+	}
+	dn->nid = nids[level];
+	dn->ofs_in_node = offset[level];
+	dn->node_page = npage[level];
+	dn->data_blkaddr = datablock_addr(dn->node_page, dn->ofs_in_node);
+	return 0;
+
+release_pages:
+	flfs_put_page(parent, 1);
+	if (i > 1)
+		flfs_put_page(npage[0], 0);
+	dn->inode_page = NULL;
+	dn->node_page = NULL;
+	return err;
+}
+
+void flfs_put_dnode(struct dnode_of_data *dn)
+{
+	if (dn->node_page)
+		flfs_put_page(dn->node_page, 1);
+	if (dn->inode_page && dn->node_page != dn->inode_page)
+		flfs_put_page(dn->inode_page, 0);
+	dn->node_page = NULL;
+	dn->inode_page = NULL;
+}
+
+static void truncate_node(struct dnode_of_data *dn)
+{
+	struct flfs_sb_info *sbi = FLFS_I_SB(dn->inode);
+	struct page *page = dn->node_page;
+	struct node_info ni;
+
+	get_node_info(sbi, dn->nid, &ni);
+	BUG_ON(ni.blk_addr == NULL_ADDR);
+
+	invalidate_blocks(sbi, ni.blk_addr);
+	dec_valid_node_count(sbi, dn->inode);
+	set_node_addr(sbi, &ni, NULL_ADDR);
+	if (dn->nid == dn->inode->i_ino)
+		dec_valid_inode_count(sbi);
+
+	if (clear_page_dirty_for_io(page))
+		dec_page_count(sbi, FLFS_DIRTY_NODES);
+	flfs_wait_on_page_writeback(page, NODE);
+	ClearPageUptodate(page);
+	flfs_put_page(page, 1);
+	invalidate_mapping_pages(NODE_MAPPING(sbi), dn->nid, dn->nid);
+	dn->node_page = NULL;
+}
+
+static int truncate_children(struct inode *inode, struct page *page,
+			int start, int depth);
+
+static int truncate_subtree(struct inode *inode, nid_t nid, int depth)
+{
+	struct dnode_of_data dn;
+	struct page *page;
+	int err;
+
+	page = get_node_page(FLFS_I_SB(inode), nid);
+	if (IS_ERR(page))
+		return PTR_ERR(page);
+
+	set_new_dnode(&dn, inode, nid);
+	dn.node_page = page;
+	if (depth == 1) {
+		truncate_data_blocks_range(&dn, ADDRS_PER_BLOCK);
+	} else {
+		err = truncate_children(inode, page, 0, depth);
+		if (err) {
+			flfs_put_page(page, 1);
+			return err;
+		}
+	}
+	truncate_node(&dn);
+	return 0;
+}
+
+static int truncate_children(struct inode *inode, struct page *page,
+			int start, int depth)
+{
+	int i, err;
+
+	for (i = start; i < NIDS_PER_BLOCK; i++) {
+		nid_t child = get_nid(page, i, false);
+
+		if (!child)
+			continue;
+		err = truncate_subtree(inode, child, depth - 1);
+		if (err)
+			return err;
+		set_nid(page, i, 0, false);
+	}
+	return 0;
+}
+
+static int truncate_partial_indirect(struct inode *inode, struct page *page,
+			nid_t nid, int start, int depth, bool *freed)
+{
+	struct dnode_of_data dn;
+	int err;
+
+	*freed = false;
+	err = truncate_children(inode, page, start, depth);
+	if (err || start) {
+		flfs_put_page(page, 1);
+		return err;
+	}
+	set_new_dnode(&dn, inode, nid);
+	dn.node_page = page;
+	truncate_node(&dn);
+	*freed = true;
+	return 0;
+}
+
+int truncate_inode_blocks(struct inode *inode, pgoff_t from)
+{
+	struct flfs_sb_info *sbi = FLFS_I_SB(inode);
+	int offset[4];
+	unsigned int noffset[4];
+	struct page *ipage, *page, *cpage;
+	int level, slot, first = 0;
+	bool freed;
+	nid_t nid, child;
+	int err = 0;
+
+	level = get_node_path(from, offset, noffset);
+	ipage = get_node_page(sbi, inode->i_ino);
+	if (IS_ERR(ipage))
+		return PTR_ERR(ipage);
+
+	if (!level)
+		goto free_slots;
+
+	slot = offset[0] - NODE_DIR1_BLOCK;
+	first = slot + 1;
+	nid = get_nid(ipage, offset[0], true);
+	if (!nid)
+		goto free_slots;
+
+	switch (level) {
+	case 1:
+		if (offset[1])
+			break;
+		err = truncate_subtree(inode, nid, 1);
+		if (!err)
+			set_nid(ipage, offset[0], 0, true);
+		break;
+	case 2:
+		page = get_node_page(sbi, nid);
+		if (IS_ERR(page)) {
+			err = PTR_ERR(page);
+			break;
+		}
+		err = truncate_partial_indirect(inode, page, nid,
+				offset[1] + (offset[2] ? 1 : 0), 2, &freed);
+		if (!err && freed)
+			set_nid(ipage, offset[0], 0, true);
+		break;
+	case 3:
+		page = get_node_page(sbi, nid);
+		if (IS_ERR(page)) {
+			err = PTR_ERR(page);
+			break;
+		}
+		child = get_nid(page, offset[1], false);
+		freed = true;
+		if (child) {
+			cpage = get_node_page(sbi, child);
+			if (IS_ERR(cpage)) {
+				flfs_put_page(page, 1);
+				err = PTR_ERR(cpage);
+				break;
+			}
+			err = truncate_partial_indirect(inode, cpage, child,
+				offset[2] + (offset[3] ? 1 : 0), 2, &freed);
+			if (err) {
+				flfs_put_page(page, 1);
+				break;
+			}
+			if (freed)
+				set_nid(page, offset[1], 0, false);
+		}
+		if (!freed || offset[1]) {
+			err = truncate_children(inode, page, offset[1] + 1, 3);
+			flfs_put_page(page, 1);
+			break;
+		}
+		err = truncate_partial_indirect(inode, page, nid, 0, 3, &freed);
+		if (!err && freed)
+			set_nid(ipage, offset[0], 0, true);
+		break;
+	}
+
+free_slots:
+	for (slot = first; !err && slot < 5; slot++) {
+		nid = get_nid(ipage, NODE_DIR1_BLOCK + slot, true);
+		if (!nid)
+			continue;
+		err = truncate_subtree(inode, nid,
+				       slot < 2 ? 1 : (slot < 4 ? 2 : 3));
+		if (!err)
+			set_nid(ipage, NODE_DIR1_BLOCK + slot, 0, true);
+	}
+	flfs_put_page(ipage, 1);
+	return err;
+}
+
+int remove_inode_page(struct inode *inode)
+{
+	struct dnode_of_data dn;
+	struct page *page;
+
+	page = get_node_page(FLFS_I_SB(inode), inode->i_ino);
+	if (IS_ERR(page))
+		return PTR_ERR(page);
+
+	set_new_dnode(&dn, inode, inode->i_ino);
+	dn.node_page = page;
+	truncate_node(&dn);
+	return 0;
+}
+
+static void __write_node_page(struct page *page)
+{
+	struct flfs_sb_info *sbi = FLFS_P_SB(page);
+	nid_t nid = nid_of_node(page);
+	struct flfs_summary sum;
+	struct node_info ni;
+	block_t new_addr;
+	int type;
+
+	get_node_info(sbi, nid, &ni);
+	if (ni.blk_addr == NULL_ADDR) {
+		dec_page_count(sbi, FLFS_DIRTY_NODES);
+		unlock_page(page);
+		return;
+	}
+
+	set_page_writeback(page);
+	FLFS_NODE(page)->footer.cp_ver = FLFS_CKPT(sbi)->checkpoint_ver;
+
+	if (!IS_DNODE(page))
+		type = CURSEG_COLD_NODE;
+	else if (is_cold_node(page))
+		type = CURSEG_WARM_NODE;
+	else
+		type = CURSEG_HOT_NODE;
+
+	memset(&sum, 0, sizeof(sum));
+	sum.nid = cpu_to_le32(nid);
+	sum.version = ni.version;
+	allocate_data_block(sbi, ni.blk_addr, &new_addr, &sum, type);
+	set_node_addr(sbi, &ni, new_addr);
+	flfs_submit_page_mbio(sbi, page, new_addr, NODE);
+
+	dec_page_count(sbi, FLFS_DIRTY_NODES);
+	unlock_page(page);
+}
+
+void sync_node_pages(struct flfs_sb_info *sbi)
+{
+	struct address_space *mapping = NODE_MAPPING(sbi);
+	struct pagevec pvec;
+	pgoff_t index = 0;
+	int i;
+
+	pagevec_init(&pvec, 0);
+	while (pagevec_lookup_tag(&pvec, mapping, &index, PAGECACHE_TAG_DIRTY,
+				  PAGEVEC_SIZE)) {
+		for (i = 0; i < pagevec_count(&pvec); i++) {
+			struct page *page = pvec.pages[i];
+
+			lock_page(page);
+			if (page->mapping != mapping || !PageDirty(page)) {
+				unlock_page(page);
+				continue;
+			}
+			flfs_wait_on_page_writeback(page, NODE);
+			if (!clear_page_dirty_for_io(page)) {
+				unlock_page(page);
+				continue;
+			}
+			__write_node_page(page);
+		}
+		pagevec_release(&pvec);
+		cond_resched();
+	}
+	flfs_submit_merged_bio(sbi, NODE);
+}
+
+static int flfs_write_node_page(struct page *page,
+			struct writeback_control *wbc)
+{
+	struct flfs_sb_info *sbi = FLFS_P_SB(page);
+
+	if (!mutex_trylock(&sbi->node_write)) {
+		redirty_page_for_writepage(wbc, page);
+		unlock_page(page);
+		return 0;
+	}
+	flfs_wait_on_page_writeback(page, NODE);
+	__write_node_page(page);
+	mutex_unlock(&sbi->node_write);
+
+	if (wbc->for_reclaim)
+		flfs_submit_merged_bio(sbi, NODE);
+	return 0;
+}
+
+static int flfs_write_node_pages(struct address_space *mapping,
+			struct writeback_control *wbc)
+{
+	struct flfs_sb_info *sbi = FLFS_SB(mapping->host->i_sb);
+	int ret;
+
+	if (wbc->sync_mode == WB_SYNC_NONE &&
+	    get_pages(sbi, FLFS_DIRTY_NODES) < sbi->blocks_per_seg)
+		return 0;
+
+	ret = generic_writepages(mapping, wbc);
+	flfs_submit_merged_bio(sbi, NODE);
+	return ret;
+}
+
+static int flfs_set_node_page_dirty(struct page *page)
+{
+	SetPageUptodate(page);
+	if (!PageDirty(page)) {
+		__set_page_dirty_nobuffers(page);
+		inc_page_count(FLFS_P_SB(page), FLFS_DIRTY_NODES);
+		SetPagePrivate(page);
+		return 1;
+	}
+	return 0;
+}
+
+static void flfs_invalidate_node_page(struct page *page, unsigned long offset)
+{
+	if (PageDirty(page))
+		dec_page_count(FLFS_P_SB(page), FLFS_DIRTY_NODES);
+	ClearPagePrivate(page);
+}
+
+static int flfs_release_node_page(struct page *page, gfp_t wait)
+{
+	ClearPagePrivate(page);
+	return 1;
+}
+
+const struct address_space_operations flfs_node_aops = {
+	.writepage	= flfs_write_node_page,
+	.writepages	= flfs_write_node_pages,
+	.set_page_dirty	= flfs_set_node_page_dirty,
+	.invalidatepage	= flfs_invalidate_node_page,
+	.releasepage	= flfs_release_node_page,
+};
+
+void flush_nat_entries(struct flfs_sb_info *sbi)
+{
+	struct flfs_nm_info *nm_i = NM_I(sbi);
+	struct flfs_checkpoint *ckpt = FLFS_CKPT(sbi);
+	struct nat_entry *gang[NATVEC_SIZE];
+	struct nat_entry *e, *tmp;
+	unsigned int blk, sit_bytes;
+	LIST_HEAD(freed);
+
+	down_write(&nm_i->nat_tree_lock);
+	list_for_each_entry(e, &nm_i->dirty_nat_entries, list)
+		if (e->ni.blk_addr != NEW_ADDR)
+			__set_bit(e->ni.nid / NAT_ENTRY_PER_BLOCK,
+				  nm_i->dirty_nat_blocks);
+
+	for_each_set_bit(blk, nm_i->dirty_nat_blocks, nm_i->nat_blocks) {
+		nid_t start_nid = blk * NAT_ENTRY_PER_BLOCK;
+		nid_t end_nid = start_nid + NAT_ENTRY_PER_BLOCK;
+		struct flfs_nat_block *nat_blk;
+		struct buffer_head *src, *dst;
+		nid_t nid = start_nid;
+		unsigned int found, i;
+
+		src = sb_bread(sbi->sb, current_nat_addr(sbi, start_nid));
+		if (!src) {
+			sbi->cp_error = true;
+			continue;
+		}
+		dst = sb_getblk(sbi->sb, next_nat_addr(sbi, blk));
+		lock_buffer(dst);
+		memcpy(dst->b_data, src->b_data, FLFS_BLKSIZE);
+		brelse(src);
+		nat_blk = (struct flfs_nat_block *)dst->b_data;
+
+		while ((found = radix_tree_gang_lookup(&nm_i->nat_root,
+				(void **)gang, nid, NATVEC_SIZE))) {
+			for (i = 0; i < found; i++) {
+				struct flfs_nat_entry *raw;
+
+				e = gang[i];
+				if (e->ni.nid >= end_nid)
+					goto done;
+				nid = e->ni.nid + 1;
+				if (!e->dirty || e->ni.blk_addr == NEW_ADDR)
+					continue;
+				raw = &nat_blk->entries[e->ni.nid - start_nid];
+				raw->ino = cpu_to_le32(e->ni.ino);
+				raw->block_addr = cpu_to_le32(e->ni.blk_addr);
+				raw->version = e->ni.version;
+			}
+		}
+done:
+		set_buffer_uptodate(dst);
+		unlock_buffer(dst);
+		mark_buffer_dirty(dst);
+		brelse(dst);
+
+		flfs_change_bit(blk, nm_i->nat_bitmap);
+		__clear_bit(blk, nm_i->dirty_nat_blocks);
+	}
+
+	list_for_each_entry_safe(e, tmp, &nm_i->dirty_nat_entries, list) {
+		if (e->ni.blk_addr == NEW_ADDR)
+			continue;
+		e->dirty = false;
+		if (e->ni.blk_addr == NULL_ADDR) {
+			nid_t nid = e->ni.nid;
+
+			__del_from_nat_cache(nm_i, e);
+			add_free_nid(nm_i, nid);
+		} else {
+			list_move_tail(&e->list, &nm_i->nat_entries);
+		}
+	}
+	try_to_free_nats(nm_i);
+
+	sit_bytes = le32_to_cpu(ckpt->sit_ver_bitmap_bytesize);
+	memcpy(ckpt->sit_nat_version_bitmap + sit_bytes, nm_i->nat_bitmap,
+	       nm_i->bitmap_size);
+	up_write(&nm_i->nat_tree_lock);
+}
+
+int build_node_manager(struct flfs_sb_info *sbi)
+{
+	struct flfs_super_block *raw_super = sbi->raw_super;
+	struct flfs_checkpoint *ckpt = FLFS_CKPT(sbi);
+	struct flfs_nm_info *nm_i;
+	unsigned int sit_bytes;
+
+	nm_i = kzalloc(sizeof(struct flfs_nm_info), GFP_KERNEL);
+	if (!nm_i)
+		return -ENOMEM;
+	sbi->nm_info = nm_i;
+
+	nm_i->nat_blkaddr = le32_to_cpu(raw_super->nat_blkaddr);
+	nm_i->nat_blocks = le32_to_cpu(raw_super->nat_blocks);
+	nm_i->nat_copy_offset = (le32_to_cpu(raw_super->segment_count_nat)
+			>> 1) << sbi->log_blocks_per_seg;
+	nm_i->max_nid = min_t(nid_t, le32_to_cpu(raw_super->max_nid),
+			      nm_i->nat_blocks * NAT_ENTRY_PER_BLOCK);
+	nm_i->next_scan_nid = le32_to_cpu(ckpt->next_free_nid);
+	sbi->total_node_count = nm_i->max_nid - FLFS_ROOT_INO;
+
+	INIT_RADIX_TREE(&nm_i->nat_root, GFP_NOFS);
+	INIT_LIST_HEAD(&nm_i->nat_entries);
+	INIT_LIST_HEAD(&nm_i->dirty_nat_entries);
+	init_rwsem(&nm_i->nat_tree_lock);
+
+	INIT_RADIX_TREE(&nm_i->free_nid_root, GFP_ATOMIC);
+	INIT_LIST_HEAD(&nm_i->free_nid_list);
+	spin_lock_init(&nm_i->free_nid_list_lock);
+	mutex_init(&nm_i->build_lock);
+
+	sit_bytes = le32_to_cpu(ckpt->sit_ver_bitmap_bytesize);
+	nm_i->bitmap_size = le32_to_cpu(ckpt->nat_ver_bitmap_bytesize);
+	if (sit_bytes + nm_i->bitmap_size > FLFS_CP_BITMAP_BYTES)
+		return -EINVAL;
+	nm_i->nat_bitmap = kmemdup(ckpt->sit_nat_version_bitmap + sit_bytes,
+				   nm_i->bitmap_size, GFP_KERNEL);
+	if (!nm_i->nat_bitmap)
+		return -ENOMEM;
+
+	nm_i->dirty_nat_blocks = kzalloc(BITS_TO_LONGS(nm_i->nat_blocks) *
+				sizeof(unsigned long), GFP_KERNEL);
+	if (!nm_i->dirty_nat_blocks)
+		return -ENOMEM;
+
+	build_free_nids(sbi);
+	return 0;
+}
+
+void destroy_node_manager(struct flfs_sb_info *sbi)
+{
+	struct flfs_nm_info *nm_i = NM_I(sbi);
+	struct free_nid *i, *next_i;
+	struct nat_entry *e, *tmp;
+
+	if (!nm_i)
+		return;
+
+	spin_lock(&nm_i->free_nid_list_lock);
+	list_for_each_entry_safe(i, next_i, &nm_i->free_nid_list, list) {
+		radix_tree_delete(&nm_i->free_nid_root, i->nid);
+		list_del(&i->list);
+		kmem_cache_free(free_nid_slab, i);
+	}
+	spin_unlock(&nm_i->free_nid_list_lock);
+
+	down_write(&nm_i->nat_tree_lock);
+	list_for_each_entry_safe(e, tmp, &nm_i->nat_entries, list)
+		__del_from_nat_cache(nm_i, e);
+	list_for_each_entry_safe(e, tmp, &nm_i->dirty_nat_entries, list)
+		__del_from_nat_cache(nm_i, e);
+	up_write(&nm_i->nat_tree_lock);
+
+	kfree(nm_i->dirty_nat_blocks);
+	kfree(nm_i->nat_bitmap);
+	sbi->nm_info = NULL;
+	kfree(nm_i);
+}
+
+int __init create_node_manager_caches(void)
+{
+	nat_entry_slab = kmem_cache_create("flfs_nat_entry",
+			sizeof(struct nat_entry), 0, 0, NULL);
+	if (!nat_entry_slab)
+		return -ENOMEM;
+
+	free_nid_slab = kmem_cache_create("flfs_free_nid",
+			sizeof(struct free_nid), 0, 0, NULL);
+	if (!free_nid_slab) {
+		kmem_cache_destroy(nat_entry_slab);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+void destroy_node_manager_caches(void)
+{
+	kmem_cache_destroy(free_nid_slab);
+	kmem_cache_destroy(nat_entry_slab);
+}
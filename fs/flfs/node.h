@@ -0,0 +1,179 @@
+/*
+ * fs/flfs/node.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef _FLFS_NODE_H
+#define _FLFS_NODE_H
+
+#define FREE_NID_PAGES			4
+#define MAX_FREE_NIDS			(NAT_ENTRY_PER_BLOCK * FREE_NID_PAGES)
+#define NAT_CACHE_MAX			4096
+
+#define COLD_BIT_SHIFT			0
+
+enum nid_state {
+	NID_NEW,
+	NID_ALLOC,
+};
+
+struct nat_entry {
+	struct list_head list;
+	bool dirty;
+	struct node_info ni;
+};
+
+struct free_nid {
+	struct list_head list;
+	nid_t nid;
+	int state;
+};
+
+struct flfs_nm_info {
+	block_t nat_blkaddr;
+	unsigned int nat_blocks;
+	unsigned int nat_copy_offset;
+	nid_t max_nid;
+	nid_t next_scan_nid;
+
+	struct radix_tree_root nat_root;
+	struct list_head nat_entries;
+	struct list_head dirty_nat_entries;
+	unsigned int nat_cnt;
+	struct rw_semaphore nat_tree_lock;
+
+	struct radix_tree_root free_nid_root;
+	struct list_head free_nid_list;
+	unsigned int fcnt;
+	spinlock_t free_nid_list_lock;
+	struct mutex build_lock;
+
+	char *nat_bitmap;
+	unsigned int bitmap_size;
+	unsigned long *dirty_nat_blocks;
+};
+
+static inline struct flfs_nm_info *NM_I(struct flfs_sb_info *sbi)
+{
+	return sbi->nm_info;
+}
+
+static inline nid_t nid_of_node(struct page *node_page)
+{
+	return le32_to_cpu(FLFS_NODE(node_page)->footer.nid);
+}
+
+static inline nid_t ino_of_node(struct page *node_page)
+{
+	return le32_to_cpu(FLFS_NODE(node_page)->footer.ino);
+}
+
+static inline unsigned int ofs_of_node(struct page *node_page)
+{
+	return le32_to_cpu(FLFS_NODE(node_page)->footer.flag) >>
+							OFFSET_BIT_SHIFT;
+}
+
+static inline bool is_cold_node(struct page *node_page)
+{
+	return le32_to_cpu(FLFS_NODE(node_page)->footer.flag) &
+							(1 << COLD_BIT_SHIFT);
+}
+
+static inline void fill_node_footer(struct page *page, nid_t nid, nid_t ino,
+				unsigned int ofs, bool cold)
+{
+	struct flfs_node *rn = FLFS_NODE(page);
+	unsigned int flag = ofs << OFFSET_BIT_SHIFT;
+
+	if (cold)
+		flag |= 1 << COLD_BIT_SHIFT;
+	rn->footer.nid = cpu_to_le32(nid);
+	rn->footer.ino = cpu_to_le32(ino);
+	rn->footer.flag = cpu_to_le32(flag);
+}
+
+static inline bool IS_INODE(struct page *page)
+{
+	return ofs_of_node(page) == 0;
+}
+
+static inline bool IS_DNODE(struct page *node_page)
+{
+	unsigned int ofs = ofs_of_node(node_page);
+
+	if (ofs == 3 || ofs == 4 + NIDS_PER_BLOCK ||
+	    ofs == 5 + 2 * NIDS_PER_BLOCK)
+		return false;
+	if (ofs >= 6 + 2 * NIDS_PER_BLOCK) {
+		ofs -= 6 + 2 * NIDS_PER_BLOCK;
+		if (!(ofs % (NIDS_PER_BLOCK + 1)))
+			return false;
+	}
+	return true;
+}
+
+static inline unsigned int ADDRS_PER_PAGE(struct page *node_page)
+{
+	return IS_INODE(node_page) ? ADDRS_PER_INODE : ADDRS_PER_BLOCK;
+}
+
+static inline __le32 *blkaddr_in_node(struct page *node_page)
+{
+	void *rn = FLFS_NODE(node_page);
+
+	if (IS_INODE(node_page))
+		return rn + offsetof(struct flfs_node, i.i_addr);
+	return rn + offsetof(struct flfs_node, dn.addr);
+}
+
+static inline block_t datablock_addr(struct page *node_page,
+				unsigned int offset)
+{
+	return le32_to_cpu(blkaddr_in_node(node_page)[offset]);
+}
+
+static inline nid_t get_nid(struct page *p, int off, bool i)
+{
+	struct flfs_node *rn = FLFS_NODE(p);
+
+	if (i)
+		return le32_to_cpu(rn->i.i_nid[off - NODE_DIR1_BLOCK]);
+	return le32_to_cpu(rn->in.nid[off]);
+}
+
+static inline void set_nid(struct page *p, int off, nid_t nid, bool i)
+{
+	struct flfs_node *rn = FLFS_NODE(p);
+
+	flfs_wait_on_page_writeback(p, NODE);
+	if (i)
+		rn->i.i_nid[off - NODE_DIR1_BLOCK] = cpu_to_le32(nid);
+	else
+		rn->in.nid[off] = cpu_to_le32(nid);
+	set_page_dirty(p);
+}
+
+static inline unsigned int start_bidx_of_node(unsigned int node_ofs)
+{
+	unsigned int indirect_blks = 2 * NIDS_PER_BLOCK + 4;
+	unsigned int bidx;
+
+	if (node_ofs == 0)
+		return 0;
+
+	if (node_ofs <= 2) {
+		bidx = node_ofs - 1;
+	} else if (node_ofs <= indirect_blks) {
+		int dec = (node_ofs - 4) / (NIDS_PER_BLOCK + 1);
+		bidx = node_ofs - 2 - dec;
+	} else {
+		int dec = (node_ofs - indirect_blks - 3) / (NIDS_PER_BLOCK + 1);
+		bidx = node_ofs - 5 - dec;
+	}
+	return bidx * ADDRS_PER_BLOCK + ADDRS_PER_INODE;
+}
+
+#endif
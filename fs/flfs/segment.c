@@ -0,0 +1,801 @@
+/*
+ * fs/flfs/segment.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/fs.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/prefetch.h>
+#include <linux/vmalloc.h>
+#include <linux/math64.h>
+
+#include "flfs.h"
+#include "segment.h"
+
+void flfs_balance_fs(struct flfs_sb_info *sbi)
+{
+	if (has_not_enough_free_segs(sbi)) {
+		mutex_lock(&sbi->gc_mutex);
+		flfs_gc(sbi, FG_GC);
+	}
+}
+
+static void __set_dirty(struct flfs_sb_info *sbi, unsigned int segno,
+			enum dirty_type t)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+
+	if (!__test_and_set_bit(segno, dirty_i->dirty_segmap[t]))
+		dirty_i->nr_dirty[t]++;
+}
+
+static void __clear_dirty(struct flfs_sb_info *sbi, unsigned int segno,
+			enum dirty_type t)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+
+	if (__test_and_clear_bit(segno, dirty_i->dirty_segmap[t]))
+		dirty_i->nr_dirty[t]--;
+}
+
+static void locate_dirty_segment(struct flfs_sb_info *sbi, unsigned int segno)
+{
+	struct seg_entry *se;
+
+	if (segno == NULL_SEGNO || is_curseg(sbi, segno))
+		return;
+
+	se = get_seg_entry(sbi, segno);
+	if (!se->valid_blocks) {
+		__set_dirty(sbi, segno, PRE);
+		__clear_dirty(sbi, segno, DIRTY);
+		__clear_dirty(sbi, segno, se->type);
+	} else if (se->valid_blocks < sbi->blocks_per_seg) {
+		__set_dirty(sbi, segno, DIRTY);
+		__set_dirty(sbi, segno, se->type);
+	} else {
+		__clear_dirty(sbi, segno, DIRTY);
+		__clear_dirty(sbi, segno, se->type);
+	}
+}
+
+static void update_sit_entry(struct flfs_sb_info *sbi, block_t blkaddr,
+			int del)
+{
+	struct sit_info *sit_i = SIT_I(sbi);
+	unsigned int segno = GET_SEGNO(sbi, blkaddr);
+	unsigned int offset = GET_BLKOFF(sbi, blkaddr);
+	struct seg_entry *se = get_seg_entry(sbi, segno);
+	int new_vblocks = se->valid_blocks + del;
+
+	BUG_ON(new_vblocks < 0 || new_vblocks > sbi->blocks_per_seg);
+
+	if (del > 0) {
+		unsigned long long mtime = get_mtime(sbi);
+
+		if (__test_and_set_bit_le(offset, se->cur_valid_map))
+			BUG();
+		if (se->valid_blocks)
+			se->mtime = div_u64(se->mtime * se->valid_blocks + mtime,
+					    se->valid_blocks + 1);
+		else
+			se->mtime = mtime;
+		if (se->mtime < sit_i->min_mtime)
+			sit_i->min_mtime = se->mtime;
+		if (se->mtime > sit_i->max_mtime)
+			sit_i->max_mtime = se->mtime;
+	} else {
+		if (!__test_and_clear_bit_le(offset, se->cur_valid_map))
+			BUG();
+	}
+	se->valid_blocks = new_vblocks;
+
+	if (!__test_and_set_bit(segno, sit_i->dirty_sentries_bitmap))
+		sit_i->dirty_sentries++;
+}
+
+void invalidate_blocks(struct flfs_sb_info *sbi, block_t addr)
+{
+	struct sit_info *sit_i = SIT_I(sbi);
+
+	if (addr == NEW_ADDR || addr == NULL_ADDR)
+		return;
+
+	mutex_lock(&sit_i->sentry_lock);
+	update_sit_entry(sbi, addr, -1);
+	locate_dirty_segment(sbi, GET_SEGNO(sbi, addr));
+	mutex_unlock(&sit_i->sentry_lock);
+}
+
+struct buffer_head *get_sum_block(struct flfs_sb_info *sbi, unsigned int segno)
+{
+	return sb_bread(sbi->sb, GET_SUM_BLKADDR(sbi, segno));
+}
+
+static void write_meta_block(struct flfs_sb_info *sbi, const void *src,
+			block_t blkaddr)
+{
+	struct buffer_head *bh = sb_getblk(sbi->sb, blkaddr);
+
+	lock_buffer(bh);
+	memcpy(bh->b_data, src, FLFS_BLKSIZE);
+	set_buffer_uptodate(bh);
+	unlock_buffer(bh);
+	mark_buffer_dirty(bh);
+	brelse(bh);
+}
+
+static unsigned int get_new_segment(struct flfs_sb_info *sbi,
+			unsigned int hint)
+{
+	struct free_segmap_info *free_i = FREE_I(sbi);
+	unsigned int segno;
+
+	segno = find_next_zero_bit(free_i->free_segmap, TOTAL_SEGS(sbi), hint);
+	if (segno >= TOTAL_SEGS(sbi))
+		segno = find_first_zero_bit(free_i->free_segmap,
+					    TOTAL_SEGS(sbi));
+	if (segno >= TOTAL_SEGS(sbi))
+		return NULL_SEGNO;
+
+	__set_bit(segno, free_i->free_segmap);
+	free_i->free_segments--;
+	return segno;
+}
+
+static unsigned short __next_free_blkoff(struct flfs_sb_info *sbi,
+			struct seg_entry *se, unsigned int start)
+{
+	unsigned int i;
+
+	for (i = start; i < sbi->blocks_per_seg; i++)
+		if (!test_bit_le(i, se->cur_valid_map) &&
+		    !test_bit_le(i, se->ckpt_valid_map))
+			break;
+	return i;
+}
+
+static bool new_curseg(struct flfs_sb_info *sbi, int type)
+{
+	struct curseg_info *curseg = CURSEG_I(sbi, type);
+	unsigned int segno;
+
+	segno = get_new_segment(sbi, curseg->segno + 1);
+	if (segno == NULL_SEGNO)
+		return false;
+
+	memset(curseg->sum_blk, 0, FLFS_BLKSIZE);
+	curseg->sum_blk->footer.entry_type =
+			IS_NODESEG(type) ? SUM_TYPE_NODE : SUM_TYPE_DATA;
+	curseg->segno = segno;
+	curseg->next_blkoff = 0;
+	curseg->alloc_type = LFS;
+	get_seg_entry(sbi, segno)->type = type;
+	sbi->stat.lfs_segments++;
+	return true;
+}
+
+static bool get_ssr_segment(struct flfs_sb_info *sbi, int type,
+			unsigned int *result)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	unsigned int segno, best = NULL_SEGNO;
+	unsigned int min_valid = sbi->blocks_per_seg;
+
+	for_each_set_bit(segno, dirty_i->dirty_segmap[type], TOTAL_SEGS(sbi)) {
+		struct seg_entry *se = get_seg_entry(sbi, segno);
+
+		if (segno == dirty_i->cur_victim || is_curseg(sbi, segno))
+			continue;
+		if (se->valid_blocks >= min_valid)
+			continue;
+		if (__next_free_blkoff(sbi, se, 0) >= sbi->blocks_per_seg)
+			continue;
+		best = segno;
+		min_valid = se->valid_blocks;
+	}
+	*result = best;
+	return best != NULL_SEGNO;
+}
+
+static void change_curseg(struct flfs_sb_info *sbi, int type,
+			unsigned int segno)
+{
+	struct curseg_info *curseg = CURSEG_I(sbi, type);
+	struct seg_entry *se = get_seg_entry(sbi, segno);
+	struct buffer_head *bh;
+
+	__clear_dirty(sbi, segno, DIRTY);
+	__clear_dirty(sbi, segno, se->type);
+
+	bh = get_sum_block(sbi, segno);
+	if (bh) {
+		memcpy(curseg->sum_blk, bh->b_data, FLFS_BLKSIZE);
+		brelse(bh);
+	} else {
+		memset(curseg->sum_blk, 0, FLFS_BLKSIZE);
+	}
+	curseg->sum_blk->footer.entry_type =
+			IS_NODESEG(type) ? SUM_TYPE_NODE : SUM_TYPE_DATA;
+	curseg->segno = segno;
+	curseg->alloc_type = SSR;
+	curseg->next_blkoff = __next_free_blkoff(sbi, se, 0);
+	se->type = type;
+	sbi->stat.ssr_segments++;
+}
+
+static void allocate_segment(struct flfs_sb_info *sbi, int type)
+{
+	struct curseg_info *curseg = CURSEG_I(sbi, type);
+	unsigned int old_segno = curseg->segno;
+	unsigned int segno;
+
+	write_meta_block(sbi, curseg->sum_blk, GET_SUM_BLKADDR(sbi, old_segno));
+
+	if (need_SSR(sbi) && get_ssr_segment(sbi, type, &segno))
+		change_curseg(sbi, type, segno);
+	else if (!new_curseg(sbi, type)) {
+		if (!get_ssr_segment(sbi, type, &segno)) {
+			flfs_msg(sbi->sb, KERN_CRIT, "out of free segments");
+			BUG();
+		}
+		change_curseg(sbi, type, segno);
+	}
+	locate_dirty_segment(sbi, old_segno);
+}
+
+void allocate_data_block(struct flfs_sb_info *sbi, block_t old_blkaddr,
+			block_t *new_blkaddr, struct flfs_summary *sum, int type)
+{
+	struct sit_info *sit_i = SIT_I(sbi);
+	struct curseg_info *curseg = CURSEG_I(sbi, type);
+
+	mutex_lock(&curseg->curseg_mutex);
+	mutex_lock(&sit_i->sentry_lock);
+
+	*new_blkaddr = NEXT_FREE_BLKADDR(sbi, curseg);
+	memcpy(&curseg->sum_blk->entries[curseg->next_blkoff], sum,
+	       sizeof(*sum));
+
+	update_sit_entry(sbi, *new_blkaddr, 1);
+	if (old_blkaddr != NULL_ADDR && old_blkaddr != NEW_ADDR) {
+		update_sit_entry(sbi, old_blkaddr, -1);
+		locate_dirty_segment(sbi, GET_SEGNO(sbi, old_blkaddr));
+	}
+
+	if (curseg->alloc_type == SSR)
+		curseg->next_blkoff = __next_free_blkoff(sbi,
+				get_seg_entry(sbi, curseg->segno),
+				curseg->next_blkoff + 1);
+	else
+		curseg->next_blkoff++;
+
+	if (curseg->next_blkoff >= sbi->blocks_per_seg)
+		allocate_segment(sbi, type);
+
+	mutex_unlock(&sit_i->sentry_lock);
+	mutex_unlock(&curseg->curseg_mutex);
+}
+
+static void flfs_write_end_io(struct bio *bio, int err)
+{
+	const int uptodate = test_bit(BIO_UPTODATE, &bio->bi_flags);
+	struct bio_vec *bvec = bio->bi_io_vec + bio->bi_vcnt - 1;
+	struct flfs_sb_info *sbi = bio->bi_private;
+
+	do {
+		struct page *page = bvec->bv_page;
+
+		if (--bvec >= bio->bi_io_vec)
+			prefetchw(&bvec->bv_page->flags);
+		if (!uptodate) {
+			SetPageError(page);
+			if (page->mapping)
+				set_bit(AS_EIO, &page->mapping->flags);
+			sbi->cp_error = true;
+		}
+		end_page_writeback(page);
+		dec_page_count(sbi, FLFS_WRITEBACK);
+	} while (bvec >= bio->bi_io_vec);
+
+	if (!get_pages(sbi, FLFS_WRITEBACK))
+		wake_up(&sbi->cp_wait);
+	bio_put(bio);
+}
+
+static void __submit_merged_bio(struct flfs_bio_info *io)
+{
+	if (!io->bio)
+		return;
+	submit_bio(WRITE, io->bio);
+	io->bio = NULL;
+}
+
+void flfs_submit_merged_bio(struct flfs_sb_info *sbi, enum page_type type)
+{
+	struct flfs_bio_info *io = &sbi->write_io[type];
+
+	mutex_lock(&io->io_mutex);
+	__submit_merged_bio(io);
+	mutex_unlock(&io->io_mutex);
+}
+
+void flfs_submit_page_mbio(struct flfs_sb_info *sbi, struct page *page,
+			block_t blkaddr, enum page_type type)
+{
+	struct block_device *bdev = sbi->sb->s_bdev;
+	struct flfs_bio_info *io = &sbi->write_io[type];
+
+	mutex_lock(&io->io_mutex);
+	inc_page_count(sbi, FLFS_WRITEBACK);
+
+	if (io->bio && io->last_block_in_bio != blkaddr - 1)
+		__submit_merged_bio(io);
+alloc_new:
+	if (!io->bio) {
+		struct bio *bio = bio_alloc(GFP_NOIO, bio_get_nr_vecs(bdev));
+
+		bio->bi_bdev = bdev;
+		bio->bi_sector = SECTOR_FROM_BLOCK(blkaddr);
+		bio->bi_end_io = flfs_write_end_io;
+		bio->bi_private = sbi;
+		io->bio = bio;
+	}
+	if (bio_add_page(io->bio, page, PAGE_CACHE_SIZE, 0) <
+							PAGE_CACHE_SIZE) {
+		__submit_merged_bio(io);
+		goto alloc_new;
+	}
+	io->last_block_in_bio = blkaddr;
+	mutex_unlock(&io->io_mutex);
+}
+
+void flfs_wait_on_page_writeback(struct page *page, enum page_type type)
+{
+	if (PageWriteback(page)) {
+		flfs_submit_merged_bio(FLFS_P_SB(page), type);
+		wait_on_page_writeback(page);
+	}
+}
+
+static void flfs_read_end_io_sync(struct bio *bio, int err)
+{
+	complete(bio->bi_private);
+}
+
+int flfs_readpage_sync(struct flfs_sb_info *sbi, struct page *page,
+			block_t blkaddr, int rw)
+{
+	DECLARE_COMPLETION_ONSTACK(wait);
+	struct bio *bio;
+	int uptodate;
+
+	bio = bio_alloc(GFP_NOFS, 1);
+	bio->bi_bdev = sbi->sb->s_bdev;
+	bio->bi_sector = SECTOR_FROM_BLOCK(blkaddr);
+	bio->bi_end_io = flfs_read_end_io_sync;
+	bio->bi_private = &wait;
+
+	if (bio_add_page(bio, page, PAGE_CACHE_SIZE, 0) < PAGE_CACHE_SIZE) {
+		bio_put(bio);
+		return -EFAULT;
+	}
+	submit_bio(rw, bio);
+	wait_for_completion(&wait);
+
+	uptodate = test_bit(BIO_UPTODATE, &bio->bi_flags);
+	bio_put(bio);
+	if (!uptodate) {
+		ClearPageUptodate(page);
+		SetPageError(page);
+		return -EIO;
+	}
+	SetPageUptodate(page);
+	return 0;
+}
+
+static block_t current_sit_addr(struct flfs_sb_info *sbi, unsigned int blk)
+{
+	struct sit_info *sit_i = SIT_I(sbi);
+	block_t addr = sit_i->sit_base_addr + blk;
+
+	if (flfs_test_bit(blk, sit_i->sit_bitmap))
+		addr += sit_i->sit_copy_offset;
+	return addr;
+}
+
+static block_t next_sit_addr(struct flfs_sb_info *sbi, unsigned int blk)
+{
+	struct sit_info *sit_i = SIT_I(sbi);
+	block_t addr = sit_i->sit_base_addr + blk;
+
+	if (!flfs_test_bit(blk, sit_i->sit_bitmap))
+		addr += sit_i->sit_copy_offset;
+	return addr;
+}
+
+static void seg_info_to_raw_sit(struct seg_entry *se,
+			struct flfs_sit_entry *raw)
+{
+	raw->vblocks = cpu_to_le16((se->type << SIT_VBLOCKS_SHIFT) |
+				   se->valid_blocks);
+	memcpy(raw->valid_map, se->cur_valid_map, SIT_VBLOCK_MAP_SIZE);
+	raw->mtime = cpu_to_le64(se->mtime);
+}
+
+void flush_sit_entries(struct flfs_sb_info *sbi)
+{
+	struct sit_info *sit_i = SIT_I(sbi);
+	unsigned int segno, blk, cur_blk = NULL_SEGNO;
+
+	mutex_lock(&sit_i->sentry_lock);
+	for_each_set_bit(segno, sit_i->dirty_sentries_bitmap, TOTAL_SEGS(sbi)) {
+		struct seg_entry *se = get_seg_entry(sbi, segno);
+
+		blk = segno / SIT_ENTRY_PER_BLOCK;
+		if (blk != cur_blk) {
+			struct flfs_sit_block *raw;
+			struct buffer_head *bh;
+			unsigned int start = blk * SIT_ENTRY_PER_BLOCK;
+			unsigned int end = min_t(unsigned int,
+				start + SIT_ENTRY_PER_BLOCK, TOTAL_SEGS(sbi));
+			unsigned int i;
+
+			bh = sb_getblk(sbi->sb, next_sit_addr(sbi, blk));
+			lock_buffer(bh);
+			memset(bh->b_data, 0, FLFS_BLKSIZE);
+			raw = (struct flfs_sit_block *)bh->b_data;
+			for (i = start; i < end; i++)
+				seg_info_to_raw_sit(get_seg_entry(sbi, i),
+						    &raw->entries[i - start]);
+			set_buffer_uptodate(bh);
+			unlock_buffer(bh);
+			mark_buffer_dirty(bh);
+			brelse(bh);
+
+			flfs_change_bit(blk, sit_i->sit_bitmap);
+			cur_blk = blk;
+		}
+
+		memcpy(se->ckpt_valid_map, se->cur_valid_map,
+		       SIT_VBLOCK_MAP_SIZE);
+		se->ckpt_valid_blocks = se->valid_blocks;
+		__clear_bit(segno, sit_i->dirty_sentries_bitmap);
+	}
+	sit_i->dirty_sentries = 0;
+	memcpy(FLFS_CKPT(sbi)->sit_nat_version_bitmap, sit_i->sit_bitmap,
+	       sit_i->bitmap_size);
+	mutex_unlock(&sit_i->sentry_lock);
+}
+
+void write_curseg_summaries(struct flfs_sb_info *sbi, block_t start)
+{
+	int i;
+
+	for (i = 0; i < NR_CURSEG_TYPE; i++) {
+		struct curseg_info *curseg = CURSEG_I(sbi, i);
+
+		mutex_lock(&curseg->curseg_mutex);
+		write_meta_block(sbi, curseg->sum_blk, start + i);
+		mutex_unlock(&curseg->curseg_mutex);
+	}
+}
+
+void fill_curseg_checkpoint(struct flfs_sb_info *sbi)
+{
+	struct flfs_checkpoint *ckpt = FLFS_CKPT(sbi);
+	int i;
+
+	for (i = 0; i < NR_CURSEG_TYPE; i++) {
+		struct curseg_info *curseg = CURSEG_I(sbi, i);
+
+		if (IS_NODESEG(i)) {
+			int n = i - CURSEG_HOT_NODE;
+
+			ckpt->cur_node_segno[n] = cpu_to_le32(curseg->segno);
+			ckpt->cur_node_blkoff[n] =
+					cpu_to_le16(curseg->next_blkoff);
+		} else {
+			ckpt->cur_data_segno[i] = cpu_to_le32(curseg->segno);
+			ckpt->cur_data_blkoff[i] =
+					cpu_to_le16(curseg->next_blkoff);
+		}
+		ckpt->alloc_type[i] = curseg->alloc_type;
+	}
+	ckpt->free_segment_count = cpu_to_le32(free_segments(sbi) +
+					       prefree_segments(sbi));
+	ckpt->elapsed_time = cpu_to_le64(get_mtime(sbi));
+}
+
+void clear_prefree_segments(struct flfs_sb_info *sbi)
+{
+	struct dirty_seglist_info *dirty_i = DIRTY_I(sbi);
+	struct free_segmap_info *free_i = FREE_I(sbi);
+	struct sit_info *sit_i = SIT_I(sbi);
+	unsigned int segno;
+
+	mutex_lock(&sit_i->sentry_lock);
+	for_each_set_bit(segno, dirty_i->dirty_segmap[PRE], TOTAL_SEGS(sbi)) {
+		__clear_dirty(sbi, segno, PRE);
+		if (__test_and_clear_bit(segno, free_i->free_segmap))
+			free_i->free_segments++;
+	}
+	mutex_unlock(&sit_i->sentry_lock);
+}
+
+static int build_sit_info(struct flfs_sb_info *sbi)
+{
+	struct flfs_super_block *raw_super = sbi->raw_super;
+	struct flfs_checkpoint *ckpt = FLFS_CKPT(sbi);
+	unsigned int nsegs = TOTAL_SEGS(sbi);
+	struct sit_info *sit_i;
+	unsigned char *maps;
+	unsigned int i;
+
+	sit_i = kzalloc(sizeof(struct sit_info), GFP_KERNEL);
+	if (!sit_i)
+		return -ENOMEM;
+	SM_I(sbi)->sit_info = sit_i;
+
+	sit_i->sentries = vzalloc(nsegs * sizeof(struct seg_entry));
+	if (!sit_i->sentries)
+		return -ENOMEM;
+
+	maps = vzalloc(nsegs * SIT_VBLOCK_MAP_SIZE * 2);
+	if (!maps)
+		return -ENOMEM;
+	for (i = 0; i < nsegs; i++) {
+		sit_i->sentries[i].cur_valid_map = maps;
+		maps += SIT_VBLOCK_MAP_SIZE;
+		sit_i->sentries[i].ckpt_valid_map = maps;
+		maps += SIT_VBLOCK_MAP_SIZE;
+	}
+
+	sit_i->dirty_sentries_bitmap = kzalloc(BITS_TO_LONGS(nsegs) *
+					sizeof(unsigned long), GFP_KERNEL);
+	if (!sit_i->dirty_sentries_bitmap)
+		return -ENOMEM;
+
+	sit_i->bitmap_size = le32_to_cpu(ckpt->sit_ver_bitmap_bytesize);
+	sit_i->sit_bitmap = kmemdup(ckpt->sit_nat_version_bitmap,
+				    sit_i->bitmap_size, GFP_KERNEL);
+	if (!sit_i->sit_bitmap)
+		return -ENOMEM;
+
+	sit_i->sit_base_addr = le32_to_cpu(raw_super->sit_blkaddr);
+	sit_i->sit_blocks = le32_to_cpu(raw_super->sit_blocks);
+	sit_i->sit_copy_offset = (le32_to_cpu(raw_super->segment_count_sit)
+			>> 1) << sbi->log_blocks_per_seg;
+	sit_i->elapsed_time = le64_to_cpu(ckpt->elapsed_time);
+	sit_i->mounted_time = get_seconds();
+	sit_i->min_mtime = ULLONG_MAX;
+	mutex_init(&sit_i->sentry_lock);
+	return 0;
+}
+
+static int build_sit_entries(struct flfs_sb_info *sbi)
+{
+	struct sit_info *sit_i = SIT_I(sbi);
+	unsigned int blk, i;
+
+	for (blk = 0; blk < sit_i->sit_blocks; blk++) {
+		unsigned int start = blk * SIT_ENTRY_PER_BLOCK;
+		unsigned int end = min_t(unsigned int,
+				start + SIT_ENTRY_PER_BLOCK, TOTAL_SEGS(sbi));
+		struct flfs_sit_block *raw;
+		struct buffer_head *bh;
+
+		if (start >= end)
+			break;
+		bh = sb_bread(sbi->sb, current_sit_addr(sbi, blk));
+		if (!bh)
+			return -EIO;
+		raw = (struct flfs_sit_block *)bh->b_data;
+		for (i = start; i < end; i++) {
+			struct flfs_sit_entry *rs = &raw->entries[i - start];
+			struct seg_entry *se = get_seg_entry(sbi, i);
+			u16 vblocks = le16_to_cpu(rs->vblocks);
+
+			se->valid_blocks = vblocks & SIT_VBLOCKS_MASK;
+			se->ckpt_valid_blocks = se->valid_blocks;
+			se->type = vblocks >> SIT_VBLOCKS_SHIFT;
+			se->mtime = le64_to_cpu(rs->mtime);
+			if (se->valid_blocks > sbi->blocks_per_seg ||
+			    se->type >= NR_CURSEG_TYPE) {
+				brelse(bh);
+				return -EINVAL;
+			}
+			memcpy(se->cur_valid_map, rs->valid_map,
+			       SIT_VBLOCK_MAP_SIZE);
+			memcpy(se->ckpt_valid_map, rs->valid_map,
+			       SIT_VBLOCK_MAP_SIZE);
+			if (se->mtime < sit_i->min_mtime)
+				sit_i->min_mtime = se->mtime;
+			if (se->mtime > sit_i->max_mtime)
+				sit_i->max_mtime = se->mtime;
+		}
+		brelse(bh);
+	}
+	return 0;
+}
+
+static int build_curseg(struct flfs_sb_info *sbi)
+{
+	struct flfs_checkpoint *ckpt = FLFS_CKPT(sbi);
+	struct curseg_info *array;
+	block_t start;
+	int i;
+
+	array = kcalloc(NR_CURSEG_TYPE, sizeof(*array), GFP_KERNEL);
+	if (!array)
+		return -ENOMEM;
+	SM_I(sbi)->curseg_array = array;
+
+	start = __start_cp_addr(sbi) + le32_to_cpu(ckpt->cp_pack_start_sum);
+	for (i = 0; i < NR_CURSEG_TYPE; i++) {
+		struct curseg_info *curseg = &array[i];
+		struct buffer_head *bh;
+
+		mutex_init(&curseg->curseg_mutex);
+		curseg->sum_blk = kmalloc(FLFS_BLKSIZE, GFP_KERNEL);
+		if (!curseg->sum_blk)
+			return -ENOMEM;
+
+		bh = sb_bread(sbi->sb, start + i);
+		if (!bh)
+			return -EIO;
+		memcpy(curseg->sum_blk, bh->b_data, FLFS_BLKSIZE);
+		brelse(bh);
+
+		if (IS_NODESEG(i)) {
+			int n = i - CURSEG_HOT_NODE;
+
+			curseg->segno = le32_to_cpu(ckpt->cur_node_segno[n]);
+			curseg->next_blkoff =
+				le16_to_cpu(ckpt->cur_node_blkoff[n]);
+		} else {
+			curseg->segno = le32_to_cpu(ckpt->cur_data_segno[i]);
+			curseg->next_blkoff =
+				le16_to_cpu(ckpt->cur_data_blkoff[i]);
+		}
+		curseg->alloc_type = ckpt->alloc_type[i];
+		if (curseg->segno >= TOTAL_SEGS(sbi) ||
+		    curseg->next_blkoff > sbi->blocks_per_seg)
+			return -EINVAL;
+	}
+	return 0;
+}
+
+static int build_free_segmap(struct flfs_sb_info *sbi)
+{
+	struct free_segmap_info *free_i;
+	unsigned int segno;
+
+	free_i = kzalloc(sizeof(*free_i), GFP_KERNEL);
+	if (!free_i)
+		return -ENOMEM;
+	SM_I(sbi)->free_info = free_i;
+
+	free_i->free_segmap = kzalloc(BITS_TO_LONGS(TOTAL_SEGS(sbi)) *
+				sizeof(unsigned long), GFP_KERNEL);
+	if (!free_i->free_segmap)
+		return -ENOMEM;
+
+	for (segno = 0; segno < TOTAL_SEGS(sbi); segno++) {
+		if (!get_seg_entry(sbi, segno)->valid_blocks &&
+		    !is_curseg(sbi, segno))
+			free_i->free_segments++;
+		else
+			__set_bit(segno, free_i->free_segmap);
+	}
+	return 0;
+}
+
+static int build_dirty_segmap(struct flfs_sb_info *sbi)
+{
+	struct dirty_seglist_info *dirty_i;
+	unsigned int segno;
+	int i;
+
+	dirty_i = kzalloc(sizeof(*dirty_i), GFP_KERNEL);
+	if (!dirty_i)
+		return -ENOMEM;
+	SM_I(sbi)->dirty_info = dirty_i;
+
+	for (i = 0; i < NR_DIRTY_TYPE; i++) {
+		dirty_i->dirty_segmap[i] = kzalloc(BITS_TO_LONGS(
+				TOTAL_SEGS(sbi)) * sizeof(unsigned long),
+				GFP_KERNEL);
+		if (!dirty_i->dirty_segmap[i])
+			return -ENOMEM;
+	}
+	dirty_i->cur_victim = NULL_SEGNO;
+
+	for (segno = 0; segno < TOTAL_SEGS(sbi); segno++) {
+		struct seg_entry *se = get_seg_entry(sbi, segno);
+
+		if (is_curseg(sbi, segno) || !se->valid_blocks)
+			continue;
+		if (se->valid_blocks < sbi->blocks_per_seg) {
+			__set_dirty(sbi, segno, DIRTY);
+			__set_dirty(sbi, segno, se->type);
+		}
+	}
+	return 0;
+}
+
+int build_segment_manager(struct flfs_sb_info *sbi)
+{
+	struct flfs_super_block *raw_super = sbi->raw_super;
+	struct flfs_checkpoint *ckpt = FLFS_CKPT(sbi);
+	struct flfs_sm_info *sm_info;
+	int err;
+
+	sm_info = kzalloc(sizeof(struct flfs_sm_info), GFP_KERNEL);
+	if (!sm_info)
+		return -ENOMEM;
+	sbi->sm_info = sm_info;
+
+	sm_info->main_blkaddr = le32_to_cpu(raw_super->main_blkaddr);
+	sm_info->ssa_blkaddr = le32_to_cpu(raw_super->ssa_blkaddr);
+	sm_info->segment_count = le32_to_cpu(raw_super->segment_count);
+	sm_info->main_segments = le32_to_cpu(raw_super->segment_count_main);
+	sm_info->reserved_segments = le32_to_cpu(ckpt->rsvd_segment_count);
+	sm_info->ovp_segments = le32_to_cpu(ckpt->overprov_segment_count);
+	sm_info->ssr_threshold = max(sm_info->ovp_segments,
+				     sm_info->reserved_segments * 2);
+
+	err = build_sit_info(sbi);
+	if (err)
+		return err;
+	err = build_curseg(sbi);
+	if (err)
+		return err;
+	err = build_sit_entries(sbi);
+	if (err)
+		return err;
+	err = build_free_segmap(sbi);
+	if (err)
+		return err;
+	return build_dirty_segmap(sbi);
+}
+
+void destroy_segment_manager(struct flfs_sb_info *sbi)
+{
+	struct flfs_sm_info *sm_info = SM_I(sbi);
+	int i;
+
+	if (!sm_info)
+		return;
+
+	if (sm_info->dirty_info) {
+		for (i = 0; i < NR_DIRTY_TYPE; i++)
+			kfree(sm_info->dirty_info->dirty_segmap[i]);
+		kfree(sm_info->dirty_info);
+	}
+	if (sm_info->free_info) {
+		kfree(sm_info->free_info->free_segmap);
+		kfree(sm_info->free_info);
+	}
+	if (sm_info->curseg_array) {
+		for (i = 0; i < NR_CURSEG_TYPE; i++)
+			kfree(sm_info->curseg_array[i].sum_blk);
+		kfree(sm_info->curseg_array);
+	}
+	if (sm_info->sit_info) {
+		struct sit_info *sit_i = sm_info->sit_info;
+
+		if (sit_i->sentries) {
+			vfree(sit_i->sentries[0].cur_valid_map);
+			vfree(sit_i->sentries);
+		}
+		kfree(sit_i->dirty_sentries_bitmap);
+		kfree(sit_i->sit_bitmap);
+		kfree(sit_i);
+	}
+	sbi->sm_info = NULL;
+	kfree(sm_info);
+}
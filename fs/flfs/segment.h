@@ -0,0 +1,192 @@
+/*
+ * fs/flfs/segment.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef _FLFS_SEGMENT_H
+#define _FLFS_SEGMENT_H
+
+#define NULL_SEGNO			((unsigned int)(~0))
+
+#define LFS				0
+#define SSR				1
+
+#define IS_DATASEG(t)			((t) <= CURSEG_COLD_DATA)
+#define IS_NODESEG(t)			((t) >= CURSEG_HOT_NODE)
+
+enum dirty_type {
+	DIRTY_HOT_DATA,
+	DIRTY_WARM_DATA,
+	DIRTY_COLD_DATA,
+	DIRTY_HOT_NODE,
+	DIRTY_WARM_NODE,
+	DIRTY_COLD_NODE,
+	DIRTY,
+	PRE,
+	NR_DIRTY_TYPE,
+};
+
+struct seg_entry {
+	unsigned short valid_blocks;
+	unsigned short ckpt_valid_blocks;
+	unsigned char *cur_valid_map;
+	unsigned char *ckpt_valid_map;
+	unsigned char type;
+	unsigned long long mtime;
+};
+
+struct sit_info {
+	block_t sit_base_addr;
+	block_t sit_blocks;
+	unsigned int sit_copy_offset;
+	char *sit_bitmap;
+	unsigned int bitmap_size;
+
+	unsigned long *dirty_sentries_bitmap;
+	unsigned int dirty_sentries;
+	struct seg_entry *sentries;
+	struct mutex sentry_lock;
+
+	unsigned long long elapsed_time;
+	unsigned long long mounted_time;
+	unsigned long long min_mtime;
+	unsigned long long max_mtime;
+};
+
+struct free_segmap_info {
+	unsigned int free_segments;
+	unsigned long *free_segmap;
+};
+
+struct dirty_seglist_info {
+	unsigned long *dirty_segmap[NR_DIRTY_TYPE];
+	int nr_dirty[NR_DIRTY_TYPE];
+	unsigned int last_victim[2];
+	unsigned int cur_victim;
+};
+
+struct curseg_info {
+	struct mutex curseg_mutex;
+	struct flfs_summary_block *sum_blk;
+	unsigned char alloc_type;
+	unsigned int segno;
+	unsigned short next_blkoff;
+};
+
+struct flfs_sm_info {
+	struct sit_info *sit_info;
+	struct free_segmap_info *free_info;
+	struct dirty_seglist_info *dirty_info;
+	struct curseg_info *curseg_array;
+
+	block_t main_blkaddr;
+	block_t ssa_blkaddr;
+	unsigned int segment_count;
+	unsigned int main_segments;
+	unsigned int reserved_segments;
+	unsigned int ovp_segments;
+	unsigned int ssr_threshold;
+};
+
+static inline struct flfs_sm_info *SM_I(struct flfs_sb_info *sbi)
+{
+	return sbi->sm_info;
+}
+
+static inline struct sit_info *SIT_I(struct flfs_sb_info *sbi)
+{
+	return sbi->sm_info->sit_info;
+}
+
+static inline struct free_segmap_info *FREE_I(struct flfs_sb_info *sbi)
+{
+	return sbi->sm_info->free_info;
+}
+
+static inline struct dirty_seglist_info *DIRTY_I(struct flfs_sb_info *sbi)
+{
+	return sbi->sm_info->dirty_info;
+}
+
+static inline struct curseg_info *CURSEG_I(struct flfs_sb_info *sbi, int type)
+{
+	return &sbi->sm_info->curseg_array[type];
+}
+
+static inline struct seg_entry *get_seg_entry(struct flfs_sb_info *sbi,
+						unsigned int segno)
+{
+	return &SIT_I(sbi)->sentries[segno];
+}
+
+#define MAIN_BLKADDR(sbi)		(SM_I(sbi)->main_blkaddr)
+#define TOTAL_SEGS(sbi)			(SM_I(sbi)->main_segments)
+#define START_BLOCK(sbi, segno)		(MAIN_BLKADDR(sbi) + \
+					((block_t)(segno) << (sbi)->log_blocks_per_seg))
+#define GET_SEGNO(sbi, blk)		((((blk) == NULL_ADDR) || \
+					((blk) == NEW_ADDR)) ? NULL_SEGNO : \
+					(((blk) - MAIN_BLKADDR(sbi)) >> \
+					(sbi)->log_blocks_per_seg))
+#define GET_BLKOFF(sbi, blk)		(((blk) - MAIN_BLKADDR(sbi)) & \
+					((sbi)->blocks_per_seg - 1))
+#define NEXT_FREE_BLKADDR(sbi, curseg)	(START_BLOCK(sbi, (curseg)->segno) + \
+					(curseg)->next_blkoff)
+#define GET_SUM_BLKADDR(sbi, segno)	(SM_I(sbi)->ssa_blkaddr + (segno))
+
+static inline unsigned int free_segments(struct flfs_sb_info *sbi)
+{
+	return FREE_I(sbi)->free_segments;
+}
+
+static inline int prefree_segments(struct flfs_sb_info *sbi)
+{
+	return DIRTY_I(sbi)->nr_dirty[PRE];
+}
+
+static inline int dirty_segments(struct flfs_sb_info *sbi)
+{
+	return DIRTY_I(sbi)->nr_dirty[DIRTY];
+}
+
+static inline unsigned int reserved_segments(struct flfs_sb_info *sbi)
+{
+	return SM_I(sbi)->reserved_segments;
+}
+
+static inline bool is_curseg(struct flfs_sb_info *sbi, unsigned int segno)
+{
+	int i;
+
+	for (i = 0; i < NR_CURSEG_TYPE; i++)
+		if (CURSEG_I(sbi, i)->segno == segno)
+			return true;
+	return false;
+}
+
+static inline bool has_not_enough_free_segs(struct flfs_sb_info *sbi)
+{
+	int node_segs = (get_pages(sbi, FLFS_DIRTY_NODES) +
+				sbi->blocks_per_seg - 1) >> sbi->log_blocks_per_seg;
+	int dent_segs = (get_pages(sbi, FLFS_DIRTY_DENTS) +
+				sbi->blocks_per_seg - 1) >> sbi->log_blocks_per_seg;
+
+	return free_segments(sbi) <=
+		reserved_segments(sbi) + node_segs + 2 * dent_segs;
+}
+
+static inline bool need_SSR(struct flfs_sb_info *sbi)
+{
+	return !test_opt(sbi, DISABLE_SSR) &&
+		free_segments(sbi) < SM_I(sbi)->ssr_threshold;
+}
+
+static inline unsigned long long get_mtime(struct flfs_sb_info *sbi)
+{
+	struct sit_info *sit_i = SIT_I(sbi);
+
+	return sit_i->elapsed_time + get_seconds() - sit_i->mounted_time;
+}
+
+#endif
@@ -0,0 +1,599 @@
+/*
+ * fs/flfs/super.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/fs.h>
+#include <linux/statfs.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/buffer_head.h>
+#include <linux/backing-dev.h>
+#include <linux/kthread.h>
+#include <linux/parser.h>
+#include <linux/mount.h>
+#include <linux/random.h>
+#include <linux/exportfs.h>
+
+#include "flfs.h"
+#include "node.h"
+#include "segment.h"
+
+static struct kmem_cache *flfs_inode_cachep;
+static struct proc_dir_entry *flfs_proc_root;
+
+enum {
+	Opt_gc_background_off,
+	Opt_disable_ssr,
+	Opt_err,
+};
+
+static match_table_t flfs_tokens = {
+	{Opt_gc_background_off, "background_gc_off"},
+	{Opt_disable_ssr, "disable_ssr"},
+	{Opt_err, NULL},
+};
+
+static int parse_options(struct super_block *sb, struct flfs_sb_info *sbi,
+			char *options)
+{
+	substring_t args[MAX_OPT_ARGS];
+	char *p;
+
+	if (!options)
+		return 0;
+
+	while ((p = strsep(&options, ",")) != NULL) {
+		int token;
+
+		if (!*p)
+			continue;
+		token = match_token(p, flfs_tokens, args);
+		switch (token) {
+		case Opt_gc_background_off:
+			clear_opt(sbi, BG_GC);
+			break;
+		case Opt_disable_ssr:
+			set_opt(sbi, DISABLE_SSR);
+			break;
+		default:
+			flfs_msg(sb, KERN_ERR,
+				 "unrecognized mount option \"%s\"", p);
+			return -EINVAL;
+		}
+	}
+	return 0;
+}
+
+static struct inode *flfs_alloc_inode(struct super_block *sb)
+{
+	struct flfs_inode_info *fi;
+
+	fi = kmem_cache_alloc(flfs_inode_cachep, GFP_NOFS);
+	if (!fi)
+		return NULL;
+
+	fi->vfs_inode.i_version = 1;
+	fi->flags = 0;
+	fi->i_current_depth = 0;
+	fi->i_pino = 0;
+	fi->i_advise = 0;
+	fi->i_ext_flags = 0;
+	INIT_LIST_HEAD(&fi->dirty_dir);
+	atomic_set(&fi->dirty_dents, 0);
+	return &fi->vfs_inode;
+}
+
+static void flfs_i_callback(struct rcu_head *head)
+{
+	struct inode *inode = container_of(head, struct inode, i_rcu);
+
+	kmem_cache_free(flfs_inode_cachep, FLFS_I(inode));
+}
+
+static void flfs_destroy_inode(struct inode *inode)
+{
+	call_rcu(&inode->i_rcu, flfs_i_callback);
+}
+
+static void init_once(void *foo)
+{
+	struct flfs_inode_info *fi = foo;
+
+	inode_init_once(&fi->vfs_inode);
+}
+
+static int flfs_status_show(struct seq_file *seq, void *v)
+{
+	struct super_block *sb = seq->private;
+	struct flfs_sb_info *sbi = FLFS_SB(sb);
+	int i;
+
+	seq_printf(seq, "segments: main %u free %u prefree %d dirty %d "
+		   "reserved %u overprov %u\n",
+		   TOTAL_SEGS(sbi), free_segments(sbi),
+		   prefree_segments(sbi), dirty_segments(sbi),
+		   reserved_segments(sbi), SM_I(sbi)->ovp_segments);
+	seq_printf(seq, "blocks: valid %u user %u\n",
+		   sbi->total_valid_block_count, sbi->user_block_count);
+	seq_printf(seq, "nodes: valid %u max %u inodes %u\n",
+		   sbi->total_valid_node_count, sbi->total_node_count,
+		   sbi->total_valid_inode_count);
+	seq_printf(seq, "dirty: nodes %d dents %d writeback %d\n",
+		   get_pages(sbi, FLFS_DIRTY_NODES),
+		   get_pages(sbi, FLFS_DIRTY_DENTS),
+		   get_pages(sbi, FLFS_WRITEBACK));
+	seq_printf(seq, "gc: bg %lu fg %lu segments %lu node_blocks %lu "
+		   "data_blocks %lu\n",
+		   sbi->stat.bg_gc, sbi->stat.fg_gc, sbi->stat.gc_segments,
+		   sbi->stat.gc_node_blocks, sbi->stat.gc_data_blocks);
+	seq_printf(seq, "alloc: lfs %lu ssr %lu ssr_threshold %u\n",
+		   sbi->stat.lfs_segments, sbi->stat.ssr_segments,
+		   SM_I(sbi)->ssr_threshold);
+	seq_printf(seq, "checkpoints: %lu\n", sbi->stat.checkpoints);
+
+	for (i = 0; i < NR_CURSEG_TYPE; i++) {
+		struct curseg_info *curseg = CURSEG_I(sbi, i);
+
+		seq_printf(seq, "curseg %d: segno %u blkoff %u %s\n", i,
+			   curseg->segno, curseg->next_blkoff,
+			   curseg->alloc_type == SSR ? "ssr" : "lfs");
+	}
+	return 0;
+}
+
+static int flfs_status_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, flfs_status_show, PDE(inode)->data);
+}
+
+static const struct file_operations flfs_status_fops = {
+	.owner		= THIS_MODULE,
+	.open		= flfs_status_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void flfs_put_super(struct super_block *sb)
+{
+	struct flfs_sb_info *sbi = FLFS_SB(sb);
+
+	if (sbi->s_proc) {
+		remove_proc_entry("status", sbi->s_proc);
+		remove_proc_entry(sb->s_id, flfs_proc_root);
+	}
+	stop_gc_thread(sbi);
+
+	if (!flfs_readonly(sb))
+		write_checkpoint(sbi, true);
+
+	iput(sbi->node_inode);
+	destroy_node_manager(sbi);
+	destroy_segment_manager(sbi);
+
+	kfree(sbi->ckpt);
+	brelse(sbi->raw_super_buf);
+	sb->s_fs_info = NULL;
+	kfree(sbi);
+}
+
+int flfs_sync_fs(struct super_block *sb, int sync)
+{
+	struct flfs_sb_info *sbi = FLFS_SB(sb);
+
+	if (!sync || flfs_readonly(sb))
+		return 0;
+
+	write_checkpoint(sbi, false);
+	return sbi->cp_error ? -EIO : 0;
+}
+
+static int flfs_statfs(struct dentry *dentry, struct kstatfs *buf)
+{
+	struct super_block *sb = dentry->d_sb;
+	struct flfs_sb_info *sbi = FLFS_SB(sb);
+	u64 id = huge_encode_dev(sb->s_bdev->bd_dev);
+
+	buf->f_type = FLFS_SUPER_MAGIC;
+	buf->f_bsize = FLFS_BLKSIZE;
+	buf->f_blocks = sbi->user_block_count;
+	buf->f_bfree = sbi->user_block_count - sbi->total_valid_block_count;
+	buf->f_bavail = buf->f_bfree;
+	buf->f_files = sbi->total_node_count;
+	buf->f_ffree = sbi->total_node_count - sbi->total_valid_node_count;
+	buf->f_namelen = FLFS_NAME_LEN;
+	buf->f_fsid.val[0] = (u32)id;
+	buf->f_fsid.val[1] = (u32)(id >> 32);
+	return 0;
+}
+
+static int flfs_show_options(struct seq_file *seq, struct dentry *root)
+{
+	struct flfs_sb_info *sbi = FLFS_SB(root->d_sb);
+
+	if (!test_opt(sbi, BG_GC))
+		seq_puts(seq, ",background_gc_off");
+	if (test_opt(sbi, DISABLE_SSR))
+		seq_puts(seq, ",disable_ssr");
+	return 0;
+}
+
+static int flfs_remount(struct super_block *sb, int *flags, char *data)
+{
+	struct flfs_sb_info *sbi = FLFS_SB(sb);
+	unsigned int old_mount_opt = sbi->mount_opt;
+	int err;
+
+	sbi->mount_opt = FLFS_MOUNT_BG_GC;
+	err = parse_options(sb, sbi, data);
+	if (err) {
+		sbi->mount_opt = old_mount_opt;
+		return err;
+	}
+
+	if ((*flags & MS_RDONLY) == flfs_readonly(sb))
+		return 0;
+
+	if (*flags & MS_RDONLY) {
+		stop_gc_thread(sbi);
+		write_checkpoint(sbi, true);
+	} else {
+		err = start_gc_thread(sbi);
+		if (err) {
+			sbi->mount_opt = old_mount_opt;
+			return err;
+		}
+	}
+	return 0;
+}
+
+static const struct super_operations flfs_sops = {
+	.alloc_inode	= flfs_alloc_inode,
+	.destroy_inode	= flfs_destroy_inode,
+	.write_inode	= flfs_write_inode,
+	.evict_inode	= flfs_evict_inode,
+	.put_super	= flfs_put_super,
+	.sync_fs	= flfs_sync_fs,
+	.statfs		= flfs_statfs,
+	.show_options	= flfs_show_options,
+	.remount_fs	= flfs_remount,
+};
+
+static struct inode *flfs_nfs_get_inode(struct super_block *sb,
+			u64 ino, u32 generation)
+{
+	struct inode *inode;
+
+	if (ino < FLFS_ROOT_INO)
+		return ERR_PTR(-ESTALE);
+
+	inode = flfs_iget(sb, ino);
+	if (IS_ERR(inode))
+		return ERR_CAST(inode);
+	if (generation && inode->i_generation != generation) {
+		iput(inode);
+		return ERR_PTR(-ESTALE);
+	}
+	return inode;
+}
+
+static struct dentry *flfs_fh_to_dentry(struct super_block *sb,
+			struct fid *fid, int fh_len, int fh_type)
+{
+	return generic_fh_to_dentry(sb, fid, fh_len, fh_type,
+				    flfs_nfs_get_inode);
+}
+
+static struct dentry *flfs_fh_to_parent(struct super_block *sb,
+			struct fid *fid, int fh_len, int fh_type)
+{
+	return generic_fh_to_parent(sb, fid, fh_len, fh_type,
+				    flfs_nfs_get_inode);
+}
+
+static const struct export_operations flfs_export_ops = {
+	.fh_to_dentry	= flfs_fh_to_dentry,
+	.fh_to_parent	= flfs_fh_to_parent,
+	.get_parent	= flfs_get_parent,
+};
+
+static loff_t max_file_size(void)
+{
+	loff_t leaf_count = ADDRS_PER_INODE;
+
+	leaf_count += 2 * ADDRS_PER_BLOCK;
+	leaf_count += 2 * (loff_t)ADDRS_PER_BLOCK * NIDS_PER_BLOCK;
+	leaf_count += (loff_t)ADDRS_PER_BLOCK * NIDS_PER_BLOCK * NIDS_PER_BLOCK;
+
+	return min_t(loff_t, leaf_count << FLFS_LOG_BLKSIZE, MAX_LFS_FILESIZE);
+}
+
+static int sanity_check_raw_super(struct super_block *sb,
+			struct flfs_super_block *raw_super)
+{
+	u32 segment_count, crc;
+
+	if (le32_to_cpu(raw_super->magic) != FLFS_SUPER_MAGIC)
+		return 1;
+
+	crc = flfs_crc32(raw_super, offsetof(struct flfs_super_block,
+					     checksum));
+	if (le32_to_cpu(raw_super->checksum) != crc) {
+		flfs_msg(sb, KERN_INFO, "bad superblock checksum");
+		return 1;
+	}
+
+	if (le32_to_cpu(raw_super->log_blocksize) != FLFS_LOG_BLKSIZE ||
+	    le32_to_cpu(raw_super->log_blocks_per_seg) !=
+						FLFS_LOG_BLOCKS_PER_SEG) {
+		flfs_msg(sb, KERN_INFO, "unsupported block or segment size");
+		return 1;
+	}
+
+	segment_count = le32_to_cpu(raw_super->segment_count_ckpt) +
+			le32_to_cpu(raw_super->segment_count_sit) +
+			le32_to_cpu(raw_super->segment_count_nat) +
+			le32_to_cpu(raw_super->segment_count_ssa) +
+			le32_to_cpu(raw_super->segment_count_main);
+	if (segment_count >= le32_to_cpu(raw_super->segment_count) ||
+	    le32_to_cpu(raw_super->segment_count_ckpt) != 2 ||
+	    le32_to_cpu(raw_super->root_ino) != FLFS_ROOT_INO ||
+	    le32_to_cpu(raw_super->node_ino) != FLFS_NODE_INO ||
+	    le32_to_cpu(raw_super->meta_ino) != FLFS_META_INO) {
+		flfs_msg(sb, KERN_INFO, "invalid superblock layout");
+		return 1;
+	}
+	return 0;
+}
+
+static int read_raw_super_block(struct super_block *sb,
+			struct flfs_super_block **raw_super,
+			struct buffer_head **raw_super_buf)
+{
+	int block;
+
+	for (block = 0; block < 2; block++) {
+		*raw_super_buf = sb_bread(sb, block);
+		if (!*raw_super_buf)
+			continue;
+		*raw_super = (struct flfs_super_block *)
+			((char *)(*raw_super_buf)->b_data + FLFS_SUPER_OFFSET);
+		if (!sanity_check_raw_super(sb, *raw_super))
+			return 0;
+		brelse(*raw_super_buf);
+	}
+	*raw_super_buf = NULL;
+	return -EINVAL;
+}
+
+static void init_sb_info(struct flfs_sb_info *sbi)
+{
+	struct flfs_super_block *raw_super = sbi->raw_super;
+	struct flfs_checkpoint *ckpt = FLFS_CKPT(sbi);
+
+	sbi->log_blocks_per_seg = le32_to_cpu(raw_super->log_blocks_per_seg);
+	sbi->blocks_per_seg = 1 << sbi->log_blocks_per_seg;
+
+	sbi->user_block_count = le64_to_cpu(ckpt->user_block_count);
+	sbi->total_valid_block_count = le64_to_cpu(ckpt->valid_block_count);
+	sbi->total_valid_node_count = le32_to_cpu(ckpt->valid_node_count);
+	sbi->total_valid_inode_count = le32_to_cpu(ckpt->valid_inode_count);
+	sbi->max_orphans = (sbi->blocks_per_seg - 2 - NR_CURSEG_TYPE) *
+						FLFS_ORPHANS_PER_BLOCK;
+}
+
+static int flfs_fill_super(struct super_block *sb, void *data, int silent)
+{
+	struct flfs_sb_info *sbi;
+	struct inode *root;
+	int i, err;
+
+	sbi = kzalloc(sizeof(struct flfs_sb_info), GFP_KERNEL);
+	if (!sbi)
+		return -ENOMEM;
+
+	set_opt(sbi, BG_GC);
+	err = parse_options(sb, sbi, data);
+	if (err)
+		goto free_sbi;
+
+	err = -EINVAL;
+	if (!sb_set_blocksize(sb, FLFS_BLKSIZE)) {
+		flfs_msg(sb, KERN_ERR, "unable to set blocksize");
+		goto free_sbi;
+	}
+
+	if (read_raw_super_block(sb, &sbi->raw_super, &sbi->raw_super_buf)) {
+		if (!silent)
+			flfs_msg(sb, KERN_ERR, "cannot find a valid superblock");
+		goto free_sbi;
+	}
+
+	sb->s_fs_info = sbi;
+	sbi->sb = sb;
+	sb->s_maxbytes = max_file_size();
+	sb->s_max_links = FLFS_LINK_MAX;
+	sb->s_magic = FLFS_SUPER_MAGIC;
+	sb->s_op = &flfs_sops;
+	sb->s_export_op = &flfs_export_ops;
+	sb->s_time_gran = 1;
+	sb->s_flags &= ~MS_POSIXACL;
+	memcpy(sb->s_uuid, sbi->raw_super->uuid, sizeof(sb->s_uuid));
+
+	mutex_init(&sbi->cp_mutex);
+	init_rwsem(&sbi->cp_rwsem);
+	mutex_init(&sbi->node_write);
+	mutex_init(&sbi->gc_mutex);
+	init_waitqueue_head(&sbi->cp_wait);
+	INIT_LIST_HEAD(&sbi->orphan_inode_list);
+	mutex_init(&sbi->orphan_inode_mutex);
+	INIT_LIST_HEAD(&sbi->dir_inode_list);
+	spin_lock_init(&sbi->dir_inode_lock);
+	spin_lock_init(&sbi->stat_lock);
+	for (i = 0; i < NR_PAGE_TYPE; i++)
+		mutex_init(&sbi->write_io[i].io_mutex);
+	for (i = 0; i < NR_COUNT_TYPE; i++)
+		atomic_set(&sbi->nr_pages[i], 0);
+	get_random_bytes(&sbi->s_next_generation, sizeof(u32));
+	sbi->blocks_per_seg = 1 << le32_to_cpu(sbi->raw_super->log_blocks_per_seg);
+
+	err = get_valid_checkpoint(sbi);
+	if (err) {
+		flfs_msg(sb, KERN_ERR, "cannot find a valid checkpoint");
+		goto free_sb_buf;
+	}
+	init_sb_info(sbi);
+
+	if (is_set_ckpt_flags(FLFS_CKPT(sbi), CP_ERROR_FLAG)) {
+		flfs_msg(sb, KERN_WARNING,
+			 "previous I/O error recorded, mounting read-only");
+		sb->s_flags |= MS_RDONLY;
+	}
+
+	err = build_segment_manager(sbi);
+	if (err) {
+		flfs_msg(sb, KERN_ERR, "failed to build segment manager");
+		goto free_sm;
+	}
+	err = build_node_manager(sbi);
+	if (err) {
+		flfs_msg(sb, KERN_ERR, "failed to build node manager");
+		goto free_nm;
+	}
+
+	sbi->node_inode = flfs_iget(sb, FLFS_NODE_INO);
+	if (IS_ERR(sbi->node_inode)) {
+		err = PTR_ERR(sbi->node_inode);
+		sbi->node_inode = NULL;
+		goto free_nm;
+	}
+
+	root = flfs_iget(sb, FLFS_ROOT_INO);
+	if (IS_ERR(root)) {
+		flfs_msg(sb, KERN_ERR, "failed to read root inode");
+		err = PTR_ERR(root);
+		goto free_node_inode;
+	}
+	if (!S_ISDIR(root->i_mode) || !root->i_blocks) {
+		iput(root);
+		err = -EINVAL;
+		goto free_node_inode;
+	}
+
+	sb->s_root = d_make_root(root);
+	if (!sb->s_root) {
+		err = -ENOMEM;
+		goto free_node_inode;
+	}
+
+	if (!flfs_readonly(sb)) {
+		err = recover_orphan_inodes(sbi);
+		if (err)
+			goto free_root;
+		err = start_gc_thread(sbi);
+		if (err)
+			goto free_root;
+	}
+
+	if (flfs_proc_root)
+		sbi->s_proc = proc_mkdir(sb->s_id, flfs_proc_root);
+	if (sbi->s_proc)
+		proc_create_data("status", S_IRUGO, sbi->s_proc,
+				 &flfs_status_fops, sb);
+	return 0;
+
+free_root:
+	dput(sb->s_root);
+	sb->s_root = NULL;
+free_node_inode:
+	iput(sbi->node_inode);
+free_nm:
+	destroy_node_manager(sbi);
+free_sm:
+	destroy_segment_manager(sbi);
+	kfree(sbi->ckpt);
+free_sb_buf:
+	brelse(sbi->raw_super_buf);
+free_sbi:
+	sb->s_fs_info = NULL;
+	kfree(sbi);
+	return err;
+}
+
+static struct dentry *flfs_mount(struct file_system_type *fs_type, int flags,
+			const char *dev_name, void *data)
+{
+	return mount_bdev(fs_type, flags, dev_name, data, flfs_fill_super);
+}
+
+static struct file_system_type flfs_fs_type = {
+	.owner		= THIS_MODULE,
+	.name		= "flfs",
+	.mount		= flfs_mount,
+	.kill_sb	= kill_block_super,
+	.fs_flags	= FS_REQUIRES_DEV,
+};
+
+static int __init init_inodecache(void)
+{
+	flfs_inode_cachep = kmem_cache_create("flfs_inode_cache",
+			sizeof(struct flfs_inode_info), 0,
+			SLAB_RECLAIM_ACCOUNT | SLAB_MEM_SPREAD, init_once);
+	if (!flfs_inode_cachep)
+		return -ENOMEM;
+	return 0;
+}
+
+static void destroy_inodecache(void)
+{
+	kmem_cache_destroy(flfs_inode_cachep);
+}
+
+static int __init init_flfs_fs(void)
+{
+	int err;
+
+	err = init_inodecache();
+	if (err)
+		goto fail;
+	err = create_node_manager_caches();
+	if (err)
+		goto free_inodecache;
+	err = create_checkpoint_caches();
+	if (err)
+		goto free_node_caches;
+	err = register_filesystem(&flfs_fs_type);
+	if (err)
+		goto free_cp_caches;
+	flfs_proc_root = proc_mkdir("fs/flfs", NULL);
+	return 0;
+
+free_cp_caches:
+	destroy_checkpoint_caches();
+free_node_caches:
+	destroy_node_manager_caches();
+free_inodecache:
+	destroy_inodecache();
+fail:
+	return err;
+}
+
+static void __exit exit_flfs_fs(void)
+{
+	remove_proc_entry("fs/flfs", NULL);
+	unregister_filesystem(&flfs_fs_type);
+	destroy_checkpoint_caches();
+	destroy_node_manager_caches();
+	destroy_inodecache();
+}
+
+module_init(init_flfs_fs)
+module_exit(exit_flfs_fs)
+
+MODULE_DESCRIPTION("Flash-friendly log-structured file system");
+MODULE_LICENSE("GPL");
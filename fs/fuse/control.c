@@ -10,6 +10,7 @@
 
 #include <linux/init.h>
 #include <linux/module.h>
+#include <linux/slab.h>
 
 #define FUSE_CTL_SUPER_MAGIC 0x65735543
 
@@ -172,6 +173,54 @@ static ssize_t fuse_conn_congestion_threshold_write(struct file *file,
 	return ret;
 }
 
+static ssize_t fuse_conn_queue_stats_read(struct file *file,
+					  char __user *buf, size_t len,
+					  loff_t *ppos)
+{
+	struct fuse_conn *fc;
+	size_t size = 0;
+	size_t bufsize;
+	ssize_t ret;
+	char *tmp;
+	int cpu;
+
+	fc = fuse_ctl_file_conn_get(file);
+	if (!fc)
+		return 0;
+
+	bufsize = 128 * (num_possible_cpus() + 1);
+	tmp = kmalloc(bufsize, GFP_KERNEL);
+	if (!tmp) {
+		fuse_conn_put(fc);
+		return -ENOMEM;
+	}
+
+	size += scnprintf(tmp + size, bufsize - size,
+			  "cpu dispatched stolen contended avg_wait_us max_wait_us\n");
+	spin_lock(&fc->lock);
+	for_each_possible_cpu(cpu) {
+		struct fuse_iqueue *iq = per_cpu_ptr(fc->iqs, cpu);
+		u64 avg = 0;
+
+		if (iq->dispatched) {
+			avg = iq->wait_time;
+			do_div(avg, iq->dispatched);
+		}
+		size += scnprintf(tmp + size, bufsize - size,
+				  "%d %lu %lu %lu %llu %llu\n", cpu,
+				  iq->dispatched, iq->stolen, iq->contended,
+				  div_u64(avg, NSEC_PER_USEC),
+				  div_u64(iq->max_wait_time, NSEC_PER_USEC));
+	}
+	spin_unlock(&fc->lock);
+	fuse_conn_put(fc);
+
+	ret = simple_read_from_buffer(buf, len, ppos, tmp, size);
+	kfree(tmp);
+
+	return ret;
+}
+
 static const struct file_operations fuse_ctl_abort_ops = {
 	.open = nonseekable_open,
 	.write = fuse_conn_abort_write,
@@ -184,6 +233,12 @@ static const struct file_operations fuse_ctl_waiting_ops = {
 	.llseek = no_llseek,
 };
 
+static const struct file_operations fuse_ctl_queue_stats_ops = {
+	.open = nonseekable_open,
+	.read = fuse_conn_queue_stats_read,
+	.llseek = no_llseek,
+};
+
 static const struct file_operations fuse_conn_max_background_ops = {
 	.open = nonseekable_open,
 	.read = fuse_conn_max_background_read,
@@ -258,7 +313,9 @@ int fuse_ctl_add_conn(struct fuse_conn *fc)
 				 1, NULL, &fuse_conn_max_background_ops) ||
 	    !fuse_ctl_add_dentry(parent, fc, "congestion_threshold",
 				 S_IFREG | 0600, 1, NULL,
-				 &fuse_conn_congestion_threshold_ops))
+				 &fuse_conn_congestion_threshold_ops) ||
+	    !fuse_ctl_add_dentry(parent, fc, "queue_stats", S_IFREG | 0400, 1,
+				 NULL, &fuse_ctl_queue_stats_ops))
 		goto err;
 
 	return 0;
@@ -486,7 +486,11 @@ static int cuse_channel_open(struct inode *inode, struct file *file)
 	if (!cc)
 		return -ENOMEM;
 
-	fuse_conn_init(&cc->fc);
+	rc = fuse_conn_init(&cc->fc);
+	if (rc) {
+		kfree(cc);
+		return rc;
+	}
 
 	INIT_LIST_HEAD(&cc->list);
 	cc->fc.release = cuse_fc_release;
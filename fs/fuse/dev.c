@@ -31,34 +31,54 @@ static struct fuse_conn *fuse_get_conn(struct file *file)
 	return file->private_data;
 }
 
-static void fuse_request_init(struct fuse_req *req)
+static void fuse_request_init(struct fuse_req *req, struct page **pages,
+			      unsigned npages)
 {
 	memset(req, 0, sizeof(*req));
 	INIT_LIST_HEAD(&req->list);
 	INIT_LIST_HEAD(&req->intr_entry);
 	init_waitqueue_head(&req->waitq);
 	atomic_set(&req->count, 1);
+	req->pages = pages;
+	req->max_pages = npages;
 }
 
-struct fuse_req *fuse_request_alloc(void)
+static struct fuse_req *__fuse_request_alloc(unsigned npages, gfp_t flags)
 {
-	struct fuse_req *req = kmem_cache_alloc(fuse_req_cachep, GFP_KERNEL);
-	if (req)
-		fuse_request_init(req);
+	struct fuse_req *req = kmem_cache_alloc(fuse_req_cachep, flags);
+	if (req) {
+		struct page **pages;
+
+		if (npages <= FUSE_MAX_PAGES_PER_REQ)
+			pages = req->inline_pages;
+		else
+			pages = kmalloc(sizeof(struct page *) * npages, flags);
+
+		if (!pages) {
+			kmem_cache_free(fuse_req_cachep, req);
+			return NULL;
+		}
+
+		fuse_request_init(req, pages, npages);
+	}
 	return req;
 }
+
+struct fuse_req *fuse_request_alloc(void)
+{
+	return __fuse_request_alloc(FUSE_MAX_PAGES_PER_REQ, GFP_KERNEL);
+}
 EXPORT_SYMBOL_GPL(fuse_request_alloc);
 
-struct fuse_req *fuse_request_alloc_nofs(void)
+struct fuse_req *fuse_request_alloc_nofs(unsigned npages)
 {
-	struct fuse_req *req = kmem_cache_alloc(fuse_req_cachep, GFP_NOFS);
-	if (req)
-		fuse_request_init(req);
-	return req;
+	return __fuse_request_alloc(npages, GFP_NOFS);
 }
 
 void fuse_request_free(struct fuse_req *req)
 {
+	if (req->pages != req->inline_pages)
+		kfree(req->pages);
 	kmem_cache_free(fuse_req_cachep, req);
 }
 
@@ -93,7 +113,7 @@ static void fuse_req_init_context(struct fuse_req *req)
 	req->in.h.pid = current->pid;
 }
 
-struct fuse_req *fuse_get_req(struct fuse_conn *fc)
+struct fuse_req *fuse_get_req_pages(struct fuse_conn *fc, unsigned npages)
 {
 	struct fuse_req *req;
 	sigset_t oldset;
@@ -112,7 +132,7 @@ struct fuse_req *fuse_get_req(struct fuse_conn *fc)
 	if (!fc->connected)
 		goto out;
 
-	req = fuse_request_alloc();
+	req = __fuse_request_alloc(npages, GFP_KERNEL);
 	err = -ENOMEM;
 	if (!req)
 		goto out;
@@ -125,6 +145,12 @@ struct fuse_req *fuse_get_req(struct fuse_conn *fc)
 	atomic_dec(&fc->num_waiting);
 	return ERR_PTR(err);
 }
+EXPORT_SYMBOL_GPL(fuse_get_req_pages);
+
+struct fuse_req *fuse_get_req(struct fuse_conn *fc)
+{
+	return fuse_get_req_pages(fc, FUSE_MAX_PAGES_PER_REQ);
+}
 EXPORT_SYMBOL_GPL(fuse_get_req);
 
 static struct fuse_req *get_reserved_req(struct fuse_conn *fc,
@@ -154,7 +180,7 @@ static void put_reserved_req(struct fuse_conn *fc, struct fuse_req *req)
 	struct fuse_file *ff = file->private_data;
 
 	spin_lock(&fc->lock);
-	fuse_request_init(req);
+	fuse_request_init(req, req->inline_pages, FUSE_MAX_PAGES_PER_REQ);
 	BUG_ON(ff->reserved_req);
 	ff->reserved_req = req;
 	wake_up_all(&fc->reserved_req_waitq);
@@ -212,17 +238,46 @@ static u64 fuse_get_unique(struct fuse_conn *fc)
 	return fc->reqctr;
 }
 
+static struct fuse_iqueue *fuse_local_iqueue(struct fuse_conn *fc)
+{
+	return per_cpu_ptr(fc->iqs, smp_processor_id());
+}
+
+static struct fuse_iqueue *fuse_target_iqueue(struct fuse_conn *fc)
+{
+	if (fc->percpu_dispatch)
+		return fuse_local_iqueue(fc);
+
+	return per_cpu_ptr(fc->iqs, 0);
+}
+
+static void fuse_conn_lock(struct fuse_conn *fc)
+__acquires(fc->lock)
+{
+	if (!spin_trylock(&fc->lock)) {
+		spin_lock(&fc->lock);
+		fuse_local_iqueue(fc)->contended++;
+	}
+}
+
 static void queue_request(struct fuse_conn *fc, struct fuse_req *req)
 {
+	struct fuse_iqueue *iq = fuse_target_iqueue(fc);
+
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
-	list_add_tail(&req->list, &fc->pending);
+	list_add_tail(&req->list, &iq->pending);
+	fc->num_pending++;
+	req->queue_time = local_clock();
 	req->state = FUSE_REQ_PENDING;
 	if (!req->waiting) {
 		req->waiting = 1;
 		atomic_inc(&fc->num_waiting);
 	}
-	wake_up(&fc->waitq);
+	if (fc->percpu_dispatch && waitqueue_active(&iq->waitq))
+		wake_up(&iq->waitq);
+	else
+		wake_up(&fc->waitq);
 	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 }
 
@@ -341,6 +396,7 @@ __acquires(fc->lock)
 		
 		if (req->state == FUSE_REQ_PENDING) {
 			list_del(&req->list);
+			fc->num_pending--;
 			__fuse_put_request(req);
 			req->out.h.error = -EINTR;
 			return;
@@ -369,7 +425,7 @@ __acquires(fc->lock)
 void fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
 	req->isreply = 1;
-	spin_lock(&fc->lock);
+	fuse_conn_lock(fc);
 	if (!fc->connected)
 		req->out.h.error = -ENOTCONN;
 	else if (fc->conn_error)
@@ -838,7 +894,7 @@ static int forget_pending(struct fuse_conn *fc)
 
 static int request_pending(struct fuse_conn *fc)
 {
-	return !list_empty(&fc->pending) || !list_empty(&fc->interrupts) ||
+	return fc->num_pending || !list_empty(&fc->interrupts) ||
 		forget_pending(fc);
 }
 
@@ -847,9 +903,17 @@ __releases(fc->lock)
 __acquires(fc->lock)
 {
 	DECLARE_WAITQUEUE(wait, current);
+	DECLARE_WAITQUEUE(cpu_wait, current);
+	struct fuse_iqueue *iq = NULL;
 
 	add_wait_queue_exclusive(&fc->waitq, &wait);
 	while (fc->connected && !request_pending(fc)) {
+		if (fc->percpu_dispatch && iq != fuse_local_iqueue(fc)) {
+			if (iq)
+				remove_wait_queue(&iq->waitq, &cpu_wait);
+			iq = fuse_local_iqueue(fc);
+			add_wait_queue_exclusive(&iq->waitq, &cpu_wait);
+		}
 		set_current_state(TASK_INTERRUPTIBLE);
 		if (signal_pending(current))
 			break;
@@ -859,9 +923,42 @@ __acquires(fc->lock)
 		spin_lock(&fc->lock);
 	}
 	set_current_state(TASK_RUNNING);
+	if (iq)
+		remove_wait_queue(&iq->waitq, &cpu_wait);
 	remove_wait_queue(&fc->waitq, &wait);
 }
 
+static struct fuse_req *dequeue_pending(struct fuse_conn *fc)
+{
+	struct fuse_iqueue *local = fuse_local_iqueue(fc);
+	struct fuse_iqueue *iq = local;
+	struct fuse_req *req;
+	u64 wait_time;
+	int cpu;
+
+	if (list_empty(&iq->pending)) {
+		for_each_possible_cpu(cpu) {
+			iq = per_cpu_ptr(fc->iqs, cpu);
+			if (!list_empty(&iq->pending))
+				break;
+		}
+	}
+	BUG_ON(list_empty(&iq->pending));
+
+	req = list_entry(iq->pending.next, struct fuse_req, list);
+	fc->num_pending--;
+
+	wait_time = local_clock() - req->queue_time;
+	iq->dispatched++;
+	if (iq != local)
+		iq->stolen++;
+	iq->wait_time += wait_time;
+	if (wait_time > iq->max_wait_time)
+		iq->max_wait_time = wait_time;
+
+	return req;
+}
+
 static int fuse_read_interrupt(struct fuse_conn *fc, struct fuse_copy_state *cs,
 			       size_t nbytes, struct fuse_req *req)
 __releases(fc->lock)
@@ -1015,7 +1112,7 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 	unsigned reqsize;
 
  restart:
-	spin_lock(&fc->lock);
+	fuse_conn_lock(fc);
 	err = -EAGAIN;
 	if ((file->f_flags & O_NONBLOCK) && fc->connected &&
 	    !request_pending(fc))
@@ -1036,14 +1133,14 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 	}
 
 	if (forget_pending(fc)) {
-		if (list_empty(&fc->pending) || fc->forget_batch-- > 0)
+		if (!fc->num_pending || fc->forget_batch-- > 0)
 			return fuse_read_forget(fc, cs, nbytes);
 
 		if (fc->forget_batch <= -8)
 			fc->forget_batch = 16;
 	}
 
-	req = list_entry(fc->pending.next, struct fuse_req, list);
+	req = dequeue_pending(fc);
 	req->state = FUSE_REQ_READING;
 	list_move(&req->list, &fc->io);
 
@@ -1450,7 +1547,7 @@ static int fuse_retrieve(struct fuse_conn *fc, struct inode *inode,
 	unsigned int offset;
 	size_t total_len = 0;
 
-	req = fuse_get_req(fc);
+	req = fuse_get_req_pages(fc, fc->max_pages);
 	if (IS_ERR(req))
 		return PTR_ERR(req);
 
@@ -1471,7 +1568,7 @@ static int fuse_retrieve(struct fuse_conn *fc, struct inode *inode,
 	else if (outarg->offset + num > file_size)
 		num = file_size - outarg->offset;
 
-	while (num && req->num_pages < FUSE_MAX_PAGES_PER_REQ) {
+	while (num && req->num_pages < req->max_pages) {
 		struct page *page;
 		unsigned int this_num;
 
@@ -1813,6 +1910,29 @@ __acquires(fc->lock)
 	}
 }
 
+static void end_pending_requests(struct fuse_conn *fc)
+__releases(fc->lock)
+__acquires(fc->lock)
+{
+	int cpu;
+
+	while (fc->num_pending) {
+		for_each_possible_cpu(cpu) {
+			struct list_head *head = &per_cpu_ptr(fc->iqs, cpu)->pending;
+
+			while (!list_empty(head)) {
+				struct fuse_req *req;
+				req = list_entry(head->next, struct fuse_req,
+						 list);
+				fc->num_pending--;
+				req->out.h.error = -ECONNABORTED;
+				request_end(fc, req);
+				spin_lock(&fc->lock);
+			}
+		}
+	}
+}
+
 static void end_io_requests(struct fuse_conn *fc)
 __releases(fc->lock)
 __acquires(fc->lock)
@@ -1845,7 +1965,7 @@ __acquires(fc->lock)
 {
 	fc->max_background = UINT_MAX;
 	flush_bg_queue(fc);
-	end_requests(fc, &fc->pending);
+	end_pending_requests(fc);
 	end_requests(fc, &fc->processing);
 	while (forget_pending(fc))
 		kfree(dequeue_forget(fc, 1, NULL));
@@ -1888,11 +2008,13 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 	struct fuse_conn *fc = fuse_get_conn(file);
 	if (fc) {
 		spin_lock(&fc->lock);
-		fc->connected = 0;
-		fc->blocked = 0;
-		end_queued_requests(fc);
-		end_polls(fc);
-		wake_up_all(&fc->blocked_waitq);
+		if (!--fc->dev_count) {
+			fc->connected = 0;
+			fc->blocked = 0;
+			end_queued_requests(fc);
+			end_polls(fc);
+			wake_up_all(&fc->blocked_waitq);
+		}
 		spin_unlock(&fc->lock);
 		fuse_conn_put(fc);
 	}
@@ -1901,6 +2023,57 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 }
 EXPORT_SYMBOL_GPL(fuse_dev_release);
 
+static int fuse_dev_clone(struct fuse_conn *fc, struct file *new)
+{
+	if (new->private_data)
+		return -EINVAL;
+
+	spin_lock(&fc->lock);
+	if (!fc->connected) {
+		spin_unlock(&fc->lock);
+		return -ENOTCONN;
+	}
+	fc->dev_count++;
+	fc->percpu_dispatch = 1;
+	spin_unlock(&fc->lock);
+
+	new->private_data = fuse_conn_get(fc);
+
+	return 0;
+}
+
+static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
+			   unsigned long arg)
+{
+	int err = -ENOTTY;
+
+	if (cmd == FUSE_DEV_IOC_CLONE) {
+		int oldfd;
+
+		err = -EFAULT;
+		if (!get_user(oldfd, (__u32 __user *) arg)) {
+			struct file *old = fget(oldfd);
+
+			err = -EINVAL;
+			if (old) {
+				struct fuse_conn *fc = NULL;
+
+				if (old->f_op == file->f_op)
+					fc = fuse_get_conn(old);
+
+				if (fc) {
+					mutex_lock(&fuse_mutex);
+					err = fuse_dev_clone(fc, file);
+					mutex_unlock(&fuse_mutex);
+				}
+				fput(old);
+			}
+		}
+	}
+
+	return err;
+}
+
 static int fuse_dev_fasync(int fd, struct file *file, int on)
 {
 	struct fuse_conn *fc = fuse_get_conn(file);
@@ -1923,6 +2096,8 @@ const struct file_operations fuse_dev_operations = {
 	.poll		= fuse_dev_poll,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
+	.unlocked_ioctl	= fuse_dev_ioctl,
+	.compat_ioctl	= fuse_dev_ioctl,
 };
 EXPORT_SYMBOL_GPL(fuse_dev_operations);
 
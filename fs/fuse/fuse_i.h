@@ -25,11 +25,13 @@
 
 #define FUSE_MAX_PAGES_PER_REQ 32
 
+#define FUSE_MAX_MAX_PAGES 256
+
 #define FUSE_NOWRITE INT_MIN
 
 #define FUSE_NAME_MAX 1024
 
-#define FUSE_CTL_NUM_DENTRIES 5
+#define FUSE_CTL_NUM_DENTRIES 6
 
 #define FUSE_DEFAULT_PERMISSIONS (1 << 0)
 
@@ -87,6 +89,29 @@ struct fuse_inode {
 
 struct fuse_conn;
 
+struct fuse_iqueue {
+	
+	struct list_head pending;
+
+	
+	wait_queue_head_t waitq;
+
+	
+	unsigned long dispatched;
+
+	
+	unsigned long stolen;
+
+	
+	unsigned long contended;
+
+	
+	u64 wait_time;
+
+	
+	u64 max_wait_time;
+};
+
 struct fuse_file {
 	
 	struct fuse_conn *fc;
@@ -249,7 +274,13 @@ struct fuse_req {
 	} misc;
 
 	
-	struct page *pages[FUSE_MAX_PAGES_PER_REQ];
+	struct page **pages;
+
+	
+	unsigned max_pages;
+
+	
+	struct page *inline_pages[FUSE_MAX_PAGES_PER_REQ];
 
 	
 	unsigned num_pages;
@@ -271,6 +302,9 @@ struct fuse_req {
 
 	
 	struct file *stolen_file;
+
+	
+	u64 queue_time;
 };
 
 struct fuse_conn {
@@ -299,10 +333,19 @@ struct fuse_conn {
 	unsigned max_write;
 
 	
+	unsigned max_pages;
+
+	
 	wait_queue_head_t waitq;
 
 	
-	struct list_head pending;
+	struct fuse_iqueue __percpu *iqs;
+
+	
+	unsigned num_pending;
+
+	
+	unsigned dev_count;
 
 	
 	struct list_head processing;
@@ -421,6 +464,12 @@ struct fuse_conn {
 	unsigned no_flock:1;
 
 	
+	unsigned writeback_cache:1;
+
+	
+	unsigned percpu_dispatch:1;
+
+	
 	atomic_t num_waiting;
 
 	
@@ -544,12 +593,14 @@ void fuse_ctl_cleanup(void);
 
 struct fuse_req *fuse_request_alloc(void);
 
-struct fuse_req *fuse_request_alloc_nofs(void);
+struct fuse_req *fuse_request_alloc_nofs(unsigned npages);
 
 void fuse_request_free(struct fuse_req *req);
 
 struct fuse_req *fuse_get_req(struct fuse_conn *fc);
 
+struct fuse_req *fuse_get_req_pages(struct fuse_conn *fc, unsigned npages);
+
 struct fuse_req *fuse_get_req_nofail(struct fuse_conn *fc, struct file *file);
 
 void fuse_put_request(struct fuse_conn *fc, struct fuse_req *req);
@@ -571,7 +622,7 @@ struct fuse_conn *fuse_conn_get(struct fuse_conn *fc);
 
 void fuse_conn_kill(struct fuse_conn *fc);
 
-void fuse_conn_init(struct fuse_conn *fc);
+int fuse_conn_init(struct fuse_conn *fc);
 
 void fuse_conn_put(struct fuse_conn *fc);
 
@@ -196,10 +196,12 @@ void fuse_change_attributes(struct inode *inode, struct fuse_attr *attr,
 	fuse_change_attributes_common(inode, attr, attr_valid);
 
 	oldsize = inode->i_size;
-	i_size_write(inode, attr->size);
+	if (!fc->writeback_cache || !S_ISREG(inode->i_mode))
+		i_size_write(inode, attr->size);
 	spin_unlock(&fc->lock);
 
-	if (S_ISREG(inode->i_mode) && oldsize != attr->size) {
+	if (!fc->writeback_cache && S_ISREG(inode->i_mode) &&
+	    oldsize != attr->size) {
 		truncate_pagecache(inode, oldsize, attr->size);
 		invalidate_inode_pages2(inode->i_mapping);
 	}
@@ -519,9 +521,22 @@ static int fuse_show_options(struct seq_file *m, struct dentry *root)
 	return 0;
 }
 
-void fuse_conn_init(struct fuse_conn *fc)
+int fuse_conn_init(struct fuse_conn *fc)
 {
+	int cpu;
+
 	memset(fc, 0, sizeof(*fc));
+	fc->iqs = alloc_percpu(struct fuse_iqueue);
+	if (!fc->iqs)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct fuse_iqueue *iq = per_cpu_ptr(fc->iqs, cpu);
+
+		INIT_LIST_HEAD(&iq->pending);
+		init_waitqueue_head(&iq->waitq);
+	}
+
 	spin_lock_init(&fc->lock);
 	mutex_init(&fc->inst_mutex);
 	init_rwsem(&fc->killsb);
@@ -529,7 +544,6 @@ void fuse_conn_init(struct fuse_conn *fc)
 	init_waitqueue_head(&fc->waitq);
 	init_waitqueue_head(&fc->blocked_waitq);
 	init_waitqueue_head(&fc->reserved_req_waitq);
-	INIT_LIST_HEAD(&fc->pending);
 	INIT_LIST_HEAD(&fc->processing);
 	INIT_LIST_HEAD(&fc->io);
 	INIT_LIST_HEAD(&fc->interrupts);
@@ -542,9 +556,13 @@ void fuse_conn_init(struct fuse_conn *fc)
 	fc->khctr = 0;
 	fc->polled_files = RB_ROOT;
 	fc->reqctr = 0;
+	fc->max_pages = FUSE_MAX_PAGES_PER_REQ;
 	fc->blocked = 1;
 	fc->attr_version = 1;
+	fc->dev_count = 1;
 	get_random_bytes(&fc->scramble_key, sizeof(fc->scramble_key));
+
+	return 0;
 }
 EXPORT_SYMBOL_GPL(fuse_conn_init);
 
@@ -553,6 +571,7 @@ void fuse_conn_put(struct fuse_conn *fc)
 	if (atomic_dec_and_test(&fc->count)) {
 		if (fc->destroy_req)
 			fuse_request_free(fc->destroy_req);
+		free_percpu(fc->iqs);
 		mutex_destroy(&fc->inst_mutex);
 		fc->release(fc);
 	}
@@ -830,6 +849,15 @@ static void process_init_reply(struct fuse_conn *fc, struct fuse_req *req)
 				fc->big_writes = 1;
 			if (arg->flags & FUSE_DONT_MASK)
 				fc->dont_mask = 1;
+			if (arg->flags & FUSE_WRITEBACK_CACHE)
+				fc->writeback_cache = 1;
+			if ((arg->flags & FUSE_MAX_PAGES) && arg->max_pages &&
+			    req->out.args[0].size >=
+			    offsetof(struct fuse_init_out, padding)) {
+				fc->max_pages = min_t(unsigned,
+						FUSE_MAX_MAX_PAGES,
+						arg->max_pages);
+			}
 		} else {
 			ra_pages = fc->max_read / PAGE_CACHE_SIZE;
 			fc->no_lock = 1;
@@ -855,7 +883,7 @@ static void fuse_send_init(struct fuse_conn *fc, struct fuse_req *req)
 	arg->max_readahead = fc->bdi.ra_pages * PAGE_CACHE_SIZE;
 	arg->flags |= FUSE_ASYNC_READ | FUSE_POSIX_LOCKS | FUSE_ATOMIC_O_TRUNC |
 		FUSE_EXPORT_SUPPORT | FUSE_BIG_WRITES | FUSE_DONT_MASK |
-		FUSE_FLOCK_LOCKS;
+		FUSE_FLOCK_LOCKS | FUSE_WRITEBACK_CACHE | FUSE_MAX_PAGES;
 	req->in.h.opcode = FUSE_INIT;
 	req->in.numargs = 1;
 	req->in.args[0].size = sizeof(*arg);
@@ -952,7 +980,11 @@ static int fuse_fill_super(struct super_block *sb, void *data, int silent)
 	if (!fc)
 		goto err_fput;
 
-	fuse_conn_init(fc);
+	err = fuse_conn_init(fc);
+	if (err) {
+		kfree(fc);
+		goto err_fput;
+	}
 
 	fc->dev = sb->s_dev;
 	fc->sb = sb;
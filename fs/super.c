@@ -44,6 +44,8 @@ static int prune_super(struct shrinker *shrink, struct shrink_control *sc)
 	struct super_block *sb;
 	int	fs_objects = 0;
 	int	total_objects;
+	int	dentries;
+	int	inodes;
 
 	sb = container_of(shrink, struct super_block, s_shrink);
 
@@ -56,18 +58,14 @@ static int prune_super(struct shrinker *shrink, struct shrink_control *sc)
 	if (sb->s_op && sb->s_op->nr_cached_objects)
 		fs_objects = sb->s_op->nr_cached_objects(sb);
 
-	total_objects = sb->s_nr_dentry_unused +
-			sb->s_nr_inodes_unused + fs_objects + 1;
+	dentries = list_lru_count(&sb->s_dentry_lru);
+	inodes = list_lru_count(&sb->s_inode_lru);
+	total_objects = dentries + inodes + fs_objects + 1;
 
 	if (sc->nr_to_scan) {
-		int	dentries;
-		int	inodes;
-
 		
-		dentries = (sc->nr_to_scan * sb->s_nr_dentry_unused) /
-							total_objects;
-		inodes = (sc->nr_to_scan * sb->s_nr_inodes_unused) /
-							total_objects;
+		dentries = (sc->nr_to_scan * dentries) / total_objects;
+		inodes = (sc->nr_to_scan * inodes) / total_objects;
 		if (fs_objects)
 			fs_objects = (sc->nr_to_scan * fs_objects) /
 							total_objects;
@@ -78,8 +76,8 @@ static int prune_super(struct shrinker *shrink, struct shrink_control *sc)
 			sb->s_op->free_cached_objects(sb, fs_objects);
 			fs_objects = sb->s_op->nr_cached_objects(sb);
 		}
-		total_objects = sb->s_nr_dentry_unused +
-				sb->s_nr_inodes_unused + fs_objects;
+		total_objects = list_lru_count(&sb->s_dentry_lru) +
+				list_lru_count(&sb->s_inode_lru) + fs_objects;
 	}
 
 	total_objects = (total_objects / 100) * sysctl_vfs_cache_pressure;
@@ -114,13 +112,15 @@ static struct super_block *alloc_super(struct file_system_type *type)
 #else
 		INIT_LIST_HEAD(&s->s_files);
 #endif
+		if (list_lru_init(&s->s_dentry_lru, "dentry", s->s_id))
+			goto err_out;
+		if (list_lru_init(&s->s_inode_lru, "inode", s->s_id))
+			goto err_out;
 		s->s_bdi = &default_backing_dev_info;
 		INIT_HLIST_NODE(&s->s_instances);
 		INIT_HLIST_BL_HEAD(&s->s_anon);
 		INIT_LIST_HEAD(&s->s_inodes);
-		INIT_LIST_HEAD(&s->s_dentry_lru);
-		INIT_LIST_HEAD(&s->s_inode_lru);
-		spin_lock_init(&s->s_inode_lru_lock);
+		spin_lock_init(&s->s_dentry_shrink_lock);
 		INIT_LIST_HEAD(&s->s_mounts);
 		init_rwsem(&s->s_umount);
 		mutex_init(&s->s_lock);
@@ -146,10 +146,22 @@ static struct super_block *alloc_super(struct file_system_type *type)
 	}
 out:
 	return s;
+
+err_out:
+	list_lru_destroy(&s->s_dentry_lru);
+	list_lru_destroy(&s->s_inode_lru);
+#ifdef CONFIG_SMP
+	free_percpu(s->s_files);
+#endif
+	security_sb_free(s);
+	kfree(s);
+	return NULL;
 }
 
 static inline void destroy_super(struct super_block *s)
 {
+	list_lru_destroy(&s->s_dentry_lru);
+	list_lru_destroy(&s->s_inode_lru);
 #ifdef CONFIG_SMP
 	free_percpu(s->s_files);
 #endif
@@ -71,6 +71,92 @@ SYSCALL_DEFINE0(sync)
 	return 0;
 }
 
+struct dirty_sync_ctx {
+	bool (*abort)(void);
+	bool aborted;
+};
+
+static bool sb_has_dirty_io(struct super_block *sb)
+{
+	struct backing_dev_info *bdi = sb->s_bdi;
+
+	if (bdi == &noop_backing_dev_info)
+		return false;
+
+	return bdi_has_dirty_io(bdi) || bdi_stat_sum(bdi, BDI_WRITEBACK) > 0;
+}
+
+static void sync_dirty_sb(struct super_block *sb, void *arg)
+{
+	struct dirty_sync_ctx *ctx = arg;
+
+	if (ctx->aborted || (sb->s_flags & MS_RDONLY))
+		return;
+
+	if (ctx->abort && ctx->abort()) {
+		ctx->aborted = true;
+		return;
+	}
+
+	if (!sb_has_dirty_io(sb)) {
+		if (sb->s_op->sync_fs)
+			sb->s_op->sync_fs(sb, 1);
+		return;
+	}
+
+	__sync_filesystem(sb, 0);
+	if (ctx->abort && ctx->abort()) {
+		ctx->aborted = true;
+		return;
+	}
+	__sync_filesystem(sb, 1);
+}
+
+static bool dirty_sync_valid;
+static unsigned long dirty_sync_mark;
+
+static bool dirty_sync_needed(void)
+{
+	struct backing_dev_info *bdi;
+	bool dirty = false;
+
+	if (!dirty_sync_valid
+	    || global_page_state(NR_DIRTIED) != dirty_sync_mark
+	    || global_page_state(NR_FILE_DIRTY)
+	    || global_page_state(NR_WRITEBACK))
+		return true;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(bdi, &bdi_list, bdi_list) {
+		if (bdi_has_dirty_io(bdi)) {
+			dirty = true;
+			break;
+		}
+	}
+	rcu_read_unlock();
+	return dirty;
+}
+
+int sync_dirty_filesystems(bool (*abort)(void))
+{
+	struct dirty_sync_ctx ctx = { .abort = abort };
+	unsigned long mark;
+
+	if (!dirty_sync_needed())
+		return 1;
+
+	mark = global_page_state(NR_DIRTIED);
+	iterate_supers(sync_dirty_sb, &ctx);
+	if (ctx.aborted) {
+		dirty_sync_valid = false;
+		return -EAGAIN;
+	}
+
+	dirty_sync_mark = mark;
+	dirty_sync_valid = true;
+	return 0;
+}
+
 static void do_sync_work(struct work_struct *work)
 {
 	sync_filesystems(0);
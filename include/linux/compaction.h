@@ -14,13 +14,24 @@ extern int sysctl_extfrag_threshold;
 extern int sysctl_extfrag_handler(struct ctl_table *table, int write,
 			void __user *buffer, size_t *length, loff_t *ppos);
 
+extern int sysctl_compaction_proactiveness;
+extern int sysctl_compaction_proactiveness_handler(struct ctl_table *table,
+			int write, void __user *buffer, size_t *length,
+			loff_t *ppos);
+
 extern int fragmentation_index(struct zone *zone, unsigned int order);
+extern int extfrag_for_order(struct zone *zone, unsigned int order);
+extern unsigned int compaction_fragmentation_score(void);
 extern unsigned long try_to_compact_pages(struct zonelist *zonelist,
 			int order, gfp_t gfp_mask, nodemask_t *mask,
 			bool sync);
 extern int compact_pgdat(pg_data_t *pgdat, int order);
 extern unsigned long compaction_suitable(struct zone *zone, int order);
 
+extern int kcompactd_run(int nid);
+extern void kcompactd_stop(int nid);
+extern void wakeup_kcompactd(pg_data_t *pgdat, int order, int classzone_idx);
+
 #define COMPACT_MAX_DEFER_SHIFT 6
 
 static inline void defer_compaction(struct zone *zone, int order)
@@ -76,6 +87,20 @@ static inline bool compaction_deferred(struct zone *zone, int order)
 	return 1;
 }
 
+static inline int kcompactd_run(int nid)
+{
+	return 0;
+}
+
+static inline void kcompactd_stop(int nid)
+{
+}
+
+static inline void wakeup_kcompactd(pg_data_t *pgdat, int order,
+				    int classzone_idx)
+{
+}
+
 #endif 
 
 #if defined(CONFIG_COMPACTION) && defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
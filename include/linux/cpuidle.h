@@ -16,6 +16,7 @@
 #include <linux/kobject.h>
 #include <linux/completion.h>
 #include <linux/hrtimer.h>
+#include <linux/cpumask.h>
 
 #define CPUIDLE_STATE_MAX	8
 #define CPUIDLE_NAME_LEN	16
@@ -33,6 +34,8 @@ struct cpuidle_state_usage {
 
 	unsigned long long	usage;
 	unsigned long long	time; 
+	unsigned long long	above;
+	unsigned long long	below;
 };
 
 struct cpuidle_state {
@@ -53,6 +56,7 @@ struct cpuidle_state {
 };
 
 #define CPUIDLE_FLAG_TIME_VALID	(0x01) 
+#define CPUIDLE_FLAG_COUPLED	(0x02)
 
 #define CPUIDLE_DRIVER_FLAGS_MASK (0xFFFF0000)
 
@@ -87,6 +91,11 @@ struct cpuidle_device {
 	struct list_head 	device_list;
 	struct kobject		kobj;
 	struct completion	kobj_unregister;
+
+#ifdef CONFIG_ARCH_NEEDS_CPU_IDLE_COUPLED
+	cpumask_t		coupled_cpus;
+	struct cpuidle_coupled	*coupled;
+#endif
 };
 
 DECLARE_PER_CPU(struct cpuidle_device *, cpuidle_devices);
@@ -519,14 +519,18 @@ static inline int device_is_registered(struct device *dev)
 
 static inline void device_enable_async_suspend(struct device *dev)
 {
-	if (!dev->power.is_prepared)
+	if (!dev->power.is_prepared) {
 		dev->power.async_suspend = true;
+		dev->power.no_async = false;
+	}
 }
 
 static inline void device_disable_async_suspend(struct device *dev)
 {
-	if (!dev->power.is_prepared)
+	if (!dev->power.is_prepared) {
 		dev->power.async_suspend = false;
+		dev->power.no_async = true;
+	}
 }
 
 static inline bool device_async_suspend_enabled(struct device *dev)
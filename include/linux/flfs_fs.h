@@ -0,0 +1,281 @@
+/*
+ * flfs_fs.h - flash-friendly log-structured file system on-disk format
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef _LINUX_FLFS_FS_H
+#define _LINUX_FLFS_FS_H
+
+#include <linux/types.h>
+
+#define FLFS_SUPER_MAGIC		0x464c4653
+#define FLFS_MAJOR_VERSION		1
+#define FLFS_MINOR_VERSION		0
+
+#define FLFS_SUPER_OFFSET		1024
+#define FLFS_LOG_BLKSIZE		12
+#define FLFS_BLKSIZE			(1 << FLFS_LOG_BLKSIZE)
+#define FLFS_LOG_BLOCKS_PER_SEG		9
+#define FLFS_BLOCKS_PER_SEG		(1 << FLFS_LOG_BLOCKS_PER_SEG)
+
+#define NULL_ADDR			0x0U
+#define NEW_ADDR			0xffffffffU
+
+#define FLFS_NODE_INO			1
+#define FLFS_META_INO			2
+#define FLFS_ROOT_INO			3
+#define FLFS_FIRST_FREE_NID		4
+
+#define FLFS_NAME_LEN			255
+#define FLFS_VOLUME_LEN			64
+
+#define NR_CURSEG_DATA_TYPE		3
+#define NR_CURSEG_NODE_TYPE		3
+#define NR_CURSEG_TYPE			(NR_CURSEG_DATA_TYPE + NR_CURSEG_NODE_TYPE)
+
+enum {
+	CURSEG_HOT_DATA	= 0,
+	CURSEG_WARM_DATA,
+	CURSEG_COLD_DATA,
+	CURSEG_HOT_NODE,
+	CURSEG_WARM_NODE,
+	CURSEG_COLD_NODE,
+};
+
+struct flfs_super_block {
+	__le32 magic;
+	__le16 major_ver;
+	__le16 minor_ver;
+	__le32 log_blocksize;
+	__le32 log_blocks_per_seg;
+	__le64 block_count;
+	__le32 segment_count;
+	__le32 segment_count_ckpt;
+	__le32 segment_count_sit;
+	__le32 segment_count_nat;
+	__le32 segment_count_ssa;
+	__le32 segment_count_main;
+	__le32 segment0_blkaddr;
+	__le32 cp_blkaddr;
+	__le32 sit_blkaddr;
+	__le32 nat_blkaddr;
+	__le32 ssa_blkaddr;
+	__le32 main_blkaddr;
+	__le32 sit_blocks;
+	__le32 nat_blocks;
+	__le32 root_ino;
+	__le32 node_ino;
+	__le32 meta_ino;
+	__le32 max_nid;
+	__u8 uuid[16];
+	__u8 volume_name[FLFS_VOLUME_LEN];
+	__le32 checksum;
+} __attribute__((packed));
+
+#define CP_UMOUNT_FLAG			0x00000001
+#define CP_ORPHAN_PRESENT_FLAG		0x00000002
+#define CP_ERROR_FLAG			0x00000004
+
+#define FLFS_CP_CHECKSUM_OFFSET		(FLFS_BLKSIZE - sizeof(__le32))
+
+struct flfs_checkpoint {
+	__le64 checkpoint_ver;
+	__le64 user_block_count;
+	__le64 valid_block_count;
+	__le32 rsvd_segment_count;
+	__le32 overprov_segment_count;
+	__le32 free_segment_count;
+	__le32 cur_node_segno[NR_CURSEG_NODE_TYPE];
+	__le16 cur_node_blkoff[NR_CURSEG_NODE_TYPE];
+	__le32 cur_data_segno[NR_CURSEG_DATA_TYPE];
+	__le16 cur_data_blkoff[NR_CURSEG_DATA_TYPE];
+	__le32 ckpt_flags;
+	__le32 cp_pack_total_block_count;
+	__le32 cp_pack_start_sum;
+	__le32 valid_node_count;
+	__le32 valid_inode_count;
+	__le32 next_free_nid;
+	__le32 sit_ver_bitmap_bytesize;
+	__le32 nat_ver_bitmap_bytesize;
+	__le32 checksum_offset;
+	__le64 elapsed_time;
+	__u8 alloc_type[NR_CURSEG_TYPE];
+	__u8 sit_nat_version_bitmap[1];
+} __attribute__((packed));
+
+#define FLFS_CP_BITMAP_BYTES		(FLFS_CP_CHECKSUM_OFFSET - \
+			offsetof(struct flfs_checkpoint, sit_nat_version_bitmap))
+
+#define FLFS_ORPHANS_PER_BLOCK		1020
+
+struct flfs_orphan_block {
+	__le32 ino[FLFS_ORPHANS_PER_BLOCK];
+	__le32 reserved;
+	__le16 blk_addr;
+	__le16 blk_count;
+	__le32 entry_count;
+	__le32 check_sum;
+} __attribute__((packed));
+
+#define ADDRS_PER_INODE			987
+#define ADDRS_PER_BLOCK			1018
+#define NIDS_PER_BLOCK			1018
+
+#define NODE_DIR1_BLOCK			(ADDRS_PER_INODE + 1)
+#define NODE_DIR2_BLOCK			(ADDRS_PER_INODE + 2)
+#define NODE_IND1_BLOCK			(ADDRS_PER_INODE + 3)
+#define NODE_IND2_BLOCK			(ADDRS_PER_INODE + 4)
+#define NODE_DIND_BLOCK			(ADDRS_PER_INODE + 5)
+
+#define FLFS_ADVISE_COLD		0x01
+
+struct flfs_inode {
+	__le16 i_mode;
+	__u8 i_advise;
+	__u8 i_reserved;
+	__le32 i_uid;
+	__le32 i_gid;
+	__le32 i_links;
+	__le64 i_size;
+	__le64 i_blocks;
+	__le64 i_atime;
+	__le64 i_ctime;
+	__le64 i_mtime;
+	__le32 i_atime_nsec;
+	__le32 i_ctime_nsec;
+	__le32 i_mtime_nsec;
+	__le32 i_generation;
+	__le32 i_current_depth;
+	__le32 i_flags;
+	__le32 i_pino;
+	__le32 i_rdev;
+	__le32 i_reserved2[4];
+
+	__le32 i_addr[ADDRS_PER_INODE];
+	__le32 i_nid[5];
+} __attribute__((packed));
+
+struct direct_node {
+	__le32 addr[ADDRS_PER_BLOCK];
+} __attribute__((packed));
+
+struct indirect_node {
+	__le32 nid[NIDS_PER_BLOCK];
+} __attribute__((packed));
+
+#define OFFSET_BIT_SHIFT		3
+
+struct node_footer {
+	__le32 nid;
+	__le32 ino;
+	__le32 flag;
+	__le64 cp_ver;
+	__le32 next_blkaddr;
+} __attribute__((packed));
+
+struct flfs_node {
+	union {
+		struct flfs_inode i;
+		struct direct_node dn;
+		struct indirect_node in;
+	};
+	struct node_footer footer;
+} __attribute__((packed));
+
+struct flfs_nat_entry {
+	__u8 version;
+	__le32 ino;
+	__le32 block_addr;
+} __attribute__((packed));
+
+#define NAT_ENTRY_PER_BLOCK		(FLFS_BLKSIZE / sizeof(struct flfs_nat_entry))
+
+struct flfs_nat_block {
+	struct flfs_nat_entry entries[NAT_ENTRY_PER_BLOCK];
+} __attribute__((packed));
+
+#define SIT_VBLOCK_MAP_SIZE		(FLFS_BLOCKS_PER_SEG / 8)
+#define SIT_VBLOCKS_SHIFT		10
+#define SIT_VBLOCKS_MASK		((1 << SIT_VBLOCKS_SHIFT) - 1)
+
+struct flfs_sit_entry {
+	__le16 vblocks;
+	__u8 valid_map[SIT_VBLOCK_MAP_SIZE];
+	__le64 mtime;
+} __attribute__((packed));
+
+#define SIT_ENTRY_PER_BLOCK		(FLFS_BLKSIZE / sizeof(struct flfs_sit_entry))
+
+struct flfs_sit_block {
+	struct flfs_sit_entry entries[SIT_ENTRY_PER_BLOCK];
+} __attribute__((packed));
+
+#define ENTRIES_IN_SUM			FLFS_BLOCKS_PER_SEG
+#define SUMMARY_SIZE			7
+#define SUM_FOOTER_SIZE			5
+#define SUM_ENTRY_SIZE			(SUMMARY_SIZE * ENTRIES_IN_SUM)
+
+#define SUM_TYPE_NODE			1
+#define SUM_TYPE_DATA			0
+
+struct flfs_summary {
+	__le32 nid;
+	union {
+		__u8 reserved[3];
+		struct {
+			__u8 version;
+			__le16 ofs_in_node;
+		} __attribute__((packed));
+	};
+} __attribute__((packed));
+
+struct summary_footer {
+	__u8 entry_type;
+	__le32 check_sum;
+} __attribute__((packed));
+
+struct flfs_summary_block {
+	struct flfs_summary entries[ENTRIES_IN_SUM];
+	__u8 reserved[FLFS_BLKSIZE - SUM_ENTRY_SIZE - SUM_FOOTER_SIZE];
+	struct summary_footer footer;
+} __attribute__((packed));
+
+#define FLFS_SLOT_LEN			8
+#define FLFS_SLOT_LEN_BITS		3
+#define NR_DENTRY_IN_BLOCK		214
+#define SIZE_OF_DIR_ENTRY		11
+#define SIZE_OF_DENTRY_BITMAP		((NR_DENTRY_IN_BLOCK + 7) / 8)
+#define SIZE_OF_RESERVED		(FLFS_BLKSIZE - ((SIZE_OF_DIR_ENTRY + \
+					FLFS_SLOT_LEN) * NR_DENTRY_IN_BLOCK + \
+					SIZE_OF_DENTRY_BITMAP))
+#define MAX_DIR_HASH_DEPTH		32
+
+struct flfs_dir_entry {
+	__le32 hash_code;
+	__le32 ino;
+	__le16 name_len;
+	__u8 file_type;
+} __attribute__((packed));
+
+struct flfs_dentry_block {
+	__u8 dentry_bitmap[SIZE_OF_DENTRY_BITMAP];
+	__u8 reserved[SIZE_OF_RESERVED];
+	struct flfs_dir_entry dentry[NR_DENTRY_IN_BLOCK];
+	__u8 filename[NR_DENTRY_IN_BLOCK][FLFS_SLOT_LEN];
+} __attribute__((packed));
+
+enum {
+	FLFS_FT_UNKNOWN,
+	FLFS_FT_REG_FILE,
+	FLFS_FT_DIR,
+	FLFS_FT_CHRDEV,
+	FLFS_FT_BLKDEV,
+	FLFS_FT_FIFO,
+	FLFS_FT_SOCK,
+	FLFS_FT_SYMLINK,
+	FLFS_FT_MAX
+};
+
+#endif
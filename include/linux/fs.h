@@ -268,6 +268,7 @@ struct inodes_stat_t {
 #include <linux/stat.h>
 #include <linux/cache.h>
 #include <linux/list.h>
+#include <linux/list_lru.h>
 #include <linux/radix-tree.h>
 #include <linux/prio_tree.h>
 #include <linux/init.h>
@@ -464,6 +465,7 @@ struct address_space {
 	struct mutex		i_mmap_mutex;	
 	
 	unsigned long		nrpages;	
+	unsigned long		nrshadows;
 	pgoff_t			writeback_index;
 	const struct address_space_operations *a_ops;	
 	unsigned long		flags;		
@@ -1160,13 +1162,10 @@ struct super_block {
 #endif
 	struct list_head	s_mounts;	
 	
-	struct list_head	s_dentry_lru;	
-	int			s_nr_dentry_unused;	
+	struct list_lru		s_dentry_lru;
+	spinlock_t		s_dentry_shrink_lock;
 
-	
-	spinlock_t		s_inode_lru_lock ____cacheline_aligned_in_smp;
-	struct list_head	s_inode_lru;		
-	int			s_nr_inodes_unused;	
+	struct list_lru		s_inode_lru;
 
 	struct block_device	*s_bdev;
 	struct backing_dev_info *s_bdi;
@@ -1664,6 +1663,7 @@ static inline int thaw_bdev(struct block_device *bdev, struct super_block *sb)
 }
 #endif
 extern int sync_filesystem(struct super_block *);
+extern int sync_dirty_filesystems(bool (*abort)(void));
 extern const struct file_operations def_blk_fops;
 extern const struct file_operations def_chr_fops;
 extern const struct file_operations bad_sock_fops;
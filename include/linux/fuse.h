@@ -11,6 +11,7 @@
 #define _LINUX_FUSE_H
 
 #include <linux/types.h>
+#include <linux/ioctl.h>
 
 
 #define FUSE_KERNEL_VERSION 7
@@ -82,6 +83,8 @@ struct fuse_file_lock {
 #define FUSE_BIG_WRITES		(1 << 5)
 #define FUSE_DONT_MASK		(1 << 6)
 #define FUSE_FLOCK_LOCKS	(1 << 10)
+#define FUSE_WRITEBACK_CACHE	(1 << 16)
+#define FUSE_MAX_PAGES		(1 << 22)
 
 #define CUSE_UNRESTRICTED_IOCTL	(1 << 0)
 
@@ -365,6 +368,10 @@ struct fuse_init_out {
 	__u16   max_background;
 	__u16   congestion_threshold;
 	__u32	max_write;
+	__u32	reserved;
+	__u16	max_pages;
+	__u16	padding;
+	__u32	unused[8];
 };
 
 #define CUSE_INIT_INFO_MAX 4096
@@ -512,4 +519,7 @@ struct fuse_notify_retrieve_in {
 	__u64	dummy4;
 };
 
+#define FUSE_DEV_IOC_MAGIC		229
+#define FUSE_DEV_IOC_CLONE		_IOR(FUSE_DEV_IOC_MAGIC, 0, __u32)
+
 #endif 
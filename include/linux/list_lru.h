@@ -0,0 +1,51 @@
+#ifndef _LINUX_LIST_LRU_H
+#define _LINUX_LIST_LRU_H
+
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/cache.h>
+#include <linux/types.h>
+
+enum lru_status {
+	LRU_REMOVED,		/* item moved off the lru by the callback */
+	LRU_ROTATE,		/* referenced, give it another trip */
+	LRU_SKIP,		/* could not be locked, try it next time */
+	LRU_RETRY,		/* lru lock was dropped, item state unknown */
+};
+
+struct list_lru_shard {
+	spinlock_t		lock;
+	struct list_head	list;
+	long			nr_items;
+#ifdef CONFIG_LIST_LRU_STAT
+	unsigned long		acquisitions;
+	unsigned long		contentions;
+	u64			wait_total;
+	u64			wait_max;
+#endif
+} ____cacheline_aligned_in_smp;
+
+struct list_lru {
+	struct list_lru_shard	*shards;
+	unsigned int		shard_bits;
+#ifdef CONFIG_LIST_LRU_STAT
+	const char		*name;
+	const char		*owner;
+	struct list_head	stat_list;
+#endif
+};
+
+typedef enum lru_status (*list_lru_walk_cb)(struct list_head *item,
+					    spinlock_t *lock, void *cb_arg);
+
+extern int list_lru_init(struct list_lru *lru, const char *name,
+			 const char *owner);
+extern void list_lru_destroy(struct list_lru *lru);
+extern bool list_lru_add(struct list_lru *lru, struct list_head *item);
+extern bool list_lru_del(struct list_lru *lru, struct list_head *item);
+extern unsigned long list_lru_count(struct list_lru *lru);
+extern unsigned long list_lru_walk(struct list_lru *lru,
+				   list_lru_walk_cb isolate, void *cb_arg,
+				   unsigned long nr_to_walk);
+
+#endif /* _LINUX_LIST_LRU_H */
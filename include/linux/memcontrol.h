@@ -175,6 +175,8 @@ unsigned long mem_cgroup_soft_limit_reclaim(struct zone *zone, int order,
 u64 mem_cgroup_get_limit(struct mem_cgroup *memcg);
 
 void mem_cgroup_count_vm_event(struct mm_struct *mm, enum vm_event_item idx);
+bool mem_cgroup_ksm_merge(struct mm_struct *mm);
+bool mem_cgroup_ksm_wanted(void);
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 void mem_cgroup_split_huge_fixup(struct page *head);
 #endif
@@ -395,6 +397,16 @@ static inline
 void mem_cgroup_count_vm_event(struct mm_struct *mm, enum vm_event_item idx)
 {
 }
+
+static inline bool mem_cgroup_ksm_merge(struct mm_struct *mm)
+{
+	return false;
+}
+
+static inline bool mem_cgroup_ksm_wanted(void)
+{
+	return false;
+}
 static inline void mem_cgroup_replace_page_cache(struct page *oldpage,
 				struct page *newpage)
 {
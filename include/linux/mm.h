@@ -106,7 +106,13 @@ extern unsigned int kobjsize(const void *objp);
 
 #define VM_CAN_NONLINEAR 0x08000000	
 #define VM_MIXEDMAP	0x10000000	
+#ifdef CONFIG_PPC
 #define VM_SAO		0x20000000	
+#define VM_NOKSM	0
+#else
+#define VM_SAO		0
+#define VM_NOKSM	0x20000000	
+#endif
 #define VM_PFN_AT_MMAP	0x40000000	
 #define VM_MERGEABLE	0x80000000	
 
@@ -155,12 +161,16 @@ struct vm_fault {
 	void __user *virtual_address;	
 
 	struct page *page;		
+
+	pgoff_t max_pgoff;		
+	pte_t *pte;			
 };
 
 struct vm_operations_struct {
 	void (*open)(struct vm_area_struct * area);
 	void (*close)(struct vm_area_struct * area);
 	int (*fault)(struct vm_area_struct *vma, struct vm_fault *vmf);
+	void (*map_pages)(struct vm_area_struct *vma, struct vm_fault *vmf);
 
 	int (*page_mkwrite)(struct vm_area_struct *vma, struct vm_fault *vmf);
 
@@ -1067,6 +1077,8 @@ extern void truncate_inode_pages_range(struct address_space *,
 				       loff_t lstart, loff_t lend);
 
 extern int filemap_fault(struct vm_area_struct *, struct vm_fault *);
+extern void filemap_map_pages(struct vm_area_struct *, struct vm_fault *);
+void do_set_pte(struct vm_area_struct *, unsigned long, struct page *, pte_t *);
 
 int write_one_page(struct page *page, int wait);
 void task_dirty_inc(struct task_struct *tsk);
@@ -1202,6 +1214,9 @@ int in_gate_area_no_mm(unsigned long addr);
 
 int drop_caches_sysctl_handler(struct ctl_table *, int,
 					void __user *, size_t *, loff_t *);
+extern int sysctl_fault_around_bytes;
+int fault_around_bytes_sysctl_handler(struct ctl_table *, int,
+					void __user *, size_t *, loff_t *);
 unsigned long shrink_slab(struct shrink_control *shrink,
 			  unsigned long nr_pages_scanned,
 			  unsigned long lru_pages);
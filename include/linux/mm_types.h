@@ -167,6 +167,9 @@ struct vm_area_struct {
 #ifdef CONFIG_NUMA
 	struct mempolicy *vm_policy;	
 #endif
+#ifdef CONFIG_SWAP
+	atomic_long_t swap_readahead_info;
+#endif
 };
 
 struct core_thread {
@@ -106,6 +106,8 @@ enum zone_stat_item {
 	NR_SHMEM,		
 	NR_DIRTIED,		
 	NR_WRITTEN,		
+	WORKINGSET_REFAULT,
+	WORKINGSET_ACTIVATE,
 #ifdef CONFIG_NUMA
 	NUMA_HIT,		
 	NUMA_MISS,		
@@ -174,8 +176,10 @@ enum zone_watermarks {
 };
 
 #define min_wmark_pages(z) (z->watermark[WMARK_MIN])
-#define low_wmark_pages(z) (z->watermark[WMARK_LOW])
-#define high_wmark_pages(z) (z->watermark[WMARK_HIGH])
+#define low_wmark_pages(z) (z->watermark[WMARK_LOW] + z->watermark_boost)
+#define high_wmark_pages(z) (z->watermark[WMARK_HIGH] + z->watermark_boost)
+#define wmark_pages(z, i) ((i) == WMARK_MIN ? min_wmark_pages(z) : \
+			   (z)->watermark[i] + (z)->watermark_boost)
 
 struct per_cpu_pages {
 	int count;		
@@ -186,8 +190,12 @@ struct per_cpu_pages {
 	struct list_head lists[MIGRATE_PCPTYPES];
 };
 
+#define NR_PCP_HIGH_ORDERS	PAGE_ALLOC_COSTLY_ORDER
+
 struct per_cpu_pageset {
 	struct per_cpu_pages pcp;
+	/* orders 1..NR_PCP_HIGH_ORDERS, counted in blocks of that order */
+	struct per_cpu_pages order_pcp[NR_PCP_HIGH_ORDERS];
 #ifdef CONFIG_NUMA
 	s8 expire;
 #endif
@@ -238,6 +246,8 @@ struct zone {
 	
 	unsigned long watermark[NR_WMARK];
 
+	unsigned long watermark_boost;
+
 	unsigned long percpu_drift_mark;
 
 	unsigned long		lowmem_reserve[MAX_NR_ZONES];
@@ -282,6 +292,8 @@ struct zone {
 	unsigned long		pages_scanned;	   
 	unsigned long		flags;		   
 
+	atomic_long_t		inactive_age;
+
 	
 	atomic_long_t		vm_stat[NR_VM_ZONE_STAT_ITEMS];
 
@@ -309,6 +321,7 @@ typedef enum {
 	ZONE_RECLAIM_LOCKED,		
 	ZONE_OOM_LOCKED,		
 	ZONE_CONGESTED,			
+	ZONE_BOOSTED_WATERMARK,		
 } zone_flags_t;
 
 static inline void zone_set_flag(struct zone *zone, zone_flags_t flag)
@@ -418,6 +431,13 @@ typedef struct pglist_data {
 	struct task_struct *kswapd;	
 	int kswapd_max_order;
 	enum zone_type classzone_idx;
+#ifdef CONFIG_COMPACTION
+	int kcompactd_max_order;
+	enum zone_type kcompactd_classzone_idx;
+	wait_queue_head_t kcompactd_wait;
+	struct task_struct *kcompactd;
+	bool kcompactd_proactive;
+#endif
 } pg_data_t;
 
 #define node_present_pages(nid)	(NODE_DATA(nid)->node_present_pages)
@@ -545,6 +565,10 @@ int lowmem_reserve_ratio_sysctl_handler(struct ctl_table *, int,
 					void __user *, size_t *, loff_t *);
 int percpu_pagelist_fraction_sysctl_handler(struct ctl_table *, int,
 					void __user *, size_t *, loff_t *);
+extern int percpu_order_pagelist_high[NR_PCP_HIGH_ORDERS];
+extern int percpu_order_pagelist_batch[NR_PCP_HIGH_ORDERS];
+int percpu_order_pagelist_sysctl_handler(struct ctl_table *, int,
+					void __user *, size_t *, loff_t *);
 int sysctl_min_unmapped_ratio_sysctl_handler(struct ctl_table *, int,
 			void __user *, size_t *, loff_t *);
 int sysctl_min_slab_ratio_sysctl_handler(struct ctl_table *, int,
@@ -188,6 +188,7 @@ struct dev_pm_info {
 	pm_message_t		power_state;
 	unsigned int		can_wakeup:1;
 	unsigned int		async_suspend:1;
+	unsigned int		no_async:1;
 	bool			is_prepared:1;	
 	bool			is_suspended:1;	
 	bool			ignore_children:1;
@@ -197,6 +198,11 @@ struct dev_pm_info {
 	struct completion	completion;
 	struct wakeup_source	*wakeup;
 	bool			wakeup_path:1;
+	bool			async_leaf:1;
+	struct list_head	suppliers;
+	struct list_head	consumers;
+	ktime_t			dpm_start;
+	ktime_t			dpm_end;
 #else
 	unsigned int		should_wakeup:1;
 #endif
@@ -266,6 +272,10 @@ extern void __suspend_report_result(const char *function, void *fn, int ret);
 	} while (0)
 
 extern int device_pm_wait_for_dev(struct device *sub, struct device *dev);
+extern int device_pm_add_supplier(struct device *consumer,
+				  struct device *supplier);
+extern void device_pm_remove_supplier(struct device *consumer,
+				      struct device *supplier);
 
 extern int pm_generic_prepare(struct device *dev);
 extern int pm_generic_suspend_late(struct device *dev);
@@ -305,6 +315,15 @@ static inline int device_pm_wait_for_dev(struct device *a, struct device *b)
 	return 0;
 }
 
+static inline int device_pm_add_supplier(struct device *consumer,
+					 struct device *supplier)
+{
+	return 0;
+}
+
+static inline void device_pm_remove_supplier(struct device *consumer,
+					     struct device *supplier) {}
+
 #define pm_generic_prepare	NULL
 #define pm_generic_suspend	NULL
 #define pm_generic_resume	NULL
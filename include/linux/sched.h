@@ -116,6 +116,9 @@ extern unsigned long nr_running(void);
 extern unsigned long nr_uninterruptible(void);
 extern unsigned long nr_iowait(void);
 extern unsigned long nr_iowait_cpu(int cpu);
+#ifdef CONFIG_NO_HZ_FULL
+extern bool sched_can_stop_tick(void);
+#endif
 extern unsigned long this_cpu_load(void);
 
 
@@ -876,6 +879,7 @@ struct sched_class {
 
 #ifdef CONFIG_SMP
 	int  (*select_task_rq)(struct task_struct *p, int sd_flag, int flags);
+	void (*migrate_task_rq)(struct task_struct *p, int next_cpu);
 
 	void (*pre_schedule) (struct rq *this_rq, struct task_struct *task);
 	void (*post_schedule) (struct rq *this_rq);
@@ -946,6 +950,13 @@ struct sched_statistics {
 };
 #endif
 
+struct sched_avg {
+	u32 runnable_avg_sum, runnable_avg_period;
+	u64 last_runnable_update;
+	s64 decay_count;
+	unsigned long load_avg_contrib;
+};
+
 struct sched_entity {
 	struct load_weight	load;		
 	struct rb_node		run_node;
@@ -970,6 +981,10 @@ struct sched_entity {
 	
 	struct cfs_rq		*my_q;
 #endif
+
+#ifdef CONFIG_SMP
+	struct sched_avg	avg;
+#endif
 };
 
 struct sched_rt_entity {
@@ -1626,6 +1641,33 @@ extern unsigned int sysctl_sched_min_granularity;
 extern unsigned int sysctl_sched_wakeup_granularity;
 extern unsigned int sysctl_sched_child_runs_first;
 
+#ifdef CONFIG_SMP
+extern unsigned int sysctl_sched_energy_aware;
+extern unsigned int sysctl_sched_energy_spread_pct;
+
+/*
+ * Platform energy model for energy-aware wakeup placement.  States are
+ * ordered by capacity, which is relative to the fastest state
+ * (SCHED_POWER_SCALE); power, idle_power and wakeup_cost share one
+ * arbitrary unit.  idle_power is what an idle but not power-collapsed
+ * core draws, wakeup_cost the price of bringing a collapsed core back.
+ */
+struct sched_energy_state {
+	unsigned long freq;
+	unsigned long capacity;
+	unsigned long power;
+};
+
+struct sched_energy {
+	unsigned int nr_states;
+	const struct sched_energy_state *states;
+	unsigned long idle_power;
+	unsigned long wakeup_cost;
+};
+
+extern int sched_energy_register(const struct sched_energy *energy);
+#endif
+
 enum sched_tunable_scaling {
 	SCHED_TUNABLESCALING_NONE,
 	SCHED_TUNABLESCALING_LOG,
@@ -44,6 +44,9 @@ struct kmem_cache_cpu {
 	struct page *page;	
 	struct page *partial;	
 	int node;		
+	unsigned long lock_acquired;	/* node list_lock taken */
+	unsigned long lock_contended;	/* ... after spinning on it */
+	u64 lock_wait;			/* ns spent spinning */
 #ifdef CONFIG_SLUB_STATS
 	unsigned stat[NR_SLUB_STAT_ITEMS];
 #endif
@@ -73,6 +76,8 @@ struct kmem_cache {
 	int objsize;		
 	int offset;		
 	int cpu_partial;	
+	int cpu_partial_base;	/* cpu_partial without adaptive growth */
+	unsigned long lock_contended_seen;
 	struct kmem_cache_order_objects oo;
 
 	
@@ -67,6 +67,11 @@ struct suspend_stats {
 	int	errno[REC_FAILED_NUM];
 	int	last_failed_step;
 	enum suspend_stat_step	failed_steps[REC_FAILED_NUM];
+	int	sync_done;
+	int	sync_skipped;
+	int	sync_aborted;
+	unsigned int	last_sync_time_us;
+	unsigned int	max_sync_time_us;
 };
 
 extern struct suspend_stats suspend_stats;
@@ -3,6 +3,9 @@
 
 #include <linux/clockchips.h>
 #include <linux/irqflags.h>
+#include <linux/cpumask.h>
+
+struct task_struct;
 
 #ifdef CONFIG_GENERIC_CLOCKEVENTS
 
@@ -43,6 +46,13 @@ struct tick_sched {
 	unsigned long			next_jiffies;
 	ktime_t				idle_expires;
 	int				do_timer_last;
+#ifdef CONFIG_NO_HZ_FULL
+	int				full_stopped;
+	int				full_user;
+	unsigned long			full_jiffies;
+	unsigned long			full_expires;
+	ktime_t				full_tick;
+#endif
 };
 
 extern void __init tick_init(void);
@@ -117,4 +127,32 @@ static inline u64 get_cpu_idle_time_us(int cpu, u64 *unused) { return -1; }
 static inline u64 get_cpu_iowait_time_us(int cpu, u64 *unused) { return -1; }
 # endif 
 
+#ifdef CONFIG_NO_HZ_FULL
+extern bool tick_nohz_full_running;
+extern cpumask_var_t tick_nohz_full_mask;
+
+static inline bool tick_nohz_full_cpu(int cpu)
+{
+	if (!tick_nohz_full_running)
+		return false;
+
+	return cpumask_test_cpu(cpu, tick_nohz_full_mask);
+}
+
+static inline bool tick_nohz_full_enabled(void)
+{
+	return tick_nohz_full_running;
+}
+
+extern void tick_nohz_full_check(void);
+extern void tick_nohz_full_kick_cpu(int cpu);
+extern void tick_nohz_task_switch(struct task_struct *prev);
+#else
+static inline bool tick_nohz_full_enabled(void) { return false; }
+static inline bool tick_nohz_full_cpu(int cpu) { return false; }
+static inline void tick_nohz_full_check(void) { }
+static inline void tick_nohz_full_kick_cpu(int cpu) { }
+static inline void tick_nohz_task_switch(struct task_struct *prev) { }
+#endif
+
 #endif
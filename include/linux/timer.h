@@ -190,11 +190,19 @@ extern void set_timer_slack(struct timer_list *time, int slack_hz);
 
 extern unsigned long get_next_timer_interrupt(unsigned long now);
 
+struct ctl_table;
+
+extern unsigned int sysctl_timer_coalesce_ms;
+extern int timer_coalesce_handler(struct ctl_table *table, int write,
+				  void __user *buffer, size_t *lenp,
+				  loff_t *ppos);
+
 #ifdef CONFIG_TIMER_STATS
 
 extern int timer_stats_active;
 
 #define TIMER_STATS_FLAG_DEFERRABLE	0x1
+#define TIMER_STATS_FLAG_MERGED		0x2
 
 extern void init_timer_stats(void);
 
@@ -17,6 +17,7 @@
 #define _LINUX_WAKELOCK_H
 
 #include <linux/list.h>
+#include <linux/rbtree.h>
 #include <linux/ktime.h>
 
 
@@ -28,6 +29,7 @@ enum {
 struct wake_lock {
 #ifdef CONFIG_HAS_WAKELOCK
 	struct list_head    link;
+	struct rb_node      node;
 	int                 flags;
 	const char         *name;
 	unsigned long       expires;
@@ -40,6 +42,7 @@ struct wake_lock {
 		ktime_t         prevent_suspend_time;
 		ktime_t         max_time;
 		ktime_t         last_time;
+		ktime_t         prevent_suspend_start;
 	} stat;
 #endif
 #endif
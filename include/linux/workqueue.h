@@ -67,6 +67,9 @@ struct work_struct {
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map lockdep_map;
 #endif
+#ifdef CONFIG_WQ_LATENCY_STATS
+	u64 queued_at;
+#endif
 };
 
 #define WORK_DATA_INIT()	ATOMIC_LONG_INIT(WORK_STRUCT_NO_CPU)
@@ -210,6 +213,8 @@ enum {
 	WQ_DRAINING		= 1 << 6, 
 	WQ_RESCUER		= 1 << 7, 
 
+	WQ_POWER_EFFICIENT	= 1 << 8, 
+
 	WQ_MAX_ACTIVE		= 512,	  
 	WQ_MAX_UNBOUND_PER_CPU	= 4,	  
 	WQ_DFL_ACTIVE		= WQ_MAX_ACTIVE / 2,
@@ -224,6 +229,8 @@ extern struct workqueue_struct *system_nrt_wq;
 extern struct workqueue_struct *system_unbound_wq;
 extern struct workqueue_struct *system_freezable_wq;
 extern struct workqueue_struct *system_nrt_freezable_wq;
+extern struct workqueue_struct *system_power_efficient_wq;
+extern struct workqueue_struct *system_freezable_power_efficient_wq;
 
 extern struct workqueue_struct *
 __alloc_workqueue_key(const char *fmt, unsigned int flags, int max_active,
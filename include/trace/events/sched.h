@@ -158,6 +158,44 @@ TRACE_EVENT(sched_migrate_task,
 		  __entry->orig_cpu, __entry->dest_cpu)
 );
 
+/*
+ * Tracepoint for energy-aware wakeup placement; target_cpu is -1 when
+ * the task was left to the regular wakeup path.
+ */
+TRACE_EVENT(sched_energy_wake,
+
+	TP_PROTO(struct task_struct *p, int prev_cpu, int target_cpu,
+		 unsigned long task_util, unsigned long cpu_util,
+		 unsigned long energy_delta),
+
+	TP_ARGS(p, prev_cpu, target_cpu, task_util, cpu_util, energy_delta),
+
+	TP_STRUCT__entry(
+		__array(	char,		comm,	TASK_COMM_LEN	)
+		__field(	pid_t,		pid			)
+		__field(	int,		prev_cpu		)
+		__field(	int,		target_cpu		)
+		__field(	unsigned long,	task_util		)
+		__field(	unsigned long,	cpu_util		)
+		__field(	unsigned long,	energy_delta		)
+	),
+
+	TP_fast_assign(
+		memcpy(__entry->comm, p->comm, TASK_COMM_LEN);
+		__entry->pid		= p->pid;
+		__entry->prev_cpu	= prev_cpu;
+		__entry->target_cpu	= target_cpu;
+		__entry->task_util	= task_util;
+		__entry->cpu_util	= cpu_util;
+		__entry->energy_delta	= energy_delta;
+	),
+
+	TP_printk("comm=%s pid=%d prev_cpu=%d target_cpu=%d task_util=%lu cpu_util=%lu energy_delta=%lu",
+		  __entry->comm, __entry->pid, __entry->prev_cpu,
+		  __entry->target_cpu, __entry->task_util, __entry->cpu_util,
+		  __entry->energy_delta)
+);
+
 DECLARE_EVENT_CLASS(sched_process_template,
 
 	TP_PROTO(struct task_struct *p),
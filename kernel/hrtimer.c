@@ -614,13 +614,15 @@ static inline void timer_stats_hrtimer_clear_start_info(struct hrtimer *timer)
 #endif
 }
 
-static inline void timer_stats_account_hrtimer(struct hrtimer *timer)
+static inline void timer_stats_account_hrtimer(struct hrtimer *timer,
+					       bool merged)
 {
 #ifdef CONFIG_TIMER_STATS
 	if (likely(!timer_stats_active))
 		return;
 	timer_stats_update_stats(timer, timer->start_pid, timer->start_site,
-				 timer->function, timer->start_comm, 0);
+				 timer->function, timer->start_comm,
+				 merged ? TIMER_STATS_FLAG_MERGED : 0);
 #endif
 }
 
@@ -892,7 +894,7 @@ int hrtimer_get_res(const clockid_t which_clock, struct timespec *tp)
 }
 EXPORT_SYMBOL_GPL(hrtimer_get_res);
 
-static void __run_hrtimer(struct hrtimer *timer, ktime_t *now)
+static void __run_hrtimer(struct hrtimer *timer, ktime_t *now, bool merged)
 {
 	struct hrtimer_clock_base *base = timer->base;
 	struct hrtimer_cpu_base *cpu_base = base->cpu_base;
@@ -903,7 +905,7 @@ static void __run_hrtimer(struct hrtimer *timer, ktime_t *now)
 
 	debug_deactivate(timer);
 	__remove_hrtimer(timer, base, HRTIMER_STATE_CALLBACK, 0);
-	timer_stats_account_hrtimer(timer);
+	timer_stats_account_hrtimer(timer, merged);
 	fn = timer->function;
 
 	raw_spin_unlock(&cpu_base->lock);
@@ -929,6 +931,7 @@ void hrtimer_interrupt(struct clock_event_device *dev)
 	struct hrtimer_cpu_base *cpu_base = &__get_cpu_var(hrtimer_bases);
 	ktime_t expires_next, now, entry_time, delta;
 	int i, retries = 0;
+	bool merged = false;
 
 	BUG_ON(!cpu_base->hres_active);
 	cpu_base->nr_events++;
@@ -967,7 +970,8 @@ retry:
 				break;
 			}
 
-			__run_hrtimer(timer, &basenow);
+			__run_hrtimer(timer, &basenow, merged);
+			merged = true;
 		}
 	}
 
@@ -1055,6 +1059,7 @@ void hrtimer_run_queues(void)
 	struct hrtimer_cpu_base *cpu_base = &__get_cpu_var(hrtimer_bases);
 	struct hrtimer_clock_base *base;
 	int index, gettime = 1;
+	bool merged = false;
 
 	if (hrtimer_hres_active())
 		return;
@@ -1079,7 +1084,8 @@ void hrtimer_run_queues(void)
 					hrtimer_get_expires_tv64(timer))
 				break;
 
-			__run_hrtimer(timer, &base->softirq_time);
+			__run_hrtimer(timer, &base->softirq_time, merged);
+			merged = true;
 		}
 		raw_spin_unlock(&cpu_base->lock);
 	}
@@ -83,6 +83,58 @@ static ssize_t pm_async_store(struct kobject *kobj, struct kobj_attribute *attr,
 
 power_attr(pm_async);
 
+int pm_async_leaf_enabled = 1;
+
+static ssize_t pm_async_leaf_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", pm_async_leaf_enabled);
+}
+
+static ssize_t pm_async_leaf_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t n)
+{
+	unsigned long val;
+
+	if (strict_strtoul(buf, 10, &val))
+		return -EINVAL;
+
+	if (val > 1)
+		return -EINVAL;
+
+	pm_async_leaf_enabled = val;
+	return n;
+}
+
+power_attr(pm_async_leaf);
+
+int pm_print_times_enabled;
+
+static ssize_t pm_print_times_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", pm_print_times_enabled);
+}
+
+static ssize_t pm_print_times_store(struct kobject *kobj,
+				    struct kobj_attribute *attr,
+				    const char *buf, size_t n)
+{
+	unsigned long val;
+
+	if (strict_strtoul(buf, 10, &val))
+		return -EINVAL;
+
+	if (val > 1)
+		return -EINVAL;
+
+	pm_print_times_enabled = val;
+	return n;
+}
+
+power_attr(pm_print_times);
+
 static ssize_t
 touch_event_show(struct kobject *kobj,
 		 struct kobj_attribute *attr, char *buf)
@@ -265,6 +317,12 @@ static int suspend_stats_show(struct seq_file *s, void *unused)
 				suspend_stats.failed_resume_early,
 			"failed_resume_noirq",
 				suspend_stats.failed_resume_noirq);
+	seq_printf(s, "%s: %d\n%s: %d\n%s: %d\n%s: %u\n%s: %u\n",
+			"sync_done", suspend_stats.sync_done,
+			"sync_skipped", suspend_stats.sync_skipped,
+			"sync_aborted", suspend_stats.sync_aborted,
+			"last_sync_time_us", suspend_stats.last_sync_time_us,
+			"max_sync_time_us", suspend_stats.max_sync_time_us);
 	seq_printf(s,	"failures:\n  last_failed_dev:\t%-s\n",
 			suspend_stats.failed_devs[last_dev]);
 	for (i = 1; i < REC_FAILED_NUM; i++) {
@@ -783,6 +841,8 @@ static struct attribute *g[] = {
 #endif
 #ifdef CONFIG_PM_SLEEP
 	&pm_async_attr.attr,
+	&pm_async_leaf_attr.attr,
+	&pm_print_times_attr.attr,
 	&wakeup_count_attr.attr,
 	&touch_event_attr.attr,
 	&touch_event_timer_attr.attr,
@@ -17,7 +17,7 @@
 #include <linux/platform_device.h>
 #include <linux/rtc.h>
 #include <linux/suspend.h>
-#include <linux/syscalls.h> 
+#include <linux/fs.h>
 #include <linux/wakelock.h>
 #include <linux/syscore_ops.h>
 #include <mach/board_htc.h>
@@ -40,11 +40,12 @@ module_param_named(debug_mask, debug_mask, int, S_IRUGO | S_IWUSR | S_IWGRP);
 #define WAKE_LOCK_INITIALIZED            (1U << 8)
 #define WAKE_LOCK_ACTIVE                 (1U << 9)
 #define WAKE_LOCK_AUTO_EXPIRE            (1U << 10)
-#define WAKE_LOCK_PREVENTING_SUSPEND     (1U << 11)
 
 static DEFINE_SPINLOCK(list_lock);
 static LIST_HEAD(inactive_locks);
 static struct list_head active_wake_locks[WAKE_LOCK_TYPE_COUNT];
+static struct rb_root timed_wake_locks[WAKE_LOCK_TYPE_COUNT];
+static struct rb_node *timed_wake_locks_last[WAKE_LOCK_TYPE_COUNT];
 static int current_event_num;
 static int suspend_sys_sync_count;
 static DEFINE_SPINLOCK(suspend_sys_sync_lock);
@@ -58,15 +59,44 @@ static struct wake_lock unknown_wakeup;
 static struct wake_lock suspend_backoff_lock;
 
 #define SUSPEND_BACKOFF_THRESHOLD	10
+#define SUSPEND_BACKOFF_WINDOW		(30 * HZ)
 #define SUSPEND_BACKOFF_INTERVAL	10000
+#define SUSPEND_BACKOFF_MAX_SHIFT	3
 
-static unsigned suspend_short_count;
+static unsigned suspend_abort_count;
+static unsigned long suspend_abort_window;
+static unsigned suspend_backoff_shift;
+static unsigned long suspend_backoff_end;
 
 #ifdef CONFIG_WAKELOCK_STAT
 static struct wake_lock deleted_wake_locks;
-static ktime_t last_sleep_time_update;
 static int wait_for_wakeup;
 
+static ktime_t last_sleep_time_update;
+static ktime_t sleep_wait_total;
+static bool sleep_waiting;
+
+static ktime_t sleep_wait_clock(ktime_t now)
+{
+	if (!sleep_waiting || now.tv64 <= last_sleep_time_update.tv64)
+		return sleep_wait_total;
+	return ktime_add(sleep_wait_total,
+			 ktime_sub(now, last_sleep_time_update));
+}
+
+static ktime_t prevent_suspend_delta(struct wake_lock *lock, ktime_t now)
+{
+	ktime_t delta;
+
+	if ((lock->flags & WAKE_LOCK_TYPE_MASK) != WAKE_LOCK_SUSPEND)
+		return ktime_set(0, 0);
+	delta = ktime_sub(sleep_wait_clock(now),
+			  lock->stat.prevent_suspend_start);
+	if (delta.tv64 < 0)
+		return ktime_set(0, 0);
+	return delta;
+}
+
 int get_expired_time(struct wake_lock *lock, ktime_t *expire_time)
 {
 	struct timespec ts;
@@ -111,9 +141,8 @@ static int print_lock_stat(struct seq_file *m, struct wake_lock *lock)
 		else
 			expire_count++;
 		total_time = ktime_add(total_time, add_time);
-		if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND)
-			prevent_suspend_time = ktime_add(prevent_suspend_time,
-					ktime_sub(now, last_sleep_time_update));
+		prevent_suspend_time = ktime_add(prevent_suspend_time,
+				prevent_suspend_delta(lock, now));
 		if (add_time.tv64 > max_time.tv64)
 			max_time = add_time;
 	}
@@ -131,6 +160,7 @@ static int wakelock_stats_show(struct seq_file *m, void *unused)
 {
 	unsigned long irqflags;
 	struct wake_lock *lock;
+	struct rb_node *node;
 	int ret;
 	int type;
 
@@ -143,6 +173,10 @@ static int wakelock_stats_show(struct seq_file *m, void *unused)
 	for (type = 0; type < WAKE_LOCK_TYPE_COUNT; type++) {
 		list_for_each_entry(lock, &active_wake_locks[type], link)
 			ret = print_lock_stat(m, lock);
+		for (node = rb_first(&timed_wake_locks[type]); node;
+		     node = rb_next(node))
+			ret = print_lock_stat(m, rb_entry(node, struct wake_lock,
+							  node));
 	}
 	spin_unlock_irqrestore(&list_lock, irqflags);
 	return 0;
@@ -166,49 +200,73 @@ static void wake_unlock_stat_locked(struct wake_lock *lock, int expired)
 	if (ktime_to_ns(duration) > ktime_to_ns(lock->stat.max_time))
 		lock->stat.max_time = duration;
 	lock->stat.last_time = ktime_get();
-	if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND) {
-		duration = ktime_sub(now, last_sleep_time_update);
-		lock->stat.prevent_suspend_time = ktime_add(
-			lock->stat.prevent_suspend_time, duration);
-		lock->flags &= ~WAKE_LOCK_PREVENTING_SUSPEND;
-	}
+	lock->stat.prevent_suspend_time = ktime_add(
+		lock->stat.prevent_suspend_time,
+		prevent_suspend_delta(lock, now));
+}
+
+static void wake_lock_stat_start_locked(struct wake_lock *lock)
+{
+	lock->stat.last_time = ktime_get();
+	lock->stat.prevent_suspend_start =
+		sleep_wait_clock(lock->stat.last_time);
 }
 
 static void update_sleep_wait_stats_locked(int done)
 {
-	struct wake_lock *lock;
-	ktime_t now, etime, elapsed, add;
-	int expired;
-
-	now = ktime_get();
-	elapsed = ktime_sub(now, last_sleep_time_update);
-	list_for_each_entry(lock, &active_wake_locks[WAKE_LOCK_SUSPEND], link) {
-		expired = get_expired_time(lock, &etime);
-		if (lock->flags & WAKE_LOCK_PREVENTING_SUSPEND) {
-			if (expired)
-				add = ktime_sub(etime, last_sleep_time_update);
-			else
-				add = elapsed;
-			lock->stat.prevent_suspend_time = ktime_add(
-				lock->stat.prevent_suspend_time, add);
-		}
-		if (done || expired)
-			lock->flags &= ~WAKE_LOCK_PREVENTING_SUSPEND;
-		else
-			lock->flags |= WAKE_LOCK_PREVENTING_SUSPEND;
-	}
+	ktime_t now = ktime_get();
+
+	sleep_wait_total = sleep_wait_clock(now);
+	sleep_waiting = !done;
 	last_sleep_time_update = now;
 }
 #endif
 
+static void wake_lock_insert_timed(struct wake_lock *lock, int type)
+{
+	struct rb_node **p = &timed_wake_locks[type].rb_node;
+	struct rb_node *parent = NULL;
+	bool last = true;
+
+	while (*p) {
+		struct wake_lock *entry = rb_entry(*p, struct wake_lock, node);
+
+		parent = *p;
+		if (time_before(lock->expires, entry->expires)) {
+			p = &parent->rb_left;
+			last = false;
+		} else {
+			p = &parent->rb_right;
+		}
+	}
+	rb_link_node(&lock->node, parent, p);
+	rb_insert_color(&lock->node, &timed_wake_locks[type]);
+	if (last)
+		timed_wake_locks_last[type] = &lock->node;
+}
+
+static void wake_lock_unlink(struct wake_lock *lock)
+{
+	int type = lock->flags & WAKE_LOCK_TYPE_MASK;
+
+	if ((lock->flags & (WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE)) ==
+	    (WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE)) {
+		if (timed_wake_locks_last[type] == &lock->node)
+			timed_wake_locks_last[type] = rb_prev(&lock->node);
+		rb_erase(&lock->node, &timed_wake_locks[type]);
+	} else {
+		list_del(&lock->link);
+	}
+}
+
 
 static void expire_wake_lock(struct wake_lock *lock)
 {
 #ifdef CONFIG_WAKELOCK_STAT
 	wake_unlock_stat_locked(lock, 1);
 #endif
+	wake_lock_unlink(lock);
 	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
-	list_del(&lock->link);
 	list_add(&lock->link, &inactive_locks);
 	if (debug_mask & (DEBUG_WAKE_LOCK | DEBUG_EXPIRE))
 		pr_info("expired wake lock %s\n", lock->name);
@@ -217,46 +275,49 @@ static void expire_wake_lock(struct wake_lock *lock)
 static void print_active_locks(int type)
 {
 	struct wake_lock *lock;
+	struct rb_node *node;
 	bool print_expired = true;
 
 	BUG_ON(type >= WAKE_LOCK_TYPE_COUNT);
 	list_for_each_entry(lock, &active_wake_locks[type], link) {
-		if (lock->flags & WAKE_LOCK_AUTO_EXPIRE) {
-			long timeout = lock->expires - jiffies;
-			if (timeout > 0)
-				pr_info("active wake lock %s, time left %ld\n",
-					lock->name, timeout);
-			else if (print_expired)
-				pr_info("wake lock %s, expired\n", lock->name);
-		} else {
-			pr_info("active wake lock %s\n", lock->name);
-			if (!(debug_mask & DEBUG_EXPIRE))
-				print_expired = false;
-		}
+		pr_info("active wake lock %s\n", lock->name);
+		if (!(debug_mask & DEBUG_EXPIRE))
+			print_expired = false;
+	}
+	for (node = rb_first(&timed_wake_locks[type]); node;
+	     node = rb_next(node)) {
+		long timeout;
+
+		lock = rb_entry(node, struct wake_lock, node);
+		timeout = lock->expires - jiffies;
+		if (timeout > 0)
+			pr_info("active wake lock %s, time left %ld\n",
+				lock->name, timeout);
+		else if (print_expired)
+			pr_info("wake lock %s, expired\n", lock->name);
 	}
 }
 
 void htc_print_active_wake_locks(int type)
 {
 	struct wake_lock *lock;
+	struct rb_node *node;
 	unsigned long irqflags;
 	spin_lock_irqsave(&list_lock, irqflags);
-	if((!list_empty(&active_wake_locks[type]))){
-#if 0 
-		if(type==WAKE_LOCK_IDLE)
-			printk("idle lock: ");
-		else
-#endif
+	if (!list_empty(&active_wake_locks[type]) ||
+	    !RB_EMPTY_ROOT(&timed_wake_locks[type])) {
 		printk("wakelock: ");
-		list_for_each_entry(lock, &active_wake_locks[type], link) {
-			if (lock->flags & WAKE_LOCK_AUTO_EXPIRE) {
-				long timeout = lock->expires - jiffies;
-				if (timeout > 0)
-					printk(" '%s', time left %ld; ",
-						lock->name, timeout);
-			} else {
-				printk(" '%s' ", lock->name);
-			}
+		list_for_each_entry(lock, &active_wake_locks[type], link)
+			printk(" '%s' ", lock->name);
+		for (node = rb_first(&timed_wake_locks[type]); node;
+		     node = rb_next(node)) {
+			long timeout;
+
+			lock = rb_entry(node, struct wake_lock, node);
+			timeout = lock->expires - jiffies;
+			if (timeout > 0)
+				printk(" '%s', time left %ld; ",
+					lock->name, timeout);
 		}
 		printk("\n");
 	}
@@ -265,21 +326,24 @@ void htc_print_active_wake_locks(int type)
 
 static long has_wake_lock_locked(int type)
 {
-	struct wake_lock *lock, *n;
-	long max_timeout = 0;
+	struct rb_node *node;
+	struct wake_lock *lock;
 
 	BUG_ON(type >= WAKE_LOCK_TYPE_COUNT);
-	list_for_each_entry_safe(lock, n, &active_wake_locks[type], link) {
-		if (lock->flags & WAKE_LOCK_AUTO_EXPIRE) {
-			long timeout = lock->expires - jiffies;
-			if (timeout <= 0)
-				expire_wake_lock(lock);
-			else if (timeout > max_timeout)
-				max_timeout = timeout;
-		} else
-			return -1;
+	if (!list_empty(&active_wake_locks[type]))
+		return -1;
+
+	while ((node = rb_first(&timed_wake_locks[type]))) {
+		lock = rb_entry(node, struct wake_lock, node);
+		if (time_after(lock->expires, jiffies))
+			break;
+		expire_wake_lock(lock);
 	}
-	return max_timeout;
+
+	node = timed_wake_locks_last[type];
+	if (!node)
+		return 0;
+	return rb_entry(node, struct wake_lock, node)->expires - jiffies;
 }
 
 long has_wake_lock(int type)
@@ -294,17 +358,42 @@ long has_wake_lock(int type)
 	return ret;
 }
 
+static bool suspend_sys_sync_failed;
+static int suspend_sys_sync_event_num;
+
+static bool suspend_sys_sync_should_abort(void)
+{
+	return ACCESS_ONCE(current_event_num) != suspend_sys_sync_event_num;
+}
+
 static void suspend_sys_sync(struct work_struct *work)
 {
+	ktime_t start;
+	unsigned int us;
+	int ret;
+
 	if (debug_mask & DEBUG_SUSPEND)
 		pr_info("PM: Syncing filesystems...\n");
 
-	sys_sync();
+	start = ktime_get();
+	ret = sync_dirty_filesystems(suspend_sys_sync_should_abort);
+	us = ktime_us_delta(ktime_get(), start);
 
 	if (debug_mask & DEBUG_SUSPEND)
-		pr_info("sync done.\n");
+		pr_info("sync %s after %u usecs.\n", ret < 0 ? "aborted" :
+			ret ? "skipped" : "done", us);
 
 	spin_lock(&suspend_sys_sync_lock);
+	if (ret < 0)
+		suspend_stats.sync_aborted++;
+	else if (ret)
+		suspend_stats.sync_skipped++;
+	else
+		suspend_stats.sync_done++;
+	suspend_stats.last_sync_time_us = us;
+	if (us > suspend_stats.max_sync_time_us)
+		suspend_stats.max_sync_time_us = us;
+	suspend_sys_sync_failed = ret < 0;
 	suspend_sys_sync_count--;
 	spin_unlock(&suspend_sys_sync_lock);
 }
@@ -315,6 +404,7 @@ void suspend_sys_sync_queue(void)
 	int ret;
 
 	spin_lock(&suspend_sys_sync_lock);
+	suspend_sys_sync_event_num = ACCESS_ONCE(current_event_num);
 	ret = queue_work(suspend_sys_sync_work_queue, &suspend_sys_sync_work);
 	if (ret)
 		suspend_sys_sync_count++;
@@ -347,7 +437,7 @@ int suspend_sys_sync_wait(void)
 				SUSPEND_SYS_SYNC_TIMEOUT);
 		wait_for_completion(&suspend_sys_sync_comp);
 	}
-	if (suspend_sys_sync_abort) {
+	if (suspend_sys_sync_abort || suspend_sys_sync_failed) {
 		pr_info("suspend aborted....while waiting for sys_sync\n");
 		return -EAGAIN;
 	}
@@ -357,9 +447,41 @@ int suspend_sys_sync_wait(void)
 
 static void suspend_backoff(void)
 {
-	pr_info("suspend: too many immediate wakeups, back off\n");
-	wake_lock_timeout(&suspend_backoff_lock,
-			  msecs_to_jiffies(SUSPEND_BACKOFF_INTERVAL));
+	unsigned int interval;
+
+	if (suspend_backoff_shift &&
+	    time_after(jiffies, suspend_backoff_end + SUSPEND_BACKOFF_WINDOW))
+		suspend_backoff_shift = 0;
+
+	interval = SUSPEND_BACKOFF_INTERVAL << suspend_backoff_shift;
+	if (suspend_backoff_shift < SUSPEND_BACKOFF_MAX_SHIFT)
+		suspend_backoff_shift++;
+
+	pr_info("suspend: %u aborted attempts in %u ms, back off %u ms\n",
+		suspend_abort_count,
+		jiffies_to_msecs(jiffies - suspend_abort_window), interval);
+	suspend_backoff_end = jiffies + msecs_to_jiffies(interval);
+	wake_lock_timeout(&suspend_backoff_lock, msecs_to_jiffies(interval));
+}
+
+static void suspend_note_abort(void)
+{
+	if (!suspend_abort_count ||
+	    time_after(jiffies, suspend_abort_window + SUSPEND_BACKOFF_WINDOW)) {
+		suspend_abort_window = jiffies;
+		suspend_abort_count = 0;
+	}
+
+	if (++suspend_abort_count >= SUSPEND_BACKOFF_THRESHOLD) {
+		suspend_backoff();
+		suspend_abort_count = 0;
+	}
+}
+
+static void suspend_note_success(void)
+{
+	suspend_abort_count = 0;
+	suspend_backoff_shift = 0;
 }
 
 static void suspend(struct work_struct *work)
@@ -391,16 +513,10 @@ static void suspend(struct work_struct *work)
 			tm.tm_hour, tm.tm_min, tm.tm_sec, ts_exit.tv_nsec);
 	}
 
-	if (ts_exit.tv_sec - ts_entry.tv_sec <= 1) {
-		++suspend_short_count;
-
-		if (suspend_short_count == SUSPEND_BACKOFF_THRESHOLD) {
-			suspend_backoff();
-			suspend_short_count = 0;
-		}
-	} else {
-		suspend_short_count = 0;
-	}
+	if (ret || ts_exit.tv_sec - ts_entry.tv_sec <= 1)
+		suspend_note_abort();
+	else
+		suspend_note_success();
 
 	if (current_event_num == entry_event_num) {
 		if (debug_mask & DEBUG_SUSPEND)
@@ -463,10 +579,12 @@ void wake_lock_init(struct wake_lock *lock, int type, const char *name)
 	lock->stat.prevent_suspend_time = ktime_set(0, 0);
 	lock->stat.max_time = ktime_set(0, 0);
 	lock->stat.last_time = ktime_set(0, 0);
+	lock->stat.prevent_suspend_start = ktime_set(0, 0);
 #endif
 	lock->flags = (type & WAKE_LOCK_TYPE_MASK) | WAKE_LOCK_INITIALIZED;
 
 	INIT_LIST_HEAD(&lock->link);
+	RB_CLEAR_NODE(&lock->node);
 	spin_lock_irqsave(&list_lock, irqflags);
 	list_add(&lock->link, &inactive_locks);
 	spin_unlock_irqrestore(&list_lock, irqflags);
@@ -495,7 +613,7 @@ void wake_lock_destroy(struct wake_lock *lock)
 				  lock->stat.max_time);
 	}
 #endif
-	list_del(&lock->link);
+	wake_lock_unlink(lock);
 	spin_unlock_irqrestore(&list_lock, irqflags);
 }
 EXPORT_SYMBOL(wake_lock_destroy);
@@ -521,16 +639,16 @@ static void wake_lock_internal(
 	if ((lock->flags & WAKE_LOCK_AUTO_EXPIRE) &&
 	    (long)(lock->expires - jiffies) <= 0) {
 		wake_unlock_stat_locked(lock, 0);
-		lock->stat.last_time = ktime_get();
+		wake_lock_stat_start_locked(lock);
 	}
 #endif
+	wake_lock_unlink(lock);
 	if (!(lock->flags & WAKE_LOCK_ACTIVE)) {
 		lock->flags |= WAKE_LOCK_ACTIVE;
 #ifdef CONFIG_WAKELOCK_STAT
-		lock->stat.last_time = ktime_get();
+		wake_lock_stat_start_locked(lock);
 #endif
 	}
-	list_del(&lock->link);
 	if (has_timeout) {
 		if (debug_mask & DEBUG_WAKE_LOCK)
 			pr_info("wake_lock: %s, type %d, timeout %ld.%03lu\n",
@@ -538,7 +656,7 @@ static void wake_lock_internal(
 				(timeout % HZ) * MSEC_PER_SEC / HZ);
 		lock->expires = jiffies + timeout;
 		lock->flags |= WAKE_LOCK_AUTO_EXPIRE;
-		list_add_tail(&lock->link, &active_wake_locks[type]);
+		wake_lock_insert_timed(lock, type);
 	} else {
 		if (debug_mask & DEBUG_WAKE_LOCK)
 			pr_info("wake_lock: %s, type %d\n", lock->name, type);
@@ -551,8 +669,6 @@ static void wake_lock_internal(
 #ifdef CONFIG_WAKELOCK_STAT
 		if (lock == &main_wake_lock)
 			update_sleep_wait_stats_locked(1);
-		else if (!wake_lock_active(&main_wake_lock))
-			update_sleep_wait_stats_locked(0);
 #endif
 		if (has_timeout)
 			expire_in = has_wake_lock_locked(type);
@@ -598,8 +714,8 @@ void wake_unlock(struct wake_lock *lock)
 #endif
 	if (debug_mask & DEBUG_WAKE_LOCK)
 		pr_info("wake_unlock: %s\n", lock->name);
+	wake_lock_unlink(lock);
 	lock->flags &= ~(WAKE_LOCK_ACTIVE | WAKE_LOCK_AUTO_EXPIRE);
-	list_del(&lock->link);
 	list_add(&lock->link, &inactive_locks);
 	if (type == WAKE_LOCK_SUSPEND) {
 		long has_lock = has_wake_lock_locked(type);
@@ -655,8 +771,10 @@ static int __init wakelocks_init(void)
 	if (get_kernel_flag() & KERNEL_FLAG_WAKELOCK_DBG)
 		debug_mask |= DEBUG_WAKE_LOCK;
 
-	for (i = 0; i < ARRAY_SIZE(active_wake_locks); i++)
+	for (i = 0; i < ARRAY_SIZE(active_wake_locks); i++) {
 		INIT_LIST_HEAD(&active_wake_locks[i]);
+		timed_wake_locks[i] = RB_ROOT;
+	}
 
 #ifdef CONFIG_WAKELOCK_STAT
 	wake_lock_init(&deleted_wake_locks, WAKE_LOCK_SUSPEND,
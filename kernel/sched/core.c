@@ -907,6 +907,8 @@ void set_task_cpu(struct task_struct *p, unsigned int new_cpu)
 	trace_sched_migrate_task(p, new_cpu);
 
 	if (task_cpu(p) != new_cpu) {
+		if (p->sched_class->migrate_task_rq)
+			p->sched_class->migrate_task_rq(p, new_cpu);
 		p->se.nr_migrations++;
 		perf_sw_event(PERF_COUNT_SW_CPU_MIGRATIONS, 1, NULL, 0);
 	}
@@ -1177,10 +1179,12 @@ static void sched_ttwu_pending(void)
 
 void scheduler_ipi(void)
 {
-	if (llist_empty(&this_rq()->wake_list) && !got_nohz_idle_kick())
+	if (llist_empty(&this_rq()->wake_list) && !got_nohz_idle_kick()
+	    && !tick_nohz_full_cpu(smp_processor_id()))
 		return;
 
 	irq_enter();
+	tick_nohz_full_check();
 	sched_ttwu_pending();
 
 	if (unlikely(got_nohz_idle_kick() && !need_resched())) {
@@ -1337,6 +1341,10 @@ static void __sched_fork(struct task_struct *p)
 	p->se.vruntime			= 0;
 	INIT_LIST_HEAD(&p->se.group_node);
 
+#ifdef CONFIG_SMP
+	memset(&p->se.avg, 0, sizeof(p->se.avg));
+#endif
+
 #ifdef CONFIG_SCHEDSTATS
 	memset(&p->se.statistics, 0, sizeof(p->se.statistics));
 #endif
@@ -1407,6 +1415,7 @@ void wake_up_new_task(struct task_struct *p)
 
 	raw_spin_lock_irqsave(&p->pi_lock, flags);
 #ifdef CONFIG_SMP
+	init_task_runnable_average(p);
 	set_task_cpu(p, select_task_rq(p, SD_BALANCE_FORK, 0));
 #endif
 
@@ -1503,6 +1512,7 @@ static void finish_task_switch(struct rq *rq, struct task_struct *prev)
 	finish_arch_post_lock_switch();
 
 	fire_sched_in_preempt_notifiers(current);
+	tick_nohz_task_switch(prev);
 	if (mm)
 		mmdrop(mm);
 	if (unlikely(prev_state == TASK_DEAD)) {
@@ -1646,6 +1656,14 @@ unsigned long nr_iowait_cpu(int cpu)
 	return atomic_read(&this->nr_iowait);
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+bool sched_can_stop_tick(void)
+{
+	smp_rmb();
+	return this_rq()->nr_running <= 1;
+}
+#endif
+
 unsigned long this_cpu_load(void)
 {
 	struct rq *this = this_rq();
@@ -1879,7 +1897,11 @@ decay_load_missed(unsigned long load, unsigned long missed_updates, int idx)
 
 void update_cpu_load(struct rq *this_rq)
 {
+#ifdef CONFIG_SMP
+	unsigned long this_load = this_rq->cfs.runnable_load_avg;
+#else
 	unsigned long this_load = this_rq->load.weight;
+#endif
 	unsigned long curr_jiffies = jiffies;
 	unsigned long pending_updates;
 	int i, scale;
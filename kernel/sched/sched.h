@@ -3,6 +3,7 @@
 #include <linux/mutex.h>
 #include <linux/spinlock.h>
 #include <linux/stop_machine.h>
+#include <linux/tick.h>
 
 #include "cpupri.h"
 
@@ -89,6 +90,10 @@ struct task_group {
 	unsigned long shares;
 
 	atomic_t load_weight;
+#ifdef CONFIG_SMP
+	atomic64_t load_avg;
+	atomic_t runnable_avg;
+#endif
 #endif
 
 #ifdef CONFIG_RT_GROUP_SCHED
@@ -177,6 +182,16 @@ struct cfs_rq {
 	unsigned int nr_spread_over;
 #endif
 
+#ifdef CONFIG_SMP
+	unsigned long runnable_load_avg, blocked_load_avg;
+	atomic64_t decay_counter, removed_load;
+	u64 last_decay;
+#ifdef CONFIG_FAIR_GROUP_SCHED
+	u32 tg_runnable_contrib;
+	u64 tg_load_contrib;
+#endif
+#endif
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	struct rq *rq;	
 
@@ -322,6 +337,8 @@ struct rq {
 	u64 age_stamp;
 	u64 idle_stamp;
 	u64 avg_idle;
+
+	struct sched_avg avg;
 #endif
 
 #ifdef CONFIG_IRQ_TIME_ACCOUNTING
@@ -671,6 +688,7 @@ extern const struct sched_class idle_sched_class;
 
 extern void trigger_load_balance(struct rq *rq, int cpu);
 extern void idle_balance(int this_cpu, struct rq *this_rq);
+extern void init_task_runnable_average(struct task_struct *p);
 
 #else	
 
@@ -732,6 +750,12 @@ static inline void cpuacct_charge(struct task_struct *tsk, u64 cputime) {}
 static inline void inc_nr_running(struct rq *rq)
 {
 	rq->nr_running++;
+#ifdef CONFIG_NO_HZ_FULL
+	if (rq->nr_running == 2 && tick_nohz_full_cpu(cpu_of(rq))) {
+		smp_wmb();
+		smp_send_reschedule(cpu_of(rq));
+	}
+#endif
 }
 
 static inline void dec_nr_running(struct rq *rq)
@@ -0,0 +1,147 @@
+/*
+ * kernel/time/nohz_full_bench.c
+ *
+ * Adaptive-tick benchmark.  On load, a kthread bound to one of the
+ * nohz_full= CPUs spins on a pure compute loop for duration_ms, once with
+ * the periodic tick forced on and once with adaptive ticks enabled.  The
+ * number of interrupts taken on that CPU and the loop throughput are
+ * printed for both runs.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/sched.h>
+#include <linux/smp.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/delay.h>
+#include <linux/jiffies.h>
+#include <linux/kernel_stat.h>
+#include <linux/interrupt.h>
+#include <linux/tick.h>
+#include <linux/math64.h>
+
+static int cpu = -1;
+module_param(cpu, int, 0444);
+MODULE_PARM_DESC(cpu, "CPU to run on, default the first nohz_full cpu");
+
+static unsigned int duration_ms = 2000;
+module_param(duration_ms, uint, 0444);
+MODULE_PARM_DESC(duration_ms, "Length of each run in milliseconds");
+
+static unsigned int settle_ms = 100;
+module_param(settle_ms, uint, 0444);
+MODULE_PARM_DESC(settle_ms, "Delay before each run in milliseconds");
+
+struct bench_result {
+	u64 ns;
+	unsigned long ops;
+	unsigned long irqs;
+	unsigned int timer_softirqs;
+};
+
+static DECLARE_COMPLETION(bench_done);
+
+static int bench_thread_fn(void *arg)
+{
+	struct bench_result *res = arg;
+	unsigned long end, irqs;
+	unsigned int softirqs;
+	u32 x = 1;
+	u64 start;
+
+	irqs = kstat_cpu_irqs_sum(cpu);
+	softirqs = kstat_cpu(cpu).softirqs[TIMER_SOFTIRQ];
+	start = local_clock();
+	end = jiffies + msecs_to_jiffies(duration_ms);
+
+	while (time_before(jiffies, end)) {
+		unsigned int i;
+
+		for (i = 0; i < 1024; i++)
+			x = x * 1664525 + 1013904223;
+		res->ops += 1024;
+	}
+
+	res->ns = local_clock() - start;
+	res->irqs = kstat_cpu_irqs_sum(cpu) - irqs;
+	res->timer_softirqs = kstat_cpu(cpu).softirqs[TIMER_SOFTIRQ] - softirqs;
+	/* keep the loop from being optimised away */
+	res->ops += x & 1;
+
+	complete_and_exit(&bench_done, 0);
+}
+
+static void bench_sync_tick(void *info)
+{
+	tick_nohz_full_check();
+}
+
+static int bench_run(bool adaptive, struct bench_result *res)
+{
+	struct task_struct *task;
+
+	tick_nohz_full_running = adaptive;
+	smp_call_function_single(cpu, bench_sync_tick, NULL, 1);
+	msleep(settle_ms);
+
+	INIT_COMPLETION(bench_done);
+	task = kthread_create(bench_thread_fn, res, "nohz_bench/%d", cpu);
+	if (IS_ERR(task))
+		return PTR_ERR(task);
+	kthread_bind(task, cpu);
+	wake_up_process(task);
+	wait_for_completion(&bench_done);
+	return 0;
+}
+
+static void bench_print(const char *mode, struct bench_result *res)
+{
+	u64 rate = res->ns ? div64_u64((u64)res->ops * NSEC_PER_SEC, res->ns) : 0;
+
+	pr_info("nohz_full_bench: cpu %d %s: %lu irqs, %u timer softirqs, %llu ops/s\n",
+		cpu, mode, res->irqs, res->timer_softirqs, rate);
+}
+
+static int __init nohz_full_bench_init(void)
+{
+	struct bench_result periodic = { 0 }, adaptive = { 0 };
+	int ret;
+
+	if (!tick_nohz_full_enabled())
+		return -ENODEV;
+
+	if (cpu < 0)
+		cpu = cpumask_first(tick_nohz_full_mask);
+	if (cpu >= nr_cpu_ids || !cpu_online(cpu) ||
+	    !cpumask_test_cpu(cpu, tick_nohz_full_mask) || !duration_ms)
+		return -EINVAL;
+
+	ret = bench_run(false, &periodic);
+	if (!ret)
+		ret = bench_run(true, &adaptive);
+	tick_nohz_full_running = true;
+	if (ret)
+		return ret;
+
+	bench_print("periodic", &periodic);
+	bench_print("adaptive", &adaptive);
+	return 0;
+}
+
+static void __exit nohz_full_bench_exit(void)
+{
+}
+
+module_init(nohz_full_bench_init);
+module_exit(nohz_full_bench_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Periodic vs adaptive tick interrupt and throughput benchmark");
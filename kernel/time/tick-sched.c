@@ -11,6 +11,7 @@
  *
  *  Distribute under GPLv2.
  */
+#include <linux/bootmem.h>
 #include <linux/cpu.h>
 #include <linux/err.h>
 #include <linux/hrtimer.h>
@@ -257,7 +258,8 @@ static void tick_nohz_stop_sched_tick(struct tick_sched *ts)
 	} while (read_seqretry(&xtime_lock, seq));
 
 	if (rcu_needs_cpu(cpu) || printk_needs_cpu(cpu) ||
-	    arch_needs_cpu(cpu)) {
+	    arch_needs_cpu(cpu) ||
+	    (tick_nohz_full_enabled() && cpu == tick_do_timer_cpu)) {
 		next_jiffies = last_jiffies + 1;
 		delta_jiffies = 1;
 	} else {
@@ -593,12 +595,156 @@ static void wakeup_user(void)
 		queue_work(rq_wq, &rq_info.def_timer_work);
 	}
 }
+
+#ifdef CONFIG_NO_HZ_FULL
+#define TICK_NOHZ_FULL_MAX_DEFER	(HZ / 10)
+
+bool tick_nohz_full_running;
+EXPORT_SYMBOL_GPL(tick_nohz_full_running);
+cpumask_var_t tick_nohz_full_mask;
+EXPORT_SYMBOL_GPL(tick_nohz_full_mask);
+
+static int __init tick_nohz_full_setup(char *str)
+{
+	int cpu = smp_processor_id();
+	char buf[64];
+
+	alloc_bootmem_cpumask_var(&tick_nohz_full_mask);
+	if (cpulist_parse(str, tick_nohz_full_mask) < 0) {
+		pr_warning("NOHZ: Incorrect nohz_full cpumask\n");
+		cpumask_clear(tick_nohz_full_mask);
+		return 1;
+	}
+
+	if (cpumask_test_cpu(cpu, tick_nohz_full_mask)) {
+		pr_warning("NOHZ: Clearing %d from nohz_full range for timekeeping\n",
+			   cpu);
+		cpumask_clear_cpu(cpu, tick_nohz_full_mask);
+	}
+
+	tick_nohz_full_running = !cpumask_empty(tick_nohz_full_mask);
+	if (tick_nohz_full_running) {
+		cpulist_scnprintf(buf, sizeof(buf), tick_nohz_full_mask);
+		pr_info("NOHZ: Full dynticks CPUs: %s\n", buf);
+	}
+	return 1;
+}
+__setup("nohz_full=", tick_nohz_full_setup);
+
+static bool tick_nohz_full_can_stop(struct tick_sched *ts, int cpu)
+{
+	struct task_struct *p = current;
+
+	if (!tick_nohz_full_cpu(cpu) || ts->inidle || is_idle_task(p))
+		return false;
+
+	if (tick_do_timer_cpu == cpu || tick_do_timer_cpu == TICK_DO_TIMER_NONE)
+		return false;
+
+	if (!sched_can_stop_tick())
+		return false;
+
+	if (rcu_needs_cpu(cpu) || printk_needs_cpu(cpu) ||
+	    arch_needs_cpu(cpu) || local_softirq_pending())
+		return false;
+
+	if (p->signal->cputimer.running || p->cputime_expires.utime ||
+	    p->cputime_expires.stime || p->cputime_expires.sum_exec_runtime)
+		return false;
+
+	return true;
+}
+
+static unsigned long tick_nohz_full_defer(struct tick_sched *ts, int cpu,
+					  int user)
+{
+	unsigned long delta;
+
+	if (!tick_nohz_full_can_stop(ts, cpu))
+		return 1;
+
+	ts->full_stopped = 1;
+	ts->full_user = user;
+	ts->full_jiffies = jiffies;
+	ts->full_tick = hrtimer_get_expires(&ts->sched_timer);
+
+	delta = get_next_timer_interrupt(jiffies) - jiffies;
+	if ((long)delta <= 1) {
+		ts->full_stopped = 0;
+		return 1;
+	}
+
+	delta = min_t(unsigned long, delta, TICK_NOHZ_FULL_MAX_DEFER);
+	ts->full_expires = ts->full_jiffies + delta;
+
+	return delta;
+}
+
+static void tick_nohz_full_account(struct tick_sched *ts,
+				   struct task_struct *p, long ticks)
+{
+	while (ticks-- > 0)
+		account_process_tick(p, ts->full_user);
+	ts->full_stopped = 0;
+}
+
+static void tick_nohz_full_restart(struct tick_sched *ts,
+				   struct task_struct *p)
+{
+	tick_nohz_full_account(ts, p, (long)(jiffies - ts->full_jiffies));
+
+	hrtimer_cancel(&ts->sched_timer);
+	hrtimer_set_expires(&ts->sched_timer, ts->full_tick);
+	hrtimer_forward(&ts->sched_timer, ktime_get(), tick_period);
+	hrtimer_start_expires(&ts->sched_timer, HRTIMER_MODE_ABS_PINNED);
+}
+
+void tick_nohz_full_check(void)
+{
+	struct tick_sched *ts = &__get_cpu_var(tick_cpu_sched);
+
+	if (!ts->full_stopped)
+		return;
+
+	if (!tick_nohz_full_can_stop(ts, smp_processor_id()) ||
+	    time_before(get_next_timer_interrupt(jiffies), ts->full_expires))
+		tick_nohz_full_restart(ts, current);
+}
+EXPORT_SYMBOL_GPL(tick_nohz_full_check);
+
+void tick_nohz_full_kick_cpu(int cpu)
+{
+	if (!tick_nohz_full_cpu(cpu))
+		return;
+
+	smp_mb();
+	if (ACCESS_ONCE(per_cpu(tick_cpu_sched, cpu).full_stopped))
+		smp_send_reschedule(cpu);
+}
+
+void tick_nohz_task_switch(struct task_struct *prev)
+{
+	struct tick_sched *ts;
+	unsigned long flags;
+
+	if (!tick_nohz_full_cpu(raw_smp_processor_id()))
+		return;
+
+	local_irq_save(flags);
+	ts = &__get_cpu_var(tick_cpu_sched);
+	if (ts->full_stopped)
+		tick_nohz_full_restart(ts, prev);
+	local_irq_restore(flags);
+}
+#endif
+
 static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 {
 	struct tick_sched *ts =
 		container_of(timer, struct tick_sched, sched_timer);
 	struct pt_regs *regs = get_irq_regs();
 	ktime_t now = ktime_get();
+	ktime_t period = tick_period;
 	int cpu = smp_processor_id();
 
 #ifdef CONFIG_NO_HZ
@@ -615,6 +761,11 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 			touch_softlockup_watchdog();
 			ts->idle_jiffies++;
 		}
+#ifdef CONFIG_NO_HZ_FULL
+		if (ts->full_stopped)
+			tick_nohz_full_account(ts, current,
+					       (long)(jiffies - ts->full_jiffies) - 1);
+#endif
 		update_process_times(user_mode(regs));
 		profile_tick(CPU_PROFILING);
 
@@ -624,9 +775,19 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 
 			wakeup_user();
 		}
+#ifdef CONFIG_NO_HZ_FULL
+		{
+			unsigned long ticks;
+
+			ticks = tick_nohz_full_defer(ts, cpu, user_mode(regs));
+			if (ticks > 1)
+				period = ns_to_ktime((u64)ticks *
+						     ktime_to_ns(tick_period));
+		}
+#endif
 	}
 
-	hrtimer_forward(timer, now, tick_period);
+	hrtimer_forward(timer, now, period);
 
 	return HRTIMER_RESTART;
 }
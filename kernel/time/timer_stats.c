@@ -54,6 +54,7 @@ struct entry {
 	pid_t			pid;
 
 	unsigned long		count;
+	unsigned long		merged;
 	unsigned int		timer_flag;
 
 	char			comm[TASK_COMM_LEN + 1];
@@ -145,6 +146,7 @@ static struct entry *tstat_lookup(struct entry *entry, char *comm)
 	if (curr) {
 		*curr = *entry;
 		curr->count = 0;
+		curr->merged = 0;
 		curr->next = NULL;
 		memcpy(curr->comm, comm, TASK_COMM_LEN);
 
@@ -178,16 +180,18 @@ void timer_stats_update_stats(void *timer, pid_t pid, void *startf,
 	input.start_func = startf;
 	input.expire_func = timerf;
 	input.pid = pid;
-	input.timer_flag = timer_flag;
+	input.timer_flag = timer_flag & TIMER_STATS_FLAG_DEFERRABLE;
 
 	raw_spin_lock_irqsave(lock, flags);
 	if (!timer_stats_active)
 		goto out_unlock;
 
 	entry = tstat_lookup(&input, comm);
-	if (likely(entry))
+	if (likely(entry)) {
 		entry->count++;
-	else
+		if (timer_flag & TIMER_STATS_FLAG_MERGED)
+			entry->merged++;
+	} else
 		atomic_inc(&overflow_count);
 
  out_unlock:
@@ -209,7 +213,7 @@ static int tstats_show(struct seq_file *m, void *v)
 	struct timespec period;
 	struct entry *entry;
 	unsigned long ms;
-	long events = 0;
+	long events = 0, merged = 0;
 	ktime_t time;
 	int i;
 
@@ -244,6 +248,7 @@ static int tstats_show(struct seq_file *m, void *v)
 		seq_puts(m, ")\n");
 
 		events += entry->count;
+		merged += entry->merged;
 	}
 
 	ms += period.tv_sec * 1000;
@@ -257,6 +262,23 @@ static int tstats_show(struct seq_file *m, void *v)
 	else
 		seq_printf(m, "%ld total events\n", events);
 
+	if (!merged)
+		goto out;
+
+	seq_printf(m, "%ld merged events, %ld wakeups\n",
+		   merged, events - merged);
+	for (i = 0; i < nr_entries; i++) {
+		entry = entries + i;
+		if (!entry->merged)
+			continue;
+		seq_printf(m, " %4lu/%-4lu %5d %-16s ", entry->merged,
+			   entry->count, entry->pid, entry->comm);
+		print_name_offset(m, (unsigned long)entry->start_func);
+		seq_puts(m, " (");
+		print_name_offset(m, (unsigned long)entry->expire_func);
+		seq_puts(m, ")\n");
+	}
+ out:
 	mutex_unlock(&show_mutex);
 
 	return 0;
@@ -74,6 +74,7 @@ struct tvec_base {
 	struct timer_list *running_timer;
 	unsigned long timer_jiffies;
 	unsigned long next_timer;
+	int cpu;
 	struct tvec_root tv1;
 	struct tvec tv2;
 	struct tvec tv3;
@@ -190,6 +191,20 @@ void set_timer_slack(struct timer_list *timer, int slack_hz)
 }
 EXPORT_SYMBOL_GPL(set_timer_slack);
 
+unsigned int sysctl_timer_coalesce_ms = 20;
+static unsigned long timer_coalesce_jiffies = DIV_ROUND_UP(20 * HZ, 1000);
+
+int timer_coalesce_handler(struct ctl_table *table, int write,
+			   void __user *buffer, size_t *lenp, loff_t *ppos)
+{
+	int ret;
+
+	ret = proc_dointvec_minmax(table, write, buffer, lenp, ppos);
+	if (!ret && write)
+		timer_coalesce_jiffies = msecs_to_jiffies(sysctl_timer_coalesce_ms);
+	return ret;
+}
+
 static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
 {
 	unsigned long expires = timer->expires;
@@ -233,7 +248,7 @@ void __timer_stats_timer_set_start_info(struct timer_list *timer, void *addr)
 	timer->start_pid = current->pid;
 }
 
-static void timer_stats_account_timer(struct timer_list *timer)
+static void timer_stats_account_timer(struct timer_list *timer, bool merged)
 {
 	unsigned int flag = 0;
 
@@ -241,13 +256,15 @@ static void timer_stats_account_timer(struct timer_list *timer)
 		return;
 	if (unlikely(tbase_get_deferrable(timer->base)))
 		flag |= TIMER_STATS_FLAG_DEFERRABLE;
+	if (merged)
+		flag |= TIMER_STATS_FLAG_MERGED;
 
 	timer_stats_update_stats(timer, timer->start_pid, timer->start_site,
 				 timer->function, timer->start_comm, flag);
 }
 
 #else
-static void timer_stats_account_timer(struct timer_list *timer) {}
+static void timer_stats_account_timer(struct timer_list *timer, bool merged) {}
 #endif
 
 #ifdef CONFIG_DEBUG_OBJECTS_TIMERS
@@ -549,6 +566,8 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 	    !tbase_get_deferrable(timer->base))
 		base->next_timer = timer->expires;
 	internal_add_timer(base, timer);
+	if (!tbase_get_deferrable(timer->base))
+		tick_nohz_full_kick_cpu(base->cpu);
 
 out_unlock:
 	spin_unlock_irqrestore(&base->lock, flags);
@@ -572,11 +591,18 @@ unsigned long apply_slack(struct timer_list *timer, unsigned long expires)
 		expires_limit = expires + timer->slack;
 	} else {
 		long delta = expires - jiffies;
-
-		if (delta < 256)
+		unsigned long slack = 0;
+
+		if (delta >= 256)
+			slack = delta / 256;
+		if (delta >= 4 && timer_coalesce_jiffies)
+			slack = max(slack, min_t(unsigned long,
+						 timer_coalesce_jiffies,
+						 delta / 4));
+		if (!slack)
 			return expires;
 
-		expires_limit = expires + delta / 256;
+		expires_limit = expires + slack;
 	}
 	mask = expires ^ expires_limit;
 	if (mask == 0)
@@ -633,6 +659,8 @@ void add_timer_on(struct timer_list *timer, int cpu)
 		base->next_timer = timer->expires;
 	internal_add_timer(base, timer);
 	wake_up_idle_cpu(cpu);
+	if (!tbase_get_deferrable(timer->base))
+		tick_nohz_full_kick_cpu(cpu);
 	spin_unlock_irqrestore(&base->lock, flags);
 }
 EXPORT_SYMBOL_GPL(add_timer_on);
@@ -757,6 +785,7 @@ static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 static inline void __run_timers(struct tvec_base *base)
 {
 	struct timer_list *timer;
+	bool merged = false;
 
 	spin_lock_irq(&base->lock);
 	while (time_after_eq(jiffies, base->timer_jiffies)) {
@@ -779,7 +808,8 @@ static inline void __run_timers(struct tvec_base *base)
 			fn = timer->function;
 			data = timer->data;
 
-			timer_stats_account_timer(timer);
+			timer_stats_account_timer(timer, merged);
+			merged = true;
 
 			base->running_timer = timer;
 			detach_timer(timer, 1);
@@ -1169,6 +1199,7 @@ static int init_timers_cpu(int cpu)
 
 	base->timer_jiffies = jiffies;
 	base->next_timer = base->timer_jiffies;
+	base->cpu = cpu;
 	return 0;
 }
 
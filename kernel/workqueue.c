@@ -42,6 +42,8 @@
 #include <linux/debug_locks.h>
 #include <linux/lockdep.h>
 #include <linux/idr.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "workqueue_sched.h"
 
@@ -167,6 +169,7 @@ struct worker {
 	int			id;		
 	struct work_struct	rebind_work;	
 	struct work_struct	*previous_work;	
+	unsigned int		cpumask_gen;	
 };
 
 struct global_cwq {
@@ -194,6 +197,19 @@ struct global_cwq {
 	struct worker		*first_idle;	
 } ____cacheline_aligned_in_smp;
 
+#ifdef CONFIG_WQ_LATENCY_STATS
+#define WQ_STATS_BUCKETS	20
+
+struct wq_stats {
+	unsigned long		nr_works;
+	int			peak_active;
+	u64			max_wait;
+	u64			max_exec;
+	unsigned long		wait[WQ_STATS_BUCKETS];
+	unsigned long		exec[WQ_STATS_BUCKETS];
+};
+#endif
+
 struct cpu_workqueue_struct {
 	struct global_cwq	*gcwq;		
 	struct workqueue_struct *wq;		
@@ -204,6 +220,9 @@ struct cpu_workqueue_struct {
 	int			nr_active;	
 	int			max_active;	
 	struct list_head	delayed_works;	
+#ifdef CONFIG_WQ_LATENCY_STATS
+	struct wq_stats		stats;
+#endif
 };
 
 struct wq_flusher {
@@ -263,12 +282,16 @@ struct workqueue_struct *system_nrt_wq __read_mostly;
 struct workqueue_struct *system_unbound_wq __read_mostly;
 struct workqueue_struct *system_freezable_wq __read_mostly;
 struct workqueue_struct *system_nrt_freezable_wq __read_mostly;
+struct workqueue_struct *system_power_efficient_wq __read_mostly;
+struct workqueue_struct *system_freezable_power_efficient_wq __read_mostly;
 EXPORT_SYMBOL_GPL(system_wq);
 EXPORT_SYMBOL_GPL(system_long_wq);
 EXPORT_SYMBOL_GPL(system_nrt_wq);
 EXPORT_SYMBOL_GPL(system_unbound_wq);
 EXPORT_SYMBOL_GPL(system_freezable_wq);
 EXPORT_SYMBOL_GPL(system_nrt_freezable_wq);
+EXPORT_SYMBOL_GPL(system_power_efficient_wq);
+EXPORT_SYMBOL_GPL(system_freezable_power_efficient_wq);
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/workqueue.h>
@@ -421,6 +444,14 @@ static DEFINE_PER_CPU_SHARED_ALIGNED(atomic_t, gcwq_nr_running);
 static struct global_cwq unbound_global_cwq;
 static atomic_t unbound_gcwq_nr_running = ATOMIC_INIT(0);	
 
+static struct cpumask wq_unbound_cpumask = CPU_MASK_ALL;
+static struct cpumask wq_unbound_cpumask_new;
+static unsigned int wq_unbound_cpumask_gen;
+static DEFINE_MUTEX(wq_unbound_mutex);
+
+static bool wq_power_efficient = IS_ENABLED(CONFIG_WQ_POWER_EFFICIENT_DEFAULT);
+module_param_named(power_efficient, wq_power_efficient, bool, 0444);
+
 static int worker_thread(void *__worker);
 
 static struct global_cwq *get_gcwq(unsigned int cpu)
@@ -575,9 +606,28 @@ static struct worker *first_worker(struct global_cwq *gcwq)
 	return list_first_entry(&gcwq->idle_list, struct worker, entry);
 }
 
+static struct worker *local_idle_worker(struct global_cwq *gcwq)
+{
+	int cpu = raw_smp_processor_id();
+	struct worker *worker;
+
+	if (!cpumask_test_cpu(cpu, &wq_unbound_cpumask))
+		return NULL;
+
+	list_for_each_entry(worker, &gcwq->idle_list, entry)
+		if (task_cpu(worker->task) == cpu)
+			return worker;
+	return NULL;
+}
+
 static void wake_up_worker(struct global_cwq *gcwq)
 {
-	struct worker *worker = first_worker(gcwq);
+	struct worker *worker = NULL;
+
+	if (wq_power_efficient && gcwq->cpu == WORK_CPU_UNBOUND)
+		worker = local_idle_worker(gcwq);
+	if (!worker)
+		worker = first_worker(gcwq);
 
 	if (likely(worker))
 		wake_up_process(worker->task);
@@ -709,6 +759,9 @@ static void insert_work(struct cpu_workqueue_struct *cwq,
 
 	smp_wmb();
 
+#ifdef CONFIG_WQ_LATENCY_STATS
+	work->queued_at = local_clock();
+#endif
 	list_add_tail(&work->entry, head);
 
 	smp_mb();
@@ -798,6 +851,10 @@ static void __queue_work(unsigned int cpu, struct workqueue_struct *wq,
 	if (likely(cwq->nr_active < cwq->max_active)) {
 		trace_workqueue_activate_work(work);
 		cwq->nr_active++;
+#ifdef CONFIG_WQ_LATENCY_STATS
+		cwq->stats.peak_active = max(cwq->stats.peak_active,
+					     cwq->nr_active);
+#endif
 		worklist = gcwq_determine_ins_pos(gcwq, cwq);
 	} else {
 		work_flags |= WORK_STRUCT_DELAYED;
@@ -1277,6 +1334,23 @@ static void cwq_dec_nr_in_flight(struct cpu_workqueue_struct *cwq, int color,
 		complete(&cwq->wq->first_flusher->done);
 }
 
+#ifdef CONFIG_WQ_LATENCY_STATS
+static void wq_stats_account(unsigned long *hist, u64 *max, s64 ns)
+{
+	u64 us;
+	int i;
+
+	if (ns < 0)
+		ns = 0;
+	if (ns > *max)
+		*max = ns;
+
+	us = div_u64(ns, NSEC_PER_USEC);
+	i = us ? min_t(int, ilog2(us) + 1, WQ_STATS_BUCKETS - 1) : 0;
+	hist[i]++;
+}
+#endif
+
 static void process_one_work(struct worker *worker, struct work_struct *work)
 __releases(&gcwq->lock)
 __acquires(&gcwq->lock)
@@ -1290,6 +1364,9 @@ __acquires(&gcwq->lock)
 	struct worker *collision;
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map lockdep_map = work->lockdep_map;
+#endif
+#ifdef CONFIG_WQ_LATENCY_STATS
+	u64 start;
 #endif
 	collision = __find_worker_executing_work(gcwq, bwh, work);
 	if (unlikely(collision)) {
@@ -1297,6 +1374,13 @@ __acquires(&gcwq->lock)
 		return;
 	}
 
+#ifdef CONFIG_WQ_LATENCY_STATS
+	start = local_clock();
+	cwq->stats.nr_works++;
+	wq_stats_account(cwq->stats.wait, &cwq->stats.max_wait,
+			 start - work->queued_at);
+#endif
+
 	
 	debug_work_deactivate(work);
 	hlist_add_head(&worker->hentry, bwh);
@@ -1350,6 +1434,10 @@ __acquires(&gcwq->lock)
 
 	spin_lock_irq(&gcwq->lock);
 
+#ifdef CONFIG_WQ_LATENCY_STATS
+	wq_stats_account(cwq->stats.exec, &cwq->stats.max_exec,
+			 local_clock() - start);
+#endif
 	
 	if (unlikely(cpu_intensive))
 		worker_clr_flags(worker, WORKER_CPU_INTENSIVE);
@@ -1371,6 +1459,29 @@ static void process_scheduled_works(struct worker *worker)
 	}
 }
 
+static void worker_update_unbound_cpumask(struct worker *worker)
+{
+	if (likely(worker->cpumask_gen == ACCESS_ONCE(wq_unbound_cpumask_gen)))
+		return;
+
+	mutex_lock(&wq_unbound_mutex);
+	if (!set_cpus_allowed_ptr(worker->task, &wq_unbound_cpumask))
+		worker->cpumask_gen = wq_unbound_cpumask_gen;
+	mutex_unlock(&wq_unbound_mutex);
+}
+
+static void wake_up_unbound_stale_workers(void)
+{
+	struct global_cwq *gcwq = get_gcwq(WORK_CPU_UNBOUND);
+	struct worker *worker;
+
+	spin_lock_irq(&gcwq->lock);
+	list_for_each_entry(worker, &gcwq->idle_list, entry)
+		if (worker->cpumask_gen != ACCESS_ONCE(wq_unbound_cpumask_gen))
+			wake_up_process(worker->task);
+	spin_unlock_irq(&gcwq->lock);
+}
+
 static int worker_thread(void *__worker)
 {
 	struct worker *worker = __worker;
@@ -1379,6 +1490,9 @@ static int worker_thread(void *__worker)
 	
 	worker->task->flags |= PF_WQ_WORKER;
 woke_up:
+	if (worker->flags & WORKER_UNBOUND)
+		worker_update_unbound_cpumask(worker);
+
 	spin_lock_irq(&gcwq->lock);
 
 	
@@ -1445,6 +1559,9 @@ repeat:
 	if (kthread_should_stop())
 		return 0;
 
+	if (is_unbound)
+		worker_update_unbound_cpumask(rescuer);
+
 	for_each_mayday_cpu(cpu, wq->mayday_mask) {
 		unsigned int tcpu = is_unbound ? WORK_CPU_UNBOUND : cpu;
 		struct cpu_workqueue_struct *cwq = get_cwq(tcpu, wq);
@@ -2040,6 +2157,9 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 	if (flags & WQ_MEM_RECLAIM)
 		flags |= WQ_RESCUER;
 
+	if ((flags & WQ_POWER_EFFICIENT) && wq_power_efficient)
+		flags |= WQ_UNBOUND;
+
 	if (flags & WQ_UNBOUND)
 		flags |= WQ_HIGHPRI;
 
@@ -2439,7 +2559,9 @@ static int workqueue_cpu_up_callback(struct notifier_block *nfb,
 	case CPU_UP_PREPARE:
 	case CPU_UP_CANCELED:
 	case CPU_DOWN_FAILED:
+		return workqueue_cpu_callback(nfb, action, hcpu);
 	case CPU_ONLINE:
+		wake_up_unbound_stale_workers();
 		return workqueue_cpu_callback(nfb, action, hcpu);
 	}
 	return NOTIFY_OK;
@@ -2625,6 +2747,145 @@ unsigned long get_work_func_of_task_struct(struct task_struct *tsk)
 	return 0;
 }
 
+static int wq_unbound_cpumask_set(const char *val,
+				  const struct kernel_param *kp)
+{
+	int ret;
+
+	mutex_lock(&wq_unbound_mutex);
+	ret = cpulist_parse(val, &wq_unbound_cpumask_new);
+	if (!ret && !cpumask_intersects(&wq_unbound_cpumask_new,
+					cpu_possible_mask))
+		ret = -EINVAL;
+	if (!ret) {
+		cpumask_and(&wq_unbound_cpumask, &wq_unbound_cpumask_new,
+			    cpu_possible_mask);
+		wq_unbound_cpumask_gen++;
+	}
+	mutex_unlock(&wq_unbound_mutex);
+
+	if (ret || !keventd_up())
+		return ret;
+
+	wake_up_unbound_stale_workers();
+	return 0;
+}
+
+static int wq_unbound_cpumask_get(char *buffer, const struct kernel_param *kp)
+{
+	int len;
+
+	mutex_lock(&wq_unbound_mutex);
+	len = cpulist_scnprintf(buffer, PAGE_SIZE - 1, &wq_unbound_cpumask);
+	mutex_unlock(&wq_unbound_mutex);
+	return len;
+}
+
+static struct kernel_param_ops wq_unbound_cpumask_ops = {
+	.set = wq_unbound_cpumask_set,
+	.get = wq_unbound_cpumask_get,
+};
+module_param_cb(unbound_cpumask, &wq_unbound_cpumask_ops, NULL, 0644);
+
+#ifdef CONFIG_WQ_LATENCY_STATS
+static void wq_stats_show_hist(struct seq_file *m, const char *what,
+			       unsigned long *hist, u64 max)
+{
+	int i;
+
+	seq_printf(m, "  %s max %llu us:", what, div_u64(max, NSEC_PER_USEC));
+	for (i = 0; i < WQ_STATS_BUCKETS; i++) {
+		if (!hist[i])
+			continue;
+		if (i == WQ_STATS_BUCKETS - 1)
+			seq_printf(m, " >=%lu:%lu", 1UL << (i - 1), hist[i]);
+		else
+			seq_printf(m, " <%lu:%lu", 1UL << i, hist[i]);
+	}
+	seq_putc(m, '\n');
+}
+
+static int wq_stats_show(struct seq_file *m, void *unused)
+{
+	struct workqueue_struct *wq;
+	struct wq_stats sum;
+	unsigned int cpu;
+	int i;
+
+	seq_puts(m, "histogram buckets are in microseconds\n");
+
+	spin_lock(&workqueue_lock);
+	list_for_each_entry(wq, &workqueues, list) {
+		memset(&sum, 0, sizeof(sum));
+		for_each_cwq_cpu(cpu, wq) {
+			struct wq_stats *st = &get_cwq(cpu, wq)->stats;
+
+			sum.nr_works += st->nr_works;
+			sum.peak_active = max(sum.peak_active,
+					      st->peak_active);
+			sum.max_wait = max(sum.max_wait, st->max_wait);
+			sum.max_exec = max(sum.max_exec, st->max_exec);
+			for (i = 0; i < WQ_STATS_BUCKETS; i++) {
+				sum.wait[i] += st->wait[i];
+				sum.exec[i] += st->exec[i];
+			}
+		}
+		if (!sum.nr_works)
+			continue;
+
+		seq_printf(m, "%s: %s works %lu max_active %d peak_active %d\n",
+			   wq->name, wq->flags & WQ_UNBOUND ? "unbound" : "percpu",
+			   sum.nr_works, wq->saved_max_active,
+			   sum.peak_active);
+		wq_stats_show_hist(m, "wait", sum.wait, sum.max_wait);
+		wq_stats_show_hist(m, "exec", sum.exec, sum.max_exec);
+	}
+	spin_unlock(&workqueue_lock);
+	return 0;
+}
+
+static ssize_t wq_stats_write(struct file *file, const char __user *buf,
+			      size_t count, loff_t *offs)
+{
+	struct workqueue_struct *wq;
+	unsigned int cpu;
+
+	spin_lock(&workqueue_lock);
+	list_for_each_entry(wq, &workqueues, list) {
+		for_each_cwq_cpu(cpu, wq) {
+			struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+
+			spin_lock_irq(&cwq->gcwq->lock);
+			memset(&cwq->stats, 0, sizeof(cwq->stats));
+			spin_unlock_irq(&cwq->gcwq->lock);
+		}
+	}
+	spin_unlock(&workqueue_lock);
+	return count;
+}
+
+static int wq_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, wq_stats_show, NULL);
+}
+
+static const struct file_operations wq_stats_fops = {
+	.open		= wq_stats_open,
+	.read		= seq_read,
+	.write		= wq_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init wq_stats_init(void)
+{
+	debugfs_create_file("workqueue_stats", S_IFREG | S_IRUGO | S_IWUSR,
+			    NULL, NULL, &wq_stats_fops);
+	return 0;
+}
+late_initcall(wq_stats_init);
+#endif
+
 static int __init init_workqueues(void)
 {
 	unsigned int cpu;
@@ -2688,9 +2949,15 @@ static int __init init_workqueues(void)
 					      WQ_FREEZABLE, 0);
 	system_nrt_freezable_wq = alloc_workqueue("events_nrt_freezable",
 			WQ_NON_REENTRANT | WQ_FREEZABLE, 0);
+	system_power_efficient_wq = alloc_workqueue("events_power_efficient",
+						    WQ_POWER_EFFICIENT, 0);
+	system_freezable_power_efficient_wq = alloc_workqueue(
+			"events_freezable_power_efficient",
+			WQ_FREEZABLE | WQ_POWER_EFFICIENT, 0);
 	BUG_ON(!system_wq || !system_long_wq || !system_nrt_wq ||
 	       !system_unbound_wq || !system_freezable_wq ||
-		!system_nrt_freezable_wq);
+		!system_nrt_freezable_wq || !system_power_efficient_wq ||
+		!system_freezable_power_efficient_wq);
 	return 0;
 }
 early_initcall(init_workqueues);
@@ -14,6 +14,8 @@
 #include <linux/backing-dev.h>
 #include <linux/sysctl.h>
 #include <linux/sysfs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 #include "internal.h"
 
 #if defined CONFIG_COMPACTION || defined CONFIG_CMA
@@ -277,6 +279,56 @@ isolate_migratepages_range(struct zone *zone, struct compact_control *cc,
 #endif 
 #ifdef CONFIG_COMPACTION
 
+#define COMPACTION_PROACTIVE_ORDER	(PAGE_ALLOC_COSTLY_ORDER + 1)
+#define KCOMPACTD_CHECK_INTERVAL_MSEC	500
+
+int sysctl_compaction_proactiveness = 20;
+
+static unsigned int fragmentation_score_node(pg_data_t *pgdat)
+{
+	unsigned long long score = 0;
+	int zoneid;
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+		score += (unsigned long long)zone->present_pages *
+			extfrag_for_order(zone, COMPACTION_PROACTIVE_ORDER);
+	}
+	return div_u64(score, pgdat->node_present_pages + 1);
+}
+
+unsigned int compaction_fragmentation_score(void)
+{
+	unsigned long long score = 0;
+	unsigned long pages = 0;
+	int nid;
+
+	for_each_online_node(nid) {
+		pg_data_t *pgdat = NODE_DATA(nid);
+
+		score += (unsigned long long)pgdat->node_present_pages *
+			fragmentation_score_node(pgdat);
+		pages += pgdat->node_present_pages;
+	}
+	return div_u64(score, pages + 1);
+}
+
+static unsigned int fragmentation_score_wmark(bool low)
+{
+	unsigned int wmark_low;
+
+	wmark_low = max(100U - sysctl_compaction_proactiveness, 5U);
+	return low ? wmark_low : min(wmark_low + 10, 100U);
+}
+
+static bool kswapd_is_running(pg_data_t *pgdat)
+{
+	return pgdat->kswapd && pgdat->kswapd->state == TASK_RUNNING;
+}
+
 static bool suitable_migration_target(struct page *page)
 {
 
@@ -433,8 +485,17 @@ static int compact_finished(struct zone *zone,
 	if (cc->free_pfn <= cc->migrate_pfn)
 		return COMPACT_COMPLETE;
 
-	if (cc->order == -1)
+	if (cc->order == -1) {
+		if (!cc->proactive)
+			return COMPACT_CONTINUE;
+		if (kswapd_is_running(zone->zone_pgdat) ||
+		    kthread_should_stop())
+			return COMPACT_PARTIAL;
+		if (fragmentation_score_node(zone->zone_pgdat) <=
+		    fragmentation_score_wmark(true))
+			return COMPACT_PARTIAL;
 		return COMPACT_CONTINUE;
+	}
 
 	
 	watermark = low_wmark_pages(zone);
@@ -579,11 +640,13 @@ unsigned long try_to_compact_pages(struct zonelist *zonelist,
 	struct zoneref *z;
 	struct zone *zone;
 	int rc = COMPACT_SKIPPED;
+	u64 start;
 
 	if (!order || !may_enter_fs || !may_perform_io)
 		return rc;
 
 	count_vm_event(COMPACTSTALL);
+	start = local_clock();
 
 	
 	for_each_zone_zonelist_nodemask(zone, z, zonelist, high_zoneidx,
@@ -598,6 +661,8 @@ unsigned long try_to_compact_pages(struct zonelist *zonelist,
 			break;
 	}
 
+	count_vm_events(COMPACTSTALL_TIME,
+			div_u64(local_clock() - start, NSEC_PER_USEC));
 	return rc;
 }
 
@@ -691,6 +756,215 @@ int sysctl_extfrag_handler(struct ctl_table *table, int write,
 	return 0;
 }
 
+static bool kcompactd_node_suitable(pg_data_t *pgdat)
+{
+	int zoneid;
+
+	for (zoneid = 0; zoneid <= pgdat->kcompactd_classzone_idx; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+		if (compaction_suitable(zone, pgdat->kcompactd_max_order) ==
+		    COMPACT_CONTINUE)
+			return true;
+	}
+	return false;
+}
+
+static void kcompactd_do_work(pg_data_t *pgdat)
+{
+	struct compact_control cc = {
+		.order = pgdat->kcompactd_max_order,
+		.sync = false,
+	};
+
+	count_vm_event(KCOMPACTD_WAKE);
+	__compact_pgdat(pgdat, &cc);
+
+	if (pgdat->kcompactd_max_order <= cc.order)
+		pgdat->kcompactd_max_order = 0;
+	pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
+}
+
+static void proactive_compact_node(pg_data_t *pgdat)
+{
+	struct compact_control cc = {
+		.order = -1,
+		.sync = false,
+		.proactive = true,
+	};
+	int zoneid;
+
+	count_vm_event(KCOMPACTD_PROACTIVE);
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (!populated_zone(zone))
+			continue;
+
+		cc.nr_freepages = 0;
+		cc.nr_migratepages = 0;
+		cc.zone = zone;
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		compact_zone(zone, &cc);
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+	}
+}
+
+static bool should_proactive_compact_node(pg_data_t *pgdat)
+{
+	if (!sysctl_compaction_proactiveness || kswapd_is_running(pgdat))
+		return false;
+	return fragmentation_score_node(pgdat) >
+		fragmentation_score_wmark(false);
+}
+
+static bool kcompactd_work_requested(pg_data_t *pgdat)
+{
+	return pgdat->kcompactd_max_order > 0 || pgdat->kcompactd_proactive ||
+		kthread_should_stop();
+}
+
+static void kcompactd_timer_fn(unsigned long data)
+{
+	pg_data_t *pgdat = (pg_data_t *)data;
+
+	pgdat->kcompactd_proactive = true;
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = (pg_data_t *)p;
+	struct task_struct *tsk = current;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+	long default_timeout = msecs_to_jiffies(KCOMPACTD_CHECK_INTERVAL_MSEC);
+	long timeout = default_timeout;
+	struct timer_list timer;
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(tsk, cpumask);
+	set_freezable();
+
+	pgdat->kcompactd_max_order = 0;
+	pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
+	setup_deferrable_timer_on_stack(&timer, kcompactd_timer_fn,
+					(unsigned long)pgdat);
+
+	while (!kthread_should_stop()) {
+		if (sysctl_compaction_proactiveness && !timer_pending(&timer))
+			mod_timer(&timer, jiffies + timeout);
+
+		wait_event_freezable(pgdat->kcompactd_wait,
+				     kcompactd_work_requested(pgdat));
+		if (kthread_should_stop())
+			break;
+
+		if (pgdat->kcompactd_max_order) {
+			kcompactd_do_work(pgdat);
+			continue;
+		}
+
+		pgdat->kcompactd_proactive = false;
+		timeout = default_timeout;
+		if (should_proactive_compact_node(pgdat)) {
+			unsigned int prev_score, score;
+
+			prev_score = fragmentation_score_node(pgdat);
+			proactive_compact_node(pgdat);
+			score = fragmentation_score_node(pgdat);
+			if (score >= prev_score) {
+				count_vm_event(KCOMPACTD_BACKOFF);
+				timeout = default_timeout << COMPACT_MAX_DEFER_SHIFT;
+			}
+		}
+	}
+
+	del_timer_sync(&timer);
+	destroy_timer_on_stack(&timer);
+	return 0;
+}
+
+void wakeup_kcompactd(pg_data_t *pgdat, int order, int classzone_idx)
+{
+	if (!order)
+		return;
+
+	if (pgdat->kcompactd_max_order < order)
+		pgdat->kcompactd_max_order = order;
+	if (pgdat->kcompactd_classzone_idx > classzone_idx)
+		pgdat->kcompactd_classzone_idx = classzone_idx;
+
+	if (!waitqueue_active(&pgdat->kcompactd_wait))
+		return;
+	if (!kcompactd_node_suitable(pgdat))
+		return;
+
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+int kcompactd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int ret = 0;
+
+	if (pgdat->kcompactd)
+		return 0;
+
+	pgdat->kcompactd = kthread_run(kcompactd, pgdat, "kcompactd%d", nid);
+	if (IS_ERR(pgdat->kcompactd)) {
+		pr_err("Failed to start kcompactd on node %d\n", nid);
+		ret = PTR_ERR(pgdat->kcompactd);
+		pgdat->kcompactd = NULL;
+	}
+	return ret;
+}
+
+void kcompactd_stop(int nid)
+{
+	struct task_struct *kcompactd = NODE_DATA(nid)->kcompactd;
+
+	if (kcompactd) {
+		kthread_stop(kcompactd);
+		NODE_DATA(nid)->kcompactd = NULL;
+	}
+}
+
+int sysctl_compaction_proactiveness_handler(struct ctl_table *table, int write,
+			void __user *buffer, size_t *length, loff_t *ppos)
+{
+	int ret, nid;
+
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (ret || !write || !sysctl_compaction_proactiveness)
+		return ret;
+
+	for_each_online_node(nid) {
+		pg_data_t *pgdat = NODE_DATA(nid);
+
+		if (!pgdat->kcompactd)
+			continue;
+		pgdat->kcompactd_proactive = true;
+		wake_up_interruptible(&pgdat->kcompactd_wait);
+	}
+	return 0;
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		kcompactd_run(nid);
+	return 0;
+}
+module_init(kcompactd_init)
+
 #if defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
 ssize_t sysfs_compact_node(struct device *dev,
 			struct device_attribute *attr,
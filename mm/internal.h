@@ -75,6 +75,7 @@ struct compact_control {
 	unsigned long free_pfn;		
 	unsigned long migrate_pfn;	
 	bool sync;			
+	bool proactive;
 
 	int order;			
 	int migratetype;		
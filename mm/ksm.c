@@ -36,6 +36,8 @@
 #include <linux/hash.h>
 #include <linux/freezer.h>
 #include <linux/oom.h>
+#include <linux/memcontrol.h>
+#include <linux/math64.h>
 
 #include <asm/tlbflush.h>
 #include "internal.h"
@@ -189,6 +191,35 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/* Checksum a sample of each page instead of all of it */
+static unsigned int ksm_fast_checksum;
+
+/*
+ * Adaptive scanning: every KSM_ADAPT_WINDOW pages, the merge yield of the
+ * window decides whether the batch size is doubled (towards pages_to_scan)
+ * or halved (towards pages_to_scan / KSM_ADAPT_RANGE).
+ */
+#define KSM_ADAPT_WINDOW	1024
+#define KSM_ADAPT_RANGE		16
+#define KSM_ADAPT_HIGH_YIELD	10	/* merges per 1000 pages scanned */
+#define KSM_ADAPT_LOW_YIELD	1
+
+static unsigned int ksm_adaptive_scan;
+static unsigned int ksm_cur_pages_to_scan = 100;
+static unsigned long ksm_adapt_scanned;
+static unsigned long ksm_adapt_merged;
+
+/* Cost and benefit accounting for the report in sysfs */
+static unsigned long ksm_pages_scanned;
+static unsigned long ksm_pages_merged;
+static u64 ksm_cpu_time;
+
+/* How often ksmd looks for new tasks in memcgs with memory.ksm_merge set */
+#define KSM_CGROUP_INTERVAL	(10 * HZ)
+#define KSM_CGROUP_BATCH	16
+#define KSM_CGROUP_ROUNDS	8
+static unsigned long ksm_cgroup_next;
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
@@ -202,6 +233,26 @@ static DEFINE_SPINLOCK(ksm_mmlist_lock);
 		sizeof(struct __struct), __alignof__(struct __struct),\
 		(__flags), NULL)
 
+/* Flags that rule out a vma for merging, whether advised or by cgroup */
+#define VM_KSM_EXCLUDE	(VM_SHARED  | VM_MAYSHARE   | VM_PFNMAP    | \
+			 VM_IO      | VM_DONTEXPAND | VM_RESERVED  | \
+			 VM_HUGETLB | VM_INSERTPAGE | VM_NONLINEAR | \
+			 VM_MIXEDMAP | VM_SAO)
+
+/*
+ * A vma is scanned if it was advised MADV_MERGEABLE, or if it is private
+ * anonymous memory of an mm whose owner's memcg has memory.ksm_merge set
+ * and it has not been advised MADV_UNMERGEABLE since.
+ */
+static inline bool vma_ksm_mergeable(struct vm_area_struct *vma,
+				     bool merge_anon)
+{
+	if (vma->vm_flags & VM_MERGEABLE)
+		return true;
+	return merge_anon && !vma->vm_file &&
+		!(vma->vm_flags & (VM_KSM_EXCLUDE | VM_NOKSM));
+}
+
 static int __init ksm_slab_init(void)
 {
 	rmap_item_cache = KSM_KMEM_CACHE(rmap_item, 0);
@@ -383,7 +434,8 @@ static struct vm_area_struct *find_mergeable_vma(struct mm_struct *mm,
 	vma = find_vma(mm, addr);
 	if (!vma || vma->vm_start > addr)
 		return NULL;
-	if (!(vma->vm_flags & VM_MERGEABLE) || !vma->anon_vma)
+	if (!vma_ksm_mergeable(vma, mem_cgroup_ksm_merge(mm)) ||
+	    !vma->anon_vma)
 		return NULL;
 	return vma;
 }
@@ -628,12 +680,16 @@ static int unmerge_and_remove_all_rmap_items(void)
 
 	for (mm_slot = ksm_scan.mm_slot;
 			mm_slot != &ksm_mm_head; mm_slot = ksm_scan.mm_slot) {
+		bool merge_anon;
+
 		mm = mm_slot->mm;
+		merge_anon = mem_cgroup_ksm_merge(mm);
 		down_read(&mm->mmap_sem);
 		for (vma = mm->mmap; vma; vma = vma->vm_next) {
 			if (ksm_test_exit(mm))
 				break;
-			if (!(vma->vm_flags & VM_MERGEABLE) || !vma->anon_vma)
+			if (!vma_ksm_mergeable(vma, merge_anon) ||
+			    !vma->anon_vma)
 				continue;
 			err = unmerge_ksm_pages(vma,
 						vma->vm_start, vma->vm_end);
@@ -673,11 +729,32 @@ error:
 }
 #endif /* CONFIG_SYSFS */
 
+/*
+ * The checksum only tells ksmd whether a page changed since the last
+ * scan; merging always compares the full contents.  A fast checksum
+ * hashes KSM_FAST_CHUNKS spread out samples of KSM_FAST_WORDS words,
+ * a sixteenth of the page, at the cost of letting some volatile pages
+ * into the unstable tree.
+ */
+#define KSM_FAST_CHUNKS	16
+#define KSM_FAST_WORDS	4
+
 static u32 calc_checksum(struct page *page)
 {
 	u32 checksum;
 	void *addr = kmap_atomic(page);
-	checksum = jhash2(addr, PAGE_SIZE / 4, 17);
+
+	if (ksm_fast_checksum) {
+		u32 *words = addr;
+		int i;
+
+		checksum = 17;
+		for (i = 0; i < KSM_FAST_CHUNKS; i++)
+			checksum = jhash2(words + i * (PAGE_SIZE / 4 /
+					  KSM_FAST_CHUNKS), KSM_FAST_WORDS,
+					  checksum);
+	} else
+		checksum = jhash2(addr, PAGE_SIZE / 4, 17);
 	kunmap_atomic(addr);
 	return checksum;
 }
@@ -863,7 +940,7 @@ static int try_to_merge_one_page(struct vm_area_struct *vma,
 	if (page == kpage)			/* ksm page forked */
 		return 0;
 
-	if (!(vma->vm_flags & VM_MERGEABLE))
+	if (!vma_ksm_mergeable(vma, mem_cgroup_ksm_merge(vma->vm_mm)))
 		goto out;
 	if (PageTransCompound(page) && page_trans_compound_anon_split(page))
 		goto out;
@@ -887,7 +964,15 @@ static int try_to_merge_one_page(struct vm_area_struct *vma,
 	 * case, we need to lock and check page_count is not raised.
 	 */
 	if (write_protect_page(vma, page, &orig_pte) == 0) {
-		if (!kpage) {
+		if (!kpage && !PageSwapBacked(page)) {
+			/*
+			 * A clean MADV_FREE page may still be discarded by
+			 * reclaim, so it must not become the ksm page that
+			 * other mappings are merged onto.  It sits on the
+			 * file lru, so it cannot simply be made SwapBacked
+			 * here either: leave it until it is written again.
+			 */
+		} else if (!kpage) {
 			/*
 			 * While we hold page lock, upgrade page from
 			 * PageAnon+anon_vma to PageKsm+NULL stable_node:
@@ -1161,6 +1246,7 @@ static void stable_tree_append(struct rmap_item *rmap_item,
 		ksm_pages_sharing++;
 	else
 		ksm_pages_shared++;
+	ksm_pages_merged++;
 }
 
 /*
@@ -1282,6 +1368,7 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 	struct mm_slot *slot;
 	struct vm_area_struct *vma;
 	struct rmap_item *rmap_item;
+	bool merge_anon;
 
 	if (list_empty(&ksm_mm_head.mm_list))
 		return NULL;
@@ -1318,6 +1405,7 @@ next_mm:
 	}
 
 	mm = slot->mm;
+	merge_anon = mem_cgroup_ksm_merge(mm);
 	down_read(&mm->mmap_sem);
 	if (ksm_test_exit(mm))
 		vma = NULL;
@@ -1325,7 +1413,7 @@ next_mm:
 		vma = find_vma(mm, ksm_scan.address);
 
 	for (; vma; vma = vma->vm_next) {
-		if (!(vma->vm_flags & VM_MERGEABLE))
+		if (!vma_ksm_mergeable(vma, merge_anon))
 			continue;
 		if (ksm_scan.address < vma->vm_start)
 			ksm_scan.address = vma->vm_start;
@@ -1424,12 +1512,93 @@ static void ksm_do_scan(unsigned int scan_npages)
 		if (!PageKsm(page) || !in_stable_tree(rmap_item))
 			cmp_and_merge_page(page, rmap_item);
 		put_page(page);
+		ksm_pages_scanned++;
 	}
 }
 
+static void ksm_adapt_scan_rate(void)
+{
+	unsigned long scanned = ksm_pages_scanned - ksm_adapt_scanned;
+	unsigned long merged = ksm_pages_merged - ksm_adapt_merged;
+	unsigned int min_pages;
+	unsigned long yield;
+
+	if (scanned < KSM_ADAPT_WINDOW)
+		return;
+	ksm_adapt_scanned = ksm_pages_scanned;
+	ksm_adapt_merged = ksm_pages_merged;
+
+	min_pages = max(ksm_thread_pages_to_scan / KSM_ADAPT_RANGE, 1U);
+	yield = merged * 1000 / scanned;
+	if (yield >= KSM_ADAPT_HIGH_YIELD)
+		ksm_cur_pages_to_scan = min(ksm_cur_pages_to_scan * 2,
+					    ksm_thread_pages_to_scan);
+	else if (yield < KSM_ADAPT_LOW_YIELD)
+		ksm_cur_pages_to_scan = max(ksm_cur_pages_to_scan / 2,
+					    min_pages);
+}
+
+/*
+ * Register the mms of tasks whose memcg asks for merging.  Candidates are
+ * collected under RCU in small batches and entered with mmap_sem held for
+ * write, which serializes against a concurrent MADV_MERGEABLE.
+ */
+static void ksm_cgroup_scan_tasks(void)
+{
+	struct mm_struct *mms[KSM_CGROUP_BATCH];
+	struct task_struct *p;
+	int rounds = KSM_CGROUP_ROUNDS;
+	int i, nr;
+
+	do {
+		nr = 0;
+		rcu_read_lock();
+		for_each_process(p) {
+			struct mm_struct *mm;
+
+			if (p->flags & PF_KTHREAD)
+				continue;
+			task_lock(p);
+			mm = p->mm;
+			if (mm && !test_bit(MMF_VM_MERGEABLE, &mm->flags) &&
+			    mem_cgroup_ksm_merge(mm)) {
+				for (i = 0; i < nr; i++)
+					if (mms[i] == mm)
+						break;
+				if (i == nr) {
+					atomic_inc(&mm->mm_users);
+					mms[nr++] = mm;
+				}
+			}
+			task_unlock(p);
+			if (nr == KSM_CGROUP_BATCH)
+				break;
+		}
+		rcu_read_unlock();
+
+		for (i = 0; i < nr; i++) {
+			struct mm_struct *mm = mms[i];
+
+			down_write(&mm->mmap_sem);
+			if (!test_bit(MMF_VM_MERGEABLE, &mm->flags) &&
+			    !ksm_test_exit(mm) && __ksm_enter(mm))
+				rounds = 1;	/* out of memory: retry later */
+			up_write(&mm->mmap_sem);
+			mmput(mm);
+		}
+	} while (nr == KSM_CGROUP_BATCH && --rounds);
+}
+
 static int ksmd_should_run(void)
 {
-	return (ksm_run & KSM_RUN_MERGE) && !list_empty(&ksm_mm_head.mm_list);
+	return (ksm_run & KSM_RUN_MERGE) &&
+		(!list_empty(&ksm_mm_head.mm_list) || mem_cgroup_ksm_wanted());
+}
+
+void ksm_cgroup_notify(void)
+{
+	ksm_cgroup_next = jiffies;
+	wake_up_interruptible(&ksm_thread_wait);
 }
 
 static int ksm_scan_thread(void *nothing)
@@ -1438,14 +1607,30 @@ static int ksm_scan_thread(void *nothing)
 	set_user_nice(current, 5);
 
 	while (!kthread_should_stop()) {
+		u64 start = task_sched_runtime(current);
+
 		mutex_lock(&ksm_thread_mutex);
-		if (ksmd_should_run())
-			ksm_do_scan(ksm_thread_pages_to_scan);
+		if (ksmd_should_run()) {
+			if (mem_cgroup_ksm_wanted() &&
+			    time_after_eq(jiffies, ksm_cgroup_next)) {
+				ksm_cgroup_next = jiffies + KSM_CGROUP_INTERVAL;
+				ksm_cgroup_scan_tasks();
+			}
+			if (ksm_adaptive_scan) {
+				ksm_do_scan(ksm_cur_pages_to_scan);
+				ksm_adapt_scan_rate();
+			} else
+				ksm_do_scan(ksm_thread_pages_to_scan);
+		}
+		ksm_cpu_time += task_sched_runtime(current) - start;
 		mutex_unlock(&ksm_thread_mutex);
 
 		try_to_freeze();
 
-		if (ksmd_should_run()) {
+		if (ksmd_should_run() && list_empty(&ksm_mm_head.mm_list)) {
+			/* only waiting for tasks to show up in a ksm memcg */
+			schedule_timeout_interruptible(KSM_CGROUP_INTERVAL);
+		} else if (ksmd_should_run()) {
 			schedule_timeout_interruptible(
 				msecs_to_jiffies(ksm_thread_sleep_millisecs));
 		} else {
@@ -1467,10 +1652,7 @@ int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 		/*
 		 * Be somewhat over-protective for now!
 		 */
-		if (*vm_flags & (VM_MERGEABLE | VM_SHARED  | VM_MAYSHARE   |
-				 VM_PFNMAP    | VM_IO      | VM_DONTEXPAND |
-				 VM_RESERVED  | VM_HUGETLB | VM_INSERTPAGE |
-				 VM_NONLINEAR | VM_MIXEDMAP | VM_SAO))
+		if (*vm_flags & (VM_MERGEABLE | VM_KSM_EXCLUDE))
 			return 0;		/* just ignore the advice */
 
 		if (!test_bit(MMF_VM_MERGEABLE, &mm->flags)) {
@@ -1479,11 +1661,19 @@ int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 				return err;
 		}
 
+		*vm_flags &= ~VM_NOKSM;
 		*vm_flags |= VM_MERGEABLE;
 		break;
 
 	case MADV_UNMERGEABLE:
-		if (!(*vm_flags & VM_MERGEABLE))
+		/*
+		 * In a memcg with memory.ksm_merge set, private anonymous
+		 * memory is merged without MADV_MERGEABLE: VM_NOKSM opts
+		 * the range out of that.
+		 */
+		if (!(*vm_flags & VM_MERGEABLE) &&
+		    (vma->vm_file || (*vm_flags & (VM_KSM_EXCLUDE | VM_NOKSM)) ||
+		     !mem_cgroup_ksm_merge(mm)))
 			return 0;		/* just ignore the advice */
 
 		if (vma->anon_vma) {
@@ -1493,6 +1683,7 @@ int ksm_madvise(struct vm_area_struct *vma, unsigned long start,
 		}
 
 		*vm_flags &= ~VM_MERGEABLE;
+		*vm_flags |= VM_NOKSM;
 		break;
 	}
 
@@ -1871,11 +2062,71 @@ static ssize_t pages_to_scan_store(struct kobject *kobj,
 		return -EINVAL;
 
 	ksm_thread_pages_to_scan = nr_pages;
+	ksm_cur_pages_to_scan = nr_pages;
 
 	return count;
 }
 KSM_ATTR(pages_to_scan);
 
+static ssize_t fast_checksum_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_fast_checksum);
+}
+
+static ssize_t fast_checksum_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	int err;
+	unsigned long enable;
+
+	err = strict_strtoul(buf, 10, &enable);
+	if (err || enable > 1)
+		return -EINVAL;
+
+	ksm_fast_checksum = enable;
+
+	return count;
+}
+KSM_ATTR(fast_checksum);
+
+static ssize_t adaptive_scan_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_adaptive_scan);
+}
+
+static ssize_t adaptive_scan_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	int err;
+	unsigned long enable;
+
+	err = strict_strtoul(buf, 10, &enable);
+	if (err || enable > 1)
+		return -EINVAL;
+
+	mutex_lock(&ksm_thread_mutex);
+	ksm_adaptive_scan = enable;
+	ksm_cur_pages_to_scan = ksm_thread_pages_to_scan;
+	ksm_adapt_scanned = ksm_pages_scanned;
+	ksm_adapt_merged = ksm_pages_merged;
+	mutex_unlock(&ksm_thread_mutex);
+
+	return count;
+}
+KSM_ATTR(adaptive_scan);
+
+static ssize_t cur_pages_to_scan_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_adaptive_scan ?
+		       ksm_cur_pages_to_scan : ksm_thread_pages_to_scan);
+}
+KSM_ATTR_RO(cur_pages_to_scan);
+
 static ssize_t run_show(struct kobject *kobj, struct kobj_attribute *attr,
 			char *buf)
 {
@@ -1971,6 +2222,33 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t pages_scanned_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_scanned);
+}
+KSM_ATTR_RO(pages_scanned);
+
+static ssize_t cpu_time_ms_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%llu\n",
+		       (unsigned long long)div_u64(ksm_cpu_time, NSEC_PER_MSEC));
+}
+KSM_ATTR_RO(cpu_time_ms);
+
+/* pages currently saved per second of cpu time ksmd has used so far */
+static ssize_t saved_pages_per_cpu_sec_show(struct kobject *kobj,
+					    struct kobj_attribute *attr,
+					    char *buf)
+{
+	u64 ms = div_u64(ksm_cpu_time, NSEC_PER_MSEC);
+
+	return sprintf(buf, "%llu\n", ms ? (unsigned long long)
+		       div64_u64((u64)ksm_pages_sharing * MSEC_PER_SEC, ms) : 0);
+}
+KSM_ATTR_RO(saved_pages_per_cpu_sec);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
@@ -1980,6 +2258,12 @@ static struct attribute *ksm_attrs[] = {
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&fast_checksum_attr.attr,
+	&adaptive_scan_attr.attr,
+	&cur_pages_to_scan_attr.attr,
+	&pages_scanned_attr.attr,
+	&cpu_time_ms_attr.attr,
+	&saved_pages_per_cpu_sec_attr.attr,
 	NULL,
 };
 
@@ -0,0 +1,298 @@
+/*
+ * Sharded LRU lists for the dentry and inode caches.
+ *
+ * Every lru is split into a power-of-two number of shards, sized from
+ * nr_cpu_ids, each with its own lock.  An object always lives on the
+ * shard picked by hashing its list_head address, so add and delete
+ * only ever touch one shard lock and need no per-object state, while
+ * reclaim walks the shards one at a time in batches.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
+#include <linux/sched.h>
+#include <linux/list_lru.h>
+#ifdef CONFIG_LIST_LRU_STAT
+#include <linux/mutex.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#endif
+
+#define LIST_LRU_MAX_SHARD_BITS	5
+#define LIST_LRU_WALK_BATCH	32
+
+#ifdef CONFIG_LIST_LRU_STAT
+static LIST_HEAD(list_lru_stat_list);
+static DEFINE_MUTEX(list_lru_stat_mutex);
+
+static void list_lru_lock(struct list_lru_shard *shard)
+{
+	if (!spin_trylock(&shard->lock)) {
+		u64 start = local_clock(), wait;
+
+		spin_lock(&shard->lock);
+		wait = local_clock() - start;
+		shard->contentions++;
+		shard->wait_total += wait;
+		if (wait > shard->wait_max)
+			shard->wait_max = wait;
+	}
+	shard->acquisitions++;
+}
+#else
+static inline void list_lru_lock(struct list_lru_shard *shard)
+{
+	spin_lock(&shard->lock);
+}
+#endif
+
+static inline struct list_lru_shard *
+list_lru_shard(struct list_lru *lru, struct list_head *item)
+{
+	if (!lru->shard_bits)
+		return lru->shards;
+	return &lru->shards[hash_ptr(item, lru->shard_bits)];
+}
+
+bool list_lru_add(struct list_lru *lru, struct list_head *item)
+{
+	struct list_lru_shard *shard = list_lru_shard(lru, item);
+	bool added = false;
+
+	list_lru_lock(shard);
+	if (list_empty(item)) {
+		list_add(item, &shard->list);
+		shard->nr_items++;
+		added = true;
+	}
+	spin_unlock(&shard->lock);
+	return added;
+}
+EXPORT_SYMBOL_GPL(list_lru_add);
+
+bool list_lru_del(struct list_lru *lru, struct list_head *item)
+{
+	struct list_lru_shard *shard = list_lru_shard(lru, item);
+	bool deleted = false;
+
+	list_lru_lock(shard);
+	if (!list_empty(item)) {
+		list_del_init(item);
+		shard->nr_items--;
+		deleted = true;
+	}
+	spin_unlock(&shard->lock);
+	return deleted;
+}
+EXPORT_SYMBOL_GPL(list_lru_del);
+
+unsigned long list_lru_count(struct list_lru *lru)
+{
+	unsigned int i;
+	long count = 0;
+
+	for (i = 0; i < (1U << lru->shard_bits); i++)
+		count += lru->shards[i].nr_items;
+	return count < 0 ? 0 : count;
+}
+EXPORT_SYMBOL_GPL(list_lru_count);
+
+/*
+ * Walk one shard from its cold end.  Rotated and skipped items are
+ * parked on a private list and spliced back to the hot end in one go;
+ * that list is only touched under the shard lock, so concurrent
+ * list_lru_del() of a parked item stays safe even when the lock is
+ * dropped by the callback or to reschedule.
+ */
+static unsigned long list_lru_walk_shard(struct list_lru_shard *shard,
+					 list_lru_walk_cb isolate, void *cb_arg,
+					 unsigned long nr_to_walk)
+{
+	LIST_HEAD(parked);
+	unsigned long isolated = 0;
+	unsigned int batch = 0;
+
+	list_lru_lock(shard);
+	while (nr_to_walk && !list_empty(&shard->list)) {
+		struct list_head *item = shard->list.prev;
+
+		nr_to_walk--;
+		switch (isolate(item, &shard->lock, cb_arg)) {
+		case LRU_REMOVED:
+			shard->nr_items--;
+			isolated++;
+			break;
+		case LRU_ROTATE:
+		case LRU_SKIP:
+			list_move(item, &parked);
+			break;
+		case LRU_RETRY:
+			break;
+		default:
+			BUG();
+		}
+
+		if (++batch == LIST_LRU_WALK_BATCH) {
+			batch = 0;
+			cond_resched_lock(&shard->lock);
+		}
+	}
+	list_splice(&parked, &shard->list);
+	spin_unlock(&shard->lock);
+	return isolated;
+}
+
+unsigned long list_lru_walk(struct list_lru *lru, list_lru_walk_cb isolate,
+			    void *cb_arg, unsigned long nr_to_walk)
+{
+	unsigned int i, nr_shards = 1U << lru->shard_bits;
+	unsigned long per_shard = nr_to_walk / nr_shards +
+				  !!(nr_to_walk % nr_shards);
+	unsigned long isolated = 0;
+
+	for (i = 0; i < nr_shards; i++) {
+		struct list_lru_shard *shard = &lru->shards[i];
+
+		if (!shard->nr_items)
+			continue;
+		isolated += list_lru_walk_shard(shard, isolate, cb_arg,
+						per_shard);
+	}
+	return isolated;
+}
+EXPORT_SYMBOL_GPL(list_lru_walk);
+
+int list_lru_init(struct list_lru *lru, const char *name, const char *owner)
+{
+	unsigned int i, bits;
+
+	bits = min_t(unsigned int, order_base_2(nr_cpu_ids),
+		     LIST_LRU_MAX_SHARD_BITS);
+	lru->shards = kcalloc(1U << bits, sizeof(*lru->shards), GFP_KERNEL);
+	if (!lru->shards)
+		return -ENOMEM;
+	lru->shard_bits = bits;
+
+	for (i = 0; i < (1U << bits); i++) {
+		spin_lock_init(&lru->shards[i].lock);
+		INIT_LIST_HEAD(&lru->shards[i].list);
+	}
+
+#ifdef CONFIG_LIST_LRU_STAT
+	lru->name = name;
+	lru->owner = owner;
+	mutex_lock(&list_lru_stat_mutex);
+	list_add_tail(&lru->stat_list, &list_lru_stat_list);
+	mutex_unlock(&list_lru_stat_mutex);
+#endif
+	return 0;
+}
+EXPORT_SYMBOL_GPL(list_lru_init);
+
+void list_lru_destroy(struct list_lru *lru)
+{
+	if (!lru->shards)
+		return;
+#ifdef CONFIG_LIST_LRU_STAT
+	mutex_lock(&list_lru_stat_mutex);
+	list_del(&lru->stat_list);
+	mutex_unlock(&list_lru_stat_mutex);
+#endif
+	kfree(lru->shards);
+	lru->shards = NULL;
+}
+EXPORT_SYMBOL_GPL(list_lru_destroy);
+
+#ifdef CONFIG_LIST_LRU_STAT
+static int list_lru_stat_show(struct seq_file *m, void *v)
+{
+	struct list_lru *lru;
+
+	seq_printf(m, "list_lru_stat version 0.1\n");
+	seq_printf(m, "%-24s %6s %10s %14s %12s %16s %12s %14s\n",
+		   "name", "shards", "items", "acquisitions", "contentions",
+		   "waittime-total", "waittime-max", "max-shard-acq");
+
+	mutex_lock(&list_lru_stat_mutex);
+	list_for_each_entry(lru, &list_lru_stat_list, stat_list) {
+		unsigned long acq = 0, con = 0, max_acq = 0;
+		u64 wait_total = 0, wait_max = 0;
+		unsigned int i;
+		char name[24];
+
+		for (i = 0; i < (1U << lru->shard_bits); i++) {
+			struct list_lru_shard *shard = &lru->shards[i];
+
+			acq += shard->acquisitions;
+			con += shard->contentions;
+			wait_total += shard->wait_total;
+			wait_max = max(wait_max, shard->wait_max);
+			max_acq = max(max_acq, shard->acquisitions);
+		}
+		snprintf(name, sizeof(name), "%s:%s", lru->name,
+			 lru->owner[0] ? lru->owner : "-");
+		seq_printf(m, "%-24s %6u %10lu %14lu %12lu %16llu %12llu %14lu\n",
+			   name, 1U << lru->shard_bits, list_lru_count(lru),
+			   acq, con, (unsigned long long)wait_total,
+			   (unsigned long long)wait_max, max_acq);
+	}
+	mutex_unlock(&list_lru_stat_mutex);
+	return 0;
+}
+
+static int list_lru_stat_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, list_lru_stat_show, NULL);
+}
+
+static ssize_t list_lru_stat_write(struct file *file, const char __user *buf,
+				   size_t count, loff_t *ppos)
+{
+	struct list_lru *lru;
+	char c;
+
+	if (count) {
+		if (get_user(c, buf))
+			return -EFAULT;
+		if (c != '0')
+			return count;
+
+		mutex_lock(&list_lru_stat_mutex);
+		list_for_each_entry(lru, &list_lru_stat_list, stat_list) {
+			unsigned int i;
+
+			for (i = 0; i < (1U << lru->shard_bits); i++) {
+				struct list_lru_shard *shard = &lru->shards[i];
+
+				spin_lock(&shard->lock);
+				shard->acquisitions = 0;
+				shard->contentions = 0;
+				shard->wait_total = 0;
+				shard->wait_max = 0;
+				spin_unlock(&shard->lock);
+			}
+		}
+		mutex_unlock(&list_lru_stat_mutex);
+	}
+	return count;
+}
+
+static const struct file_operations proc_list_lru_stat_operations = {
+	.open		= list_lru_stat_open,
+	.read		= seq_read,
+	.write		= list_lru_stat_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init list_lru_stat_init(void)
+{
+	proc_create("list_lru_stat", S_IRUSR | S_IWUSR, NULL,
+		    &proc_list_lru_stat_operations);
+	return 0;
+}
+module_init(list_lru_stat_init);
+#endif
@@ -14,6 +14,10 @@
 #include <linux/sched.h>
 #include <linux/ksm.h>
 #include <linux/file.h>
+#include <linux/swap.h>
+#include <linux/swapops.h>
+#include <linux/mmu_notifier.h>
+#include <asm/tlbflush.h>
 
 static int madvise_need_mmap_write(int behavior)
 {
@@ -21,6 +25,7 @@ static int madvise_need_mmap_write(int behavior)
 	case MADV_REMOVE:
 	case MADV_WILLNEED:
 	case MADV_DONTNEED:
+	case MADV_FREE:
 		return 0;
 	default:
 		
@@ -156,6 +161,99 @@ static long madvise_dontneed(struct vm_area_struct * vma,
 	return 0;
 }
 
+static int madvise_free_pte_range(pmd_t *pmd, unsigned long addr,
+				  unsigned long end, struct mm_walk *walk)
+{
+	struct vm_area_struct *vma = walk->private;
+	struct mm_struct *mm = walk->mm;
+	pte_t *orig_pte, *pte, ptent;
+	spinlock_t *ptl;
+	struct page *page;
+	int nr_swap = 0;
+
+	split_huge_page_pmd(mm, pmd);
+	if (pmd_trans_unstable(pmd))
+		return 0;
+
+	orig_pte = pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
+	arch_enter_lazy_mmu_mode();
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		ptent = *pte;
+
+		if (pte_none(ptent))
+			continue;
+		if (!pte_present(ptent)) {
+			swp_entry_t entry;
+
+			if (pte_file(ptent))
+				continue;
+			entry = pte_to_swp_entry(ptent);
+			if (non_swap_entry(entry))
+				continue;
+			nr_swap--;
+			free_swap_and_cache(entry);
+			pte_clear_not_present_full(mm, addr, pte, 0);
+			continue;
+		}
+
+		page = vm_normal_page(vma, addr, ptent);
+		if (!page || !PageAnon(page) || PageKsm(page))
+			continue;
+		if (page_mapcount(page) != 1)
+			continue;
+		if (!trylock_page(page))
+			continue;
+		if (PageSwapCache(page) && !try_to_free_swap(page)) {
+			unlock_page(page);
+			continue;
+		}
+		if (!PageSwapBacked(page) && pte_dirty(ptent))
+			count_vm_event(PGLAZYFREE_REUSED);
+		ClearPageDirty(page);
+		unlock_page(page);
+
+		if (pte_young(ptent) || pte_dirty(ptent)) {
+			ptent = ptep_get_and_clear_full(mm, addr, pte, 0);
+			ptent = pte_mkold(ptent);
+			ptent = pte_mkclean(ptent);
+			set_pte_at(mm, addr, pte, ptent);
+		}
+		mark_page_lazyfree(page);
+	}
+	if (nr_swap)
+		add_mm_counter(mm, MM_SWAPENTS, nr_swap);
+	arch_leave_lazy_mmu_mode();
+	pte_unmap_unlock(orig_pte, ptl);
+	cond_resched();
+	return 0;
+}
+
+static long madvise_free(struct vm_area_struct *vma,
+			 struct vm_area_struct **prev,
+			 unsigned long start, unsigned long end)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct mm_walk free_walk = {
+		.pmd_entry = madvise_free_pte_range,
+		.mm = mm,
+		.private = vma,
+	};
+
+	*prev = vma;
+	if (vma->vm_flags & (VM_LOCKED|VM_HUGETLB|VM_PFNMAP))
+		return -EINVAL;
+	if (vma->vm_file || vma->vm_ops || (vma->vm_flags & VM_SHARED))
+		return -EINVAL;
+
+	lru_add_drain();
+	update_hiwater_rss(mm);
+	mmu_notifier_invalidate_range_start(mm, start, end);
+	walk_page_range(start, end, &free_walk);
+	flush_tlb_range(vma, start, end);
+	mmu_notifier_invalidate_range_end(mm, start, end);
+	return 0;
+}
+
 static long madvise_remove(struct vm_area_struct *vma,
 				struct vm_area_struct **prev,
 				unsigned long start, unsigned long end)
@@ -234,6 +332,8 @@ madvise_vma(struct vm_area_struct *vma, struct vm_area_struct **prev,
 		return madvise_willneed(vma, prev, start, end);
 	case MADV_DONTNEED:
 		return madvise_dontneed(vma, prev, start, end);
+	case MADV_FREE:
+		return madvise_free(vma, prev, start, end);
 	default:
 		return madvise_behavior(vma, prev, start, end, behavior);
 	}
@@ -251,6 +351,7 @@ madvise_behavior_valid(int behavior)
 	case MADV_REMOVE:
 	case MADV_WILLNEED:
 	case MADV_DONTNEED:
+	case MADV_FREE:
 #ifdef CONFIG_KSM
 	case MADV_MERGEABLE:
 	case MADV_UNMERGEABLE:
@@ -49,6 +49,8 @@
 #include <linux/page_cgroup.h>
 #include <linux/cpu.h>
 #include <linux/oom.h>
+#include <linux/vmpressure.h>
+#include <linux/ksm.h>
 #include "internal.h"
 #include <net/sock.h>
 #include <net/tcp_memcontrol.h>
@@ -273,6 +275,8 @@ struct mem_cgroup {
 	atomic_t	refcnt;
 
 	int	swappiness;
+	/* merge all private anonymous memory of member tasks with KSM */
+	bool	ksm_merge;
 	/* OOM-Killer disable */
 	int		oom_kill_disable;
 
@@ -291,6 +295,9 @@ struct mem_cgroup {
 	/* For oom notifier event fd */
 	struct list_head oom_notify;
 
+	/* reclaim efficiency notifications (memory.pressure_level) */
+	struct vmpressure vmpressure;
+
 	/*
 	 * Should we move charges of a task when a task is moved into this
 	 * mem_cgroup ? And what type of charges should we move ?
@@ -832,6 +839,24 @@ struct mem_cgroup *mem_cgroup_from_cont(struct cgroup *cont)
 				css);
 }
 
+/* Some nice accessors for the vmpressure. */
+struct vmpressure *memcg_to_vmpressure(struct mem_cgroup *memcg)
+{
+	if (!memcg)
+		memcg = root_mem_cgroup;
+	return &memcg->vmpressure;
+}
+
+struct cgroup_subsys_state *vmpressure_to_css(struct vmpressure *vmpr)
+{
+	return &container_of(vmpr, struct mem_cgroup, vmpressure)->css;
+}
+
+struct vmpressure *css_to_vmpressure(struct cgroup_subsys_state *css)
+{
+	return &container_of(css, struct mem_cgroup, css)->vmpressure;
+}
+
 struct mem_cgroup *mem_cgroup_from_task(struct task_struct *p)
 {
 	/*
@@ -4002,6 +4027,70 @@ static int mem_cgroup_reset(struct cgroup *cont, unsigned int event)
 	return 0;
 }
 
+#ifdef CONFIG_KSM
+/* number of memcgs with ksm_merge set */
+static atomic_t memcg_ksm_groups = ATOMIC_INIT(0);
+
+bool mem_cgroup_ksm_wanted(void)
+{
+	return !mem_cgroup_disabled() && atomic_read(&memcg_ksm_groups);
+}
+
+bool mem_cgroup_ksm_merge(struct mm_struct *mm)
+{
+	struct mem_cgroup *memcg;
+	bool merge = false;
+
+	if (!mem_cgroup_ksm_wanted())
+		return false;
+
+	rcu_read_lock();
+	memcg = mem_cgroup_from_task(rcu_dereference(mm->owner));
+	if (memcg)
+		merge = memcg->ksm_merge;
+	rcu_read_unlock();
+	return merge;
+}
+
+static u64 mem_cgroup_ksm_merge_read(struct cgroup *cgrp, struct cftype *cft)
+{
+	return mem_cgroup_from_cont(cgrp)->ksm_merge;
+}
+
+static int mem_cgroup_ksm_merge_write(struct cgroup *cgrp, struct cftype *cft,
+				      u64 val)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_cont(cgrp);
+
+	if (val > 1)
+		return -EINVAL;
+
+	cgroup_lock();
+	if (memcg->ksm_merge != val) {
+		memcg->ksm_merge = val;
+		if (val)
+			atomic_inc(&memcg_ksm_groups);
+		else
+			atomic_dec(&memcg_ksm_groups);
+	}
+	cgroup_unlock();
+
+	if (val)
+		ksm_cgroup_notify();
+	return 0;
+}
+#else
+bool mem_cgroup_ksm_wanted(void)
+{
+	return false;
+}
+
+bool mem_cgroup_ksm_merge(struct mm_struct *mm)
+{
+	return false;
+}
+#endif
+
 static u64 mem_cgroup_move_charge_read(struct cgroup *cgrp,
 					struct cftype *cft)
 {
@@ -4706,6 +4795,13 @@ static struct cftype mem_cgroup_files[] = {
 		.read_u64 = mem_cgroup_move_charge_read,
 		.write_u64 = mem_cgroup_move_charge_write,
 	},
+#ifdef CONFIG_KSM
+	{
+		.name = "ksm_merge",
+		.read_u64 = mem_cgroup_ksm_merge_read,
+		.write_u64 = mem_cgroup_ksm_merge_write,
+	},
+#endif
 	{
 		.name = "oom_control",
 		.read_map = mem_cgroup_oom_control_read,
@@ -4714,6 +4810,11 @@ static struct cftype mem_cgroup_files[] = {
 		.unregister_event = mem_cgroup_oom_unregister_event,
 		.private = MEMFILE_PRIVATE(_OOM_TYPE, OOM_CONTROL),
 	},
+	{
+		.name = "pressure_level",
+		.register_event = vmpressure_register_event,
+		.unregister_event = vmpressure_unregister_event,
+	},
 #ifdef CONFIG_NUMA
 	{
 		.name = "numa_stat",
@@ -5012,10 +5113,17 @@ mem_cgroup_create(struct cgroup *cont)
 
 	if (parent)
 		memcg->swappiness = mem_cgroup_swappiness(parent);
+#ifdef CONFIG_KSM
+	if (parent && parent->ksm_merge) {
+		memcg->ksm_merge = true;
+		atomic_inc(&memcg_ksm_groups);
+	}
+#endif
 	atomic_set(&memcg->refcnt, 1);
 	memcg->move_charge_at_immigrate = 0;
 	mutex_init(&memcg->thresholds_lock);
 	spin_lock_init(&memcg->move_lock);
+	vmpressure_init(&memcg->vmpressure);
 	return &memcg->css;
 free_out:
 	__mem_cgroup_free(memcg);
@@ -5035,6 +5143,11 @@ static void mem_cgroup_destroy(struct cgroup *cont)
 
 	kmem_cgroup_destroy(cont);
 
+#ifdef CONFIG_KSM
+	if (memcg->ksm_merge)
+		atomic_dec(&memcg_ksm_groups);
+#endif
+	vmpressure_cleanup(&memcg->vmpressure);
 	mem_cgroup_put(memcg);
 }
 
@@ -5200,7 +5313,7 @@ static struct page *mc_handle_file_pte(struct vm_area_struct *vma,
 		pgoff = pte_to_pgoff(ptent);
 
 	/* page is moved even if it's not RSS of this task(page-faulted). */
-	page = find_get_page(mapping, pgoff);
+	page = find_get_entry(mapping, pgoff);
 
 #ifdef CONFIG_SWAP
 	/* shmem/tmpfs may report page out on swap: account for that too. */
@@ -27,6 +27,8 @@
 #include <linux/swapops.h>
 #include <linux/elf.h>
 #include <linux/gfp.h>
+#include <linux/sysctl.h>
+#include <linux/log2.h>
 
 #include <asm/io.h>
 #include <asm/pgalloc.h>
@@ -673,7 +675,7 @@ copy_one_pte(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		goto out_set_pte;
 	}
 
-	if (is_cow_mapping(vm_flags)) {
+	if (is_cow_mapping(vm_flags) && pte_write(pte)) {
 		ptep_set_wrprotect(src_mm, addr, src_pte);
 		pte = pte_wrprotect(pte);
 	}
@@ -697,6 +699,44 @@ out_set_pte:
 	return 0;
 }
 
+static unsigned int
+copy_present_ptes(struct mm_struct *dst_mm, struct mm_struct *src_mm,
+		  pte_t *dst_pte, pte_t *src_pte, struct vm_area_struct *vma,
+		  unsigned long addr, unsigned long end, int *rss)
+{
+	bool cow = is_cow_mapping(vma->vm_flags);
+	bool shared = vma->vm_flags & VM_SHARED;
+	unsigned int nr = 0;
+
+	do {
+		pte_t pte = *src_pte;
+		struct page *page;
+
+		if (!pte_present(pte))
+			break;
+		if (cow && pte_write(pte)) {
+			ptep_set_wrprotect(src_mm, addr, src_pte);
+			pte = pte_wrprotect(pte);
+		}
+		if (shared)
+			pte = pte_mkclean(pte);
+		pte = pte_mkold(pte);
+
+		page = vm_normal_page(vma, addr, pte);
+		if (page) {
+			get_page(page);
+			page_dup_rmap(page);
+			rss[PageAnon(page) ? MM_ANONPAGES : MM_FILEPAGES]++;
+		}
+		set_pte_at(dst_mm, addr, dst_pte, pte);
+		nr++;
+	} while (dst_pte++, src_pte++, addr += PAGE_SIZE, addr != end);
+
+	return nr;
+}
+
+#define COPY_PTE_BATCH	64
+
 int copy_pte_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		   pmd_t *dst_pmd, pmd_t *src_pmd, struct vm_area_struct *vma,
 		   unsigned long addr, unsigned long end)
@@ -722,16 +762,26 @@ again:
 	arch_enter_lazy_mmu_mode();
 
 	do {
-		if (progress >= 32) {
+		unsigned int nr;
+
+		if (progress >= COPY_PTE_BATCH) {
 			progress = 0;
-			if (need_resched() ||
-			    spin_needbreak(src_ptl) || spin_needbreak(dst_ptl))
+			if (need_resched())
 				break;
 		}
 		if (pte_none(*src_pte)) {
 			progress++;
 			continue;
 		}
+		if (pte_present(*src_pte)) {
+			nr = copy_present_ptes(dst_mm, src_mm, dst_pte, src_pte,
+					       vma, addr, end, rss);
+			progress += nr;
+			dst_pte += nr - 1;
+			src_pte += nr - 1;
+			addr += (nr - 1) * PAGE_SIZE;
+			continue;
+		}
 		entry.val = copy_one_pte(dst_mm, src_mm, dst_pte, src_pte,
 							vma, addr, rss);
 		if (entry.val)
@@ -2136,10 +2186,10 @@ static int do_swap_page(struct mm_struct *mm, struct vm_area_struct *vma,
 		goto out;
 	}
 	delayacct_set_flag(DELAYACCT_PF_SWAPIN);
-	page = lookup_swap_cache(entry);
+	page = lookup_swap_cache(entry, vma, address);
 	if (!page) {
 		grab_swap_token(mm); 
-		page = swapin_readahead(entry,
+		page = swap_vma_readahead(entry,
 					GFP_HIGHUSER_MOVABLE, vma, address);
 		if (!page) {
 			page_table = pte_offset_map_lock(mm, pmd, address, &ptl);
@@ -2333,6 +2383,79 @@ oom:
 	return VM_FAULT_OOM;
 }
 
+int sysctl_fault_around_bytes __read_mostly = 65536;
+
+int fault_around_bytes_sysctl_handler(struct ctl_table *table, int write,
+		void __user *buffer, size_t *length, loff_t *ppos)
+{
+	struct ctl_table t = *table;
+	int bytes = sysctl_fault_around_bytes;
+	int ret;
+
+	t.data = &bytes;
+	ret = proc_dointvec_minmax(&t, write, buffer, length, ppos);
+	if (ret || !write)
+		return ret;
+
+	if (bytes > PTRS_PER_PTE * PAGE_SIZE)
+		bytes = PTRS_PER_PTE * PAGE_SIZE;
+	if (bytes)
+		bytes = rounddown_pow_of_two(bytes);
+	ACCESS_ONCE(sysctl_fault_around_bytes) = bytes;
+	return 0;
+}
+
+void do_set_pte(struct vm_area_struct *vma, unsigned long address,
+		struct page *page, pte_t *pte)
+{
+	pte_t entry;
+
+	flush_icache_page(vma, page);
+	entry = mk_pte(page, vma->vm_page_prot);
+	inc_mm_counter_fast(vma->vm_mm, MM_FILEPAGES);
+	page_add_file_rmap(page);
+	set_pte_at(vma->vm_mm, address, pte, entry);
+	update_mmu_cache(vma, address, pte);
+}
+
+static bool do_fault_around(struct vm_area_struct *vma, unsigned long address,
+		pmd_t *pmd, pgoff_t pgoff, unsigned int flags, pte_t orig_pte,
+		unsigned long bytes)
+{
+	unsigned long start_addr, end_addr;
+	struct vm_fault vmf;
+	spinlock_t *ptl;
+	pte_t *pte, *start_pte;
+	bool done;
+
+	address &= PAGE_MASK;
+	start_addr = max(address & ~(bytes - 1), vma->vm_start);
+	end_addr = min3(start_addr + bytes, vma->vm_end,
+			pmd_addr_end(address, vma->vm_end));
+
+	pte = pte_offset_map_lock(vma->vm_mm, pmd, address, &ptl);
+	start_pte = pte - ((address - start_addr) >> PAGE_SHIFT);
+	pgoff -= (address - start_addr) >> PAGE_SHIFT;
+
+	while (start_addr < end_addr && !pte_none(*start_pte)) {
+		start_addr += PAGE_SIZE;
+		start_pte++;
+		pgoff++;
+	}
+	if (start_addr < end_addr) {
+		vmf.virtual_address = (void __user *)start_addr;
+		vmf.pgoff = pgoff;
+		vmf.max_pgoff = pgoff + ((end_addr - start_addr) >> PAGE_SHIFT) - 1;
+		vmf.flags = flags;
+		vmf.page = NULL;
+		vmf.pte = start_pte;
+		vma->vm_ops->map_pages(vma, &vmf);
+	}
+	done = !pte_same(*pte, orig_pte);
+	pte_unmap_unlock(pte, ptl);
+	return done;
+}
+
 static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 		unsigned long address, pmd_t *pmd,
 		pgoff_t pgoff, unsigned int flags, pte_t orig_pte)
@@ -2347,6 +2470,12 @@ static int __do_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	struct vm_fault vmf;
 	int ret;
 	int page_mkwrite = 0;
+	unsigned long around = ACCESS_ONCE(sysctl_fault_around_bytes);
+
+	if (!(flags & (FAULT_FLAG_WRITE | FAULT_FLAG_NONLINEAR)) &&
+	    vma->vm_ops->map_pages && around > PAGE_SIZE &&
+	    do_fault_around(vma, address, pmd, pgoff, flags, orig_pte, around))
+		return 0;
 
 	if ((flags & FAULT_FLAG_WRITE) && !(vma->vm_flags & VM_SHARED)) {
 
@@ -51,7 +51,7 @@ static unsigned char mincore_page(struct address_space *mapping, pgoff_t pgoff)
 	unsigned char present = 0;
 	struct page *page;
 
-	page = find_get_page(mapping, pgoff);
+	page = find_get_entry(mapping, pgoff);
 #ifdef CONFIG_SWAP
 	
 	if (radix_tree_exceptional_entry(page)) {
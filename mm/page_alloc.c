@@ -165,6 +165,12 @@ static char * const zone_names[MAX_NR_ZONES] = {
 };
 
 int min_free_kbytes = 1024;
+
+int percpu_order_pagelist_high[NR_PCP_HIGH_ORDERS] = { 8, 4, 2 };
+int percpu_order_pagelist_batch[NR_PCP_HIGH_ORDERS] = { 2, 1, 1 };
+
+int extra_free_kbytes;
+int watermark_boost_factor __read_mostly = 15000;
 int min_free_order_shift = 1;
 
 static unsigned long __meminitdata nr_kernel_pages;
@@ -496,7 +502,7 @@ static inline int free_pages_check(struct page *page)
 }
 
 static void free_pcppages_bulk(struct zone *zone, int count,
-					struct per_cpu_pages *pcp)
+					struct per_cpu_pages *pcp, int order)
 {
 	int migratetype = 0;
 	int batch_free = 0;
@@ -526,11 +532,11 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 			
 			list_del(&page->lru);
 			
-			__free_one_page(page, zone, 0, page_private(page));
-			trace_mm_page_pcpu_drain(page, 0, page_private(page));
+			__free_one_page(page, zone, order, page_private(page));
+			trace_mm_page_pcpu_drain(page, order, page_private(page));
 		} while (--to_free && --batch_free && !list_empty(list));
 	}
-	__mod_zone_page_state(zone, NR_FREE_PAGES, count);
+	__mod_zone_page_state(zone, NR_FREE_PAGES, count << order);
 	spin_unlock(&zone->lock);
 }
 
@@ -572,20 +578,55 @@ static bool free_pages_prepare(struct page *page, unsigned int order)
 	return true;
 }
 
+static bool free_pcp_high_order(struct page *page, unsigned int order,
+				int migratetype)
+{
+	struct zone *zone = page_zone(page);
+	struct per_cpu_pages *pcp;
+
+	pcp = &this_cpu_ptr(zone->pageset)->order_pcp[order - 1];
+	if (!pcp->high)
+		return false;
+
+	if (unlikely(PageCompound(page)) &&
+	    unlikely(destroy_compound_page(page, order)))
+		return true;
+
+	set_page_private(page, migratetype);
+	if (migratetype >= MIGRATE_PCPTYPES)
+		migratetype = MIGRATE_MOVABLE;
+
+	list_add(&page->lru, &pcp->lists[migratetype]);
+	pcp->count++;
+	if (pcp->count >= pcp->high) {
+		int to_free = min(pcp->batch, pcp->count);
+
+		free_pcppages_bulk(zone, to_free, pcp, order);
+		pcp->count -= to_free;
+	}
+	return true;
+}
+
 static void __free_pages_ok(struct page *page, unsigned int order)
 {
 	unsigned long flags;
+	int migratetype;
 	int wasMlocked = __TestClearPageMlocked(page);
 
 	if (!free_pages_prepare(page, order))
 		return;
 
+	migratetype = get_pageblock_migratetype(page);
 	local_irq_save(flags);
 	if (unlikely(wasMlocked))
 		free_page_mlock(page);
 	__count_vm_events(PGFREE, 1 << order);
-	free_one_page(page_zone(page), page, order,
-					get_pageblock_migratetype(page));
+	if (order && order <= NR_PCP_HIGH_ORDERS &&
+	    migratetype != MIGRATE_ISOLATE &&
+	    free_pcp_high_order(page, order, migratetype))
+		goto out;
+	free_one_page(page_zone(page), page, order, migratetype);
+out:
 	local_irq_restore(flags);
 }
 
@@ -800,6 +841,28 @@ static void change_pageblock_range(struct page *pageblock_page,
 	}
 }
 
+static void boost_watermark(struct zone *zone)
+{
+	unsigned long max_boost;
+
+	if (!watermark_boost_factor)
+		return;
+
+	if ((pageblock_nr_pages * 4) > zone->present_pages)
+		return;
+
+	max_boost = mult_frac(zone->watermark[WMARK_HIGH],
+			      watermark_boost_factor, 10000);
+	max_boost = max(pageblock_nr_pages, max_boost);
+	if (zone->watermark_boost >= max_boost)
+		return;
+
+	zone->watermark_boost = min(zone->watermark_boost + pageblock_nr_pages,
+				    max_boost);
+	zone_set_flag(zone, ZONE_BOOSTED_WATERMARK);
+	__count_vm_event(WATERMARK_BOOST);
+}
+
 static inline struct page *
 __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 {
@@ -857,6 +920,10 @@ __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 			       is_migrate_cma(migratetype)
 			     ? migratetype : start_migratetype);
 
+			if (current_order < pageblock_order &&
+			    !is_migrate_cma(migratetype))
+				boost_watermark(zone);
+
 			trace_mm_page_alloc_extfrag(page, order, current_order,
 				start_migratetype, migratetype);
 
@@ -917,6 +984,36 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 	return i;
 }
 
+static struct page *rmqueue_pcp_high_order(struct zone *zone,
+					   unsigned int order,
+					   int migratetype, int cold)
+{
+	struct per_cpu_pages *pcp;
+	struct list_head *list;
+	struct page *page;
+
+	pcp = &this_cpu_ptr(zone->pageset)->order_pcp[order - 1];
+	if (!pcp->high)
+		return NULL;
+
+	list = &pcp->lists[migratetype];
+	if (list_empty(list)) {
+		pcp->count += rmqueue_bulk(zone, order, pcp->batch, list,
+					   migratetype, cold);
+		if (unlikely(list_empty(list)))
+			return NULL;
+	}
+
+	if (cold)
+		page = list_entry(list->prev, struct page, lru);
+	else
+		page = list_entry(list->next, struct page, lru);
+
+	list_del(&page->lru);
+	pcp->count--;
+	return page;
+}
+
 #ifdef CONFIG_NUMA
 void drain_zone_pages(struct zone *zone, struct per_cpu_pages *pcp)
 {
@@ -928,29 +1025,50 @@ void drain_zone_pages(struct zone *zone, struct per_cpu_pages *pcp)
 		to_drain = pcp->batch;
 	else
 		to_drain = pcp->count;
-	free_pcppages_bulk(zone, to_drain, pcp);
+	free_pcppages_bulk(zone, to_drain, pcp, 0);
 	pcp->count -= to_drain;
 	local_irq_restore(flags);
 }
 #endif
 
+static void drain_pageset(struct zone *zone, struct per_cpu_pageset *pset)
+{
+	int order;
+
+	if (pset->pcp.count) {
+		free_pcppages_bulk(zone, pset->pcp.count, &pset->pcp, 0);
+		pset->pcp.count = 0;
+	}
+	for (order = 1; order <= NR_PCP_HIGH_ORDERS; order++) {
+		struct per_cpu_pages *pcp = &pset->order_pcp[order - 1];
+
+		if (pcp->count) {
+			free_pcppages_bulk(zone, pcp->count, pcp, order);
+			pcp->count = 0;
+		}
+	}
+}
+
+static bool pageset_has_pages(struct per_cpu_pageset *pset)
+{
+	int order;
+
+	if (pset->pcp.count)
+		return true;
+	for (order = 1; order <= NR_PCP_HIGH_ORDERS; order++)
+		if (pset->order_pcp[order - 1].count)
+			return true;
+	return false;
+}
+
 static void drain_pages(unsigned int cpu)
 {
 	unsigned long flags;
 	struct zone *zone;
 
 	for_each_populated_zone(zone) {
-		struct per_cpu_pageset *pset;
-		struct per_cpu_pages *pcp;
-
 		local_irq_save(flags);
-		pset = per_cpu_ptr(zone->pageset, cpu);
-
-		pcp = &pset->pcp;
-		if (pcp->count) {
-			free_pcppages_bulk(zone, pcp->count, pcp);
-			pcp->count = 0;
-		}
+		drain_pageset(zone, per_cpu_ptr(zone->pageset, cpu));
 		local_irq_restore(flags);
 	}
 }
@@ -972,7 +1090,7 @@ void drain_all_pages(void)
 		bool has_pcps = false;
 		for_each_populated_zone(zone) {
 			pcp = per_cpu_ptr(zone->pageset, cpu);
-			if (pcp->pcp.count) {
+			if (pageset_has_pages(pcp)) {
 				has_pcps = true;
 				break;
 			}
@@ -1054,7 +1172,7 @@ void free_hot_cold_page(struct page *page, int cold)
 		list_add(&page->lru, &pcp->lists[migratetype]);
 	pcp->count++;
 	if (pcp->count >= pcp->high) {
-		free_pcppages_bulk(zone, pcp->batch, pcp);
+		free_pcppages_bulk(zone, pcp->batch, pcp, 0);
 		pcp->count -= pcp->batch;
 	}
 
@@ -1163,18 +1281,31 @@ again:
 		if (unlikely(gfp_flags & __GFP_NOFAIL)) {
 			WARN_ON_ONCE(order > 1);
 		}
-		spin_lock_irqsave(&zone->lock, flags);
-		page = __rmqueue(zone, order, migratetype);
-		spin_unlock(&zone->lock);
-		if (!page)
-			goto failed;
-		__mod_zone_page_state(zone, NR_FREE_PAGES, -(1 << order));
+		local_irq_save(flags);
+		page = NULL;
+		if (order <= NR_PCP_HIGH_ORDERS)
+			page = rmqueue_pcp_high_order(zone, order,
+						      migratetype, cold);
+		if (!page) {
+			spin_lock(&zone->lock);
+			page = __rmqueue(zone, order, migratetype);
+			spin_unlock(&zone->lock);
+			if (!page)
+				goto failed;
+			__mod_zone_page_state(zone, NR_FREE_PAGES,
+					      -(1 << order));
+		}
 	}
 
 	__count_zone_vm_events(PGALLOC, zone, 1 << order);
 	zone_statistics(preferred_zone, zone, gfp_flags);
 	local_irq_restore(flags);
 
+	if (unlikely(test_bit(ZONE_BOOSTED_WATERMARK, &zone->flags))) {
+		zone_clear_flag(zone, ZONE_BOOSTED_WATERMARK);
+		wakeup_kswapd(zone, 0, zone_idx(zone));
+	}
+
 	VM_BUG_ON(bad_range(zone, page));
 	if (prep_new_page(page, order, gfp_flags))
 		goto again;
@@ -1439,7 +1570,7 @@ zonelist_scan:
 			unsigned long mark;
 			int ret;
 
-			mark = zone->watermark[alloc_flags & ALLOC_WMARK_MASK];
+			mark = wmark_pages(zone, alloc_flags & ALLOC_WMARK_MASK);
 			if (zone_watermark_ok(zone, order, mark,
 				    classzone_idx, alloc_flags))
 				goto try_this_zone;
@@ -2911,10 +3042,24 @@ static int zone_batchsize(struct zone *zone)
 #endif
 }
 
+static void setup_pageset_high_orders(struct per_cpu_pageset *p)
+{
+	int order;
+
+	for (order = 1; order <= NR_PCP_HIGH_ORDERS; order++) {
+		struct per_cpu_pages *pcp = &p->order_pcp[order - 1];
+		int high = percpu_order_pagelist_high[order - 1];
+
+		pcp->batch = clamp(percpu_order_pagelist_batch[order - 1],
+				   1, max(high, 1));
+		pcp->high = high;
+	}
+}
+
 static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 {
 	struct per_cpu_pages *pcp;
-	int migratetype;
+	int migratetype, order;
 
 	memset(p, 0, sizeof(*p));
 
@@ -2924,6 +3069,16 @@ static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 	pcp->batch = max(1UL, 1 * batch);
 	for (migratetype = 0; migratetype < MIGRATE_PCPTYPES; migratetype++)
 		INIT_LIST_HEAD(&pcp->lists[migratetype]);
+
+	for (order = 1; order <= NR_PCP_HIGH_ORDERS; order++) {
+		pcp = &p->order_pcp[order - 1];
+		pcp->batch = 1;
+		for (migratetype = 0; migratetype < MIGRATE_PCPTYPES;
+		     migratetype++)
+			INIT_LIST_HEAD(&pcp->lists[migratetype]);
+	}
+	if (batch)
+		setup_pageset_high_orders(p);
 }
 
 
@@ -3008,7 +3163,7 @@ static int __zone_pcp_update(void *data)
 		pcp = &pset->pcp;
 
 		local_irq_save(flags);
-		free_pcppages_bulk(zone, pcp->count, pcp);
+		drain_pageset(zone, pset);
 		setup_pageset(pset, batch);
 		local_irq_restore(flags);
 	}
@@ -3354,6 +3509,9 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 	pgdat->nr_zones = 0;
 	init_waitqueue_head(&pgdat->kswapd_wait);
 	pgdat->kswapd_max_order = 0;
+#ifdef CONFIG_COMPACTION
+	init_waitqueue_head(&pgdat->kcompactd_wait);
+#endif
 	pgdat_page_cgroup_init(pgdat);
 
 	for (j = 0; j < MAX_NR_ZONES; j++) {
@@ -3869,6 +4027,7 @@ static void setup_per_zone_lowmem_reserve(void)
 static void __setup_per_zone_wmarks(void)
 {
 	unsigned long pages_min = min_free_kbytes >> (PAGE_SHIFT - 10);
+	unsigned long pages_low = extra_free_kbytes >> (PAGE_SHIFT - 10);
 	unsigned long lowmem_pages = 0;
 	struct zone *zone;
 	unsigned long flags;
@@ -3880,11 +4039,13 @@ static void __setup_per_zone_wmarks(void)
 	}
 
 	for_each_zone(zone) {
-		u64 tmp;
+		u64 tmp, low;
 
 		spin_lock_irqsave(&zone->lock, flags);
 		tmp = (u64)pages_min * zone->present_pages;
 		do_div(tmp, lowmem_pages);
+		low = (u64)pages_low * zone->present_pages;
+		do_div(low, vm_total_pages);
 		if (is_highmem(zone)) {
 			int min_pages;
 
@@ -3898,8 +4059,11 @@ static void __setup_per_zone_wmarks(void)
 			zone->watermark[WMARK_MIN] = tmp;
 		}
 
-		zone->watermark[WMARK_LOW]  = min_wmark_pages(zone) + (tmp >> 2);
-		zone->watermark[WMARK_HIGH] = min_wmark_pages(zone) + (tmp >> 1);
+		zone->watermark[WMARK_LOW]  = min_wmark_pages(zone) + low +
+					      (tmp >> 2);
+		zone->watermark[WMARK_HIGH] = min_wmark_pages(zone) + low +
+					      (tmp >> 1);
+		zone->watermark_boost = 0;
 
 		zone->watermark[WMARK_MIN] += cma_wmark_pages(zone);
 		zone->watermark[WMARK_LOW] += cma_wmark_pages(zone);
@@ -4013,6 +4177,25 @@ int lowmem_reserve_ratio_sysctl_handler(ctl_table *table, int write,
 }
 
 
+int percpu_order_pagelist_sysctl_handler(ctl_table *table, int write,
+	void __user *buffer, size_t *length, loff_t *ppos)
+{
+	struct zone *zone;
+	unsigned int cpu;
+	int ret;
+
+	ret = proc_dointvec_minmax(table, write, buffer, length, ppos);
+	if (!write || (ret < 0))
+		return ret;
+	for_each_populated_zone(zone) {
+		for_each_possible_cpu(cpu)
+			setup_pageset_high_orders(
+				per_cpu_ptr(zone->pageset, cpu));
+	}
+	drain_all_pages();
+	return 0;
+}
+
 int percpu_pagelist_fraction_sysctl_handler(ctl_table *table, int write,
 	void __user *buffer, size_t *length, loff_t *ppos)
 {
@@ -0,0 +1,177 @@
+/*
+ * mm/page_alloc_bench.c
+ *
+ * Page allocator throughput benchmark.  On load, one kthread per online
+ * CPU (or nr_workers of them) allocates and frees batches of pages of
+ * each order from 0 to max_order concurrently, and the aggregate
+ * alloc+free rate per order is printed.  Compare runs with
+ * vm.percpu_order_pagelist_high set to 0 to see what the per-cpu lists
+ * for high orders save under zone->lock contention.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/gfp.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/atomic.h>
+#include <linux/math64.h>
+
+static unsigned int max_order = PAGE_ALLOC_COSTLY_ORDER;
+module_param(max_order, uint, 0444);
+MODULE_PARM_DESC(max_order, "Highest order to benchmark (default 3)");
+
+static unsigned int nr_loops = 10000;
+module_param(nr_loops, uint, 0444);
+MODULE_PARM_DESC(nr_loops, "Alloc/free rounds per thread and order");
+
+static unsigned int batch = 16;
+module_param(batch, uint, 0444);
+MODULE_PARM_DESC(batch, "Blocks held before they are freed again");
+
+static unsigned int nr_workers;
+module_param(nr_workers, uint, 0444);
+MODULE_PARM_DESC(nr_workers, "Threads to run, default one per online cpu");
+
+struct bench_thread {
+	struct task_struct *task;
+	unsigned int order;
+	u64 ns;
+	unsigned long ops;
+	unsigned long failed;
+	struct completion done;
+};
+
+static atomic_t bench_ready;
+static DECLARE_COMPLETION(bench_start);
+static DECLARE_COMPLETION(bench_all_ready);
+
+static int bench_thread_fn(void *arg)
+{
+	struct bench_thread *bt = arg;
+	struct page **pages;
+	unsigned int i, j;
+	u64 start;
+
+	pages = kcalloc(batch, sizeof(*pages), GFP_KERNEL);
+
+	if (atomic_dec_and_test(&bench_ready))
+		complete(&bench_all_ready);
+	wait_for_completion(&bench_start);
+
+	if (!pages)
+		goto out;
+
+	start = local_clock();
+	for (i = 0; i < nr_loops; i++) {
+		for (j = 0; j < batch; j++) {
+			pages[j] = alloc_pages(GFP_KERNEL | __GFP_NOWARN,
+					       bt->order);
+			if (pages[j])
+				bt->ops++;
+			else
+				bt->failed++;
+		}
+		for (j = 0; j < batch; j++) {
+			if (pages[j])
+				__free_pages(pages[j], bt->order);
+		}
+		cond_resched();
+	}
+	bt->ns = local_clock() - start;
+	kfree(pages);
+out:
+	complete_and_exit(&bt->done, 0);
+}
+
+static int bench_order(unsigned int order, unsigned int threads)
+{
+	struct bench_thread *bt;
+	unsigned long ops = 0, failed = 0;
+	u64 ns = 0, rate;
+	unsigned int i, started = 0;
+	int cpu = -1;
+
+	bt = kcalloc(threads, sizeof(*bt), GFP_KERNEL);
+	if (!bt)
+		return -ENOMEM;
+
+	atomic_set(&bench_ready, threads);
+	INIT_COMPLETION(bench_start);
+	INIT_COMPLETION(bench_all_ready);
+
+	for (i = 0; i < threads; i++) {
+		bt[i].order = order;
+		init_completion(&bt[i].done);
+		bt[i].task = kthread_create(bench_thread_fn, &bt[i],
+					    "pa_bench/%u", i);
+		if (IS_ERR(bt[i].task))
+			break;
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids)
+			cpu = cpumask_first(cpu_online_mask);
+		kthread_bind(bt[i].task, cpu);
+		wake_up_process(bt[i].task);
+		started++;
+	}
+
+	/* account for threads that were never created */
+	for (i = started; i < threads; i++)
+		if (atomic_dec_and_test(&bench_ready))
+			complete(&bench_all_ready);
+
+	wait_for_completion(&bench_all_ready);
+	complete_all(&bench_start);
+	for (i = 0; i < started; i++)
+		wait_for_completion(&bt[i].done);
+
+	for (i = 0; i < started; i++) {
+		ops += bt[i].ops;
+		failed += bt[i].failed;
+		ns = max(ns, bt[i].ns);
+	}
+	kfree(bt);
+
+	if (!started)
+		return -ENOMEM;
+
+	rate = ns ? div64_u64((u64)ops * NSEC_PER_SEC, ns) : 0;
+	pr_info("page_alloc_bench: order %u threads %u: %lu alloc+free in %llu us, %llu ops/s, %llu ns/op per thread, %lu failed\n",
+		order, started, ops, div_u64(ns, NSEC_PER_USEC), rate,
+		ops ? div64_u64(ns * started, ops) : 0, failed);
+	return 0;
+}
+
+static int __init page_alloc_bench_init(void)
+{
+	unsigned int threads = nr_workers ? nr_workers : num_online_cpus();
+	unsigned int order;
+	int ret = 0;
+
+	if (!batch || max_order >= MAX_ORDER)
+		return -EINVAL;
+
+	for (order = 0; order <= max_order && !ret; order++)
+		ret = bench_order(order, threads);
+	return ret;
+}
+
+static void __exit page_alloc_bench_exit(void)
+{
+}
+
+module_init(page_alloc_bench_init);
+module_exit(page_alloc_bench_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Page allocator per-order alloc/free throughput benchmark");
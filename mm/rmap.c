@@ -872,6 +872,19 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	} else if (PageAnon(page)) {
 		swp_entry_t entry = { .val = page_private(page) };
 
+		if (!PageSwapBacked(page) &&
+		    TTU_ACTION(flags) != TTU_MIGRATION) {
+			if (PageDirty(page)) {
+				set_pte_at(mm, address, pte, pteval);
+				SetPageSwapBacked(page);
+				count_vm_event(PGLAZYFREE_REUSED);
+				ret = SWAP_FAIL;
+				goto out_unmap;
+			}
+			dec_mm_counter(mm, MM_ANONPAGES);
+			goto discard;
+		}
+
 		if (PageSwapCache(page)) {
 			if (swap_duplicate(entry) < 0) {
 				set_pte_at(mm, address, pte, pteval);
@@ -901,6 +914,7 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	} else
 		dec_mm_counter(mm, MM_FILEPAGES);
 
+discard:
 	page_remove_rmap(page);
 	page_cache_release(page);
 
@@ -20,6 +20,9 @@
 #include <linux/fault-inject.h>
 #include <linux/stacktrace.h>
 #include <linux/prefetch.h>
+#include <linux/hash.h>
+#include <linux/debugfs.h>
+#include <linux/vmalloc.h>
 
 #include <trace/events/kmem.h>
 
@@ -117,6 +120,20 @@ static inline void stat(const struct kmem_cache *s, enum stat_item si)
 #endif
 }
 
+static inline void lock_node(struct kmem_cache *s, struct kmem_cache_node *n)
+{
+	struct kmem_cache_cpu *c = __this_cpu_ptr(s->cpu_slab);
+
+	if (unlikely(!spin_trylock(&n->list_lock))) {
+		u64 start = local_clock();
+
+		spin_lock(&n->list_lock);
+		c->lock_wait += local_clock() - start;
+		c->lock_contended++;
+	}
+	c->lock_acquired++;
+}
+
 
 int slab_is_available(void)
 {
@@ -1251,7 +1268,7 @@ static void *get_partial_node(struct kmem_cache *s,
 	if (!n || !n->nr_partial)
 		return NULL;
 
-	spin_lock(&n->list_lock);
+	lock_node(s, n);
 	list_for_each_entry_safe(page, page2, &n->partial, lru) {
 		void *t = acquire_slab(s, n, page, object == NULL);
 		int available;
@@ -1451,13 +1468,13 @@ redo:
 		m = M_PARTIAL;
 		if (!lock) {
 			lock = 1;
-			spin_lock(&n->list_lock);
+			lock_node(s, n);
 		}
 	} else {
 		m = M_FULL;
 		if (kmem_cache_debug(s) && !lock) {
 			lock = 1;
-			spin_lock(&n->list_lock);
+			lock_node(s, n);
 		}
 	}
 
@@ -1539,7 +1556,7 @@ static void unfreeze_partials(struct kmem_cache *s)
 						spin_unlock(&n->list_lock);
 
 					n = n2;
-					spin_lock(&n->list_lock);
+					lock_node(s, n);
 				}
 			}
 
@@ -1654,6 +1671,102 @@ static void flush_all(struct kmem_cache *s)
 	on_each_cpu_cond(has_cpu_slab, flush_cpu_slab, s, 1, GFP_ATOMIC);
 }
 
+#define SLUB_PARTIAL_SCALE		4
+#define SLUB_CONTENDED_THRESHOLD	16
+
+static unsigned int slub_partial_adapt_ms = 1000;
+static struct delayed_work slub_adapt_work;
+
+static unsigned long cache_lock_contended(struct kmem_cache *s)
+{
+	unsigned long contended = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		contended += per_cpu_ptr(s->cpu_slab, cpu)->lock_contended;
+	return contended;
+}
+
+static void adapt_cpu_partial(struct kmem_cache *s)
+{
+	unsigned long contended = cache_lock_contended(s);
+	unsigned long delta = contended - s->lock_contended_seen;
+	int base = s->cpu_partial_base;
+
+	s->lock_contended_seen = contended;
+	if (!base)
+		return;
+
+	if (delta >= SLUB_CONTENDED_THRESHOLD)
+		s->cpu_partial = min(s->cpu_partial + base,
+				     base * SLUB_PARTIAL_SCALE);
+	else if (!delta && s->cpu_partial > base)
+		s->cpu_partial = max(s->cpu_partial - max(base / 2, 1), base);
+}
+
+static void slub_adapt_partial(struct work_struct *work)
+{
+	struct kmem_cache *s;
+
+	if (down_read_trylock(&slub_lock)) {
+		list_for_each_entry(s, &slab_caches, list)
+			adapt_cpu_partial(s);
+		up_read(&slub_lock);
+	}
+	schedule_delayed_work(&slub_adapt_work,
+			      msecs_to_jiffies(slub_partial_adapt_ms));
+}
+
+static int slub_partial_shrink(struct shrinker *shrink,
+			       struct shrink_control *sc)
+{
+	struct kmem_cache *s;
+	int excess = 0;
+
+	if (!down_read_trylock(&slub_lock))
+		return sc->nr_to_scan ? -1 : 0;
+
+	list_for_each_entry(s, &slab_caches, list) {
+		if (s->cpu_partial <= s->cpu_partial_base)
+			continue;
+		if (sc->nr_to_scan) {
+			s->cpu_partial = s->cpu_partial_base;
+			flush_all(s);
+		} else
+			excess += s->cpu_partial - s->cpu_partial_base;
+	}
+	up_read(&slub_lock);
+	return excess;
+}
+
+static struct shrinker slub_partial_shrinker = {
+	.shrink = slub_partial_shrink,
+	.seeks = DEFAULT_SEEKS,
+	.batch = 1,
+};
+
+static int __init setup_slub_partial_adapt(char *str)
+{
+	get_option(&str, (int *)&slub_partial_adapt_ms);
+
+	return 1;
+}
+
+__setup("slub_partial_adapt=", setup_slub_partial_adapt);
+
+static int __init slub_partial_adapt_init(void)
+{
+	if (!slub_partial_adapt_ms)
+		return 0;
+
+	INIT_DELAYED_WORK_DEFERRABLE(&slub_adapt_work, slub_adapt_partial);
+	schedule_delayed_work(&slub_adapt_work,
+			      msecs_to_jiffies(slub_partial_adapt_ms));
+	register_shrinker(&slub_partial_shrinker);
+	return 0;
+}
+__initcall(slub_partial_adapt_init);
+
 static inline int node_match(struct kmem_cache_cpu *c, int node)
 {
 #ifdef CONFIG_NUMA
@@ -1858,6 +1971,166 @@ new_slab:
 	return object;
 }
 
+#ifdef CONFIG_SLUB_PROFILE
+#define PROFILE_SITE_BITS	8
+#define PROFILE_OBJ_BITS	10
+#define PROFILE_OBJ_PROBE	8
+#define PROFILE_BUCKETS		28
+
+struct profile_site {
+	struct kmem_cache *s;
+	unsigned long addr;
+	unsigned long allocs;
+	unsigned long frees;
+	unsigned long lifetime[PROFILE_BUCKETS];
+};
+
+struct profile_obj {
+	void *object;
+	struct profile_site *site;
+	u64 when;
+};
+
+static unsigned int slub_profile_rate __read_mostly;
+static struct kmem_cache *slub_profile_cache __read_mostly;
+static DEFINE_SPINLOCK(slub_profile_lock);
+static DEFINE_PER_CPU(unsigned int, slub_profile_count);
+static struct profile_site profile_sites[1 << PROFILE_SITE_BITS];
+static struct profile_obj profile_objs[1 << PROFILE_OBJ_BITS];
+static unsigned long profile_dropped;
+
+static struct profile_site *profile_find_site(struct kmem_cache *s,
+					      unsigned long addr)
+{
+	unsigned int h = hash_long(addr ^ (unsigned long)s, PROFILE_SITE_BITS);
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(profile_sites); i++) {
+		struct profile_site *site = &profile_sites[(h + i) &
+					(ARRAY_SIZE(profile_sites) - 1)];
+
+		if (!site->s) {
+			site->s = s;
+			site->addr = addr;
+			return site;
+		}
+		if (site->s == s && site->addr == addr)
+			return site;
+	}
+	return NULL;
+}
+
+static noinline void slub_profile_alloc(struct kmem_cache *s, void *object,
+					unsigned long addr)
+{
+	struct profile_site *site;
+	unsigned long flags;
+	unsigned int *count, h, i;
+	bool sample;
+
+	if (slub_profile_cache && slub_profile_cache != s)
+		return;
+
+	count = &get_cpu_var(slub_profile_count);
+	sample = ++(*count) >= slub_profile_rate;
+	if (sample)
+		*count = 0;
+	put_cpu_var(slub_profile_count);
+	if (!sample)
+		return;
+
+	spin_lock_irqsave(&slub_profile_lock, flags);
+	if (!slub_profile_rate)
+		goto out;
+	site = profile_find_site(s, addr);
+	if (!site) {
+		profile_dropped++;
+		goto out;
+	}
+	site->allocs++;
+
+	h = hash_ptr(object, PROFILE_OBJ_BITS);
+	for (i = 0; i < PROFILE_OBJ_PROBE; i++) {
+		struct profile_obj *po = &profile_objs[(h + i) &
+					(ARRAY_SIZE(profile_objs) - 1)];
+
+		if (!po->object || po->object == object) {
+			po->site = site;
+			po->when = local_clock();
+			po->object = object;
+			goto out;
+		}
+	}
+	profile_dropped++;
+out:
+	spin_unlock_irqrestore(&slub_profile_lock, flags);
+}
+
+static noinline void slub_profile_free(struct kmem_cache *s, void *object)
+{
+	unsigned int h = hash_ptr(object, PROFILE_OBJ_BITS);
+	unsigned long flags;
+	unsigned int i;
+
+	for (i = 0; i < PROFILE_OBJ_PROBE; i++) {
+		struct profile_obj *po = &profile_objs[(h + i) &
+					(ARRAY_SIZE(profile_objs) - 1)];
+		u64 usecs;
+		int bucket;
+
+		if (ACCESS_ONCE(po->object) != object)
+			continue;
+
+		spin_lock_irqsave(&slub_profile_lock, flags);
+		if (po->object == object) {
+			usecs = div_u64(local_clock() - po->when,
+					NSEC_PER_USEC);
+			bucket = usecs ? min_t(int, ilog2(usecs) + 1,
+					       PROFILE_BUCKETS - 1) : 0;
+			po->site->lifetime[bucket]++;
+			po->site->frees++;
+			po->object = NULL;
+		}
+		spin_unlock_irqrestore(&slub_profile_lock, flags);
+		return;
+	}
+}
+
+static void slub_profile_reset(void)
+{
+	memset(profile_sites, 0, sizeof(profile_sites));
+	memset(profile_objs, 0, sizeof(profile_objs));
+	profile_dropped = 0;
+}
+
+static void slub_profile_cache_destroy(struct kmem_cache *s)
+{
+	unsigned long flags;
+	unsigned int i;
+
+	spin_lock_irqsave(&slub_profile_lock, flags);
+	if (slub_profile_cache == s) {
+		slub_profile_cache = NULL;
+		slub_profile_rate = 0;
+	}
+	for (i = 0; i < ARRAY_SIZE(profile_objs); i++)
+		if (profile_objs[i].object && profile_objs[i].site->s == s)
+			profile_objs[i].object = NULL;
+	for (i = 0; i < ARRAY_SIZE(profile_sites); i++)
+		if (profile_sites[i].s == s) {
+			slub_profile_reset();
+			break;
+		}
+	spin_unlock_irqrestore(&slub_profile_lock, flags);
+}
+#else
+static inline void slub_profile_alloc(struct kmem_cache *s, void *object,
+				      unsigned long addr) { }
+static inline void slub_profile_free(struct kmem_cache *s, void *object) { }
+static inline void slub_profile_cache_destroy(struct kmem_cache *s) { }
+#define slub_profile_rate 0
+#endif
+
 static __always_inline void *slab_alloc(struct kmem_cache *s,
 		gfp_t gfpflags, int node, unsigned long addr)
 {
@@ -1898,6 +2171,9 @@ redo:
 	if (unlikely(gfpflags & __GFP_ZERO) && object)
 		memset(object, 0, s->objsize);
 
+	if (unlikely(slub_profile_rate) && object)
+		slub_profile_alloc(s, object, addr);
+
 	slab_post_alloc_hook(s, gfpflags, object);
 
 	return object;
@@ -1991,7 +2267,8 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 			else { 
 
 	                        n = get_node(s, page_to_nid(page));
-				spin_lock_irqsave(&n->list_lock, flags);
+				local_irq_save(flags);
+				lock_node(s, n);
 
 			}
 		}
@@ -2050,6 +2327,9 @@ static __always_inline void slab_free(struct kmem_cache *s,
 
 	slab_free_hook(s, x);
 
+	if (unlikely(slub_profile_rate))
+		slub_profile_free(s, x);
+
 redo:
 	c = __this_cpu_ptr(s->cpu_slab);
 
@@ -2399,6 +2679,7 @@ static int kmem_cache_open(struct kmem_cache *s,
 		s->cpu_partial = 13;
 	else
 		s->cpu_partial = 30;
+	s->cpu_partial_base = s->cpu_partial;
 
 	s->refcount = 1;
 #ifdef CONFIG_NUMA
@@ -2493,6 +2774,7 @@ void kmem_cache_destroy(struct kmem_cache *s)
 	if (!s->refcount) {
 		list_del(&s->list);
 		up_write(&slub_lock);
+		slub_profile_cache_destroy(s);
 		if (kmem_cache_close(s)) {
 			printk(KERN_ERR "SLUB %s: %s called for cache that "
 				"still has objects.\n", s->name, __func__);
@@ -3867,6 +4149,7 @@ static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
 		return -EINVAL;
 
 	s->cpu_partial = objects;
+	s->cpu_partial_base = objects;
 	flush_all(s);
 	return length;
 }
@@ -4656,3 +4939,259 @@ static int __init slab_proc_init(void)
 }
 module_init(slab_proc_init);
 #endif 
+
+#ifdef CONFIG_SLUB_PROFILE
+static int profile_rate_get(void *data, u64 *val)
+{
+	*val = slub_profile_rate;
+	return 0;
+}
+
+static int profile_rate_set(void *data, u64 val)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&slub_profile_lock, flags);
+	slub_profile_reset();
+	slub_profile_rate = val;
+	spin_unlock_irqrestore(&slub_profile_lock, flags);
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(profile_rate_fops, profile_rate_get,
+			profile_rate_set, "%llu\n");
+
+static int profile_cache_show(struct seq_file *m, void *v)
+{
+	struct kmem_cache *s;
+
+	down_read(&slub_lock);
+	s = slub_profile_cache;
+	seq_printf(m, "%s\n", s ? s->name : "all");
+	up_read(&slub_lock);
+	return 0;
+}
+
+static int profile_cache_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, profile_cache_show, NULL);
+}
+
+static ssize_t profile_cache_write(struct file *file, const char __user *buf,
+				   size_t count, loff_t *ppos)
+{
+	struct kmem_cache *s, *found = NULL;
+	char name[64];
+	size_t len = min(count, sizeof(name) - 1);
+
+	if (copy_from_user(name, buf, len))
+		return -EFAULT;
+	name[len] = '\0';
+	strim(name);
+
+	down_read(&slub_lock);
+	if (strcmp(name, "all")) {
+		list_for_each_entry(s, &slab_caches, list) {
+			if (!strcmp(s->name, name)) {
+				found = s;
+				break;
+			}
+		}
+		if (!found) {
+			up_read(&slub_lock);
+			return -EINVAL;
+		}
+	}
+	slub_profile_cache = found;
+	up_read(&slub_lock);
+	return count;
+}
+
+static const struct file_operations profile_cache_fops = {
+	.open		= profile_cache_open,
+	.read		= seq_read,
+	.write		= profile_cache_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+struct profile_snap {
+	char name[24];
+	int objsize;
+	unsigned long addr;
+	unsigned long allocs;
+	unsigned long frees;
+	unsigned long lifetime[PROFILE_BUCKETS];
+};
+
+static struct profile_snap *profile_snapshot(unsigned int *nr,
+					     unsigned int *rate,
+					     unsigned long *dropped)
+{
+	struct profile_snap *snap;
+	unsigned long flags;
+	unsigned int i, n = 0;
+
+	snap = vmalloc(sizeof(*snap) * ARRAY_SIZE(profile_sites));
+	if (!snap)
+		return NULL;
+
+	spin_lock_irqsave(&slub_profile_lock, flags);
+	for (i = 0; i < ARRAY_SIZE(profile_sites); i++) {
+		struct profile_site *site = &profile_sites[i];
+
+		if (!site->s)
+			continue;
+		strlcpy(snap[n].name, site->s->name, sizeof(snap[n].name));
+		snap[n].objsize = site->s->objsize;
+		snap[n].addr = site->addr;
+		snap[n].allocs = site->allocs;
+		snap[n].frees = site->frees;
+		memcpy(snap[n].lifetime, site->lifetime,
+		       sizeof(snap[n].lifetime));
+		n++;
+	}
+	*rate = slub_profile_rate;
+	*dropped = profile_dropped;
+	spin_unlock_irqrestore(&slub_profile_lock, flags);
+
+	*nr = n;
+	return snap;
+}
+
+static int profile_sites_show(struct seq_file *m, void *v)
+{
+	struct profile_snap *snap;
+	unsigned int i, nr, rate;
+	unsigned long dropped;
+
+	snap = profile_snapshot(&nr, &rate, &dropped);
+	if (!snap)
+		return -ENOMEM;
+
+	seq_printf(m, "rate 1/%u dropped %lu\n", rate, dropped);
+	seq_printf(m, "%-24s %7s %10s %10s %10s  %s\n", "cache", "size",
+		   "allocs", "frees", "live", "caller");
+	for (i = 0; i < nr; i++)
+		seq_printf(m, "%-24s %7d %10lu %10lu %10lu  %pS\n",
+			   snap[i].name, snap[i].objsize, snap[i].allocs,
+			   snap[i].frees, snap[i].allocs - snap[i].frees,
+			   (void *)snap[i].addr);
+	vfree(snap);
+	return 0;
+}
+
+static int profile_sites_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, profile_sites_show, NULL);
+}
+
+static const struct file_operations profile_sites_fops = {
+	.open		= profile_sites_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int profile_lifetime_show(struct seq_file *m, void *v)
+{
+	struct profile_snap *snap;
+	unsigned int i, b, nr, rate;
+	unsigned long dropped;
+
+	snap = profile_snapshot(&nr, &rate, &dropped);
+	if (!snap)
+		return -ENOMEM;
+
+	for (i = 0; i < nr; i++) {
+		if (!snap[i].frees)
+			continue;
+		seq_printf(m, "%s %pS\n", snap[i].name, (void *)snap[i].addr);
+		for (b = 0; b < PROFILE_BUCKETS; b++) {
+			if (!snap[i].lifetime[b])
+				continue;
+			if (b)
+				seq_printf(m, "  >= %10luus %10lu\n",
+					   1UL << (b - 1), snap[i].lifetime[b]);
+			else
+				seq_printf(m, "  <  %10luus %10lu\n",
+					   1UL, snap[i].lifetime[b]);
+		}
+	}
+	vfree(snap);
+	return 0;
+}
+
+static int profile_lifetime_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, profile_lifetime_show, NULL);
+}
+
+static const struct file_operations profile_lifetime_fops = {
+	.open		= profile_lifetime_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int contention_show(struct seq_file *m, void *v)
+{
+	struct kmem_cache *s;
+
+	seq_printf(m, "%-24s %8s %8s %12s %12s %14s\n", "cache",
+		   "partial", "base", "acquired", "contended", "wait-us");
+	down_read(&slub_lock);
+	list_for_each_entry(s, &slab_caches, list) {
+		unsigned long acquired = 0, contended = 0;
+		u64 wait = 0;
+		int cpu;
+
+		for_each_possible_cpu(cpu) {
+			struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
+
+			acquired += c->lock_acquired;
+			contended += c->lock_contended;
+			wait += c->lock_wait;
+		}
+		if (!acquired)
+			continue;
+		seq_printf(m, "%-24s %8d %8d %12lu %12lu %14llu\n", s->name,
+			   s->cpu_partial, s->cpu_partial_base, acquired,
+			   contended, div_u64(wait, NSEC_PER_USEC));
+	}
+	up_read(&slub_lock);
+	return 0;
+}
+
+static int contention_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, contention_show, NULL);
+}
+
+static const struct file_operations contention_fops = {
+	.open		= contention_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init slub_profile_init(void)
+{
+	struct dentry *dir;
+
+	dir = debugfs_create_dir("slub", NULL);
+	if (!dir)
+		return -ENOMEM;
+	debugfs_create_file("profile_rate", S_IRUSR | S_IWUSR, dir, NULL,
+			    &profile_rate_fops);
+	debugfs_create_file("profile_cache", S_IRUSR | S_IWUSR, dir, NULL,
+			    &profile_cache_fops);
+	debugfs_create_file("profile_sites", S_IRUSR, dir, NULL,
+			    &profile_sites_fops);
+	debugfs_create_file("profile_lifetime", S_IRUSR, dir, NULL,
+			    &profile_lifetime_fops);
+	debugfs_create_file("contention", S_IRUSR, dir, NULL,
+			    &contention_fops);
+	return 0;
+}
+late_initcall(slub_profile_init);
+#endif
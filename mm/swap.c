@@ -30,6 +30,7 @@ int page_cluster;
 static DEFINE_PER_CPU(struct pagevec[NR_LRU_LISTS], lru_add_pvecs);
 static DEFINE_PER_CPU(struct pagevec, lru_rotate_pvecs);
 static DEFINE_PER_CPU(struct pagevec, lru_deactivate_pvecs);
+static DEFINE_PER_CPU(struct pagevec, lru_lazyfree_pvecs);
 
 static void __page_cache_release(struct page *page)
 {
@@ -299,6 +300,8 @@ void mark_page_accessed(struct page *page)
 			PageReferenced(page) && PageLRU(page)) {
 		activate_page(page);
 		ClearPageReferenced(page);
+		if (page_is_file_cache(page))
+			workingset_activation(page);
 	} else if (!PageReferenced(page)) {
 		SetPageReferenced(page);
 	}
@@ -380,6 +383,28 @@ static void lru_deactivate_fn(struct page *page, void *arg)
 	update_page_reclaim_stat(zone, page, file, 0);
 }
 
+static void lru_lazyfree_fn(struct page *page, void *arg)
+{
+	struct zone *zone = page_zone(page);
+	bool active;
+
+	if (!PageLRU(page) || !PageAnon(page) || !PageSwapBacked(page) ||
+	    PageSwapCache(page) || PageUnevictable(page))
+		return;
+
+	active = PageActive(page);
+	del_page_from_lru_list(zone, page, LRU_INACTIVE_ANON + active);
+	ClearPageActive(page);
+	ClearPageReferenced(page);
+	ClearPageSwapBacked(page);
+	add_page_to_lru_list(zone, page, LRU_INACTIVE_FILE);
+
+	__count_vm_event(PGLAZYFREE);
+	if (active)
+		__count_vm_event(PGDEACTIVATE);
+	update_page_reclaim_stat(zone, page, 0, 0);
+}
+
 void lru_add_drain_cpu(int cpu)
 {
 	struct pagevec *pvecs = per_cpu(lru_add_pvecs, cpu);
@@ -406,6 +431,10 @@ void lru_add_drain_cpu(int cpu)
 	if (pagevec_count(pvec))
 		pagevec_lru_move_fn(pvec, lru_deactivate_fn, NULL);
 
+	pvec = &per_cpu(lru_lazyfree_pvecs, cpu);
+	if (pagevec_count(pvec))
+		pagevec_lru_move_fn(pvec, lru_lazyfree_fn, NULL);
+
 	activate_page_drain(cpu);
 }
 
@@ -423,6 +452,20 @@ void deactivate_page(struct page *page)
 	}
 }
 
+void mark_page_lazyfree(struct page *page)
+{
+	if (PageUnevictable(page) || !PageSwapBacked(page))
+		return;
+
+	if (likely(get_page_unless_zero(page))) {
+		struct pagevec *pvec = &get_cpu_var(lru_lazyfree_pvecs);
+
+		if (!pagevec_add(pvec, page))
+			pagevec_lru_move_fn(pvec, lru_lazyfree_fn, NULL);
+		put_cpu_var(lru_lazyfree_pvecs);
+	}
+}
+
 void lru_add_drain(void)
 {
 	lru_add_drain_cpu(get_cpu());
@@ -17,6 +17,7 @@
 #include <linux/pagevec.h>
 #include <linux/migrate.h>
 #include <linux/page_cgroup.h>
+#include <linux/blkdev.h>
 
 #include <asm/pgtable.h>
 
@@ -48,6 +49,26 @@ static struct {
 	unsigned long find_total;
 } swap_cache_info;
 
+int swap_vma_readahead_enabled = 1;
+
+#define SWAP_RA_ORDER_CEILING	3
+
+#define SWAP_RA_WIN_SHIFT	(PAGE_SHIFT / 2)
+#define SWAP_RA_HITS_MASK	((1UL << SWAP_RA_WIN_SHIFT) - 1)
+#define SWAP_RA_HITS_MAX	SWAP_RA_HITS_MASK
+#define SWAP_RA_WIN_MASK	(~PAGE_MASK & ~SWAP_RA_HITS_MASK)
+
+#define SWAP_RA_HITS(v)		((v) & SWAP_RA_HITS_MASK)
+#define SWAP_RA_WIN(v)		(((v) & SWAP_RA_WIN_MASK) >> SWAP_RA_WIN_SHIFT)
+#define SWAP_RA_ADDR(v)		((v) & PAGE_MASK)
+
+#define SWAP_RA_VAL(addr, win, hits)				\
+	(((addr) & PAGE_MASK) |					\
+	 (((win) << SWAP_RA_WIN_SHIFT) & SWAP_RA_WIN_MASK) |	\
+	 ((hits) & SWAP_RA_HITS_MASK))
+
+static atomic_t swapin_readahead_hits = ATOMIC_INIT(4);
+
 void show_swap_cache_info(void)
 {
 	printk("%lu pages in swap cache\n", total_swapcache_pages);
@@ -111,6 +132,10 @@ void __delete_from_swap_cache(struct page *page)
 	radix_tree_delete(&swapper_space.page_tree, page_private(page));
 	set_page_private(page, 0);
 	ClearPageSwapCache(page);
+	if (unlikely(PageReadahead(page))) {
+		ClearPageReadahead(page);
+		__count_vm_event(SWAP_RA_MISS);
+	}
 	total_swapcache_pages--;
 	__dec_zone_page_state(page, NR_FILE_PAGES);
 	INC_CACHE_INFO(del_total);
@@ -191,25 +216,44 @@ void free_pages_and_swap_cache(struct page **pages, int nr)
 	}
 }
 
-struct page * lookup_swap_cache(swp_entry_t entry)
+struct page *lookup_swap_cache(swp_entry_t entry, struct vm_area_struct *vma,
+				unsigned long addr)
 {
 	struct page *page;
 
 	page = find_get_page(&swapper_space, entry.val);
 
-	if (page)
+	if (page) {
 		INC_CACHE_INFO(find_success);
+		if (TestClearPageReadahead(page)) {
+			count_vm_event(SWAP_RA_HIT);
+			if (vma && swap_vma_readahead_enabled) {
+				unsigned long ra_val;
+				int hits;
+
+				ra_val = atomic_long_read(&vma->swap_readahead_info);
+				hits = min_t(int, SWAP_RA_HITS(ra_val) + 1,
+					     SWAP_RA_HITS_MAX);
+				atomic_long_set(&vma->swap_readahead_info,
+					SWAP_RA_VAL(addr, SWAP_RA_WIN(ra_val), hits));
+			} else
+				atomic_inc(&swapin_readahead_hits);
+		}
+	}
 
 	INC_CACHE_INFO(find_total);
 	return page;
 }
 
-struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
-			struct vm_area_struct *vma, unsigned long addr)
+static struct page *__read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr,
+			bool *allocated)
 {
 	struct page *found_page, *new_page = NULL;
 	int err;
 
+	*allocated = false;
+
 	do {
 		found_page = find_get_page(&swapper_space, entry.val);
 		if (found_page)
@@ -242,7 +286,7 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 		if (likely(!err)) {
 			radix_tree_preload_end();
 			lru_cache_add_anon(new_page);
-			swap_readpage(new_page);
+			*allocated = true;
 			return new_page;
 		}
 		radix_tree_preload_end();
@@ -256,28 +300,198 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 	return found_page;
 }
 
-struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
+struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	bool allocated;
+	struct page *page;
+
+	page = __read_swap_cache_async(entry, gfp_mask, vma, addr, &allocated);
+	if (allocated)
+		swap_readpage(page);
+	return page;
+}
+
+static void swap_ra_read_page(swp_entry_t entry, gfp_t gfp_mask,
 			struct vm_area_struct *vma, unsigned long addr)
 {
+	bool allocated;
 	struct page *page;
-	unsigned long offset = swp_offset(entry);
-	unsigned long start_offset, end_offset;
-	unsigned long mask = (1UL << page_cluster) - 1;
 
-	
-	start_offset = offset & ~mask;
-	end_offset = offset | mask;
+	page = __read_swap_cache_async(entry, gfp_mask, vma, addr, &allocated);
+	if (!page)
+		return;
+	if (allocated) {
+		SetPageReadahead(page);
+		swap_readpage(page);
+		count_vm_event(SWAP_RA);
+	}
+	page_cache_release(page);
+}
+
+static unsigned int __swapin_nr_pages(unsigned long prev_offset,
+				      unsigned long offset, int hits,
+				      int max_pages, int prev_win)
+{
+	unsigned int pages, last_ra;
+
+	pages = hits + 2;
+	if (pages == 2) {
+		if (offset != prev_offset + 1 && offset != prev_offset - 1)
+			pages = 1;
+	} else {
+		unsigned int roundup = 4;
+
+		while (roundup < pages)
+			roundup <<= 1;
+		pages = roundup;
+	}
+
+	if (pages > max_pages)
+		pages = max_pages;
+
+	last_ra = prev_win / 2;
+	if (pages < last_ra)
+		pages = last_ra;
+
+	return pages;
+}
+
+static unsigned long swapin_nr_pages(unsigned long offset)
+{
+	static unsigned long prev_offset;
+	static atomic_t last_readahead_pages;
+	unsigned int hits, pages, max_pages;
+
+	max_pages = 1 << ACCESS_ONCE(page_cluster);
+	if (max_pages <= 1)
+		return 1;
+
+	hits = atomic_xchg(&swapin_readahead_hits, 0);
+	pages = __swapin_nr_pages(prev_offset, offset, hits, max_pages,
+				  atomic_read(&last_readahead_pages));
+	if (!hits)
+		prev_offset = offset;
+	atomic_set(&last_readahead_pages, pages);
+
+	return pages;
+}
+
+struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	unsigned long entry_offset = swp_offset(entry);
+	unsigned long offset, start_offset, end_offset;
+	unsigned long mask;
+	struct blk_plug plug;
+
+	mask = swapin_nr_pages(entry_offset) - 1;
+	if (!mask)
+		goto skip;
+
+	start_offset = entry_offset & ~mask;
+	end_offset = entry_offset | mask;
 	if (!start_offset)	
 		start_offset++;
 
+	blk_start_plug(&plug);
 	for (offset = start_offset; offset <= end_offset ; offset++) {
-		
-		page = read_swap_cache_async(swp_entry(swp_type(entry), offset),
-						gfp_mask, vma, addr);
-		if (!page)
+		if (offset == entry_offset)
 			continue;
-		page_cache_release(page);
+		swap_ra_read_page(swp_entry(swp_type(entry), offset),
+				  gfp_mask, vma, addr);
 	}
+	blk_finish_plug(&plug);
 	lru_add_drain();	
+skip:
 	return read_swap_cache_async(entry, gfp_mask, vma, addr);
 }
+
+static pte_t *swap_ra_pte_map(struct vm_area_struct *vma, unsigned long addr)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	pgd = pgd_offset(vma->vm_mm, addr);
+	if (pgd_none_or_clear_bad(pgd))
+		return NULL;
+	pud = pud_offset(pgd, addr);
+	if (pud_none_or_clear_bad(pud))
+		return NULL;
+	pmd = pmd_offset(pud, addr);
+	if (pmd_none(*pmd) || pmd_trans_huge(*pmd) || pmd_bad(*pmd))
+		return NULL;
+	return pte_offset_map(pmd, addr);
+}
+
+struct page *swap_vma_readahead(swp_entry_t fentry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	pte_t ptes[1 << SWAP_RA_ORDER_CEILING];
+	unsigned long ra_val, fpfn, pfn, lpfn, rpfn, start, end;
+	unsigned int max_win, win, prev_win, hits, left, i, nr_pte = 0;
+	struct blk_plug plug;
+	pte_t *pte;
+
+	if (!swap_vma_readahead_enabled)
+		return swapin_readahead(fentry, gfp_mask, vma, addr);
+
+	max_win = 1 << min_t(unsigned int, ACCESS_ONCE(page_cluster),
+			     SWAP_RA_ORDER_CEILING);
+	if (max_win == 1)
+		goto skip;
+
+	fpfn = PFN_DOWN(addr);
+	ra_val = atomic_long_read(&vma->swap_readahead_info);
+	pfn = PFN_DOWN(SWAP_RA_ADDR(ra_val));
+	prev_win = SWAP_RA_WIN(ra_val);
+	hits = SWAP_RA_HITS(ra_val);
+	win = __swapin_nr_pages(pfn, fpfn, hits, max_win, prev_win);
+	atomic_long_set(&vma->swap_readahead_info, SWAP_RA_VAL(addr, win, 0));
+	if (win == 1)
+		goto skip;
+
+	if (fpfn == pfn + 1) {
+		lpfn = fpfn;
+		rpfn = fpfn + win;
+	} else if (pfn == fpfn + 1) {
+		lpfn = fpfn + 1 > win ? fpfn + 1 - win : 0;
+		rpfn = fpfn + 1;
+	} else {
+		left = (win - 1) / 2;
+		lpfn = fpfn > left ? fpfn - left : 0;
+		rpfn = lpfn + win;
+	}
+	start = max3(lpfn, PFN_DOWN(vma->vm_start),
+		     PFN_DOWN(addr & PMD_MASK));
+	end = min3(rpfn, PFN_DOWN(vma->vm_end),
+		   PFN_DOWN((addr & PMD_MASK) + PMD_SIZE));
+
+	pte = swap_ra_pte_map(vma, start << PAGE_SHIFT);
+	if (!pte)
+		goto skip;
+	for (pfn = start; pfn < end; pfn++)
+		ptes[nr_pte++] = pte[pfn - start];
+	pte_unmap(pte);
+
+	blk_start_plug(&plug);
+	for (i = 0; i < nr_pte; i++) {
+		swp_entry_t entry;
+
+		if (start + i == fpfn)
+			continue;
+		if (pte_none(ptes[i]) || pte_present(ptes[i]) ||
+		    pte_file(ptes[i]))
+			continue;
+		entry = pte_to_swp_entry(ptes[i]);
+		if (unlikely(non_swap_entry(entry)))
+			continue;
+		swap_ra_read_page(entry, gfp_mask, vma,
+				  (start + i) << PAGE_SHIFT);
+	}
+	blk_finish_plug(&plug);
+	lru_add_drain();
+skip:
+	return read_swap_cache_async(fentry, gfp_mask, vma, addr);
+}
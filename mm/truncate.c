@@ -123,6 +123,40 @@ int invalidate_inode_page(struct page *page)
 	return invalidate_complete_page(mapping, page);
 }
 
+static void truncate_shadow_entries(struct address_space *mapping,
+				    pgoff_t start, pgoff_t end)
+{
+	void **slots[PAGEVEC_SIZE];
+	unsigned long indices[PAGEVEC_SIZE];
+	pgoff_t index = start;
+	unsigned int i, nr;
+
+	while (index <= end && mapping->nrshadows) {
+		unsigned int nr_shadows = 0;
+
+		spin_lock_irq(&mapping->tree_lock);
+		nr = radix_tree_gang_lookup_slot(&mapping->page_tree, slots,
+						 indices, index, PAGEVEC_SIZE);
+		for (i = 0; i < nr && indices[i] <= end; i++) {
+			void *entry;
+
+			entry = radix_tree_deref_slot_protected(slots[i],
+							&mapping->tree_lock);
+			if (radix_tree_exceptional_entry(entry))
+				indices[nr_shadows++] = indices[i];
+		}
+		index = nr ? indices[nr - 1] + 1 : end + 1;
+		for (i = 0; i < nr_shadows; i++) {
+			radix_tree_delete(&mapping->page_tree, indices[i]);
+			mapping->nrshadows--;
+		}
+		spin_unlock_irq(&mapping->tree_lock);
+		if (!nr || !index)
+			break;
+		cond_resched();
+	}
+}
+
 void truncate_inode_pages_range(struct address_space *mapping,
 				loff_t lstart, loff_t lend)
 {
@@ -134,12 +168,15 @@ void truncate_inode_pages_range(struct address_space *mapping,
 	int i;
 
 	cleancache_invalidate_inode(mapping);
-	if (mapping->nrpages == 0)
+	if (mapping->nrpages == 0 && mapping->nrshadows == 0)
 		return;
 
 	BUG_ON((lend & (PAGE_CACHE_SIZE - 1)) != (PAGE_CACHE_SIZE - 1));
 	end = (lend >> PAGE_CACHE_SHIFT);
 
+	if (mapping->nrpages == 0)
+		goto shadows;
+
 	pagevec_init(&pvec, 0);
 	index = start;
 	while (index <= end && pagevec_lookup(&pvec, mapping, index,
@@ -212,6 +249,8 @@ void truncate_inode_pages_range(struct address_space *mapping,
 		mem_cgroup_uncharge_end();
 		index++;
 	}
+shadows:
+	truncate_shadow_entries(mapping, start, end);
 	cleancache_invalidate_inode(mapping);
 }
 EXPORT_SYMBOL(truncate_inode_pages_range);
@@ -277,7 +316,7 @@ invalidate_complete_page2(struct address_space *mapping, struct page *page)
 
 	clear_page_mlock(page);
 	BUG_ON(page_has_private(page));
-	__delete_from_page_cache(page);
+	__delete_from_page_cache(page, NULL);
 	spin_unlock_irq(&mapping->tree_lock);
 	mem_cgroup_uncharge_cache_page(page);
 
@@ -46,6 +46,7 @@
 #include <asm/div64.h>
 
 #include <linux/swapops.h>
+#include <linux/vmpressure.h>
 
 #include "internal.h"
 
@@ -401,7 +402,8 @@ static pageout_t pageout(struct page *page, struct address_space *mapping,
 	return PAGE_CLEAN;
 }
 
-static int __remove_mapping(struct address_space *mapping, struct page *page)
+static int __remove_mapping(struct address_space *mapping, struct page *page,
+			    bool reclaimed)
 {
 	BUG_ON(!PageLocked(page));
 	BUG_ON(mapping != page_mapping(page));
@@ -422,10 +424,13 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 		swapcache_free(swap, page);
 	} else {
 		void (*freepage)(struct page *);
+		void *shadow = NULL;
 
 		freepage = mapping->a_ops->freepage;
 
-		__delete_from_page_cache(page);
+		if (reclaimed && page_is_file_cache(page))
+			shadow = workingset_eviction(mapping, page);
+		__delete_from_page_cache(page, shadow);
 		spin_unlock_irq(&mapping->tree_lock);
 		mem_cgroup_uncharge_cache_page(page);
 
@@ -442,7 +447,7 @@ cannot_free:
 
 int remove_mapping(struct address_space *mapping, struct page *page)
 {
-	if (__remove_mapping(mapping, page)) {
+	if (__remove_mapping(mapping, page, false)) {
 		page_unfreeze_refs(page, 1);
 		return 1;
 	}
@@ -551,6 +556,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		struct address_space *mapping;
 		struct page *page;
 		int may_enter_fs;
+		bool lazyfree;
 
 		cond_resched();
 
@@ -600,7 +606,10 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			; 
 		}
 
-		if (PageAnon(page) && !PageSwapCache(page)) {
+		/* MADV_FREE pages are discarded instead of swapped out */
+		lazyfree = PageAnon(page) && !PageSwapBacked(page);
+
+		if (PageAnon(page) && !lazyfree && !PageSwapCache(page)) {
 			if (!(sc->gfp_mask & __GFP_IO))
 				goto keep_locked;
 			if (!add_to_swap(page))
@@ -610,7 +619,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 
 		mapping = page_mapping(page);
 
-		if (page_mapped(page) && mapping) {
+		if (page_mapped(page) && (mapping || lazyfree)) {
 			switch (try_to_unmap(page, TTU_UNMAP)) {
 			case SWAP_FAIL:
 				goto activate_locked;
@@ -623,6 +632,21 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
+		if (lazyfree) {
+			if (PageDirty(page)) {
+				SetPageSwapBacked(page);
+				goto activate_locked;
+			}
+			if (!page_freeze_refs(page, 1))
+				goto keep_locked;
+			if (PageDirty(page)) {
+				page_unfreeze_refs(page, 1);
+				goto keep_locked;
+			}
+			count_vm_event(PGLAZYFREED);
+			goto free_locked;
+		}
+
 		if (PageDirty(page)) {
 			nr_dirty++;
 
@@ -678,9 +702,10 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
-		if (!mapping || !__remove_mapping(mapping, page))
+		if (!mapping || !__remove_mapping(mapping, page, true))
 			goto keep_locked;
 
+free_locked:
 		__clear_page_locked(page);
 free_it:
 		nr_reclaimed++;
@@ -1527,6 +1552,8 @@ static void shrink_zone(int priority, struct zone *zone,
 		.zone = zone,
 		.priority = priority,
 	};
+	unsigned long nr_reclaimed = sc->nr_reclaimed;
+	unsigned long nr_scanned = sc->nr_scanned;
 	struct mem_cgroup *memcg;
 
 	memcg = mem_cgroup_iter(root, NULL, &reclaim);
@@ -1543,6 +1570,9 @@ static void shrink_zone(int priority, struct zone *zone,
 		}
 		memcg = mem_cgroup_iter(root, memcg, &reclaim);
 	} while (memcg);
+
+	vmpressure(sc->gfp_mask, root, sc->nr_scanned - nr_scanned,
+		   sc->nr_reclaimed - nr_reclaimed);
 }
 
 static inline bool compaction_ready(struct zone *zone, struct scan_control *sc)
@@ -1654,6 +1684,7 @@ static unsigned long do_try_to_free_pages(struct zonelist *zonelist,
 		count_vm_event(ALLOCSTALL);
 
 	for (priority = DEF_PRIORITY; priority >= 0; priority--) {
+		vmpressure_prio(sc->gfp_mask, sc->target_mem_cgroup, priority);
 		sc->nr_scanned = 0;
 		if (!priority)
 			disable_swap_token(sc->target_mem_cgroup);
@@ -1893,6 +1924,29 @@ static bool sleeping_prematurely(pg_data_t *pgdat, int order, long remaining,
 		return !all_zones_ok;
 }
 
+static bool pgdat_reset_watermark_boost(pg_data_t *pgdat)
+{
+	bool boosted = false;
+	int i;
+
+	for (i = 0; i < pgdat->nr_zones; i++) {
+		struct zone *zone = pgdat->node_zones + i;
+		unsigned long flags;
+
+		if (!zone->watermark_boost)
+			continue;
+
+		spin_lock_irqsave(&zone->lock, flags);
+		zone->watermark_boost = 0;
+		spin_unlock_irqrestore(&zone->lock, flags);
+		boosted = true;
+	}
+
+	if (boosted)
+		count_vm_event(KSWAPD_BOOST_RESET);
+	return boosted;
+}
+
 static unsigned long balance_pgdat(pg_data_t *pgdat, int order,
 							int *classzone_idx)
 {
@@ -2094,9 +2148,12 @@ out:
 		}
 
 		if (zones_need_compaction)
-			compact_pgdat(pgdat, order);
+			wakeup_kcompactd(pgdat, order, end_zone);
 	}
 
+	if (pgdat_reset_watermark_boost(pgdat))
+		wakeup_kcompactd(pgdat, pageblock_order, end_zone);
+
 	*classzone_idx = end_zone;
 	return order;
 }
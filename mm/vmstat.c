@@ -424,6 +424,19 @@ int fragmentation_index(struct zone *zone, unsigned int order)
 	fill_contig_page_info(zone, order, &info);
 	return __fragmentation_index(order, &info);
 }
+
+int extfrag_for_order(struct zone *zone, unsigned int order)
+{
+	struct contig_page_info info;
+
+	fill_contig_page_info(zone, order, &info);
+	if (!info.free_pages)
+		return 0;
+
+	return div_u64((info.free_pages -
+			(info.free_blocks_suitable << order)) * 100ULL,
+			info.free_pages);
+}
 #endif
 
 #if defined(CONFIG_PROC_FS) || defined(CONFIG_COMPACTION)
@@ -533,6 +546,8 @@ const char * const vmstat_text[] = {
 	"nr_shmem",
 	"nr_dirtied",
 	"nr_written",
+	"workingset_refault",
+	"workingset_activate",
 
 #ifdef CONFIG_NUMA
 	"numa_hit",
@@ -545,6 +560,9 @@ const char * const vmstat_text[] = {
 	"nr_anon_transparent_hugepages",
 	"nr_dirty_threshold",
 	"nr_dirty_background_threshold",
+#ifdef CONFIG_COMPACTION
+	"compact_fragmentation_index",
+#endif
 
 #ifdef CONFIG_VM_EVENT_COUNTERS
 	"pgpgin",
@@ -580,6 +598,11 @@ const char * const vmstat_text[] = {
 	"allocstall",
 
 	"pgrotated",
+	"watermark_boost",
+	"kswapd_boost_reset",
+	"pglazyfree",
+	"pglazyfreed",
+	"pglazyfree_reused",
 
 #ifdef CONFIG_COMPACTION
 	"compact_blocks_moved",
@@ -588,6 +611,10 @@ const char * const vmstat_text[] = {
 	"compact_stall",
 	"compact_fail",
 	"compact_success",
+	"compact_stall_time_us",
+	"compact_daemon_wake",
+	"compact_daemon_proactive",
+	"compact_daemon_backoff",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE
@@ -603,6 +630,12 @@ const char * const vmstat_text[] = {
 	"unevictable_pgs_stranded",
 	"unevictable_pgs_mlockfreed",
 
+#ifdef CONFIG_SWAP
+	"swap_ra",
+	"swap_ra_hit",
+	"swap_ra_miss",
+#endif
+
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 	"thp_fault_alloc",
 	"thp_fault_fallback",
@@ -789,6 +822,7 @@ static void zoneinfo_show_print(struct seq_file *m, pg_data_t *pgdat,
 		   "\n        min      %lu"
 		   "\n        low      %lu"
 		   "\n        high     %lu"
+		   "\n        boost    %lu"
 		   "\n        scanned  %lu"
 		   "\n        spanned  %lu"
 		   "\n        present  %lu",
@@ -796,6 +830,7 @@ static void zoneinfo_show_print(struct seq_file *m, pg_data_t *pgdat,
 		   min_wmark_pages(zone),
 		   low_wmark_pages(zone),
 		   high_wmark_pages(zone),
+		   zone->watermark_boost,
 		   zone->pages_scanned,
 		   zone->spanned_pages,
 		   zone->present_pages);
@@ -814,6 +849,7 @@ static void zoneinfo_show_print(struct seq_file *m, pg_data_t *pgdat,
 		   "\n  pagesets");
 	for_each_online_cpu(i) {
 		struct per_cpu_pageset *pageset;
+		int order;
 
 		pageset = per_cpu_ptr(zone->pageset, i);
 		seq_printf(m,
@@ -825,6 +861,13 @@ static void zoneinfo_show_print(struct seq_file *m, pg_data_t *pgdat,
 			   pageset->pcp.count,
 			   pageset->pcp.high,
 			   pageset->pcp.batch);
+		for (order = 1; order <= NR_PCP_HIGH_ORDERS; order++) {
+			struct per_cpu_pages *pcp = &pageset->order_pcp[order - 1];
+
+			seq_printf(m,
+				   "\n      order %d: count: %i high: %i batch: %i",
+				   order, pcp->count, pcp->high, pcp->batch);
+		}
 #ifdef CONFIG_SMP
 		seq_printf(m, "\n  vm stats threshold: %d",
 				pageset->stat_threshold);
@@ -881,6 +924,9 @@ static void *vmstat_start(struct seq_file *m, loff_t *pos)
 		return NULL;
 	stat_items_size = NR_VM_ZONE_STAT_ITEMS * sizeof(unsigned long) +
 			  NR_VM_WRITEBACK_STAT_ITEMS * sizeof(unsigned long);
+#ifdef CONFIG_COMPACTION
+	stat_items_size += sizeof(unsigned long);
+#endif
 
 #ifdef CONFIG_VM_EVENT_COUNTERS
 	stat_items_size += sizeof(struct vm_event_state);
@@ -898,6 +944,10 @@ static void *vmstat_start(struct seq_file *m, loff_t *pos)
 			    v + NR_DIRTY_THRESHOLD);
 	v += NR_VM_WRITEBACK_STAT_ITEMS;
 
+#ifdef CONFIG_COMPACTION
+	*v++ = compaction_fragmentation_score();
+#endif
+
 #ifdef CONFIG_VM_EVENT_COUNTERS
 	all_vm_events(v);
 	v[PGPGIN] /= 2;		
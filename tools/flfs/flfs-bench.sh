@@ -0,0 +1,69 @@
+#!/bin/sh
+#
+# flfs-bench.sh - compare flfs and ext4 on the same block device
+#
+# usage: flfs-bench.sh <device> <mountpoint> [jobfile]
+#
+# The device is reformatted for each file system.  For every fio job the
+# script prints bandwidth, IOPS and the number of bytes the device actually
+# received (from /sys/block/<dev>/stat), so that write amplification caused
+# by the file system is visible next to the throughput.
+
+DEV=$1
+MNT=$2
+JOB=${3:-$(dirname $0)/flfs-bench.fio}
+MKFS_FLFS=${MKFS_FLFS:-$(dirname $0)/mkfs.flfs}
+
+if [ -z "$DEV" ] || [ -z "$MNT" ]; then
+	echo "usage: $0 <device> <mountpoint> [jobfile]" >&2
+	exit 1
+fi
+
+NAME=$(basename $(readlink -f $DEV))
+STAT=/sys/class/block/$NAME/stat
+JOBS=$(sed -n 's/^\[\(.*\)\]$/\1/p' $JOB | grep -v '^global$')
+
+sectors_written()
+{
+	awk '{ print $7 }' $STAT
+}
+
+run()
+{
+	fs=$1
+
+	sync
+	echo 3 > /proc/sys/vm/drop_caches
+	for job in $JOBS; do
+		before=$(sectors_written)
+		DIR=$MNT fio --minimal --section=$job $JOB > /tmp/fio.$fs.$job ||
+			exit 1
+		sync
+		after=$(sectors_written)
+		# terse v3: 7/8 read KB/s and IOPS, 48/49 write KB/s and IOPS,
+		# 47 KB written by the job
+		awk -F';' -v fs=$fs -v job=$job -v dev=$((after - before)) '{
+			rbw += $7; riops += $8; wbw += $48; wiops += $49
+			wkb += $47
+		} END {
+			wa = wkb ? (dev / 2) / wkb : 0
+			printf "%-6s %-16s %9d %8d %9d %8d %10d %6.2f\n",
+			       fs, job, rbw, riops, wbw, wiops, dev / 2, wa
+		}' /tmp/fio.$fs.$job
+		rm -f $MNT/$job.*
+	done
+}
+
+printf "%-6s %-16s %9s %8s %9s %8s %10s %6s\n" fs job "rd KB/s" "rd IOPS" \
+	"wr KB/s" "wr IOPS" "dev KB" WAF
+
+$MKFS_FLFS -q $DEV || exit 1
+mount -t flfs $DEV $MNT || exit 1
+run flfs
+cat /proc/fs/flfs/$NAME/status
+umount $MNT
+
+mkfs.ext4 -q -F $DEV || exit 1
+mount -t ext4 $DEV $MNT || exit 1
+run ext4
+umount $MNT
@@ -0,0 +1,431 @@
+/*
+ * mkfs.flfs: create a flash-friendly log-structured file system
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; version 2.
+ *
+ * Layout, in 2MB segments:
+ *
+ *   | SB | CP x2 | SIT x2 | NAT x2 | SSA | main area ... |
+ *
+ * The six current segments start at main segments 0..5 and the root
+ * directory inode is written as the first block of the hot node log.
+ */
+
+#define _LARGEFILE64_SOURCE
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+#include <endian.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+#include "../../include/linux/flfs_fs.h"
+
+#define BLKSIZE		FLFS_BLKSIZE
+#define SEGBLKS		FLFS_BLOCKS_PER_SEG
+#define MIN_SEGMENTS	32
+
+#define DIV_ROUND_UP(n, d)	(((n) + (d) - 1) / (d))
+
+static const char *progname = "mkfs.flfs";
+static int fd;
+static int quiet;
+static int nodiscard;
+static unsigned int ovp_ratio = 5;
+static const char *label = "";
+
+static struct {
+	uint64_t block_count;
+	uint32_t segment_count;
+	uint32_t sit_segs;
+	uint32_t nat_segs;
+	uint32_t ssa_segs;
+	uint32_t main_segs;
+	uint32_t cp_blkaddr;
+	uint32_t sit_blkaddr;
+	uint32_t nat_blkaddr;
+	uint32_t ssa_blkaddr;
+	uint32_t main_blkaddr;
+	uint32_t sit_blocks;
+	uint32_t nat_blocks;
+	uint32_t ovp_segs;
+	uint32_t rsvd_segs;
+	uint32_t sit_bitmap_bytes;
+	uint32_t nat_bitmap_bytes;
+} g;
+
+static void fatal(const char *msg)
+{
+	if (errno)
+		fprintf(stderr, "%s: %s: %s\n", progname, msg, strerror(errno));
+	else
+		fprintf(stderr, "%s: %s\n", progname, msg);
+	exit(1);
+}
+
+static uint32_t crc32_le(uint32_t crc, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+	int i;
+
+	while (len--) {
+		crc ^= *p++;
+		for (i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320 : 0);
+	}
+	return crc;
+}
+
+static uint32_t flfs_crc32(const void *buf, size_t len)
+{
+	return crc32_le(FLFS_SUPER_MAGIC, buf, len);
+}
+
+static void write_block(uint64_t blkaddr, const void *buf)
+{
+	if (pwrite(fd, buf, BLKSIZE, blkaddr * BLKSIZE) != BLKSIZE)
+		fatal("write failed");
+}
+
+static void zero_blocks(uint64_t blkaddr, uint64_t count)
+{
+	static char zero[SEGBLKS * BLKSIZE];
+	uint64_t n;
+
+	while (count) {
+		n = count > SEGBLKS ? SEGBLKS : count;
+		if (pwrite(fd, zero, n * BLKSIZE, blkaddr * BLKSIZE) !=
+		    (ssize_t)(n * BLKSIZE))
+			fatal("write failed");
+		blkaddr += n;
+		count -= n;
+	}
+}
+
+static uint64_t device_size(void)
+{
+	struct stat st;
+	uint64_t bytes;
+
+	if (fstat(fd, &st) < 0)
+		fatal("cannot stat device");
+	if (S_ISREG(st.st_mode))
+		return st.st_size;
+	if (!S_ISBLK(st.st_mode))
+		fatal("not a block device or regular file");
+	if (ioctl(fd, BLKGETSIZE64, &bytes) < 0)
+		fatal("BLKGETSIZE64 failed");
+
+	if (!nodiscard) {
+		uint64_t range[2] = { 0, bytes };
+
+		if (ioctl(fd, BLKDISCARD, range) < 0 && !quiet)
+			printf("discard not supported, continuing\n");
+	}
+	return bytes;
+}
+
+static void prepare_layout(uint64_t bytes)
+{
+	uint32_t sit_entries, nat_max;
+
+	g.block_count = bytes / BLKSIZE;
+	g.segment_count = g.block_count / SEGBLKS;
+	if (g.segment_count < MIN_SEGMENTS) {
+		errno = 0;
+		fatal("device too small");
+	}
+
+	sit_entries = g.segment_count;
+	g.sit_blocks = DIV_ROUND_UP(sit_entries, SIT_ENTRY_PER_BLOCK);
+	g.sit_segs = 2 * DIV_ROUND_UP(g.sit_blocks, SEGBLKS);
+	g.sit_bitmap_bytes = DIV_ROUND_UP(g.sit_blocks, 8);
+
+	g.nat_blocks = DIV_ROUND_UP(g.block_count, NAT_ENTRY_PER_BLOCK);
+	nat_max = (FLFS_CP_BITMAP_BYTES - g.sit_bitmap_bytes) * 8;
+	if (g.nat_blocks > nat_max)
+		g.nat_blocks = nat_max;
+	g.nat_segs = 2 * DIV_ROUND_UP(g.nat_blocks, SEGBLKS);
+	g.nat_blocks = g.nat_segs / 2 * SEGBLKS;
+	if (g.nat_blocks > nat_max)
+		g.nat_blocks = nat_max;
+	g.nat_bitmap_bytes = DIV_ROUND_UP(g.nat_blocks, 8);
+
+	g.ssa_segs = DIV_ROUND_UP(g.segment_count, SEGBLKS);
+
+	g.main_segs = g.segment_count - 1 - 2 - g.sit_segs - g.nat_segs -
+								g.ssa_segs;
+
+	g.cp_blkaddr = SEGBLKS;
+	g.sit_blkaddr = g.cp_blkaddr + 2 * SEGBLKS;
+	g.nat_blkaddr = g.sit_blkaddr + g.sit_segs * SEGBLKS;
+	g.ssa_blkaddr = g.nat_blkaddr + g.nat_segs * SEGBLKS;
+	g.main_blkaddr = g.ssa_blkaddr + g.ssa_segs * SEGBLKS;
+
+	g.ovp_segs = g.main_segs * ovp_ratio / 100;
+	if (g.ovp_segs < 2 * NR_CURSEG_TYPE)
+		g.ovp_segs = 2 * NR_CURSEG_TYPE;
+	g.rsvd_segs = g.ovp_segs / 2;
+	if (g.main_segs <= g.ovp_segs + NR_CURSEG_TYPE) {
+		errno = 0;
+		fatal("device too small for the requested overprovisioning");
+	}
+}
+
+static uint32_t curseg_segno(int type)
+{
+	return type;
+}
+
+static uint64_t root_blkaddr(void)
+{
+	return g.main_blkaddr +
+		(uint64_t)curseg_segno(CURSEG_HOT_NODE) * SEGBLKS;
+}
+
+static void write_super_block(void)
+{
+	char buf[BLKSIZE];
+	struct flfs_super_block *sb =
+		(struct flfs_super_block *)(buf + FLFS_SUPER_OFFSET);
+	int i;
+
+	memset(buf, 0, sizeof(buf));
+	sb->magic = htole32(FLFS_SUPER_MAGIC);
+	sb->major_ver = htole16(FLFS_MAJOR_VERSION);
+	sb->minor_ver = htole16(FLFS_MINOR_VERSION);
+	sb->log_blocksize = htole32(FLFS_LOG_BLKSIZE);
+	sb->log_blocks_per_seg = htole32(FLFS_LOG_BLOCKS_PER_SEG);
+	sb->block_count = htole64(g.block_count);
+	sb->segment_count = htole32(g.segment_count);
+	sb->segment_count_ckpt = htole32(2);
+	sb->segment_count_sit = htole32(g.sit_segs);
+	sb->segment_count_nat = htole32(g.nat_segs);
+	sb->segment_count_ssa = htole32(g.ssa_segs);
+	sb->segment_count_main = htole32(g.main_segs);
+	sb->segment0_blkaddr = htole32(0);
+	sb->cp_blkaddr = htole32(g.cp_blkaddr);
+	sb->sit_blkaddr = htole32(g.sit_blkaddr);
+	sb->nat_blkaddr = htole32(g.nat_blkaddr);
+	sb->ssa_blkaddr = htole32(g.ssa_blkaddr);
+	sb->main_blkaddr = htole32(g.main_blkaddr);
+	sb->sit_blocks = htole32(g.sit_blocks);
+	sb->nat_blocks = htole32(g.nat_blocks);
+	sb->root_ino = htole32(FLFS_ROOT_INO);
+	sb->node_ino = htole32(FLFS_NODE_INO);
+	sb->meta_ino = htole32(FLFS_META_INO);
+	sb->max_nid = htole32(g.nat_blocks * NAT_ENTRY_PER_BLOCK);
+
+	srand(time(NULL) ^ getpid());
+	for (i = 0; i < 16; i++)
+		sb->uuid[i] = rand();
+	strncpy((char *)sb->volume_name, label, FLFS_VOLUME_LEN - 1);
+
+	sb->checksum = htole32(flfs_crc32(sb,
+				offsetof(struct flfs_super_block, checksum)));
+
+	zero_blocks(0, SEGBLKS);
+	write_block(0, buf);
+	write_block(1, buf);
+}
+
+static void write_checkpoint(void)
+{
+	char buf[BLKSIZE];
+	struct flfs_checkpoint *cp = (struct flfs_checkpoint *)buf;
+	struct flfs_summary_block *sum = (struct flfs_summary_block *)buf;
+	uint32_t crc;
+	int i;
+
+	zero_blocks(g.cp_blkaddr, 2 * SEGBLKS);
+
+	memset(buf, 0, sizeof(buf));
+	cp->checkpoint_ver = htole64(1);
+	cp->user_block_count = htole64((uint64_t)(g.main_segs - g.ovp_segs) *
+								SEGBLKS);
+	cp->valid_block_count = htole64(1);
+	cp->rsvd_segment_count = htole32(g.rsvd_segs);
+	cp->overprov_segment_count = htole32(g.ovp_segs);
+	cp->free_segment_count = htole32(g.main_segs - NR_CURSEG_TYPE);
+	for (i = 0; i < NR_CURSEG_NODE_TYPE; i++) {
+		cp->cur_node_segno[i] =
+			htole32(curseg_segno(CURSEG_HOT_NODE + i));
+		cp->cur_node_blkoff[i] = htole16(0);
+	}
+	cp->cur_node_blkoff[0] = htole16(1);
+	for (i = 0; i < NR_CURSEG_DATA_TYPE; i++) {
+		cp->cur_data_segno[i] = htole32(curseg_segno(i));
+		cp->cur_data_blkoff[i] = htole16(0);
+	}
+	cp->ckpt_flags = htole32(CP_UMOUNT_FLAG);
+	cp->cp_pack_total_block_count = htole32(2 + NR_CURSEG_TYPE);
+	cp->cp_pack_start_sum = htole32(1);
+	cp->valid_node_count = htole32(1);
+	cp->valid_inode_count = htole32(1);
+	cp->next_free_nid = htole32(FLFS_FIRST_FREE_NID);
+	cp->sit_ver_bitmap_bytesize = htole32(g.sit_bitmap_bytes);
+	cp->nat_ver_bitmap_bytesize = htole32(g.nat_bitmap_bytes);
+	cp->checksum_offset = htole32(FLFS_CP_CHECKSUM_OFFSET);
+
+	crc = flfs_crc32(cp, FLFS_CP_CHECKSUM_OFFSET);
+	*(uint32_t *)(buf + FLFS_CP_CHECKSUM_OFFSET) = htole32(crc);
+
+	write_block(g.cp_blkaddr, buf);
+	write_block(g.cp_blkaddr + 1 + NR_CURSEG_TYPE, buf);
+
+	for (i = 0; i < NR_CURSEG_TYPE; i++) {
+		memset(buf, 0, sizeof(buf));
+		if (i >= CURSEG_HOT_NODE)
+			sum->footer.entry_type = SUM_TYPE_NODE;
+		else
+			sum->footer.entry_type = SUM_TYPE_DATA;
+		if (i == CURSEG_HOT_NODE) {
+			sum->entries[0].nid = htole32(FLFS_ROOT_INO);
+			sum->entries[0].version = 0;
+			sum->entries[0].ofs_in_node = 0;
+		}
+		write_block(g.cp_blkaddr + 1 + i, buf);
+	}
+}
+
+static void write_sit(void)
+{
+	char buf[BLKSIZE];
+	struct flfs_sit_block *sit = (struct flfs_sit_block *)buf;
+	int i;
+
+	zero_blocks(g.sit_blkaddr, (uint64_t)g.sit_segs * SEGBLKS);
+
+	memset(buf, 0, sizeof(buf));
+	for (i = 0; i < NR_CURSEG_TYPE; i++) {
+		struct flfs_sit_entry *se = &sit->entries[curseg_segno(i)];
+		uint16_t valid = i == CURSEG_HOT_NODE ? 1 : 0;
+
+		se->vblocks = htole16((i << SIT_VBLOCKS_SHIFT) | valid);
+		if (valid)
+			se->valid_map[0] = 1;
+	}
+	write_block(g.sit_blkaddr, buf);
+}
+
+static void write_nat(void)
+{
+	char buf[BLKSIZE];
+	struct flfs_nat_block *nat = (struct flfs_nat_block *)buf;
+
+	zero_blocks(g.nat_blkaddr, (uint64_t)g.nat_segs * SEGBLKS);
+
+	memset(buf, 0, sizeof(buf));
+	nat->entries[FLFS_ROOT_INO].version = 0;
+	nat->entries[FLFS_ROOT_INO].ino = htole32(FLFS_ROOT_INO);
+	nat->entries[FLFS_ROOT_INO].block_addr = htole32(root_blkaddr());
+	write_block(g.nat_blkaddr, buf);
+}
+
+static void write_root_inode(void)
+{
+	char buf[BLKSIZE];
+	struct flfs_node *node = (struct flfs_node *)buf;
+	struct flfs_inode *ri = &node->i;
+	uint64_t now = time(NULL);
+
+	memset(buf, 0, sizeof(buf));
+	ri->i_mode = htole16(S_IFDIR | 0755);
+	ri->i_uid = htole32(getuid());
+	ri->i_gid = htole32(getgid());
+	ri->i_links = htole32(2);
+	ri->i_size = htole64(0);
+	ri->i_blocks = htole64(BLKSIZE >> 9);
+	ri->i_atime = htole64(now);
+	ri->i_ctime = htole64(now);
+	ri->i_mtime = htole64(now);
+	ri->i_current_depth = htole32(0);
+	ri->i_pino = htole32(FLFS_ROOT_INO);
+
+	node->footer.nid = htole32(FLFS_ROOT_INO);
+	node->footer.ino = htole32(FLFS_ROOT_INO);
+	node->footer.flag = htole32(0);
+	node->footer.cp_ver = htole64(1);
+	node->footer.next_blkaddr = htole32(root_blkaddr() + 1);
+
+	write_block(root_blkaddr(), buf);
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: %s [-l label] [-o overprovision%%] [-n] [-q] device\n"
+		"  -l  volume label\n"
+		"  -o  percentage of the main area kept for cleaning (default 5)\n"
+		"  -n  do not discard the device before formatting\n"
+		"  -q  quiet\n", progname);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "l:o:nq")) != -1) {
+		switch (opt) {
+		case 'l':
+			label = optarg;
+			break;
+		case 'o':
+			ovp_ratio = atoi(optarg);
+			if (ovp_ratio < 1 || ovp_ratio > 50)
+				usage();
+			break;
+		case 'n':
+			nodiscard = 1;
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc - 1)
+		usage();
+
+	fd = open(argv[optind], O_RDWR);
+	if (fd < 0)
+		fatal(argv[optind]);
+
+	prepare_layout(device_size());
+
+	if (!quiet) {
+		printf("%s: %llu blocks, %u segments\n", argv[optind],
+		       (unsigned long long)g.block_count, g.segment_count);
+		printf("  sit %u nat %u ssa %u main %u segments\n",
+		       g.sit_segs, g.nat_segs, g.ssa_segs, g.main_segs);
+		printf("  overprovision %u reserved %u segments, max nid %u\n",
+		       g.ovp_segs, g.rsvd_segs,
+		       g.nat_blocks * (uint32_t)NAT_ENTRY_PER_BLOCK);
+	}
+
+	write_sit();
+	write_nat();
+	zero_blocks(g.ssa_blkaddr, (uint64_t)g.ssa_segs * SEGBLKS);
+	write_root_inode();
+	write_checkpoint();
+	if (fsync(fd) < 0)
+		fatal("fsync failed");
+	write_super_block();
+	if (fsync(fd) < 0)
+		fatal("fsync failed");
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,323 @@
+/*
+ * energy-replay: estimate cpu energy from a scheduler trace
+ *
+ * Licensed under the terms of the GNU GPL License version 2.
+ *
+ * Replays the sched_switch, power:cpu_frequency and power:cpu_idle events
+ * of an ftrace text dump against the platform energy table the kernel
+ * prints at boot, and reports per-cpu busy and idle time and estimated
+ * energy.  Busy time is charged at the power of the current frequency,
+ * idle time at the idle power, or at zero while the cpu sits in a
+ * cpuidle state deeper than WFI, and every exit from such a state costs
+ * one wakeup.  sched_energy_wake events are summarised as well, so two
+ * traces of the same workload with sched_energy_aware off and on can be
+ * compared directly.
+ *
+ *   dmesg | grep sched_energy: > table
+ *   echo 1 > /sys/kernel/debug/tracing/events/sched/sched_switch/enable
+ *   echo 1 > /sys/kernel/debug/tracing/events/sched/sched_energy_wake/enable
+ *   echo 1 > /sys/kernel/debug/tracing/events/power/enable
+ *   ... run the workload ...
+ *   cat /sys/kernel/debug/tracing/trace > trace
+ *   energy-replay -t table trace
+ *
+ * Energy is reported in table power units times milliseconds.
+ *
+ * Compile with:
+ *
+ * gcc -o energy-replay energy-replay.c
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#define MAX_CPUS	32
+#define MAX_STATES	64
+
+struct energy_state {
+	unsigned long freq;
+	unsigned long power;
+};
+
+static struct energy_state states[MAX_STATES];
+static int nr_states;
+static unsigned long idle_power, wakeup_cost;
+
+struct cpu_stat {
+	int seen;
+	int busy;
+	int deep_idle;
+	unsigned long freq;
+	double last;
+	double busy_time;
+	double idle_time;
+	double energy;
+	unsigned long wakeups;
+};
+
+static struct cpu_stat cpus[MAX_CPUS];
+static unsigned long start_freq;
+static unsigned long nr_placed, nr_moved, nr_fallback;
+
+static void usage(void)
+{
+	printf("energy-replay [options] <trace>\n"
+		"-t|--table <file>	Energy table as printed by the kernel (sched_energy: lines)\n"
+		"-f|--freq <kHz>		Frequency assumed before the first cpu_frequency event\n"
+		"			(default: highest in the table)\n"
+		"-h|--help		Show this message\n");
+}
+
+static void fatal(const char *msg, const char *arg)
+{
+	fprintf(stderr, "energy-replay: %s%s\n", msg, arg ? arg : "");
+	exit(1);
+}
+
+static void read_table(const char *path)
+{
+	char line[256];
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f)
+		fatal("cannot open ", path);
+
+	while (fgets(line, sizeof(line), f)) {
+		unsigned long freq, cap, power, idle, wake;
+		char *p = strstr(line, "sched_energy:");
+
+		if (!p)
+			continue;
+		p += strlen("sched_energy:");
+		if (sscanf(p, " %lu kHz capacity %lu power %lu",
+			   &freq, &cap, &power) == 3) {
+			if (nr_states == MAX_STATES)
+				fatal("too many states in ", path);
+			states[nr_states].freq = freq;
+			states[nr_states].power = power;
+			nr_states++;
+		} else if (sscanf(p, " idle %lu wakeup %lu", &idle, &wake) == 2) {
+			idle_power = idle;
+			wakeup_cost = wake;
+		}
+	}
+	fclose(f);
+
+	if (!nr_states)
+		fatal("no sched_energy states in ", path);
+}
+
+static unsigned long power_at(unsigned long freq)
+{
+	int i;
+
+	for (i = 0; i < nr_states - 1; i++) {
+		if (states[i].freq >= freq)
+			break;
+	}
+	return states[i].power;
+}
+
+static void account(struct cpu_stat *c, double now)
+{
+	double dt;
+
+	if (!c->seen) {
+		c->seen = 1;
+		c->freq = start_freq;
+		c->last = now;
+		return;
+	}
+
+	dt = (now - c->last) * 1000.0;
+	if (dt < 0)
+		dt = 0;
+	c->last = now;
+
+	if (c->busy) {
+		c->busy_time += dt;
+		c->energy += dt * power_at(c->freq);
+	} else {
+		c->idle_time += dt;
+		if (!c->deep_idle)
+			c->energy += dt * idle_power;
+	}
+}
+
+static unsigned long field(const char *s, const char *name, int *found)
+{
+	const char *p = strstr(s, name);
+
+	*found = p != NULL;
+	return p ? strtoul(p + strlen(name), NULL, 10) : 0;
+}
+
+static long sfield(const char *s, const char *name, int *found)
+{
+	const char *p = strstr(s, name);
+
+	*found = p != NULL;
+	return p ? strtol(p + strlen(name), NULL, 10) : 0;
+}
+
+/*
+ * Lines look like
+ *   <comm>-<pid>  [001] d..2  1234.567890: sched_switch: prev_comm=...
+ * with the irq-info column being optional.
+ */
+static void parse_line(char *line)
+{
+	char *p, *ev, *args;
+	struct cpu_stat *c;
+	double ts;
+	int cpu, found;
+
+	p = strstr(line, "] ");
+	if (!p || p - line < 2)
+		return;
+	ev = p;
+	while (ev > line && ev[-1] != '[')
+		ev--;
+	cpu = atoi(ev);
+	if (cpu < 0 || cpu >= MAX_CPUS)
+		return;
+
+	p += 2;
+	ev = strstr(p, ": ");
+	if (!ev)
+		return;
+	*ev = '\0';
+	args = strrchr(p, ' ');
+	ts = atof(args ? args + 1 : p);
+	ev += 2;
+
+	args = strstr(ev, ": ");
+	if (!args)
+		return;
+	*args = '\0';
+	args += 2;
+
+	if (!strcmp(ev, "sched_switch")) {
+		long next = sfield(args, "next_pid=", &found);
+
+		if (!found)
+			return;
+		c = &cpus[cpu];
+		account(c, ts);
+		c->busy = next != 0;
+	} else if (!strcmp(ev, "cpu_frequency")) {
+		unsigned long freq = field(args, "state=", &found);
+		unsigned long id = field(args, "cpu_id=", &found);
+
+		if (!found || id >= MAX_CPUS)
+			return;
+		c = &cpus[id];
+		account(c, ts);
+		c->freq = freq;
+	} else if (!strcmp(ev, "cpu_idle")) {
+		unsigned long state = field(args, "state=", &found);
+		unsigned long id = field(args, "cpu_id=", &found);
+
+		if (!found || id >= MAX_CPUS)
+			return;
+		c = &cpus[id];
+		account(c, ts);
+		if (state == 4294967295UL) {
+			if (c->deep_idle) {
+				c->wakeups++;
+				c->energy += wakeup_cost;
+			}
+			c->deep_idle = 0;
+		} else {
+			c->deep_idle = state > 0;
+		}
+	} else if (!strcmp(ev, "sched_energy_wake")) {
+		long target = sfield(args, "target_cpu=", &found);
+		long prev = sfield(args, "prev_cpu=", &found);
+
+		if (!found)
+			return;
+		if (target < 0)
+			nr_fallback++;
+		else if (target != prev)
+			nr_moved++;
+		else
+			nr_placed++;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct option opts[] = {
+		{ "table", 1, NULL, 't' },
+		{ "freq", 1, NULL, 'f' },
+		{ "help", 0, NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+	const char *table = NULL;
+	double total = 0, last = 0;
+	char line[1024];
+	FILE *f;
+	int c, i;
+
+	while ((c = getopt_long(argc, argv, "t:f:h", opts, NULL)) != -1) {
+		switch (c) {
+		case 't':
+			table = optarg;
+			break;
+		case 'f':
+			start_freq = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			usage();
+			return 0;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	if (!table || optind != argc - 1) {
+		usage();
+		return 1;
+	}
+
+	read_table(table);
+	if (!start_freq)
+		start_freq = states[nr_states - 1].freq;
+
+	f = fopen(argv[optind], "r");
+	if (!f)
+		fatal("cannot open ", argv[optind]);
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#')
+			continue;
+		parse_line(line);
+	}
+	fclose(f);
+
+	for (i = 0; i < MAX_CPUS; i++) {
+		if (cpus[i].seen && cpus[i].last > last)
+			last = cpus[i].last;
+	}
+
+	printf("%-4s %12s %12s %8s %16s\n", "cpu", "busy(ms)", "idle(ms)",
+		"wakeups", "energy");
+	for (i = 0; i < MAX_CPUS; i++) {
+		struct cpu_stat *cs = &cpus[i];
+
+		if (!cs->seen)
+			continue;
+		account(cs, last);
+		printf("%-4d %12.3f %12.3f %8lu %16.0f\n", i, cs->busy_time,
+			cs->idle_time, cs->wakeups, cs->energy);
+		total += cs->energy;
+	}
+	printf("total energy %.0f\n", total);
+
+	if (nr_placed + nr_moved + nr_fallback)
+		printf("energy-aware wakeups: %lu on prev cpu, %lu moved, %lu left to regular path\n",
+			nr_placed, nr_moved, nr_fallback);
+	return 0;
+}
@@ -0,0 +1,196 @@
+/*
+ * forkexec-bench: measure fork and exec latency
+ *
+ * Licensed under the terms of the GNU GPL License version 2.
+ *
+ * A parent with a configurable amount of touched anonymous memory and a
+ * mapped file (a stand-in for a zygote with its preloaded classes and
+ * libraries) repeatedly
+ *
+ *   fork:  forks a child that exits immediately,
+ *   exec:  forks a child that execs a program (default /bin/true),
+ *
+ * and reports min/avg/median/p99/max latency of each in microseconds.
+ * Compare runs with vm.fault_around_bytes set to 0 and to its default
+ * to see what fault-around saves on exec.
+ *
+ * Compile with:
+ *
+ * gcc -o forkexec-bench forkexec-bench.c
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+static unsigned long nr_iter = 1000;
+static unsigned long anon_mb = 64;
+static const char *map_file;
+static char *exec_argv[] = { "/bin/true", NULL };
+
+static void fatal(const char *x)
+{
+	perror(x);
+	exit(1);
+}
+
+static void usage(void)
+{
+	printf("forkexec-bench [options]\n"
+		"-n|--iterations <n>	Iterations per test (default 1000)\n"
+		"-a|--anon <MB>		Touched anonymous memory in the parent (default 64)\n"
+		"-f|--file <path>	File to map and read in the parent\n"
+		"-e|--exec <path>	Program to exec (default /bin/true)\n"
+		"-h|--help		Show this message\n");
+}
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void report(const char *name, double *lat, unsigned long n)
+{
+	double sum = 0;
+	unsigned long i;
+
+	qsort(lat, n, sizeof(*lat), cmp_double);
+	for (i = 0; i < n; i++)
+		sum += lat[i];
+	printf("%-5s %8lu %10.1f %10.1f %10.1f %10.1f %10.1f\n", name, n,
+		lat[0], sum / n, lat[n / 2], lat[n * 99 / 100], lat[n - 1]);
+}
+
+static void run(const char *name, int do_exec, double *lat)
+{
+	unsigned long i;
+	pid_t pid;
+	int status;
+
+	for (i = 0; i < nr_iter; i++) {
+		double start = now_us();
+
+		pid = fork();
+		if (pid < 0)
+			fatal("fork");
+		if (!pid) {
+			if (do_exec) {
+				execv(exec_argv[0], exec_argv);
+				_exit(127);
+			}
+			_exit(0);
+		}
+		if (waitpid(pid, &status, 0) < 0)
+			fatal("waitpid");
+		lat[i] = now_us() - start;
+		if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+			fprintf(stderr, "%s: child failed with status %d\n",
+				name, status);
+			exit(1);
+		}
+	}
+	report(name, lat, nr_iter);
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct option opts[] = {
+		{ "iterations", 1, NULL, 'n' },
+		{ "anon", 1, NULL, 'a' },
+		{ "file", 1, NULL, 'f' },
+		{ "exec", 1, NULL, 'e' },
+		{ "help", 0, NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+	long page_size = sysconf(_SC_PAGESIZE);
+	volatile char sink = 0;
+	double *lat;
+	char *anon;
+	size_t i, len;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "n:a:f:e:h", opts, NULL)) != -1) {
+		switch (c) {
+		case 'n':
+			nr_iter = strtoul(optarg, NULL, 0);
+			break;
+		case 'a':
+			anon_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			map_file = optarg;
+			break;
+		case 'e':
+			exec_argv[0] = optarg;
+			break;
+		case 'h':
+			usage();
+			return 0;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	if (!nr_iter) {
+		usage();
+		return 1;
+	}
+
+	lat = calloc(nr_iter, sizeof(*lat));
+	if (!lat)
+		fatal("calloc");
+
+	len = anon_mb << 20;
+	if (len) {
+		anon = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (anon == MAP_FAILED)
+			fatal("mmap anon");
+		for (i = 0; i < len; i += page_size)
+			anon[i] = 1;
+	}
+
+	if (map_file) {
+		struct stat st;
+		char *map;
+		int fd;
+
+		fd = open(map_file, O_RDONLY);
+		if (fd < 0 || fstat(fd, &st) < 0)
+			fatal(map_file);
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED)
+			fatal("mmap file");
+		for (i = 0; i < (size_t)st.st_size; i += page_size)
+			sink += map[i];
+		close(fd);
+	}
+
+	printf("anon %lu MB, file %s, exec %s\n", anon_mb,
+		map_file ? map_file : "-", exec_argv[0]);
+	printf("%-5s %8s %10s %10s %10s %10s %10s\n", "test", "iters",
+		"min(us)", "avg(us)", "p50(us)", "p99(us)", "max(us)");
+	run("fork", 0, lat);
+	run("exec", 1, lat);
+
+	free(lat);
+	return 0;
+}